@@ -0,0 +1,56 @@
+//------------------------------------------------------------------------------
+// Interrupt-driven ADC sampling
+//------------------------------------------------------------------------------
+
+#include "adc_sampler.h"
+
+static const uint8_t schedule[] = {
+    ADC_THROTTLE, ADC_RPM,  ADC_THROTTLE, ADC_GEAR,
+    ADC_THROTTLE, ADC_RPM,  ADC_THROTTLE, ADC_FUEL,
+    ADC_THROTTLE, ADC_RPM,  ADC_THROTTLE, ADC_RADIATOR
+};
+const uint8_t SCHEDULE_LENGTH = sizeof(schedule) / sizeof(schedule[0]);
+
+static uint8_t           channelPins[ADC_CHANNELS];
+static volatile uint16_t buffers[2][ADC_CHANNELS];
+static volatile uint8_t  front    = 0;
+static volatile uint8_t  sequence = 0;
+static uint8_t           slot     = 0;   //Schedule slot being converted, interrupt only
+
+static void onConversion(uint16_t value)
+{
+    uint8_t back = front ^ 1;
+    for (uint8_t c = 0; c < ADC_CHANNELS; c++) buffers[back][c] = buffers[front][c];
+    buffers[back][schedule[slot]] = value;
+    front = back;
+    sequence++;
+
+    slot++;
+    if (slot >= SCHEDULE_LENGTH) slot = 0;
+    halAdcStart(channelPins[schedule[slot]]);
+}
+
+void adcSamplerBegin(const uint8_t pins[ADC_CHANNELS])
+{
+    for (uint8_t c = 0; c < ADC_CHANNELS; c++) {
+        channelPins[c] = pins[c];
+        buffers[0][c]  = halAnalogRead(pins[c]);
+    }
+    front    = 0;
+    sequence = 0;
+    slot     = 0;
+
+    halAdcBegin(onConversion);
+    halAdcStart(channelPins[schedule[0]]);
+}
+
+void adcSamplerRead(AdcSnapshot* snapshot)
+{
+    uint8_t seen;
+    do {
+        seen = sequence;
+        const volatile uint16_t* latest = buffers[front];
+        for (uint8_t c = 0; c < ADC_CHANNELS; c++) snapshot->value[c] = latest[c];
+    } while (seen != sequence);
+    snapshot->sequence = seen;
+}
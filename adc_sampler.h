@@ -0,0 +1,37 @@
+//------------------------------------------------------------------------------
+// Interrupt-driven ADC sampling
+//------------------------------------------------------------------------------
+//The ADC converts continuously: each conversion-complete interrupt stores its
+//result and starts the next channel of a fixed schedule, so the main loop
+//never waits ~110 us per analogRead(). The throttle is every other slot of
+//the schedule (~4.8 kHz), rpm every fourth, gear, fuel and radiator
+//temperature every twelfth (~800 Hz).
+//
+//Results are double buffered. The interrupt builds the next snapshot in the
+//back buffer, then flips the front index and bumps a sequence counter.
+//adcSamplerRead() copies the front buffer and retries if the counter moved
+//meanwhile, so it always returns one consistent snapshot and never blocks.
+
+#ifndef ADC_SAMPLER_H
+#define ADC_SAMPLER_H
+
+#include "hal.h"
+
+const uint8_t ADC_RPM       = 0;
+const uint8_t ADC_FUEL      = 1;
+const uint8_t ADC_THROTTLE  = 2;
+const uint8_t ADC_RADIATOR  = 3;
+const uint8_t ADC_GEAR      = 4;
+const uint8_t ADC_CHANNELS  = 5;
+
+struct AdcSnapshot {
+    uint16_t value[ADC_CHANNELS];  //0-1023, indexed by ADC_*
+    uint8_t  sequence;             //changes with every conversion
+};
+
+//pins[] gives the analog pin of each ADC_* channel. Every channel is read
+//once with a blocking conversion first, so the first snapshot is complete.
+void adcSamplerBegin(const uint8_t pins[ADC_CHANNELS]);
+void adcSamplerRead(AdcSnapshot* snapshot);
+
+#endif
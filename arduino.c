@@ -1,7 +1,5 @@
     //todo:
     //    endurance power limit w/ dial
-    //    compensate for engine torque curve in autocross mode: map power to function
-    //    boost button: overrides any mode and puts motor => 100%, esp to help w/ launch control.  and, motor still runs even when clutch is enabled
     //    refactor to run based on dashboard button values rather than "modes"
     //    add telemetry stuff from Stephen
     
@@ -62,8 +60,9 @@
     
     4. EXECUTION
        
-       4.1 Setup function (executed once)
-       4.1 Loop Function  (executed repeatedly)
+       4.1 Task table     (what runs how often)
+       4.2 Setup function (executed once)
+       4.3 Loop Function  (executed repeatedly)
     
     */
     
@@ -75,6 +74,30 @@
     //------------------------------------------------------------------------------
     //{
     
+        #include "hal.h"      //All pin, clock, servo and serial access goes through the HAL
+        #include "hal_ports.h" //Direct port register access for the digital pins read and written every cycle
+        #include "profiler.h" //Per-stage loop timing, dumped over telemetry on request
+        #include "reed.h"     //Interrupt-timestamped wheel speed
+        #include "input_record.h" //Raw inputs of one control cycle, recordable and replayable
+        #include "logger.h"   //Every control cycle to the SD card, written in the background
+        #include "adc_sampler.h" //Analog inputs converted in the background by the ADC interrupt
+        #include "telemetry_frame.h" //Binary telemetry frame format
+        #include "telemetry_channels.h" //Per channel rate, deadband and priority of what is sent
+        #include "tx_queue.h" //Non-blocking transmit queues in front of both serial ports
+        #include "uplink_parser.h" //Streaming parser for the commands we receive
+        #include "scheduler.h" //Fixed-rate task table that replaces the free-running loop
+        #include "sensor_tables.h" //Calibration tables for the analog senders, generated from calibration/
+        #include "fixed.h"    //Fixed-point math instead of float and runtime division
+        #include "throttle_map.h" //Per mode throttle and torque maps, from EEPROM
+        #include "energy.h"   //Battery and fuel estimates and the endurance energy plan
+        #include "launch.h"   //Boost button and launch control
+        #include "slip.h"     //Wheel slip from engine rpm against the reed switch, traction control
+        #include "gear.h"     //Gear from the gear sensor's bands, checked against the engine's turns per wheel turn
+        #include "conditioning.h" //Debouncing of the switches and filters for the analog inputs
+        #include "safety.h"   //Safety monitor in a timer interrupt, kills the car without the main loop
+        #include "watchdog.h" //Hardware watchdog fed while every task runs, and a record of what it caught
+        #include "params.h"   //Tunables in RAM, saved to EEPROM, set over telemetry
+    
         //------------------------------------------------------------------------------
         // 1.1 Pin nicknames
         //------------------------------------------------------------------------------
@@ -96,14 +119,17 @@
                 #define BMSFaultPin        23 //HIGH when there is a problem with the BMS (critical temperature for example)
                 #define clutchPin          24 //HIGH when the clutch is pressed
                 #define brakePin           25 //HIGH when the brake is pressed
-                #define reedPin            26 //HIGH when reed switch is on (magnet adjacent to sensor)
+                #define reedPin            21 //LOW when reed switch is on (magnet adjacent to sensor).
+                                              //Must be an external interrupt pin (INT0), see reed.h
                 
                 //dashboard buttons
                 #define boostPin           27 //HIGH when the boost button is pressed
-                #define engineEnablePin    28 //HIGH when the gas engine enable button is pressed
-                #define motorEnablePin     29 //HIGH when the electric motor enable button is pressed
-                #define endurancePin       30 //HIGH when the endurance mode enable button is pressed
-                #define telemetryEnablePin 31 //HIGH when telemetry enable switch enabled
+                #define servoEnablePin     28 //LOW when the gas engine (servo) enable button is pressed
+                #define kellyEnablePin     29 //LOW when the electric motor (kelly) enable button is pressed
+                #define modeEndurancePin   30 //LOW when the mode selector is on endurance
+                #define telemetryEnablePin 31 //LOW when telemetry enable switch enabled
+                #define assistPin          34 //HIGH when the assist button is pressed
+                #define modeElectricPin    39 //LOW when the mode selector is on electric
         
         //output pins
                  //PWM output pins
@@ -120,6 +146,7 @@
                  #define engineEnablePin    36 //Connected to a relay, needs to be HIGH in order to accelerate
                  #define hiVoltageEnablePin 37 //Is HIGH when the high voltage system is supposed to be on
                  #define moduleSleepPin     38 //Pauses the onboard telemetry module
+                 #define logCardSelectPin   53 //Chip select of the data logger's SD card, on the SPI port (50-52)
         
                  #define sevenSeg0Pin       44 // velocity sevenseg output bit 0
                  #define sevenSeg1Pin       45 // velocity sevenseg output bit 1
@@ -139,6 +166,7 @@
         //If any of the variables reaches a critical value, the car will stop all
         //motor and engine input until the values drop below limit values. Limit
         //values were introduced to prevent oscillations.
+        //The rpm, velocity and temperature ones are the initial values of parameters (PARAMETERS in 1.4).
         
         const int CRITICAL_RPM =    4000;    //In revolutions per minute !adjust
         const int CRITICAL_VELOCITY = 45;    //In miles per hour !adjust 
@@ -179,6 +207,64 @@
         const int kTelemetryDataTypeMAX =                          14;
         
         const int kTelemetryDataCommandSetCarEnableState =         15; 
+        const int kTelemetryDataCommandProfile =                   16; //1 = dump the loop profile, 2 = reset it
+        
+        //Only sent in answer to kTelemetryDataCommandProfile, one frame per loop stage
+        const int kTelemetryDataTypeProfileStage =                 20;
+        const int kTelemetryDataTypeProfileCount =                 21;
+        const int kTelemetryDataTypeProfileMin =                   22; //In microseconds
+        const int kTelemetryDataTypeProfileMax =                   23;
+        const int kTelemetryDataTypeProfileP99 =                   24;
+        
+        const int kTelemetryDataTypeRadioDrops =                   25; //Frames the transceiver queue refused so far
+        const int kTelemetryDataTypeTaskOverruns =                 26; //Scheduler overruns and skipped releases so far
+        const int kTelemetryDataTypeLogDrops =                     27; //Control cycles the data logger could not write, -1 without a card
+        const int kTelemetryDataTypeBatteryEstimate =              28; //In percent, counted from the Kelly and regen outputs
+        const int kTelemetryDataTypeEnergySource =                 29; //Endurance: 0 engine, 1 engine with the boost, 2 motor only
+        const int kTelemetryDataTypeLaunchState =                  39; //0 off, 1 staged, 2 clutch slipping, 3 boost, 4 braked
+        const int kTelemetryDataTypeWheelSlip =                    40; //In percent, driven wheels over the ground
+        
+        const int kTelemetryDataCommandTractionControl =           41; //1 = cut engine and motor on wheel slip (default), 0 = off
+        
+        //Sent once from setup() after a reset that left a watchdog record, see watchdog.h
+        const int kTelemetryDataTypeResetCause =                   42; //1 watchdog, 2 a reset that kept the RAM (reset button, USB port opened)
+        const int kTelemetryDataTypeResetCount =                   43; //Watchdog resets since power on
+        const int kTelemetryDataTypeResetTask =                    44; //Index in the task table (4.1) running then, 255 between tasks
+        const int kTelemetryDataTypeResetStage =                   45; //Loop profiler stage in it, 255 none
+        const int kTelemetryDataTypeResetMissing =                 46; //Tasks without a heartbeat then, bit per task
+        const int kTelemetryDataTypeResetRuns =                    47; //Task runs since setup(), in thousands
+        const int kTelemetryDataTypeResetLongest =                 48; //Longest task run in microseconds
+        const int kTelemetryDataTypeResetLongestTask =             49;
+        const int kTelemetryDataTypeResetAnalog =                  50; //50-54, last raw analog inputs: rpm, fuel, throttle, radiator, gear
+        const int kTelemetryDataTypeResetSwitches =                55; //Last digital inputs, INPUT_* bits (input_record.h)
+        const int kTelemetryDataTypeResetServo =                   56; //Last outputs
+        const int kTelemetryDataTypeResetKelly =                   57;
+        const int kTelemetryDataTypeResetRegen =                   58;
+        const int kTelemetryDataTypeResetFlags =                   59; //LOG_* bits (logger.h)
+        
+        //Parameter store, see params.h and PARAMETERS in 1.4. Select a parameter, then set it:
+        //<60=0,61=560> moves the throttle pot's low end to 560. The car answers with the parameter,
+        //the value it has now (the old one when the new one was refused) and the store's state
+        const int kTelemetryDataCommandParameter =                 60; //PARAM_* ID to read or change; in answers, the one sent
+        const int kTelemetryDataCommandParameterValue =            61; //Sets the selected one; in answers, its value
+        const int kTelemetryDataCommandParameters =                62; //1 = send the selected one, 2 = send all, 3 = all back to initial values
+        const int kTelemetryDataTypeParameterState =               63; //In answers: 0 initial values, 1 saved to EEPROM, 2 changed, not saved yet
+        
+        //Channel settings, see telemetry_channels.h. Select a channel, then set any of the
+        //others, e.g. <30=8,31=100,32=2000> sends the gear every 100 ms if changed, every 2 s anyway
+        const int kTelemetryDataCommandChannel =                   30; //kTelemetryDataType* of the channel to change
+        const int kTelemetryDataCommandChannelPeriod =             31; //In ms, 0 = off
+        const int kTelemetryDataCommandChannelMaxAge =             32; //In ms
+        const int kTelemetryDataCommandChannelDeadband =           33;
+        const int kTelemetryDataCommandChannelPriority =           34; //0 low, 1 normal, 2 high
+        
+        const int kTelemetryDataCommandDeltaFrames =               35; //1 = send delta frames (default), 0 = plain frames
+        
+        //Endurance energy plan, see energy.h. At the start line: <36=80,37=22000> for a battery
+        //at 80 % and 22 km to go
+        const int kTelemetryDataCommandBatteryLevel =              36; //In percent, what the battery holds now
+        const int kTelemetryDataCommandEnduranceDistance =         37; //In meters from here, restarts the plan
+        const int kTelemetryDataCommandEnergyManager =             38; //1 = endurance follows the plan (default), 0 = fixed assist and regen
         
         //}
         //------------------------------------------------------------------------------
@@ -191,18 +277,82 @@
         const int ELECTRICREGEN_MODE = 4;
         
         const int FULL =      255;           //Maximum PWM output 
-        const int ENDURANCE_IDLE_REGEN_PERCENT = 10;           //Regen when throttle is not pressed
-        const int ELECTRIC_IDLE_REGEN_PERCENT = 50;   
+        const int ENDURANCE_IDLE_REGEN_PERCENT = 10;           //Regen when throttle is not pressed !adjust
+        const int ELECTRIC_IDLE_REGEN_PERCENT = 50;            //!adjust
         const int ENDURANCE_ASSIST = 0;
         const int AUTOCROSS_ASSIST = FULL;
         
         const int LOWER_EFFICIENCY_LEVEL = 1000; //In rounds per minute, used in endurance mode !adjust
         const int UPPER_EFFICIENCY_LEVEL = 3000; //!adjust
         
-        const int RPM_SCALE_MAX =         4000; //!adjust
+        const int ENDURANCE_DISTANCE =    22000; //In meters, the plan until kTelemetryDataCommandEnduranceDistance !adjust
+        const int BATTERY_START_PERCENT =   100; //Charge assumed at power on !adjust
+        
+        //Battery model and endurance plan (energy.h). The joules per wheel revolution are
+        //motor torque x ratio x 2 pi over the efficiency at full PWM, times it for regen
+        const EnergyConfig ENERGY_CONFIG = {
+            4320000,   //batteryJoules, 1.2 kWh !adjust
+            1142,      //motorJoulesPerTurn: 40 Nm x 4 x 2 pi / 0.88 !adjust
+            528,       //regenJoulesPerTurn: 30 Nm x 4 x 2 pi x 0.7 !adjust
+            13600,     //motorMaxWatts: 12 kW / 0.88 !adjust
+            1676,      //wheelMillimeters: WHEEL_CIRCUMFERENCE
+            16,        //batteryReserve, percent, just above the BMS line !adjust
+            15,        //lowBattery, percent, where the BMS pulls hiVoltageLoBattPin !adjust
+            1,         //fuelReserve, percent, one step of the sender !adjust
+            5,         //batteryBand, percent !adjust
+            2,         //fuelBand, percent !adjust
+        };
+        
+        //Launch control and boost (launch.h)
+        const LaunchConfig LAUNCH_CONFIG = {
+            13,        //slipEndMph: first gear at 2000 rpm, where the clutch bites !adjust
+            2000,      //slipMaxMillis !adjust
+        };
+        
+        //Traction control (slip.h)
+        const SlipConfig SLIP_CONFIG = {
+            {928, 672, 512, 416, 352},  //ratios: gears 2.9 2.1 1.6 1.3 1.1 x final drive 3.2, x 100 !adjust
+            2100,      //minRpm, just over where the clutch bites !adjust
+            10,        //target, percent of slip !adjust
+            4,         //gain: 10 % over the target cuts 40 % !adjust
+            20,        //floor, percent !adjust
+            1,         //recovery: full power back 0.2 s after a cut to the floor !adjust
+        };
+        
+        //Gear detection (gear.h)
+        const GearConfig GEAR_CONFIG = {
+            {0, 170, 340, 510, 680, 850},  //centers: gear sensor ADC counts in neutral, 1st ... 5th (log_decode gear_adc) !adjust
+            60,        //width: counts either side of a center !adjust
+            20,        //hysteresis !adjust
+            20,        //confirm: 20 ms for a new reading !adjust
+            200,       //vetoed: 200 ms while the engine's turns say the old gear !adjust
+            SLIP_CONFIG.ratios,
+        };
+        
+        //Input conditioning (conditioning.h): control cycles (ms) a switch has to hold a new level.
+        //Switches not listed, the reed switch and the boost button, pass through
+        const SwitchDebounce SWITCH_DEBOUNCE[] = {
+            {INPUT_BMS_FAULT,                              3},  //kills the car, so only a little !adjust
+            {INPUT_BRAKE | INPUT_CLUTCH,                   5},  //!adjust
+            {INPUT_ASSIST,                                10},  //!adjust
+            {INPUT_HV_LOW_BATT,                           20},  //!adjust
+            {INPUT_SERVO_ENABLE | INPUT_KELLY_ENABLE,     20},  //!adjust
+            {INPUT_MODE_ENDURANCE | INPUT_MODE_ELECTRIC,  50},  //a mode change takes a while anyway !adjust
+            {INPUT_TELEMETRY,                             50},  //!adjust
+        };
+        
+        //Median of three against spikes, then an IIR of about 2^shift ms, by ADC_* channel
+        const AnalogConditioning ANALOG_CONDITIONING[ADC_CHANNELS] = {
+            {true,  2},  //ADC_RPM !adjust
+            {false, 5},  //ADC_FUEL: slosh !adjust
+            {true,  3},  //ADC_THROTTLE: its whole travel is 47 counts, noise shows on the servo !adjust
+            {false, 5},  //ADC_RADIATOR !adjust
+            {true,  0},  //ADC_GEAR: no IIR, it would slide through the other gears' bands !adjust
+        };
+        
+        //The rpm, radiator temperature and fuel scales are calibration tables: calibration/*.csv !adjust
         const int VELOCITY_SCALE_MAX =      50; //!adjust
         const int RADIATORTEMP_SCALE_MIN = 180; //In degrees Fahrenheit !adjust
-        const int RADIATORTEMP_SCALE_MAX = 300; //In degrees Fahrenheit !adjust
         
         const int THROTTLE_SCALE_MIN = 555;  //Boundary values that the throttle pot sends,
                                              //the effective path of the throttle pedal
@@ -210,6 +360,22 @@
         
         const int SHORT_COMM_INTERVAL = 50;  // for high frequency data in ms !adjust
         const int LONG_COMM_INTERVAL = 1000; //for low frequency data in ms !adjust
+        const int MAX_AGE_SHORT = 1000;      //unchanged values are sent again after this many ms !adjust
+        const int MAX_AGE_LONG =  5000;
+        
+        //Task periods for the scheduler, in microseconds (see 4.1 Task table)
+        const unsigned long LAUNCH_PERIOD =          500; //boost button and launch control, 2 kHz !adjust
+        const unsigned long CONTROL_PERIOD =        1000; //inputs, security block and modes, 1 kHz !adjust
+        const unsigned long OUTPUT_PERIOD =         2000; //servo, kelly and relay outputs, 500 Hz !adjust
+        const unsigned long DISPLAY_PERIOD =       50000; //seven segment display, 20 Hz
+        const unsigned long COMMUNICATION_PERIOD = 10000; //uplink and transmit queues, 100 Hz
+        const unsigned long TELEMETRY_PERIOD =     10000; //telemetry channels, each has its own period on top
+        const unsigned long LOG_PERIOD =            1000; //data logger, one slice of an SD card write per run
+        const unsigned long PARAMETER_PERIOD =     10000; //parameter store, one EEPROM byte of a save per run
+        const unsigned long SAFETY_PERIOD =         1000; //safety monitor, its own timer interrupt, 1 kHz !adjust
+        const uint16_t      WATCHDOG_TIMEOUT =       500; //ms without every task running before the watchdog kills the
+                                                          //outputs, it resets the board as long after. A stall of the
+                                                          //main loop plus a 50 ms task's period has to fit !adjust
         
         const int SERVO_MIN =       900;     // pulse width range for the servo in ms for the HS-805bb currently used
         const int SERVO_MAX =      2100;
@@ -218,8 +384,71 @@
         const int THROTTLE_ENGAGE_ASSIST = SERVO_MAX_ANGLE - 5;
         const int THROTTLE_DISENGAGE_ASSIST = SERVO_MAX_ANGLE - 20;
         
-        const float WHEEL_CIRCUMFERENCE = 66; // in inches
-        const float VELOCITY_SCALAR = 56.82;  //This converts from feet/ms to mph
+        const long WHEEL_CIRCUMFERENCE = 66;  // in inches
+        const long VELOCITY_SCALAR = 5682;    //This converts from inches/ms to mph, x100
+        //mph = VELOCITY_DIVIDEND / reed period in us: one integer division, no float
+        const uint32_t VELOCITY_DIVIDEND = WHEEL_CIRCUMFERENCE * VELOCITY_SCALAR * 1000 / 100;
+        
+        //Safety monitor (safety.h): what the sensors can read when they work, by ADC_* channel.
+        //The critical and limit values and the throttle's fields (0 here) are the parameters'
+        //at power on, filled in by safetyLimits()
+        const SafetyConfig SAFETY_CONFIG = {
+            0, 0,              //criticalRpm, limitRpm
+            0, 0,              //criticalMph, limitMph
+            0, 0,              //criticalTemp, limitTemp
+            {0,    0,    0,   10,    0},   //plausibleLow: rpm, fuel, throttle, radiator, gear !adjust
+            {1023, 1023, 0, 1013, 1000},   //plausibleHigh !adjust
+            0,                 //conflictThrottle: 25% of the pedal
+            0,                 //releasedThrottle: 5%
+            5,                 //staleTicks: the ADC snapshot moves every ~100 us
+            {3, 10, 10, 50, 1, 20, 10}, //confirm, ticks: BMS, rpm, velocity, temp, button, sensor, conflict !adjust
+            VELOCITY_DIVIDEND,
+        };
+        const int THROTTLE_PLAUSIBLE_MARGIN = 30; //ADC counts the throttle pot may read beyond its scale !adjust
+        const int THROTTLE_SCALE_SPAN_MAX = 255;  //Widest throttle scale, where fixedMap() still gives map()'s results
+        
+        //Parameters (params.h): the !adjust values above that can be changed over telemetry
+        //(kTelemetryDataCommandParameter*) and are kept in EEPROM. The control code reads
+        //param[PARAM_*]; what is worked out from them is redone by applyParameters().
+        //Append new ones, and bump PARAMS_VERSION when one changes its meaning or ID
+        const uint8_t PARAM_THROTTLE_SCALE_MIN        =  0;
+        const uint8_t PARAM_THROTTLE_SCALE_MAX        =  1;
+        const uint8_t PARAM_THROTTLE_ENGAGE_ASSIST    =  2;
+        const uint8_t PARAM_THROTTLE_DISENGAGE_ASSIST =  3;
+        const uint8_t PARAM_ENDURANCE_IDLE_REGEN      =  4;  //percent
+        const uint8_t PARAM_ELECTRIC_IDLE_REGEN       =  5;
+        const uint8_t PARAM_SHORT_COMM_INTERVAL       =  6;  //period of the channels at it, ms
+        const uint8_t PARAM_LONG_COMM_INTERVAL        =  7;
+        const uint8_t PARAM_CRITICAL_RPM              =  8;  //this one to PARAM_ENDURANCE_DISTANCE: taken at power on
+        const uint8_t PARAM_LIMIT_RPM                 =  9;
+        const uint8_t PARAM_CRITICAL_VELOCITY         = 10;
+        const uint8_t PARAM_LIMIT_VELOCITY            = 11;
+        const uint8_t PARAM_CRITICAL_TEMP             = 12;
+        const uint8_t PARAM_LIMIT_TEMP                = 13;
+        const uint8_t PARAM_BATTERY_START_PERCENT     = 14;
+        const uint8_t PARAM_ENDURANCE_DISTANCE        = 15;
+        const uint8_t PARAMS                          = 16;
+        const uint8_t PARAMS_VERSION                  =  1;
+        
+        const ParamSpec PARAMETERS[PARAMS] = {
+        //   initial                      min              max
+            {THROTTLE_SCALE_MIN,          0,               1023},
+            {THROTTLE_SCALE_MAX,          0,               1023},
+            {THROTTLE_ENGAGE_ASSIST,      SERVO_MIN_ANGLE, SERVO_MAX_ANGLE},
+            {THROTTLE_DISENGAGE_ASSIST,   SERVO_MIN_ANGLE, SERVO_MAX_ANGLE},
+            {ENDURANCE_IDLE_REGEN_PERCENT, 0,              100},
+            {ELECTRIC_IDLE_REGEN_PERCENT, 0,               100},
+            {SHORT_COMM_INTERVAL,         10,              10000},
+            {LONG_COMM_INTERVAL,          10,              10000},
+            {CRITICAL_RPM,                1000,            8000},
+            {LIMIT_RPM,                   500,             8000},
+            {CRITICAL_VELOCITY,           5,               100},
+            {LIMIT_VELOCITY,              1,               100},   //safetyBegin() divides by it
+            {CRITICAL_TEMP,               150,             300},
+            {LIMIT_TEMP,                  100,             300},
+            {BATTERY_START_PERCENT,       0,               100},
+            {ENDURANCE_DISTANCE,          1,               30000},
+        };
         //}
     //}
     //---------------------------------------------------------------------------------------------
@@ -264,12 +493,38 @@
         boolean hiVoltageEnable =     false; //True value sets the high voltage system on
         boolean moduleSleep =         false; //True value sets the telemetry module asleep
         
-        boolean reedOffPrevious =     false; //Is true when the reed was HIGH (not at the magnet) in the previous loop,
-                                             //so velocity calculation will occur immediately
-                                             //after it is turned HIGH
         boolean engineOn        =     false; //determines if engine is on in each loop
         boolean assisting          =  false;
         
+        //Throttle and torque maps of the current mode, from EEPROM (see throttle_map.h)
+        boolean     mapsValid = false;       //The EEPROM holds valid maps, checked in setup()
+        int         mapsMode =  0;           //Mode the maps below were loaded for
+        ThrottleMap servoMap;                //Servo angle from rpm x pedal
+        ThrottleMap kellyMap;                //Kelly PWM from velocity x pedal
+        
+        EnergyManager energy;                //Battery and fuel against the endurance plan (see energy.h)
+        boolean       energyManaged = true;  //Endurance follows the plan, or the fixed assist and regen
+        
+        LaunchControl launch;                //Boost button and launch control, run by launchTask() (see launch.h)
+        SlipEstimator slip;                  //Driven wheel slip (see slip.h)
+        GearDetector  gearDetector;          //Gear sensor bands and the engine's turns (see gear.h)
+        boolean       tractionControl = true; //Outputs are cut on slip
+        
+        SwitchFilter  switchFilter;          //Debounced switches, and filtered analog inputs (see conditioning.h)
+        AnalogFilter  analogFilter;
+        SafetyMonitor safety;                //Run by safetyInterrupt() (see safety.h)
+        SafetyConfig  safetyConfig;          //SAFETY_CONFIG with the parameters' limits at power on
+        
+        //Parameters, by PARAM_* ID, and what is worked out from them (see applyParameters())
+        ParamStore parameters;               //Saves param to EEPROM in the background (see params.h)
+        int16_t    param[PARAMS];
+        FixedMap   throttleToServo;          //Throttle pot to servo angle and to Kelly PWM, map() with the
+        FixedMap   throttleToKelly;          //division done when the throttle's scale changes
+        int        enduranceIdleRegen = 0;   //As PWM values
+        int        electricIdleRegen =  0;
+        uint16_t   shortCommInterval = SHORT_COMM_INTERVAL;  //Channel periods the intervals were set to last
+        uint16_t   longCommInterval =  LONG_COMM_INTERVAL;
+        
         //analog variables are in the scope of 0-1023, as read from the sensors.
         int rpmAnalog =          0;        
         int fuelAnalog =         0;
@@ -278,6 +533,10 @@
         int radiatorTempAnalog = 0;
         int gearAnalog =         0;
         
+        InputRecord   controlInputs;         //Raw inputs of the current control cycle, see input_record.h
+        uint32_t      inputTime =        0;  //micros() when they were read
+        boolean       reedClosed =   false;  //Reed switch closed, the wheel magnet is at the sensor
+        
         //These variables are sent to the servo and kelly
         int servoOut =           0;
         int kellyOut =           0;
@@ -289,10 +548,8 @@
         boolean endloop =             false;   //Goes to end of runTheCar.
         
         //Time variables controlling the telemetry
-        unsigned long currentTime =            0;   //Timestamp corresponding to the start of te loop
-        unsigned long previousShortTime =      0;   //Time in ms when last short time transmission occured
-        unsigned long previousLongTime =       0;   //Time in ms when last long time transmission occured
-        unsigned long previousVelocityTime =   0;   //Last time when velocity was measured in ms
+        unsigned long currentTime =            0;   //Timestamp corresponding to the start of the control task
+        uint32_t      previousControlStart =   0;   //micros() at the start of the previous control task, for the profiler
         
         //}
         //---------------------------------------------------------------------------------------------
@@ -300,20 +557,47 @@
         //---------------------------------------------------------------------------------------------
         //{
         
-        const int MAX_SEND_LENGTH = 64;    //Set a maximum packet size just to define the buffer array.
-        char writeBuffer[MAX_SEND_LENGTH]; //Write buffer of chars to be sent to a serial port.
-                                           //Though it has space up to MAX_SEND_LENGTH,
-                                           //right now we only add about 10-20 values to the array and send those.
-        
-        int writeIndex = 0;                //The current array index new data will be written to. This increments until data is written.
-        
-        char readBuffer[MAX_SEND_LENGTH];
-        char readBufferIndex = 0;
-        int  processingSerialBuffer = 0;
-        char sendID[3];
-        char sendValue[2];
-        int  storeIndex = 0; //0 is for ID, 1 is for value
-        int  storeVariable = 0;
+        TelemetryFrame writeFrame;         //Binary frame being built, see telemetry_frame.h for the format
+        uint8_t writeSequence = 0;         //Sequence number of the next frame, lets the receiver count lost frames
+        boolean writeFrameEnded = false;   //The CRC is added once, before the first port sends the frame
+        boolean telemetryDelta = true;     //Send delta frames, values as differences to the last one sent
+        DeltaEncoder deltaEncoder;         //Last value sent per ID, for the delta frames
+        
+        UplinkParser uplink;               //Incremental parser of the <ID=value,...> commands we receive
+        
+        int  profileDumpStage = -1;        //Next loop profiler stage to send, -1 when no dump is running
+        
+        int  parameterSelected = 0;        //PARAM_* ID the kTelemetryDataCommandParameter* commands are about
+        int  parameterSendNext = -1;       //Next parameter to send, -1 when none; up to parameterSendEnd
+        int  parameterSendEnd =   0;
+        
+        //What is sent, how often and in which frames. Values are looked at every period and
+        //sent when they moved more than the deadband, or when the last one sent is max age old.
+        //Changed at runtime with the kTelemetryDataCommandChannel* commands
+        TelemetryChannel telemetryChannels[] = {
+        //   ID                                          period               max age        deadband  priority
+            {kTelemetryDataTypeCritical,                SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_HIGH},
+            {kTelemetryDataTypeBMSFault,                SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_HIGH},
+            {kTelemetryDataTypeHighVoltageBatteryLevel, SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_HIGH},
+            {kTelemetryDataTypeSpeed,                   SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeEngineRPM,               SHORT_COMM_INTERVAL, MAX_AGE_SHORT, 50,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeClutchPedal,             SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeBrakePedal,              SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeGasPedal,                SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  2,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeGear,                    SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeRadiatorTemperature,     LONG_COMM_INTERVAL,  MAX_AGE_LONG,   1,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeDemoSpecial,             LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeFuelLevel,               LONG_COMM_INTERVAL,  MAX_AGE_LONG,   1,        TX_PRIORITY_LOW},
+            {kTelemetryDataTypeRadioDrops,              LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_LOW},
+            {kTelemetryDataTypeTaskOverruns,            LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_LOW},
+            {kTelemetryDataTypeLogDrops,                LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_LOW},
+            {kTelemetryDataTypeBatteryEstimate,         LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeEnergySource,            LONG_COMM_INTERVAL,  MAX_AGE_LONG,   0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeLaunchState,             SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  0,        TX_PRIORITY_NORMAL},
+            {kTelemetryDataTypeWheelSlip,               SHORT_COMM_INTERVAL, MAX_AGE_SHORT,  2,        TX_PRIORITY_NORMAL},
+        };
+        const uint8_t TELEMETRY_CHANNELS = sizeof(telemetryChannels) / sizeof(telemetryChannels[0]);
+        int telemetryConfigChannel = kTelemetryDataTypeNone;   //Channel the kTelemetryDataCommandChannel* commands change
         
         //}
         //---------------------------------------------------------------------------------------------
@@ -321,9 +605,7 @@
         //---------------------------------------------------------------------------------------------
         //{
         
-        #include <Servo.h>    //Give access to the Arduino Servo library                                                                     
-        
-        Servo throttleServo;  //This is the instance of our servo
+        //The throttle servo is owned by the HAL (hal.h), it is attached in setup()
         
         
         //}
@@ -335,45 +617,137 @@
     //---------------------------------------------------------------------------------------------
     //{
         
+        //Prototypes, so the functions can be called before they are defined. The Arduino
+        //IDE only generates these for .ino sketches, the host build needs them spelled out.
+        void readInputs();
+        void applyInputs(const InputRecord* in);
+        void processInputs();
+        void runSecurityBlock();
+        void runCommunication();
+        void runTheCar();
+        void applyLaunch();
+        int  tractionLimit(int output);
+        int  servoForPedal();
+        int  kellyForPedal(int withoutMaps);
+        void writeOutputs();
+        void sendTelemetry();
+        int  telemetryValue(uint8_t id);
+        void sendProfileDump();
+        void sendResetReport();
+        void sendParameters();
+        void applyParameters();
+        boolean parameterAllowed(int id, int val);
+        void safetyLimits();
+        uint8_t outputFlags();
+        void logControlCycle();
+        void serialWriteBegin();
+        boolean serialWriteValue(int value, int ID);
+        void serialWriteCommit(int serial, uint8_t priority = TX_PRIORITY_NORMAL);
+        int  telemetrySendSetGlobal(int id, int val);
+        void serialPortReadInBackgroundToBuffer(int port);
+        void sevenSegOut();
+        void regenTest();
+        void testTheCar();
+        void kill();
+        void doScenario(int type, int timeInSeconds);
+        
         //---------------------------------------------------------------------------------------------
         // 3.1 Main program body functions
         //---------------------------------------------------------------------------------------------
         //{
         
         void readInputs(){
-               //analog pins
+        //Reads everything raw into controlInputs, applyInputs() does the rest. A host
+        //replay calls applyInputs() with recorded records instead
+        
+               //wheel pulses timestamped by the reed interrupt since the last cycle, taken
+               //before the time is, so none of them can be stamped after the record's time
+               boolean lost;
+               controlInputs.reedCount = reedTake(controlInputs.reed, INPUT_REED_MAX, &lost);
                
-               rpmAnalog =          analogRead(rpmPin);           
-               fuelAnalog =         analogRead(fuelPin); 
-               throttleAnalog =     analogRead(throttlePin);
-               radiatorTempAnalog = analogRead(radiatorTempPin);
-               gearAnalog =         analogRead(gearPin);
+               controlInputs.time = halMicros();
                
-               //digital pins
+               //analog pins, latest consistent set of ADC interrupt samples (does not wait)
+               AdcSnapshot adc;
+               adcSamplerRead(&adc);
+               for(uint8_t i = 0; i < ADC_CHANNELS; i++) controlInputs.analog[i] = adc.value[i];
+               
+               //digital pins, all ports read at once (they share ports A, C, D and G)
+               HalPortSnapshot pins;
+               halPortsRead(&pins);
+               
+               uint16_t switches = 0;
+               if(halPinIn(&pins, hiVoltageLoBattPin)) switches |= INPUT_HV_LOW_BATT;
+               if(halPinIn(&pins, BMSFaultPin))        switches |= INPUT_BMS_FAULT;
+               if(halPinIn(&pins, clutchPin))          switches |= INPUT_CLUTCH;
+               if(halPinIn(&pins, assistPin))          switches |= INPUT_ASSIST;
+               if(halPinIn(&pins, servoEnablePin))     switches |= INPUT_SERVO_ENABLE;
+               if(halPinIn(&pins, kellyEnablePin))     switches |= INPUT_KELLY_ENABLE;
+               if(halPinIn(&pins, brakePin))           switches |= INPUT_BRAKE;
+               if(halPinIn(&pins, modeEndurancePin))   switches |= INPUT_MODE_ENDURANCE;
+               if(halPinIn(&pins, modeElectricPin))    switches |= INPUT_MODE_ELECTRIC;
+               if(halPinIn(&pins, telemetryEnablePin)) switches |= INPUT_TELEMETRY;
+               if(halPinIn(&pins, reedPin))            switches |= INPUT_REED;
+               if(halPinIn(&pins, boostPin))           switches |= INPUT_BOOST;   //for the log, launchTask() reads the pin itself
+               
+               if(lost) switches |= INPUT_REED_LOST;
+               controlInputs.switches = switches;
+               
+               applyInputs(&controlInputs);
+        }
+        
+        
+        void applyInputs(const InputRecord* in){
+        
+               inputTime = in->time;
+               
+               //analog pins, with spikes and noise filtered out
+               uint16_t analog[ADC_CHANNELS];
+               analogFilterStep(&analogFilter, in->analog, analog);
+               rpmAnalog =          analog[ADC_RPM];
+               fuelAnalog =         analog[ADC_FUEL];
+               throttleAnalog =     analog[ADC_THROTTLE];
+               radiatorTempAnalog = analog[ADC_RADIATOR];
+               gearAnalog =         analog[ADC_GEAR];
+               
+               //digital pins, debounced
                //Most of the variables are set true when pins are driven LOW. Refer to Ports_2011 on Google Docs
-               hiVoltageLoBatt =   (digitalRead(hiVoltageLoBattPin) == LOW);
-               BMSFault =          (digitalRead(BMSFaultPin) ==        LOW);
-               clutchPressed =     (digitalRead(clutchPin) ==          LOW);
-               assist =            (digitalRead(assistPin) ==          HIGH);
-               servoEnable =       (digitalRead(servoEnablePin) ==     LOW);
-               kellyEnable =       (digitalRead(kellyEnablePin) ==     LOW);
+               uint16_t pins = switchFilterStep(&switchFilter, in->switches);
+               hiVoltageLoBatt =   !(pins & INPUT_HV_LOW_BATT);
+               BMSFault =          !(pins & INPUT_BMS_FAULT);
+               clutchPressed =     !(pins & INPUT_CLUTCH);
+               assist =             (pins & INPUT_ASSIST) != 0;
+               servoEnable =       !(pins & INPUT_SERVO_ENABLE);
+               kellyEnable =       !(pins & INPUT_KELLY_ENABLE);
                
-        if(hiVoltageEnable==true) brake =(digitalRead(brakePin) ==     LOW);  //the brake is only checked if HV is enabled,                                           
-        else brake = false;                                                     //otherwise set to false
+        if(hiVoltageEnable==true) brake = !(pins & INPUT_BRAKE);  //the brake is only checked if HV is enabled,
+        else brake = false;                                       //otherwise set to false
               
-               modeEndurance =     (digitalRead(modeEndurancePin) ==   LOW);
-               modeElectric =      (digitalRead(modeElectricPin) ==    LOW);
-               telemetryEnable =   (digitalRead(telemetryEnablePin) == LOW);
+               modeEndurance =     !(pins & INPUT_MODE_ENDURANCE);
+               modeElectric =      !(pins & INPUT_MODE_ELECTRIC);
+               telemetryEnable =   !(pins & INPUT_TELEMETRY);
+               reedClosed =        !(pins & INPUT_REED);
+               
+               //wheel pulses into the speed filter
+               if(pins & INPUT_REED_LOST){
+                   reedLost();
+                   slipLost(&slip);
+               }
+               for(uint8_t i = 0; i < in->reedCount; i++){
+                   reedFeed(in->reed[i]);
+                   energyTurn(&energy, in->reed[i]);   //every revolution also counts toward the energy plan
+                   slipTurn(&slip, in->reed[i]);       //and closes a count of engine turns
+               }
                
         }
         
         
         void processInputs(){
                   
-            //transform the analog 0-1023 data to actual values    
-            rpm       =    map(rpmAnalog,         0,1023, 0,RPM_SCALE_MAX);         //in Rounds Per Minute (RPM)          
-            radiatorTemp = map(radiatorTempAnalog,0,1023, RADIATORTEMP_SCALE_MAX, 0);//in degrees F  (yes this is correct, increased temp -> lower signal)
-            fuel      =    map(fuelAnalog,        0,1023, 0,100);                   //in percent
+            //transform the analog 0-1023 data to actual values, through the calibration tables (calibration/*.csv)
+            rpm       =    sensorTableLookup(RPM_TABLE,           RPM_TABLE_BITS,           rpmAnalog);          //in Rounds Per Minute (RPM)
+            radiatorTemp = sensorTableLookup(RADIATOR_TEMP_TABLE, RADIATOR_TEMP_TABLE_BITS, radiatorTempAnalog); //in degrees F (increased temp -> lower signal)
+            fuel      =    sensorTableLookup(FUEL_TABLE,          FUEL_TABLE_BITS,          fuelAnalog);         //in percent
             
             //The mode is made of the two digital pins
             if(modeEndurance == false && modeElectric == false)      mode = AUTOCROSS_MODE;
@@ -381,38 +755,36 @@
             else if (modeElectric == true && modeEndurance == false) mode = ELECTRIC_MODE;
             else if (modeElectric == true && modeEndurance == true)  mode = ELECTRICREGEN_MODE;
           
-            //Mapping of analog throttle to useful values
+            //Mapping of analog throttle to useful values, clamped outside the pedal's path
             //Throttle scaled from 0 to 180, used for servo.write()
-            if      (throttleAnalog < THROTTLE_SCALE_MIN) throttle = SERVO_MIN_ANGLE;
-            else if (throttleAnalog > THROTTLE_SCALE_MAX) throttle = SERVO_MAX_ANGLE;
-            else     throttle = map(throttleAnalog,THROTTLE_SCALE_MIN,THROTTLE_SCALE_MAX,SERVO_MIN_ANGLE,SERVO_MAX_ANGLE); 
+            throttle = fixedMap(throttleToServo, throttleAnalog);
             
             //Throttle scaled from 0 to 255, used for analogWrite() to Kelly
-            if (throttleAnalog < THROTTLE_SCALE_MIN) throttleKelly = 0;
-            else if (throttleAnalog > THROTTLE_SCALE_MAX) throttleKelly = FULL;
-            else throttleKelly = map(throttleAnalog,THROTTLE_SCALE_MIN,THROTTLE_SCALE_MAX,0,FULL);
+            throttleKelly = fixedMap(throttleToKelly, throttleAnalog);
             
-            //Calculation of velocity from the reed switch on the wheel
-            if (digitalRead(reedPin) == LOW)
-            {
-                if (reedOffPrevious == true)
-                {
-                    velocity = (WHEEL_CIRCUMFERENCE / (currentTime - previousVelocityTime)) * VELOCITY_SCALAR; 
-                    previousVelocityTime = currentTime;
-                    reedOffPrevious = false;
-                }
-                
-                else if (currentTime - previousVelocityTime > 300) velocity = 0;
-                
-            }
+            //Calculation of velocity from the reed switch on the wheel. The reed interrupt
+            //timestamps every revolution, reedPeriod() gives the filtered period in us
+            //and handles the zero speed timeouts
+            uint32_t reedPeriodMicros = reedPeriod(inputTime, reedClosed);
+            if (reedPeriodMicros == 0) velocity = 0;
+            else velocity = VELOCITY_DIVIDEND / reedPeriodMicros;
             
-            else {
-                reedOffPrevious = true;
-                if (currentTime - previousVelocityTime > 2000) velocity = 0;    
-            } 
+            //Each mode has its own maps, read from EEPROM when it is selected (~100 us)
+            if (mapsValid && mode != mapsMode) {
+                throttleMapLoad(throttleMapIndex(mode, MAP_SERVO), &servoMap);
+                throttleMapLoad(throttleMapIndex(mode, MAP_KELLY), &kellyMap);
+                mapsMode = mode;
+            }
                         
-            //Calculation of gear position
-            //To do: map gear sensor outputs to gears
+            //Fuel sender and the BMS low battery line into the energy estimates
+            energyInputs(&energy, fuel, hiVoltageLoBatt);
+            
+            //Calculation of gear position, from the sensor's bands, checked against the engine's
+            //turns per wheel turn over the last revolution
+            gear = gearUpdate(&gearDetector, gearAnalog, slip.turns);
+            
+            //Engine turns per revolution of the reed switch's wheel, for the driven wheels' slip
+            slipUpdate(&slip, inputTime, rpm, gear, clutchPressed);
                
         }
           
@@ -420,40 +792,41 @@
                        
         void runSecurityBlock(){
         //Security block is executed in ever loop and if a variable reaches a critical
-        //limit, the servo and kelly outputs are both set to 0, until the conditions are
-        //under the limit again.
-        
-        
-            if (//rpm > CRITICAL_RPM ||  Disclaimer: this car has been made less safe by Sid, don't blame Jan and Geoffrey if things go wrong ;) 
-                //velocity > CRITICAL_VELOCITY || 
-                // radiatorTemp > CRITICAL_TEMP ||
-                BMSFault ==            true )
-                // || virtualBigRedButton == true
-                
+        //limit, the car is killed (engine relay, high voltage, servo and kelly), until the
+        //conditions are under the limit again. The safety monitor's interrupt does the same
+        //on the raw inputs whether the loop gets here or not (see safety.h); this is the
+        //second line, on the conditioned inputs, and takes over what the monitor tripped.
+        
+            if ((safety.faults & SAFETY_CRITICAL) != 0 ||
+                rpm >                  safetyConfig.criticalRpm ||
+                velocity >             safetyConfig.criticalMph || 
+                radiatorTemp >         safetyConfig.criticalTemp ||
+                BMSFault ==            true ||
+                virtualBigRedButton == true)
                {          
                criticalCycle = true;
-               endloop = true;
-               digitalWrite(criticalPin,HIGH);
                }
                        
             if (criticalCycle == true){
-              kill();
+               kill();
                endloop = true;
-               digitalWrite(criticalPin,HIGH);
                //set servo and kelly output to zero
+               servoOut = SERVO_MIN_ANGLE;
+               kellyOut = 0;
                         
-               if (//rpm <                  LIMIT_RPM &&
-                   //velocity <             LIMIT_VELOCITY && 
-                   //radiatorTemp <         LIMIT_TEMP &&
-                   BMSFault ==            false )
-                  // && virtualBigRedButton == false
+               if ((safety.faults & SAFETY_CRITICAL) == 0 &&
+                   rpm <                  safetyConfig.limitRpm &&
+                   velocity <             safetyConfig.limitMph && 
+                   radiatorTemp <         safetyConfig.limitTemp &&
+                   BMSFault ==            false &&
+                   virtualBigRedButton == false)
                    
                //Checks if the conditions are OK again
                //the reason for separate CRITICAL and LIMIT values is
                //to prevent oscillations from critical cycle to normal and back
                 {criticalCycle = false;
                 endloop = false;
-                digitalWrite(criticalPin,LOW);}       
+                halFastWrite(criticalPin,LOW);}       
           
                  //if the conditions are still critical, do not execute the main program body         
             }        
@@ -461,46 +834,173 @@
         
         
         void runCommunication(){
-        //Important data are sent at a shorter interval than less important data, which is
-        //the reason for high and low frequency communication.
-        //It is not frequency of the radio, but of the sending period.
+        //Hands queued telemetry to the UARTs and applies the commands received. The
+        //frames themselves are built by sendTelemetry() and sendProfileDump().
         
-           digitalWrite(moduleSleepPin,HIGH);
+           if(telemetryEnable == false){
+               halFastWrite(moduleSleepPin,LOW);  //If not communicating, set the module asleep
+               return;
+           }
+           halFastWrite(moduleSleepPin,HIGH);
            
-           //SENDING
+           //Hand queued bytes to the UARTs, as many as they take without waiting
+           txQueuePump(1);
+           txQueuePump(0);
+           
+           //RECEIVING
+           serialPortReadInBackgroundToBuffer(1);
+        }
+        
+        
+        void sendTelemetry(){
+        //Every channel of telemetryChannels that is due and has changed goes into one frame,
+        //nothing is sent when nothing changed. Frames during a critical cycle go first
+        
+            if(telemetryEnable == false) return;
+            
+            serialWriteBegin();
+            uint8_t priority;
+            if(telemetryChannelsFill(serialWriteValue, halMillis(), &priority) == 0) return;
+            if(criticalCycle) priority = TX_PRIORITY_HIGH;
+            
+            serialWriteCommit(1, priority); // 0 for USB, 1 for tranceiver
+            serialWriteCommit(0, priority);
+        }
+        
+        
+        int telemetryValue(uint8_t id){
+        //Current value of a telemetry channel
+        
+            switch(id){
+                case kTelemetryDataTypeSpeed:                   return velocity;
+                case kTelemetryDataTypeRadiatorTemperature:     return radiatorTemp;
+                case kTelemetryDataTypeBMSFault:                return (int)BMSFault;
+                case kTelemetryDataTypeEngineRPM:               return rpm;
+                case kTelemetryDataTypeClutchPedal:             return (int)clutchPressed;
+                case kTelemetryDataTypeBrakePedal:              return (int)brake;
+                case kTelemetryDataTypeGasPedal:                return throttle;
+                case kTelemetryDataTypeGear:                    return gear;
+                case kTelemetryDataTypeCritical:                return (int)criticalCycle;
+                case kTelemetryDataTypeHighVoltageBatteryLevel: return (int)hiVoltageLoBatt;
+                case kTelemetryDataTypeFuelLevel:               return fuel;
+                case kTelemetryDataTypeDemoSpecial:             return mode;
+                case kTelemetryDataTypeRadioDrops:              return txQueueTotalDrops(1);
+                case kTelemetryDataTypeTaskOverruns:            return schedulerOverruns();
+                case kTelemetryDataTypeLogDrops:                return logActive() || logDropped() ? profileValue(logDropped()) : -1;
+                case kTelemetryDataTypeBatteryEstimate:         return energyBatteryPercent(&energy);
+                case kTelemetryDataTypeEnergySource:            return energySource(&energy);
+                case kTelemetryDataTypeLaunchState:             return launch.state;
+                case kTelemetryDataTypeWheelSlip:               return slipPercent(&slip);
+                default:                                        return 0;
+            }
+        }
+        
+        
+        void sendProfileDump(){
+        //One loop profiler stage per SHORT_COMM_INTERVAL while a dump is running, to keep frames short
+        
+            if(telemetryEnable == false || profileDumpStage < 0) return;
             
-            //High frequency communication
-            if(currentTime - previousShortTime > SHORT_COMM_INTERVAL)
+            ProfileStats stats;
+            if(profilerStats(profileDumpStage, &stats))
             {
-                previousShortTime = currentTime;     //Reset time
-                
-                serialWriteBegin();                  //Initiate serial sending
-                serialWriteValue(     velocity,      kTelemetryDataTypeSpeed);
-                serialWriteValue(     rpm,           kTelemetryDataTypeEngineRPM);
-                serialWriteValue((int)clutchPressed, kTelemetryDataTypeClutchPedal);
-                serialWriteValue((int)brake,         kTelemetryDataTypeBrakePedal);
-                serialWriteValue(     throttle,      kTelemetryDataTypeGasPedal);
-                //serialWriteValue(     gear,          kTelemetryDataTypeGear);
-                
-                //Low frequency communication
-                if(currentTime - previousLongTime > LONG_COMM_INTERVAL)
-                {
-                    previousLongTime = currentTime;
-                    
-                    serialWriteValue(     radiatorTemp,      kTelemetryDataTypeRadiatorTemperature);
-                    serialWriteValue((int)hiVoltageLoBatt,   kTelemetryDataTypeHighVoltageBatteryLevel);
-                    serialWriteValue((int)criticalCycle,     kTelemetryDataTypeCritical);
-                    serialWriteValue((int)BMSFault,          kTelemetryDataTypeBMSFault);
-                    serialWriteValue(     mode,              kTelemetryDataTypeDemoSpecial);
-                }
-                
-                //actually send the data
-                serialWriteCommit(1); // 0 for USB, 1 for tranceiver
-                serialWriteCommit(0);
+                serialWriteBegin();
+                serialWriteValue(profileDumpStage,          kTelemetryDataTypeProfileStage);
+                serialWriteValue(profileValue(stats.count), kTelemetryDataTypeProfileCount);
+                serialWriteValue(profileValue(stats.min),   kTelemetryDataTypeProfileMin);
+                serialWriteValue(profileValue(stats.max),   kTelemetryDataTypeProfileMax);
+                serialWriteValue(profileValue(stats.p99),   kTelemetryDataTypeProfileP99);
+                serialWriteCommit(1, TX_PRIORITY_LOW);
+                serialWriteCommit(0, TX_PRIORITY_LOW);
+            }
+            profileDumpStage++;
+            if(profileDumpStage >= PROFILE_STAGES) profileDumpStage = -1;
+        }
+        
+        
+        void sendResetReport(){
+        //What the watchdog supervisor recorded before the last reset (see watchdog.h), once from
+        //setup(). It waits in the transmit queues until the telemetry switch lets it out
+        
+            WatchdogRecord last;
+            uint8_t cause = watchdogLastReset(&last);
+            if(cause == WATCHDOG_POWER_ON) return;
+            
+            serialWriteBegin();
+            serialWriteValue(cause,                          kTelemetryDataTypeResetCause);
+            serialWriteValue(last.resets,                    kTelemetryDataTypeResetCount);
+            serialWriteValue(last.task,                      kTelemetryDataTypeResetTask);
+            serialWriteValue(last.stage,                     kTelemetryDataTypeResetStage);
+            serialWriteValue(last.missing,                   kTelemetryDataTypeResetMissing);
+            serialWriteValue(profileValue(last.runs / 1000), kTelemetryDataTypeResetRuns);
+            serialWriteValue(profileValue(last.longest),     kTelemetryDataTypeResetLongest);
+            serialWriteValue(last.longestTask,               kTelemetryDataTypeResetLongestTask);
+            if(last.snapshot){
+                for(uint8_t i = 0; i < ADC_CHANNELS; i++) serialWriteValue(last.last.analog[i], kTelemetryDataTypeResetAnalog + i);
+                serialWriteValue(last.last.switches,         kTelemetryDataTypeResetSwitches);
+                serialWriteValue(last.last.servo,            kTelemetryDataTypeResetServo);
+                serialWriteValue(last.last.kelly,            kTelemetryDataTypeResetKelly);
+                serialWriteValue(last.last.regen,            kTelemetryDataTypeResetRegen);
+                serialWriteValue(last.last.flags,            kTelemetryDataTypeResetFlags);
+            }
+            serialWriteCommit(1, TX_PRIORITY_HIGH);
+            serialWriteCommit(0, TX_PRIORITY_HIGH);
+        }
+        
+        
+        void sendParameters(){
+        //Answers to the kTelemetryDataCommandParameter* commands: the parameters asked for as
+        //ID and value pairs, nine to a frame, each frame with the store's state
+        
+            if(telemetryEnable == false || parameterSendNext < 0) return;
+            
+            serialWriteBegin();
+            for(uint8_t n = 0; n < 9 && parameterSendNext < parameterSendEnd && parameterSendNext < PARAMS; n++){
+                serialWriteValue(parameterSendNext,        kTelemetryDataCommandParameter);
+                serialWriteValue(param[parameterSendNext], kTelemetryDataCommandParameterValue);
+                parameterSendNext++;
             }
+            serialWriteValue(paramsState(&parameters),     kTelemetryDataTypeParameterState);
+            serialWriteCommit(1, TX_PRIORITY_LOW);
+            serialWriteCommit(0, TX_PRIORITY_LOW);
+            if(parameterSendNext >= parameterSendEnd || parameterSendNext >= PARAMS) parameterSendNext = -1;
+        }
+        
+        
+        //Outputs and program flow as LOG_* bits, for the data log and the watchdog's record
+        uint8_t outputFlags(){
+            uint8_t flags = 0;
+            if(engineOn)        flags |= LOG_ENGINE_ON;
+            if(hiVoltageEnable) flags |= LOG_HV_ENABLE;
+            if(regenEnable)     flags |= LOG_REGEN_ENABLE;
+            if(engineEnable)    flags |= LOG_ENGINE_ENABLE;
+            if(criticalCycle)   flags |= LOG_CRITICAL;
+            if(assisting)       flags |= LOG_ASSISTING;
+            if(brake)           flags |= LOG_BRAKE;
+            if(endloop)         flags |= LOG_ENDLOOP;
+            return flags;
+        }
+        
+        
+        void logControlCycle(){
+        //The raw inputs of this cycle, what was made of them and the outputs, to the
+        //SD card logger. Only copies, the card is written by logService()
+        
+            LogRecord record;
+            record.inputs =       controlInputs;
+            record.rpm =          rpm;
+            record.velocity =     velocity;
+            record.throttle =     throttle;
+            record.radiatorTemp = radiatorTemp;
+            record.fuel =         fuel;
+            record.gear =         gear;
+            record.mode =         mode;
+            record.servoOut =     servoOut;
+            record.kellyOut =     kellyOut;
+            record.regenOut =     regenOut;
+            record.flags =        outputFlags();
             
-            //RECEIVING
-            serialPortReadInBackgroundToBuffer(1);
+            logAppend(&record);
         }
         
         
@@ -515,15 +1015,15 @@
             if (mode == AUTOCROSS_MODE && endloop == false)
             {          
                engineOn = true;
-               servoOut = throttle;
+               servoOut = servoForPedal();
                regenEnable = false;
                regenOut = 0;
                
                //If assist button is pressed, motor engages
-                if(throttle > THROTTLE_ENGAGE_ASSIST && assisting == false){
+                if(throttle > param[PARAM_THROTTLE_ENGAGE_ASSIST] && assisting == false){
                     assisting = true;
                 }
-                else if(throttle < THROTTLE_DISENGAGE_ASSIST && assisting == true){
+                else if(throttle < param[PARAM_THROTTLE_DISENGAGE_ASSIST] && assisting == true){
                     assisting = false;
                 }
                 
@@ -531,7 +1031,7 @@
                if ((assist == true || assisting == true)){
                     hiVoltageEnable = true;
                     if(brake == false){  
-                        kellyOut = AUTOCROSS_ASSIST;
+                        kellyOut = kellyForPedal(AUTOCROSS_ASSIST);
                     }
                     else{
                         kellyOut = 0;
@@ -544,13 +1044,53 @@
                 
             }
             
-            // 3.5.2 Endurance mode ( = Autocross with regen)
+            // 3.5.2 Endurance mode: the energy plan decides between engine, motor or both
+            else if (mode == ENDURANCE_MODE && endloop == false && energyManaged == true)
+            {
+                hiVoltageEnable = true;
+                
+                //The engine is off while the fuel is behind the plan, the motor takes the pedal
+                engineOn = (energy.engineOff == false);
+                if (engineOn == true) servoOut = servoForPedal();
+                else                  servoOut = SERVO_MIN_ANGLE;
+                
+                //Braking always regens, a released pedal only while the charge will be used:
+                //coasting is faster
+                if (brake == true && kellyEnable == true){
+                    regenEnable = true;
+                    regenOut = FULL;
+                }
+                else if (brake == false && throttle == SERVO_MIN_ANGLE && kellyEnable == true && energy.surplus == false){
+                    regenEnable = true;
+                    regenOut = enduranceIdleRegen;
+                }
+                else{
+                    regenEnable = false;
+                    regenOut = 0;
+                }
+                
+                //Full pedal or the assist button engage the boost, while the plan allows it
+                if(throttle > param[PARAM_THROTTLE_ENGAGE_ASSIST] && assisting == false){
+                    assisting = true;
+                }
+                else if(throttle < param[PARAM_THROTTLE_DISENGAGE_ASSIST] && assisting == true){
+                    assisting = false;
+                }
+                
+                boolean boost = (assist == true || assisting == true) && energy.assist == true;
+                if (brake == true)          kellyOut = 0;
+                else if (engineOn == false) kellyOut = kellyForPedal(throttleKelly);
+                else if (boost == true)     kellyOut = kellyForPedal(AUTOCROSS_ASSIST);
+                else                        kellyOut = 0;
+            }
+            
+            // 3.5.2b Endurance mode with fixed assist and regen ( = Autocross with regen)
             else if (mode == ENDURANCE_MODE && endloop == false)
             {       
                 hiVoltageEnable = true;
                
                 engineOn = true;
-                servoOut = throttle;
+                servoOut = servoForPedal();
     
                 
              
@@ -562,7 +1102,7 @@
                        }      
                else if (brake == false && throttle == SERVO_MIN_ANGLE && kellyEnable == true){
                     regenEnable = true;
-                    regenOut = 255*ENDURANCE_IDLE_REGEN_PERCENT/100;
+                    regenOut = enduranceIdleRegen;
                }
                else{
                     regenEnable = false;
@@ -571,10 +1111,10 @@
                
                
                //If assist button is pressed, motor engages
-                if(throttle > THROTTLE_ENGAGE_ASSIST && assisting == false){
+                if(throttle > param[PARAM_THROTTLE_ENGAGE_ASSIST] && assisting == false){
                     assisting = true;
                 }
-                else if(throttle < THROTTLE_DISENGAGE_ASSIST && assisting == true){
+                else if(throttle < param[PARAM_THROTTLE_DISENGAGE_ASSIST] && assisting == true){
                     assisting = false;
                 }
                 
@@ -585,7 +1125,7 @@
                             kellyOut = ENDURANCE_ASSIST;
                         }
                         else if(assisting == true){
-                            kellyOut = AUTOCROSS_ASSIST;
+                            kellyOut = kellyForPedal(AUTOCROSS_ASSIST);
                         }
                     }
                     else{
@@ -606,7 +1146,7 @@
                engineOn = false;
                servoOut = SERVO_MIN_ANGLE;
                if(brake == false && hiVoltageLoBatt == false){
-                    kellyOut = throttleKelly;
+                    kellyOut = kellyForPedal(throttleKelly);
                }
                else{
                 kellyOut = 0;
@@ -621,7 +1161,7 @@
                engineOn = false;
                servoOut = SERVO_MIN_ANGLE;
                if(brake == false && hiVoltageLoBatt == false){
-                    kellyOut = throttleKelly;
+                    kellyOut = kellyForPedal(throttleKelly);
                }
                else{
                 kellyOut = 0;
@@ -629,12 +1169,12 @@
                
                 if(throttle == SERVO_MIN_ANGLE && brake == false){
                     regenEnable = true;
-                    regenOut = 255*ELECTRIC_IDLE_REGEN_PERCENT/100;
+                    regenOut = electricIdleRegen;
     
                 }
                 else if(throttle == SERVO_MIN_ANGLE && brake == true){
                     regenEnable = true;
-                    int regenOut = FULL;
+                    regenOut = FULL;
                 }
                 else{
                     regenEnable = false;
@@ -642,24 +1182,66 @@
                 }
                      
             }
+            
+            // 3.5.5 Boost button, over any of the modes
+            applyLaunch();
             //}
+        }
+        
+        //While the boost is held the launch control has the motor, in every mode (see launchTask())
+        void applyLaunch(){
+            if (launchActive(&launch) == false) return;
+            hiVoltageEnable = true;
+            regenEnable = false;
+            regenOut = 0;
+            kellyOut = launch.pwm;
+        }
+        
+        //An engine or motor output less the wheel slip over the target (see slip.h)
+        int tractionLimit(int output){
+            if (tractionControl == false) return output;
+            return slipLimit(&slip, output);
+        }
+        
+        //Servo angle for the pedal, from the mode's map (evens out the engine torque
+        //curve over rpm) or, without maps, the pedal as it is
+        int servoForPedal(){
+            if (mapsValid == false) return throttle;
+            return throttleMapLookup(&servoMap, rpm, throttleKelly);
+        }
+        
+        //Kelly PWM for the pedal, from the mode's map over velocity or, without maps,
+        //the value the mode used before
+        int kellyForPedal(int withoutMaps){
+            if (mapsValid == false) return withoutMaps;
+            return throttleMapLookup(&kellyMap, velocity, throttleKelly);
+        }
+        
+        
+        void writeOutputs(){
+            
             //---------------------------------------------------------------------------------------------
-            // runTheCar OUTPUT
+            // runTheCar OUTPUT (own task, see 4.1 Task table)
             //---------------------------------------------------------------------------------------------
             //{
             
-            //send velocity to seven seg display
-            sevenSegOut();
+            //The safety monitor's interrupt may have killed the car since the control cycle, or
+            //the watchdog's before its reset
+            if ((safety.faults & SAFETY_CRITICAL) != 0 || watchdogExpired()) return;
+            
+            //The launch may have changed since the control cycle
+            applyLaunch();
             
             //Turn the engine relay on if there is an output to engine
-            if (engineOn == true) {digitalWrite(engineEnablePin, HIGH);}
-            else                  {digitalWrite(engineEnablePin, LOW);}
+            if (engineOn == true) {halFastWrite(engineEnablePin, HIGH);}
+            else                  {halFastWrite(engineEnablePin, LOW);}
             
-            if (hiVoltageEnable == true) {digitalWrite(hiVoltageEnablePin, HIGH);}
-            else                         {digitalWrite(hiVoltageEnablePin, LOW);}   
+            if (hiVoltageEnable == true) {halFastWrite(hiVoltageEnablePin, HIGH);}
+            else                         {halFastWrite(hiVoltageEnablePin, LOW);}   
             
-            //Don't accelerate when braking
-            if (brake == true){
+            //Don't accelerate when braking, nor after braking with the throttle down until the
+            //pedal is let up (see safety.h)
+            if (brake == true || (safety.faults & SAFETY_CONFLICT) != 0){
                 kellyOut = 0;
                 servoOut = 0;
             }
@@ -667,26 +1249,32 @@
             
             //Output regen if enabled
             if (regenEnable == true){
-                digitalWrite(regenEnablePin, HIGH);
-                analogWrite(regenPin,regenOut);
+                halFastWrite(regenEnablePin, HIGH);
+                halAnalogWrite(regenPin,regenOut);
             }
             else{
-                digitalWrite(regenEnablePin, LOW);
-                analogWrite(regenPin,0);
+                halFastWrite(regenEnablePin, LOW);
+                halAnalogWrite(regenPin,0);
             }
             
-            //Send output to servo
-            if(servoEnable==true&&engineOn==true)  throttleServo.write(servoOut);
-            else throttleServo.write(SERVO_MIN_ANGLE); //Reset the servo if servoEnable is false
+            //Send output to servo, less what the driven wheels would spin away
+            if(servoEnable==true&&engineOn==true)  halServoWrite(tractionLimit(servoOut));
+            else halServoWrite(SERVO_MIN_ANGLE); //Reset the servo if servoEnable is false
             
             //Send output to kelly
+            int kellyApplied = 0;
             if(kellyEnable==true&&hiVoltageEnable==true&&hiVoltageLoBatt == false){                 
-                analogWrite(kellyPin,kellyOut);
+                kellyApplied = tractionLimit(kellyOut);
+                halAnalogWrite(kellyPin,kellyApplied);
             }
             else {
-                analogWrite (kellyPin,0);
+                halAnalogWrite(kellyPin,0);
             }
             
+            //What the battery actually gave and got, for its estimate
+            int regenApplied = (regenEnable == true && hiVoltageEnable == true) ? regenOut : 0;
+            energyOutputs(&energy, inputTime, kellyApplied, regenApplied);
+            
             //}
         }
         
@@ -699,70 +1287,33 @@
         
         // 3.2.1 Sending functions
         
-        //Call this method to initiate a new serial write operation. 
+        //Call this method to initiate a new telemetry frame. 
         void serialWriteBegin() {
-          writeIndex = 0;        //Reset the write index, and add the initial characters for the protocol.
-          writeBuffer[0] = '<';
-          writeIndex++;
+          if (telemetryDelta) deltaFrameBegin(&writeFrame, writeSequence);
+          else frameBegin(&writeFrame, writeSequence);
+          writeFrameEnded = false;
         }
         
-        //Add a value to the buffer. 
-        //Format of the buffer string is <ID=value,ID=value>, like <0=23,1=100,2=0>
-        void serialWriteValue(int value,int ID) {
-          if (writeIndex>1) {
-            writeBuffer[writeIndex] = ',';//Here we add a comma to separate the entries
-            writeIndex++;
-          }
-          
-          char c[10];//Use this array to convert the value and IDs into individual chars.
-          itoa(ID,c,10);//This function does the integer to string conversion. 
-          writeBuffer[writeIndex] = c[0];//Write the ID, which corresponds to the data type
-          writeIndex++;
-          
-          //If the ID has two digits, move the index one place forward
-          if (ID>9) {
-            writeBuffer[writeIndex] = c[1];
-            writeIndex++; 
-          }
-          //Write the '=' to the buffer par the protocol
-          writeBuffer[writeIndex] = '=';
-          writeIndex++;
-          
-          //We convert the value from an integer to a string, then write that to the buffer.
-          //Note that c[]is overwritten here
-          itoa(value,c,10);
-          writeBuffer[writeIndex]= c[0];
-          writeIndex++;
-          if (value>9) {//Move the index acccordingly to the number of digits
-             writeBuffer[writeIndex]= c[1];
-             writeIndex++;
-          }
-          if (value>99) {
-             writeBuffer[writeIndex]= c[2];
-             writeIndex++;
-          }
-          if (value>999) {
-             writeBuffer[writeIndex]= c[3];
-             writeIndex++;
-          }
+        //Add a value to the frame. Every value goes out as a 16 bit integer keyed by its
+        //kTelemetryDataType ID, in delta frames mostly as a few bits of difference to the
+        //last one sent. Returns false, and drops the value, when the frame is full.
+        boolean serialWriteValue(int value,int ID) {
+          if (telemetryDelta) return deltaFrameAdd(&writeFrame, &deltaEncoder, ID, value);
+          return frameAdd(&writeFrame, ID, value);
         }
         
-        //This function does the actual sending. It writes the buffer to the given serial port
-        //up until write index (after adding in the final protocol characters). 
-        //You can pass in which serial port to send over.
-        void serialWriteCommit(int serial) {
-          writeBuffer[writeIndex] = '>';//Close the buffer string
-          writeIndex++;
-          int i=0;
-          
-          for (i;i<writeIndex;i++) {
-          if      (serial == 0) Serial.write(  writeBuffer[i]);
-          else if (serial == 1) Serial1.write( writeBuffer[i]);
+        //This function does the actual sending. It closes the frame (adds the CRC) and
+        //queues it for the given serial port, which only copies it: txQueuePump() sends
+        //it in the background. Call it once per port for the same frame. If the queue
+        //is too full for the priority, the frame is dropped and counted.
+        void serialWriteCommit(int serial, uint8_t priority) {
+          if (writeFrameEnded == false) {
+            frameEnd(&writeFrame);
+            writeFrameEnded = true;
+            writeSequence++;   //Counted once committed, a frame left empty leaves no gap
           }
           
-          if      (serial == 0) Serial.write(  '\n');//Indicate that sending is over
-          else if (serial == 1) Serial1.write( '\n');
-          
+          txQueueFrame(serial, writeFrame.bytes, writeFrame.length, priority);
         }
         
         // 3.2.2. Receiving functions
@@ -774,87 +1325,84 @@
                  if(val==1 || virtualBigRedButton == true) virtualBigRedButton = true;
                  else virtualBigRedButton = false;
             break;
+            case kTelemetryDataCommandProfile:
+                 if(val==1) profileDumpStage = 0;
+                 else if(val==2) profilerReset();
+            break;
+            case kTelemetryDataCommandChannel:
+                 telemetryConfigChannel = val;
+            break;
+            case kTelemetryDataCommandChannelPeriod:
+                 telemetryChannelSet(telemetryConfigChannel, CHANNEL_PERIOD, val);
+            break;
+            case kTelemetryDataCommandChannelMaxAge:
+                 telemetryChannelSet(telemetryConfigChannel, CHANNEL_MAX_AGE, val);
+            break;
+            case kTelemetryDataCommandChannelDeadband:
+                 telemetryChannelSet(telemetryConfigChannel, CHANNEL_DEADBAND, val);
+            break;
+            case kTelemetryDataCommandChannelPriority:
+                 telemetryChannelSet(telemetryConfigChannel, CHANNEL_PRIORITY, val);
+            break;
+            case kTelemetryDataCommandDeltaFrames:
+                 telemetryDelta = (val == 1);
+                 deltaEncoderReset(&deltaEncoder);   //Start over with whole values
+            break;
+            case kTelemetryDataCommandBatteryLevel:
+                 if(val >= 0 && val <= 100) energySetBattery(&energy, val);
+            break;
+            case kTelemetryDataCommandEnduranceDistance:
+                 if(val > 0) energyPlan(&energy, val);
+            break;
+            case kTelemetryDataCommandEnergyManager:
+                 energyManaged = (val == 1);
+            break;
+            case kTelemetryDataCommandTractionControl:
+                 tractionControl = (val == 1);
+            break;
+            case kTelemetryDataCommandParameter:
+                 parameterSelected = val;
+            break;
+            case kTelemetryDataCommandParameterValue:
+                 if(parameterAllowed(parameterSelected, val) &&
+                    paramSet(&parameters, parameterSelected, val, halMillis())) applyParameters();
+                 parameterSendNext = parameterSelected;   //The value it has now, also when refused
+                 parameterSendEnd = parameterSelected + 1;
+            break;
+            case kTelemetryDataCommandParameters:
+                 if(val==1){
+                     parameterSendNext = parameterSelected;
+                     parameterSendEnd = parameterSelected + 1;
+                 }
+                 else if(val==2){
+                     parameterSendNext = 0;
+                     parameterSendEnd = PARAMS;
+                 }
+                 else if(val==3){
+                     paramsDefaults(&parameters, halMillis());
+                     applyParameters();
+                 }
+            break;
             //...
             //...
            default:
             break; 
           }
+          return 0;
         }
         
-        void processSerialBuffer() { //Processes a string in the read buffer and then clears the buffer
-           processingSerialBuffer = 1;
-           
-           if (readBuffer[0] == '<') {
-             //First byte is okay. Let's try and read a command
-             for (int i=1;i<MAX_SEND_LENGTH;i++) {
-               //Serial.write(".");Serial.write(i);Serial.write(".");
-               if (readBuffer[i] == '=') {
-                 //Serial.print("Found=\n");
-                 storeIndex=0;
-                 storeVariable = 1;
-                 sendID[2]='\o';
-                 continue;
-               } else if (readBuffer[i] == ',' | readBuffer[i]=='>') {
-                 //Serial.print("Foundbreak\n");
-                 int currentID = atoi(sendID);
-                 int currentValue = atoi(sendValue);
-                 telemetrySendSetGlobal(currentID,currentValue);
-                 storeIndex=0;
-                 storeVariable = 0;
-                 sendID[0] = sendID[1] = 0;
-                 sendValue[0]=sendValue[1]=0;
-                 if (readBuffer[i]=='>') break;
-                 continue;
-               } else {
-                // Store an id or value
-                if (storeVariable == 0) {//store ID
-                  //Serial.print("StoringID:");
-                  //Serial.write(readBuffer[i]);
-                  sendID[storeIndex] = readBuffer[i];
-                  storeIndex++;
-                } else {//store value
-                  //Serial.print("StoringValue:");
-                  //Serial.write(readBuffer[i]);
-                  sendValue[storeIndex] = readBuffer[i];
-                  storeIndex++;
-                }
-              }
-             }
-           }
-           //Clear the array
-           for (int i=0;i<readBufferIndex;i++) {
-              readBuffer[i] = ' ';
-           }
-           readBufferIndex = 0;
-           processingSerialBuffer = 0;
-        }
-         
-        
         //Call this in the background to read from the serial port. Pass in the serial port number to read from that port.
+        //Every byte that arrived since the last call is parsed right away. The commands of a
+        //message are applied once its closing '>' arrived.
         void serialPortReadInBackgroundToBuffer(int port) {
-          //If there's no serial available, do nothing in this function
-          int serialAvailable = 0;
-          if (port==0) serialAvailable = Serial.available() > 0;
-          if (port==1) serialAvailable = Serial1.available() > 0;
-          if (serialAvailable>0 && processingSerialBuffer == 0) {
-            
-            int newByte;
-           if (port==0) {
-              newByte = Serial.read();
-           } else if (port == 1) {
-              newByte = Serial1.read(); 
-           } else {
-             return; 
-           }
+          while (halSerialAvailable(port) > 0) {
+            int newByte = halSerialRead(port);
+            if (newByte < 0) break;
             
-            readBuffer[readBufferIndex] = newByte;
-            readBufferIndex++;
-            if (newByte == '>') {
-               //This is the end byte of the communication protocol. We should have a complete string in the buffer to parse.
-              processSerialBuffer(); 
+            if (uplinkPush(&uplink, newByte)) {
+              for (int i=0;i<uplink.count;i++) telemetrySendSetGlobal(uplink.ids[i], uplink.values[i]);
             }
           }
-          
         }
         
         void sevenSegOut() {  // takes velocity and outputs appropriate binary signals
@@ -862,30 +1410,20 @@
             int tensDigit = (velocity - (velocity % 10))/10;
             int onesDigit = velocity % 10;
             
-              
-            if(tensDigit % 2 == 1) {digitalWrite(sevenSeg3Pin, HIGH);}
-            else {digitalWrite(sevenSeg3Pin, LOW);}
-            
-            if(tensDigit % 4 >= 2) {digitalWrite(sevenSeg2Pin, HIGH);}
-            else {digitalWrite(sevenSeg2Pin, LOW);}
+            //The eight bits go out together, one write per port (pins 40-47 are on ports G and L)
+            HalPortUpdate segments;
+            halPortUpdateBegin(&segments);
+            halPortUpdatePin(&segments, sevenSeg3Pin, tensDigit % 2 == 1);
+            halPortUpdatePin(&segments, sevenSeg2Pin, tensDigit % 4 >= 2);
+            halPortUpdatePin(&segments, sevenSeg1Pin, tensDigit % 8 >= 4);
+            halPortUpdatePin(&segments, sevenSeg0Pin, tensDigit >= 8);
             
-            if(tensDigit % 8 >= 4) {digitalWrite(sevenSeg1Pin, HIGH);}
-            else {digitalWrite(sevenSeg1Pin, LOW);}
+            halPortUpdatePin(&segments, sevenSeg7Pin, onesDigit % 2 >= 1);
+            halPortUpdatePin(&segments, sevenSeg6Pin, onesDigit % 4 >= 2);
+            halPortUpdatePin(&segments, sevenSeg5Pin, onesDigit % 8 >= 4);
+            halPortUpdatePin(&segments, sevenSeg4Pin, onesDigit >= 8);
             
-            if(tensDigit >= 8) {digitalWrite(sevenSeg0Pin, HIGH);}
-            else {digitalWrite(sevenSeg0Pin, LOW);}
-            
-            if(onesDigit % 2 >= 1) {digitalWrite(sevenSeg7Pin, HIGH);}
-            else {digitalWrite(sevenSeg7Pin, LOW);}
-            
-            if(onesDigit % 4 >= 2) {digitalWrite(sevenSeg6Pin, HIGH);}
-            else {digitalWrite(sevenSeg6Pin, LOW);}
-            
-            if(onesDigit % 8 >= 4) {digitalWrite(sevenSeg5Pin, HIGH);}
-            else {digitalWrite(sevenSeg5Pin, LOW);}
-            
-            if(onesDigit >= 8) {digitalWrite(sevenSeg4Pin, HIGH);}
-            else {digitalWrite(sevenSeg4Pin, LOW);}
+            halPortUpdateCommit(&segments);
             
         }
         
@@ -902,16 +1440,16 @@
                 
                 if(mode == ELECTRIC_MODE && throttle == SERVO_MIN_ANGLE){
                     //digitalWrite(hiVoltageEnablePin,HIGH); THIS IS ALREADY IN TESTTHECAR
-                    digitalWrite(regenEnablePin,HIGH);
+                    halFastWrite(regenEnablePin,HIGH);
                     int percentRegen = 50;
                     int regen = 255*percentRegen/100;
-                    analogWrite(regenPin,regen);
+                    halAnalogWrite(regenPin,regen);
                 }
                 else
                 {
-                    digitalWrite(regenEnablePin,LOW);
+                    halFastWrite(regenEnablePin,LOW);
                 
-                    analogWrite(regenPin,0);
+                    halAnalogWrite(regenPin,0);
                 }
                 testTheCar();
             }
@@ -922,22 +1460,22 @@
              servoOut = throttle;
              kellyOut = throttleKelly;
         
-            digitalWrite(engineEnablePin, HIGH);
+            halFastWrite(engineEnablePin, HIGH);
         
-            if (mode == ELECTRIC_MODE) digitalWrite(hiVoltageEnablePin, HIGH);  //Allow High Voltage to be ON for testing if required
-            else digitalWrite(hiVoltageEnablePin, LOW);                         //Might need it for programming BMS/Kelly
+            if (mode == ELECTRIC_MODE) halFastWrite(hiVoltageEnablePin, HIGH);  //Allow High Voltage to be ON for testing if required
+            else halFastWrite(hiVoltageEnablePin, LOW);                         //Might need it for programming BMS/Kelly
         
             if (brake == true)
             {
                 servoOut = SERVO_MIN_ANGLE;
             }
             if(servoEnable==true)  {
-                throttleServo.write(servoOut);
-                analogWrite(kellyPin,0);
+                halServoWrite(servoOut);
+                halAnalogWrite(kellyPin,0);
             }    //If Servo Enable is ON, then use servo
             else{
-                throttleServo.write(SERVO_MIN_ANGLE);                   //Otherwise reset the Servo
-                analogWrite(kellyPin,kellyOut);
+                halServoWrite(SERVO_MIN_ANGLE);                   //Otherwise reset the Servo
+                halAnalogWrite(kellyPin,kellyOut);
             }
              
              }
@@ -945,31 +1483,31 @@
         
         //Overloaded debug() function: 4 different ones to handle 4 input types
         //Delay can be added to be able to freeze the debugging stream for a while
-        void debug(String outstring){
-          Serial.println(outstring);
-          delay(0);
+        void debug(const char* outstring){
+          halSerialPrintln(0, outstring);
+          halDelay(0);
         }
               
         void debug(float outfloat){
-          Serial.println(outfloat);
-          delay(0);
+          halSerialPrintln(0, (double)outfloat);
+          halDelay(0);
         }
               
         void debug(boolean outboolean){
-          if (outboolean == true)  Serial.println("true");
-          else                     Serial.println("false");
-          delay(0);
+          if (outboolean == true)  halSerialPrintln(0, "true");
+          else                     halSerialPrintln(0, "false");
+          halDelay(0);
         
         }
         
         void debug(int outint){
-          Serial.println(outint);
-          delay(0);
+          halSerialPrintln(0, (long)outint);
+          halDelay(0);
         }
         
         //Custom debugging delay function exist to be able to find it using find "debug"
         //No delay() functions are supposed to be in the program flow      
-        void debugDelay(int ms) {delay(ms);}
+        void debugDelay(int ms) {halDelay(ms);}
         
         //}
         //---------------------------------------------------------------------------------------------
@@ -979,15 +1517,75 @@
         
         //steals power from motor and engine, used to stop the car when 
         //Virtual Big Red Button is activated or in critical cycle
+        //Engine relay, high voltage and regen off, servo and kelly to zero, the critical light
+        //on. Only pins, the safety monitor's interrupt calls it too
         void kill() 
         {
-             digitalWrite(engineEnablePin, LOW);
-             digitalWrite(hiVoltageEnablePin, HIGH);
-             digitalWrite(regenEnablePin, LOW);
-             servoOut = SERVO_MIN_ANGLE;
-             kellyOut = 0;
-             throttleServo.write(servoOut);
-             digitalWrite(kellyPin,kellyOut);
+             halFastWrite(engineEnablePin, LOW);
+             halFastWrite(hiVoltageEnablePin, LOW);
+             halFastWrite(regenEnablePin, LOW);
+             halFastWrite(criticalPin, HIGH);
+             halServoWrite(SERVO_MIN_ANGLE);
+             halAnalogWrite(kellyPin, 0);
+             halAnalogWrite(regenPin, 0);
+        }
+        
+        //What is worked out from the parameters, again after any of them changed. Channels still
+        //at the short or long interval move with it, ones set otherwise over telemetry stay
+        void applyParameters()
+        {
+             throttleToServo = fixedMapMake(param[PARAM_THROTTLE_SCALE_MIN], param[PARAM_THROTTLE_SCALE_MAX], SERVO_MIN_ANGLE, SERVO_MAX_ANGLE);
+             throttleToKelly = fixedMapMake(param[PARAM_THROTTLE_SCALE_MIN], param[PARAM_THROTTLE_SCALE_MAX], 0, FULL);
+             enduranceIdleRegen = FULL * param[PARAM_ENDURANCE_IDLE_REGEN] / 100;
+             electricIdleRegen =  FULL * param[PARAM_ELECTRIC_IDLE_REGEN] / 100;
+             
+             for(uint8_t i = 0; i < TELEMETRY_CHANNELS; i++){
+                  TelemetryChannel& channel = telemetryChannels[i];
+                  if(channel.periodMs == shortCommInterval)     channel.periodMs = param[PARAM_SHORT_COMM_INTERVAL];
+                  else if(channel.periodMs == longCommInterval) channel.periodMs = param[PARAM_LONG_COMM_INTERVAL];
+             }
+             shortCommInterval = param[PARAM_SHORT_COMM_INTERVAL];
+             longCommInterval =  param[PARAM_LONG_COMM_INTERVAL];
+        }
+        
+        //Pairs of parameters that have to stay in order, on top of each one's own bounds
+        boolean parameterAllowed(int id, int val)
+        {
+             switch(id){
+                  case PARAM_THROTTLE_SCALE_MIN:        return val < param[PARAM_THROTTLE_SCALE_MAX] &&
+                                                               param[PARAM_THROTTLE_SCALE_MAX] - val <= THROTTLE_SCALE_SPAN_MAX;
+                  case PARAM_THROTTLE_SCALE_MAX:        return val > param[PARAM_THROTTLE_SCALE_MIN] &&
+                                                               val - param[PARAM_THROTTLE_SCALE_MIN] <= THROTTLE_SCALE_SPAN_MAX;
+                  case PARAM_THROTTLE_ENGAGE_ASSIST:    return val > param[PARAM_THROTTLE_DISENGAGE_ASSIST];
+                  case PARAM_THROTTLE_DISENGAGE_ASSIST: return val < param[PARAM_THROTTLE_ENGAGE_ASSIST];
+                  case PARAM_CRITICAL_RPM:              return val > param[PARAM_LIMIT_RPM];
+                  case PARAM_LIMIT_RPM:                 return val < param[PARAM_CRITICAL_RPM];
+                  case PARAM_CRITICAL_VELOCITY:         return val > param[PARAM_LIMIT_VELOCITY];
+                  case PARAM_LIMIT_VELOCITY:            return val < param[PARAM_CRITICAL_VELOCITY];
+                  case PARAM_CRITICAL_TEMP:             return val > param[PARAM_LIMIT_TEMP];
+                  case PARAM_LIMIT_TEMP:                return val < param[PARAM_CRITICAL_TEMP];
+                  default:                              return true;
+             }
+        }
+        
+        //The safety monitor's limits, from the parameters at power on: the monitor's interrupt
+        //and runSecurityBlock() both go by them until the next one
+        void safetyLimits()
+        {
+             int throttleMin = param[PARAM_THROTTLE_SCALE_MIN];
+             int throttleMax = param[PARAM_THROTTLE_SCALE_MAX];
+             
+             safetyConfig = SAFETY_CONFIG;
+             safetyConfig.criticalRpm =  param[PARAM_CRITICAL_RPM];
+             safetyConfig.limitRpm =     param[PARAM_LIMIT_RPM];
+             safetyConfig.criticalMph =  param[PARAM_CRITICAL_VELOCITY];
+             safetyConfig.limitMph =     param[PARAM_LIMIT_VELOCITY];
+             safetyConfig.criticalTemp = param[PARAM_CRITICAL_TEMP];
+             safetyConfig.limitTemp =    param[PARAM_LIMIT_TEMP];
+             safetyConfig.plausibleLow[ADC_THROTTLE] =  throttleMin > THROTTLE_PLAUSIBLE_MARGIN ? throttleMin - THROTTLE_PLAUSIBLE_MARGIN : 0;
+             safetyConfig.plausibleHigh[ADC_THROTTLE] = throttleMax < 1023 - THROTTLE_PLAUSIBLE_MARGIN ? throttleMax + THROTTLE_PLAUSIBLE_MARGIN : 1023;
+             safetyConfig.conflictThrottle = throttleMin + (throttleMax - throttleMin) / 4;
+             safetyConfig.releasedThrottle = throttleMin + (throttleMax - throttleMin) / 20;
         }
         
         //Creates various kill scenarios, 4 types, occur timeInSeconds after program initiation
@@ -995,7 +1593,7 @@
         void doScenario(int type, int timeInSeconds)  
         {
             unsigned long time = timeInSeconds * 1000;
-            if (millis() > time)
+            if (halMillis() > time)
             {
             switch (type) {
                 case 1: //Virtual big red button is pressed
@@ -1003,15 +1601,15 @@
                 break;
                 
                 case 2: //Rpm is maxed out
-                rpm = CRITICAL_RPM + 1;
+                rpm = safetyConfig.criticalRpm + 1;
                 break;
                 
                 case 3: //Velocity is maxed out
-                velocity = CRITICAL_VELOCITY + 1;
+                velocity = safetyConfig.criticalMph + 1;
                 break;
                 
                 case 4: //Temperature is maxed out
-                radiatorTemp = CRITICAL_TEMP + 1;
+                radiatorTemp = safetyConfig.criticalTemp + 1;
                 break;
             }
             }
@@ -1028,7 +1626,129 @@
     //{
         
         //---------------------------------------------------------------------------------------------
-        // 4.1 Setup function (executed once)
+        // 4.1 Task table
+        //---------------------------------------------------------------------------------------------
+        //{
+        
+        //Inputs, security block and modes. Time is read once here because various procedures
+        //like velocity measuring use it
+        void controlTask()
+        {
+        //The control period is measured from one start to the next, the stages back to back
+        //with one micros() read each
+        uint32_t lap = profilerStart();
+        if(previousControlStart != 0) profilerRecord(PROFILE_CONTROL_PERIOD, lap - previousControlStart);
+        previousControlStart = lap;
+        
+        currentTime = halMillis();
+        endloop = false; // resets "end loop" condition
+        
+        //The profiler's stages also tell the watchdog's record where a hang was
+        watchdogStage(PROFILE_READ_INPUTS);
+        readInputs();
+        lap = profilerLap(PROFILE_READ_INPUTS, lap);
+        
+        watchdogStage(PROFILE_PROCESS_INPUTS);
+        processInputs();
+        lap = profilerLap(PROFILE_PROCESS_INPUTS, lap);
+        
+        watchdogStage(PROFILE_SECURITY);
+        runSecurityBlock();
+        lap = profilerLap(PROFILE_SECURITY, lap);
+        
+        //Modes, the outputs are written by outputTask()
+        if(endloop == false){
+            //regenTest();
+           watchdogStage(PROFILE_RUN_THE_CAR);
+           runTheCar();
+           profilerLap(PROFILE_RUN_THE_CAR, lap);
+        }
+        
+        logControlCycle();
+        
+        //testTheCar();
+        }
+        
+        //Boost button and launch control. The button, clutch and brake are read from the pins
+        //here, and the outputs written as soon as the launch changes the Kelly PWM, so a press
+        //does not wait for the next control and output tasks
+        void launchTask()
+        {
+        boolean boostPressed = halFastRead(boostPin) == HIGH;
+        boolean clutchIn =     halFastRead(clutchPin) == LOW;
+        boolean braking =      hiVoltageEnable == true && halFastRead(brakePin) == LOW;  //as in applyInputs()
+        
+        if (launchStep(&launch, halMicros(), boostPressed, clutchIn, braking, velocity) == false) return;
+        if (launchActive(&launch) == false) kellyOut = 0;   //Let go or braked: nothing until the mode's next control cycle
+        if (endloop == false) writeOutputs();
+        }
+        
+        //Safety monitor tick, from its timer interrupt every SAFETY_PERIOD (see safety.h). Reads
+        //its inputs itself and, while a check is tripped, forces the outputs off every tick, so
+        //the main loop can neither hold them on nor has to get round to it
+        void safetyInterrupt()
+        {
+        SafetyInputs in;
+        adcSamplerRead(&in.adc);
+        in.rpm =        sensorTableLookup(RPM_TABLE,           RPM_TABLE_BITS,           in.adc.value[ADC_RPM]);
+        in.temp =       sensorTableLookup(RADIATOR_TEMP_TABLE, RADIATOR_TEMP_TABLE_BITS, in.adc.value[ADC_RADIATOR]);
+        in.revolution = reedSlowestRevolution(halMicros());
+        in.bmsFault =   halFastRead(BMSFaultPin) == LOW;
+        in.braking =    hiVoltageEnable == true && halFastRead(brakePin) == LOW;  //as in applyInputs()
+        in.button =     virtualBigRedButton;
+        
+        uint8_t faults = safetyTick(&safety, &in);
+        if (faults & SAFETY_CRITICAL) kill();
+        else if (faults & SAFETY_CONFLICT){
+             halServoWrite(SERVO_MIN_ANGLE);
+             halAnalogWrite(kellyPin, 0);
+        }
+        }
+        
+        //Watchdog expired, from its interrupt (see watchdog.h): the last inputs and outputs for
+        //the record, then everything off until the reset
+        void watchdogSnapshot(WatchdogSnapshot* last)
+        {
+        for(uint8_t i = 0; i < ADC_CHANNELS; i++) last->analog[i] = controlInputs.analog[i];
+        last->switches = controlInputs.switches;
+        last->servo =    servoOut;
+        last->kelly =    kellyOut;
+        last->regen =    regenOut;
+        last->flags =    outputFlags();
+        kill();
+        }
+        
+        //Servo, kelly and relays, unless the security block ended the last control cycle
+        void outputTask()
+        {
+        if(endloop == false) writeOutputs();
+        }
+        
+        //Changed parameters to EEPROM a byte at a time (see params.h), and the answers about them
+        void parameterTask()
+        {
+        paramsService(&parameters, halMillis());
+        sendParameters();
+        }
+        
+        //In priority order: the scheduler always runs the first task that is due
+        Task tasks[] = {
+        //   run                 period                        deadline                      profiler stage
+            {launchTask,         LAUNCH_PERIOD,                LAUNCH_PERIOD,                PROFILE_LAUNCH},
+            {controlTask,        CONTROL_PERIOD,               CONTROL_PERIOD,               PROFILE_NONE},
+            {outputTask,         OUTPUT_PERIOD,                OUTPUT_PERIOD,                PROFILE_OUTPUTS},
+            {logService,         LOG_PERIOD,                   LOG_PERIOD,                   PROFILE_LOGGER},
+            {sevenSegOut,        DISPLAY_PERIOD,               DISPLAY_PERIOD,               PROFILE_DISPLAY},
+            {runCommunication,   COMMUNICATION_PERIOD,         COMMUNICATION_PERIOD,         PROFILE_COMMUNICATION},
+            {sendTelemetry,      TELEMETRY_PERIOD,             TELEMETRY_PERIOD,             PROFILE_COMMUNICATION},
+            {sendProfileDump,    SHORT_COMM_INTERVAL * 1000UL, SHORT_COMM_INTERVAL * 1000UL, PROFILE_COMMUNICATION},
+            {parameterTask,      PARAMETER_PERIOD,             PARAMETER_PERIOD,             PROFILE_COMMUNICATION},
+        };
+        extern const uint8_t TASKS = sizeof(tasks) / sizeof(tasks[0]);
+        
+        //}
+        //---------------------------------------------------------------------------------------------
+        // 4.2 Setup function (executed once)
         //---------------------------------------------------------------------------------------------
         //{
         
@@ -1038,56 +1758,118 @@
                
           
                //Input pins setup       
-               pinMode(hiVoltageLoBattPin,INPUT);
-               pinMode(BMSFaultPin,       INPUT);
-               pinMode(clutchPin,         INPUT);
-               pinMode(assistPin,         INPUT);
-               pinMode(brakePin,          INPUT);
-               pinMode(servoEnablePin,    INPUT);
-               pinMode(kellyEnablePin,    INPUT);
-               pinMode(reedPin,           INPUT);
-               pinMode(telemetryEnablePin,INPUT);
+               halPinMode(hiVoltageLoBattPin,INPUT);
+               halPinMode(BMSFaultPin,       INPUT);
+               halPinMode(clutchPin,         INPUT);
+               halPinMode(assistPin,         INPUT);
+               halPinMode(boostPin,          INPUT);
+               halPinMode(brakePin,          INPUT);
+               halPinMode(servoEnablePin,    INPUT);
+               halPinMode(kellyEnablePin,    INPUT);
+               halPinMode(reedPin,           INPUT);
+               halPinMode(telemetryEnablePin,INPUT);
                  
                //Output pins setup (set some to low to begin, for safety)
-               pinMode(powerIndicatorPin,   OUTPUT);
+               halPinMode(powerIndicatorPin,   OUTPUT);
                
-               pinMode(criticalPin,       OUTPUT);
-               digitalWrite(criticalPin, LOW);
+               halPinMode(criticalPin,       OUTPUT);
+               halDigitalWrite(criticalPin, LOW);
                
-               pinMode(regenEnablePin,    OUTPUT);
-               digitalWrite(regenEnablePin, LOW);
+               halPinMode(regenEnablePin,    OUTPUT);
+               halDigitalWrite(regenEnablePin, LOW);
                
-               pinMode(engineEnablePin,     OUTPUT);
-               digitalWrite(engineEnablePin, LOW);
+               halPinMode(engineEnablePin,     OUTPUT);
+               halDigitalWrite(engineEnablePin, LOW);
                
-               pinMode(hiVoltageEnablePin,OUTPUT);
-               digitalWrite(hiVoltageEnablePin, LOW);
+               halPinMode(hiVoltageEnablePin,OUTPUT);
+               halDigitalWrite(hiVoltageEnablePin, LOW);
                
-               pinMode(moduleSleepPin,    OUTPUT);     
+               halPinMode(moduleSleepPin,    OUTPUT);     
                
-               pinMode(sevenSeg0Pin, OUTPUT);
-               pinMode(sevenSeg1Pin, OUTPUT);
-               pinMode(sevenSeg2Pin, OUTPUT);
-               pinMode(sevenSeg3Pin, OUTPUT);
-               pinMode(sevenSeg4Pin, OUTPUT);
-               pinMode(sevenSeg5Pin, OUTPUT);
-               pinMode(sevenSeg6Pin, OUTPUT);
-               pinMode(sevenSeg7Pin, OUTPUT);
+               halPinMode(sevenSeg0Pin, OUTPUT);
+               halPinMode(sevenSeg1Pin, OUTPUT);
+               halPinMode(sevenSeg2Pin, OUTPUT);
+               halPinMode(sevenSeg3Pin, OUTPUT);
+               halPinMode(sevenSeg4Pin, OUTPUT);
+               halPinMode(sevenSeg5Pin, OUTPUT);
+               halPinMode(sevenSeg6Pin, OUTPUT);
+               halPinMode(sevenSeg7Pin, OUTPUT);
                
                
                
                
                //Initialize serial communications at 9600 bps:
-               Serial.begin(9600);   //Serial - first serial port of the Arduino board connected to
+               halSerialBegin(0, 9600);   //Serial - first serial port of the Arduino board connected to
                                      //the built in serial to USB converter. Calls to this serial port 
                                      //will communicate over USB to a computer.
-               Serial1.begin(9600);  //Serial1 - second serial port of the Arduino board connected to 
+               halSerialBegin(1, 9600);  //Serial1 - second serial port of the Arduino board connected to 
                                      //the RF transceiver. Data sent to this port will be added to the transceiver's queue. 
         
                
+               //Analog inputs are sampled by the ADC interrupt from now on, in ADC_* order
+               const uint8_t adcPins[ADC_CHANNELS] = {rpmPin, fuelPin, throttlePin, radiatorTempPin, gearPin};
+               adcSamplerBegin(adcPins);
+               
+               txQueueReset();
+               telemetryChannelsBegin(telemetryChannels, TELEMETRY_CHANNELS, telemetryValue);
+               deltaEncoderReset(&deltaEncoder);
+               uplinkReset(&uplink);
+               
+               //What the watchdog caught before the last reset, if it was one, goes out first
+               sendResetReport();
+               
+               //Wheel speed pulses are timestamped by the reed switch interrupt
+               reedBegin(reedPin);
+               
                //Setup the servo (set to min angle to begin)
-               throttleServo.attach(servoPin, SERVO_MIN, SERVO_MAX);
-               throttleServo.write(SERVO_MIN_ANGLE);
+               halServoAttach(servoPin, SERVO_MIN, SERVO_MAX);
+               halServoWrite(SERVO_MIN_ANGLE);
+               
+               profilerReset();
+               
+               //Data logger, a new session on the SD card if there is one
+               logBegin(logCardSelectPin);
+               
+               //Throttle and torque maps, loaded per mode by processInputs()
+               mapsValid = throttleMapsCheck();
+               mapsMode = 0;
+               
+               //Parameters as last saved, or their initial values, and what depends on them
+               //A record with a pair out of order or too far apart (parameterAllowed()) is not
+               //used, a throttle scale of zero width would divide by zero in applyParameters()
+               paramsBegin(&parameters, PARAMETERS, param, PARAMS, PARAMS_VERSION);
+               for(uint8_t i = 0; i < PARAMS; i++){
+                   if(parameterAllowed(i, param[i]) == false){
+                       paramsDefaults(&parameters, halMillis());
+                       break;
+                   }
+               }
+               applyParameters();
+               safetyLimits();
+               parameterSendNext = -1;
+               
+               //Energy plan over the whole endurance, until told otherwise over telemetry
+               energyBegin(&energy, &ENERGY_CONFIG, param[PARAM_BATTERY_START_PERCENT], param[PARAM_ENDURANCE_DISTANCE]);
+               
+               launchBegin(&launch, &LAUNCH_CONFIG);
+               slipBegin(&slip, &SLIP_CONFIG);
+               gearBegin(&gearDetector, &GEAR_CONFIG);
+               
+               //Safety monitor, from here on whatever the main loop does
+               safetyBegin(&safety, &safetyConfig);
+               halTimerBegin(SAFETY_PERIOD, safetyInterrupt);
+               
+               //Input conditioning, primed by the first control cycle's inputs
+               switchFilterBegin(&switchFilter, SWITCH_DEBOUNCE, sizeof(SWITCH_DEBOUNCE) / sizeof(SWITCH_DEBOUNCE[0]));
+               analogFilterBegin(&analogFilter, ANALOG_CONDITIONING);
+               
+               halDigitalWrite(powerIndicatorPin, HIGH);
+               
+               //Hardware watchdog, fed while every task of the table keeps running
+               watchdogBegin(TASKS, WATCHDOG_TIMEOUT, watchdogSnapshot);
+               
+               //Everything from here on runs from the task table
+               schedulerBegin(tasks, TASKS);
     
                 
         
@@ -1095,44 +1877,13 @@
         
         //}
         //---------------------------------------------------------------------------------------------
-        // 4.2 Loop function (executed repeatedly)
+        // 4.3 Loop function (executed repeatedly)
         //---------------------------------------------------------------------------------------------
         //{
         
         void loop()
         {
-        digitalWrite(powerIndicatorPin, HIGH);
-        
-        currentTime = millis(); //Time is reset at the beginning of the loop because various procedures
-                                //like velocity measuring and telemetry timing use it
-        endloop = false; // resets "end loop" condition
-        
-        //Read Inputs
-        readInputs();
-                 
-        //Process Inputs
-        processInputs();
-        
-        //Run Communication
-        if(telemetryEnable == true) {runCommunication();}
-        else {digitalWrite(moduleSleepPin,LOW);}  //If not communicating, set the module asleep
-        
-        //Run Security Block
-        runSecurityBlock();
-        
-        
-        //Modes, servo and kelly output commands
-        if(endloop == false){
-            //regenTest();
-           runTheCar();
-        }
-        
-        
-        //testTheCar();
-        
-        
-        
-        
+        schedulerRun();
         
         }//End of loop() function
         
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// Input signal conditioning
+//------------------------------------------------------------------------------
+
+#include "conditioning.h"
+
+void switchFilterBegin(SwitchFilter* f, const SwitchDebounce* table, uint8_t entries)
+{
+    memset(f, 0, sizeof(*f));
+    for (uint8_t i = 0; i < entries; i++)
+        for (uint8_t b = 0; b < SWITCH_BITS; b++)
+            if (table[i].bit & (1U << b)) f->limits[b] = table[i].cycles;
+}
+
+uint16_t switchFilterStep(SwitchFilter* f, uint16_t raw)
+{
+    if (f->primed == false) {
+        f->state  = raw;
+        f->primed = true;
+        return raw;
+    }
+
+    uint16_t work = (raw ^ f->state) | f->pending;
+    if (work == 0) return f->state;
+
+    for (uint8_t b = 0; b < SWITCH_BITS; b++) {
+        uint16_t mask = 1U << b;
+        if ((work & mask) == 0) continue;
+        uint8_t limit = f->limits[b];
+        if ((raw ^ f->state) & mask) {
+            if (++f->count[b] < limit) {
+                f->pending |= mask;
+                continue;
+            }
+            f->state ^= mask;
+        }
+        else if (--f->count[b] != 0) continue;
+        f->count[b]  = 0;
+        f->pending  &= ~mask;
+    }
+    return f->state;
+}
+
+void analogFilterBegin(AnalogFilter* f, const AnalogConditioning config[ADC_CHANNELS])
+{
+    memset(f, 0, sizeof(*f));
+    f->config = config;
+}
+
+static uint16_t median3(uint16_t a, uint16_t b, uint16_t c)
+{
+    if (a > b) {uint16_t t = a; a = b; b = t;}
+    if (b > c) b = c;
+    return a > b ? a : b;
+}
+
+void analogFilterStep(AnalogFilter* f, const uint16_t raw[ADC_CHANNELS], uint16_t out[ADC_CHANNELS])
+{
+    if (f->config == NULL) {
+        memcpy(out, raw, ADC_CHANNELS * sizeof(raw[0]));
+        return;
+    }
+    if (f->primed == false) {
+        for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+            f->history[i][0] = f->history[i][1] = raw[i];
+            f->level[i] = raw[i] << ANALOG_FRACTION;
+        }
+        f->primed = true;
+    }
+
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+        const AnalogConditioning* c = &f->config[i];
+        uint16_t x = raw[i];
+        if (c->median) {
+            uint16_t m = median3(x, f->history[i][0], f->history[i][1]);
+            f->history[i][1] = f->history[i][0];
+            f->history[i][0] = x;
+            x = m;
+        }
+        if (c->shift) {
+            f->level[i] += ((int16_t)(x << ANALOG_FRACTION) - f->level[i]) >> c->shift;
+            //Rounded back to counts
+            x = (f->level[i] + (1 << (ANALOG_FRACTION - 1))) >> ANALOG_FRACTION;
+        }
+        out[i] = x;
+    }
+}
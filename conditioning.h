@@ -0,0 +1,66 @@
+//------------------------------------------------------------------------------
+// Input signal conditioning
+//------------------------------------------------------------------------------
+//Between the raw inputs of a control cycle (input_record.h) and the program's
+//input variables, so a replay of raw records is conditioned the same way.
+//
+//Switches go through an integrator debouncer each: a switch reading other
+//than its debounced level counts up, one reading the same counts back down,
+//and the level only flips when the count reaches the switch's limit. A
+//single noisy read never flips a level, a bouncing contact flips it once,
+//and a clean edge comes through limit control cycles late. Switches that are
+//settled cost nothing past a mask test: only bits with a reading other than
+//their level, or a count still up, are looked at.
+//
+//Analog channels each get an optional median of the last three readings,
+//which takes out single spikes, then an optional first order IIR,
+//
+//    level += (reading - level) >> shift
+//
+//in 5 fraction bits, which smooths noise at a time constant of about 2^shift
+//control cycles. 10 bit readings with 5 fraction bits fit a 16 bit int, so
+//both are 16 bit adds, shifts and compares.
+
+#ifndef CONDITIONING_H
+#define CONDITIONING_H
+
+#include "hal.h"
+#include "adc_sampler.h"
+
+const uint8_t SWITCH_BITS      = 16;
+const uint8_t ANALOG_FRACTION  = 5;     //fraction bits of the IIR level, and the largest shift
+
+struct SwitchDebounce {
+    uint16_t bit;                   //INPUT_* of input_record.h
+    uint8_t  cycles;                //control cycles a new level has to hold
+};
+
+struct AnalogConditioning {
+    boolean  median;                //median of the last three readings first
+    uint8_t  shift;                 //IIR, 0 for none
+};
+
+struct SwitchFilter {
+    uint8_t  limits[SWITCH_BITS];   //per bit, 0 passes the bit through
+    uint16_t state;                 //debounced levels
+    uint16_t pending;               //bits with a count up
+    uint8_t  count[SWITCH_BITS];
+    boolean  primed;                //the first reading was taken as it is
+};
+
+struct AnalogFilter {
+    const AnalogConditioning* config;       //per ADC_* channel
+    uint16_t history[ADC_CHANNELS][2];      //the two readings before, for the median
+    int16_t  level[ADC_CHANNELS];           //IIR, x 2^ANALOG_FRACTION
+    boolean  primed;
+};
+
+//The bits not in the table pass through
+void     switchFilterBegin(SwitchFilter* f, const SwitchDebounce* table, uint8_t entries);
+uint16_t switchFilterStep(SwitchFilter* f, uint16_t raw);
+
+//Before analogFilterBegin() (config still NULL) the readings pass through
+void     analogFilterBegin(AnalogFilter* f, const AnalogConditioning config[ADC_CHANNELS]);
+void     analogFilterStep(AnalogFilter* f, const uint16_t raw[ADC_CHANNELS], uint16_t out[ADC_CHANNELS]);
+
+#endif
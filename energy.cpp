@@ -0,0 +1,146 @@
+//------------------------------------------------------------------------------
+// Endurance energy manager
+//------------------------------------------------------------------------------
+
+#include "energy.h"
+
+static int32_t percentOf(uint32_t joules, uint8_t percent)
+{
+    return joules / 100 * percent;
+}
+
+//Where the battery and the fuel should be for the distance covered, and what
+//to do about it
+static void checkPlan(EnergyManager* e)
+{
+    const EnergyConfig* c = e->config;
+
+    //Share of the distance still to go, 0-65535
+    uint32_t left  = e->turns < e->planTurns ? e->planTurns - e->turns : 0;
+    uint32_t togo  = e->planTurns ? left * 65535UL / e->planTurns : 0;
+
+    int32_t reserve = percentOf(c->batteryJoules, c->batteryReserve);
+    int32_t planned = reserve + (((e->batteryStart - reserve) >> 8) * (int32_t)togo >> 8);
+    e->batteryAhead = e->battery - planned;
+
+    int32_t fuelReserve = (int32_t)c->fuelReserve << 8;
+    int32_t fuelPlanned = fuelReserve + (((int32_t)e->fuelStart - fuelReserve) * (int32_t)togo >> 16);
+    e->fuelAhead = (int32_t)e->fuel - fuelPlanned;
+
+    //Boost at full pedal on or ahead of the plan, none behind it. All or nothing does
+    //better than less boost for longer: a launch with all of it is over sooner
+    int32_t band = percentOf(c->batteryJoules, c->batteryBand);
+    e->assist  = e->batteryAhead >= 0;
+    e->surplus = e->batteryAhead >= band;
+
+    //Engine off while the fuel is more than fuelBand behind and the battery is not,
+    //back on once the fuel is on plan or the battery batteryBand behind. Whole
+    //stretches on the motor cost less time than the motor standing in for part of
+    //the pedal, the engine has more torque at the wheel in the low gears
+    int16_t fuelBand = (int16_t)c->fuelBand << 8;
+    if (!e->engineOff && e->fuelAhead < -fuelBand && e->batteryAhead >= 0 && !e->lowBattery) e->engineOff = true;
+    else if (e->engineOff && (e->fuelAhead >= 0 || e->batteryAhead <= -band)) e->engineOff = false;
+}
+
+void energyBegin(EnergyManager* e, const EnergyConfig* config, uint8_t batteryPercent, uint16_t meters)
+{
+    memset(e, 0, sizeof(*e));
+    e->config = config;
+    energySetBattery(e, batteryPercent);
+    energyPlan(e, meters);
+}
+
+void energySetBattery(EnergyManager* e, uint8_t percent)
+{
+    if (percent > 100) percent = 100;
+    e->battery      = percentOf(e->config->batteryJoules, percent);
+    e->batteryStart = e->battery;
+    checkPlan(e);
+}
+
+void energyPlan(EnergyManager* e, uint16_t meters)
+{
+    e->planTurns    = (uint32_t)meters * 1000 / e->config->wheelMillimeters;
+    e->turns        = 0;
+    e->batteryStart = e->battery;
+    e->fuelStart    = e->fuel;
+    e->engineOff    = false;
+    checkPlan(e);
+}
+
+void energyInputs(EnergyManager* e, int fuelPercent, boolean lowBattery)
+{
+    if (fuelPercent < 0)   fuelPercent = 0;
+    if (fuelPercent > 100) fuelPercent = 100;
+    e->fuelReading = fuelPercent;
+    if (e->fuel == 0) {
+        e->fuel = (uint16_t)fuelPercent << 8;
+        if (e->fuelStart == 0) e->fuelStart = e->fuel;
+    }
+
+    //The BMS line says which side of its level the battery is on. Below it the Kelly
+    //is cut off, so the engine has to run whatever the plan says
+    int32_t low = percentOf(e->config->batteryJoules, e->config->lowBattery);
+    if (lowBattery && e->battery > low)   e->battery = low;
+    if (!lowBattery && e->battery < low)  e->battery = low;
+    e->lowBattery = lowBattery;
+    if (lowBattery) e->engineOff = false;
+}
+
+void energyTurn(EnergyManager* e, uint32_t micros)
+{
+    const EnergyConfig* c = e->config;
+    uint32_t duration = micros - e->lastTurn;
+    if (e->lastTurn != 0 && duration >= 256) {
+        //Average PWM over the revolution x 256, then the joules it took or gave back
+        uint32_t kelly = e->kellyTime / (duration >> 8);
+        uint32_t regen = e->regenTime / (duration >> 8);
+        if (kelly > 255UL * 256) kelly = 255UL * 256;
+        if (regen > 255UL * 256) regen = 255UL * 256;
+        int32_t drawn    = (uint32_t)c->motorJoulesPerTurn * kelly / (255UL * 256);
+        int32_t returned = (uint32_t)c->regenJoulesPerTurn * regen / (255UL * 256);
+        int32_t most     = (uint32_t)c->motorMaxWatts * (duration / 1000) / 1000;
+        if (drawn > most) drawn = most;
+
+        e->battery += returned - drawn;
+        if (e->battery < 0) e->battery = 0;
+        if (e->battery > (int32_t)c->batteryJoules) e->battery = c->batteryJoules;
+    }
+    e->lastTurn  = micros;
+    e->kellyTime = 0;
+    e->regenTime = 0;
+    e->turns++;
+
+    //Fuel sender, over about 16 revolutions (27 m)
+    e->fuel += (((int32_t)e->fuelReading << 8) - (int32_t)e->fuel) / 16;
+    checkPlan(e);
+}
+
+void energyOutputs(EnergyManager* e, uint32_t micros, uint8_t kelly, uint8_t regen)
+{
+    uint32_t step = e->lastOutput != 0 ? micros - e->lastOutput : 0;
+    if (step > ENERGY_MAX_STEP_US) step = ENERGY_MAX_STEP_US;
+    e->lastOutput = micros;
+    if (e->lastTurn == 0) return;
+
+    //A wheel that stopped turning: whatever the Kelly got meanwhile moved nothing
+    if (micros - e->lastTurn > ENERGY_STOPPED_US) {
+        e->lastTurn  = 0;
+        e->kellyTime = 0;
+        e->regenTime = 0;
+        return;
+    }
+    e->kellyTime += (uint32_t)kelly * step;
+    e->regenTime += (uint32_t)regen * step;
+}
+
+int energyBatteryPercent(const EnergyManager* e)
+{
+    return e->battery * 100 / e->config->batteryJoules;
+}
+
+uint8_t energySource(const EnergyManager* e)
+{
+    if (e->engineOff) return ENERGY_MOTOR;
+    return e->assist > 0 ? ENERGY_BOTH : ENERGY_ENGINE;
+}
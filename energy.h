@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Endurance energy manager
+//------------------------------------------------------------------------------
+//Keeps track of what is left in the battery and the tank and decides, for
+//endurance mode, how much of the work the motor takes. The goal is to finish
+//the event distance with the reserves left and nothing more: whatever is
+//spent above the plan makes the laps faster.
+//
+//Battery: there is no current sensor, so the energy is counted from what the
+//Kelly is told to do. Motor torque follows the PWM, so the energy per wheel
+//revolution at a given PWM does not depend on speed: the average Kelly and
+//regen PWM over each revolution times the joules per revolution at full PWM
+//(calibrated on the car) is what left or came back. The low battery line of
+//the BMS anchors the estimate, above or below its level.
+//
+//Fuel: the fuel sender, smoothed over a few revolutions against sloshing.
+//
+//The plan runs from the charge and fuel at the start line, given by
+//energyPlan(), straight down to the reserves at the finish. Once per wheel
+//revolution both are compared with the plan for the distance covered. Only
+//the motor's boost at full pedal makes the laps faster, so:
+//
+//    battery far ahead of plan     boost, no regen with the pedal
+//                                  released (coasting is faster, and the
+//                                  charge would not be used anyway)
+//    battery on or ahead of plan   boost
+//    battery behind                no boost
+//    fuel behind by fuelBand       engine off, the motor takes the pedal,
+//                                  while the battery is not behind; on again
+//                                  when the fuel is back on plan, the battery
+//                                  batteryBand behind or at the BMS line
+//
+//Everything that divides runs once per revolution; the per cycle work is two
+//multiply-adds.
+
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include "hal.h"
+
+const uint32_t ENERGY_MAX_STEP_US = 10000;    //Longer gaps between outputs (critical cycles) count as this
+const uint32_t ENERGY_STOPPED_US  = 2000000;  //No revolution for this long: the wheel stopped, as REED_STOPPED_US
+
+//What energySource() reports: engine only, engine with the boost, motor only
+const uint8_t ENERGY_ENGINE = 0;
+const uint8_t ENERGY_BOTH   = 1;
+const uint8_t ENERGY_MOTOR  = 2;
+
+struct EnergyConfig {
+    uint32_t batteryJoules;         //usable energy between empty and full
+    uint16_t motorJoulesPerTurn;    //taken from the battery per wheel revolution at full Kelly PWM
+    uint16_t regenJoulesPerTurn;    //put back per wheel revolution at full regen PWM
+    uint16_t motorMaxWatts;         //most the Kelly takes from the battery
+    uint16_t wheelMillimeters;      //wheel circumference
+    uint8_t  batteryReserve;        //percent to finish with
+    uint8_t  lowBattery;            //percent at which the BMS pulls the low battery line
+    uint8_t  fuelReserve;           //percent
+    uint8_t  batteryBand;           //percent off the plan: ahead is a surplus, behind turns the engine back on
+    uint8_t  fuelBand;              //percent behind plan at which the engine is turned off
+};
+
+struct EnergyManager {
+    const EnergyConfig* config;
+    int32_t  battery;               //J left, estimated
+    uint32_t kellyTime;             //Kelly PWM x us since the last revolution
+    uint32_t regenTime;             //regen PWM x us
+    uint32_t lastOutput;            //micros of the last energyOutputs()
+    uint32_t lastTurn;              //micros of the last revolution, 0 before the first
+    uint32_t turns;                 //wheel revolutions since the plan started
+    uint32_t planTurns;             //the whole distance
+    int32_t  batteryStart;          //J when the plan started
+    uint8_t  fuelReading;           //sender, percent, this control cycle
+    uint16_t fuel;                  //sender, smoothed, percent x 256; 0 before the first reading
+    uint16_t fuelStart;
+    int32_t  batteryAhead;          //J over the plan, negative when behind
+    int16_t  fuelAhead;             //percent x 256 over the plan
+    boolean  assist;                //full pedal boost allowed
+    boolean  surplus;               //battery batteryBand or more ahead: no idle regen
+    boolean  engineOff;
+    boolean  lowBattery;            //the BMS line, last control cycle
+};
+
+//Starts with the battery at batteryPercent and a plan over meters
+void    energyBegin(EnergyManager* e, const EnergyConfig* config, uint8_t batteryPercent, uint16_t meters);
+void    energySetBattery(EnergyManager* e, uint8_t percent);
+
+//Restarts the plan from the current charge and fuel, over meters from here
+void    energyPlan(EnergyManager* e, uint16_t meters);
+
+//Every control cycle, after the inputs are processed
+void    energyInputs(EnergyManager* e, int fuelPercent, boolean lowBattery);
+//Every wheel revolution, with the reed pulse time
+void    energyTurn(EnergyManager* e, uint32_t micros);
+//Every time the outputs are written, with the PWM the Kelly actually got
+void    energyOutputs(EnergyManager* e, uint32_t micros, uint8_t kelly, uint8_t regen);
+
+int     energyBatteryPercent(const EnergyManager* e);
+uint8_t energySource(const EnergyManager* e);
+
+#endif
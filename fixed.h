@@ -0,0 +1,144 @@
+//------------------------------------------------------------------------------
+// Fixed-point arithmetic
+//------------------------------------------------------------------------------
+//Q-format numbers for the control math, so it runs without soft-float: the
+//AVR has no FPU and a float multiply or divide costs it several hundred
+//cycles, while these are integer adds, shifts and one hardware-assisted
+//multiply. A Fixed<FRAC> holds value * 2^FRAC in 32 bits, FRAC fraction bits
+//and 31 - FRAC integer bits, e.g. Fixed<16> covers +-32767 in steps of
+//1/65536.
+//
+//Add, subtract and multiply saturate at the ends of the range instead of
+//wrapping. Division is left out on purpose: divide by a constant through
+//fixedReciprocal(), worked out once (at compile time for constants), and a
+//multiply.
+//
+//fixedMap() is map() for a constant range with the division done ahead, and
+//gives exactly map()'s results when (inMax - inMin)^2 < 2^FIXED_MAP_FRAC, an
+//input span of 255 at most (host/bench fixed checks every span up to that).
+//Wider ranges may come out one count off.
+
+#ifndef FIXED_H
+#define FIXED_H
+
+#include "hal.h"
+
+template <uint8_t FRAC>
+struct Fixed {
+    int32_t raw;                 //value * 2^FRAC
+};
+
+const int32_t FIXED_RAW_MAX = 0x7FFFFFFFL;
+const int32_t FIXED_RAW_MIN = -FIXED_RAW_MAX - 1;
+
+//A constant, rounded to the nearest step; folded by the compiler for constant values
+#define FIXED_CONST(value, frac) ((int32_t)((value) * (double)(1L << (frac)) + ((value) < 0 ? -0.5 : 0.5)))
+
+//num / den for positive constants, rounded up so that multiplying by it and
+//truncating gives the same results as dividing (see fixedMap())
+#define FIXED_RATIO(num, den, frac) ((int32_t)((((int64_t)(num) << (frac)) + (den) - 1) / (den)))
+
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedRaw(int32_t raw)
+{
+    Fixed<FRAC> f = {raw};
+    return f;
+}
+
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedFromInt(int16_t value)
+{
+    return fixedRaw<FRAC>((int32_t)value << FRAC);
+}
+
+//Toward minus infinity, like a shift
+template <uint8_t FRAC>
+inline int32_t fixedToInt(Fixed<FRAC> f)
+{
+    return f.raw >> FRAC;
+}
+
+template <uint8_t FRAC>
+inline int32_t fixedRound(Fixed<FRAC> f)
+{
+    if (f.raw > FIXED_RAW_MAX - (1L << (FRAC - 1))) return FIXED_RAW_MAX >> FRAC;
+    return (f.raw + (1L << (FRAC - 1))) >> FRAC;
+}
+
+inline int32_t fixedSaturate(int64_t raw)
+{
+    if (raw > FIXED_RAW_MAX) return FIXED_RAW_MAX;
+    if (raw < FIXED_RAW_MIN) return FIXED_RAW_MIN;
+    return (int32_t)raw;
+}
+
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedAdd(Fixed<FRAC> a, Fixed<FRAC> b)
+{
+    int32_t sum = (int32_t)((uint32_t)a.raw + (uint32_t)b.raw);
+    if (a.raw >= 0 && b.raw >= 0 && sum < 0)  sum = FIXED_RAW_MAX;   //Both signs the same and the sum's not
+    if (a.raw < 0 && b.raw < 0 && sum >= 0)   sum = FIXED_RAW_MIN;
+    return fixedRaw<FRAC>(sum);
+}
+
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedSub(Fixed<FRAC> a, Fixed<FRAC> b)
+{
+    int32_t difference = (int32_t)((uint32_t)a.raw - (uint32_t)b.raw);
+    if (a.raw >= 0 && b.raw < 0 && difference < 0)  difference = FIXED_RAW_MAX;
+    if (a.raw < 0 && b.raw >= 0 && difference >= 0) difference = FIXED_RAW_MIN;
+    return fixedRaw<FRAC>(difference);
+}
+
+//Truncated toward minus infinity
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedMul(Fixed<FRAC> a, Fixed<FRAC> b)
+{
+    return fixedRaw<FRAC>(fixedSaturate(((int64_t)a.raw * b.raw) >> FRAC));
+}
+
+//An integer times a fixed-point factor, the result as an integer (truncated)
+template <uint8_t FRAC>
+inline int32_t fixedScale(int16_t value, Fixed<FRAC> factor)
+{
+    return fixedSaturate(((int64_t)value * factor.raw) >> FRAC);
+}
+
+//1 / divisor, rounded up; for divisors known ahead, not in the control path
+template <uint8_t FRAC>
+inline Fixed<FRAC> fixedReciprocal(int32_t divisor)
+{
+    return fixedRaw<FRAC>(FIXED_RATIO(1, divisor, FRAC));
+}
+
+//map() of an input range onto an output range, clamped to the output range
+//outside the input range. inMax > inMin and outMax >= outMin.
+const uint8_t FIXED_MAP_FRAC = 16;
+
+struct FixedMap {
+    int16_t inMin, inMax;
+    int16_t outMin, outMax;
+    int32_t scale;               //(outMax - outMin) / (inMax - inMin), Q16 rounded up
+};
+
+#define FIXED_MAP(inMin, inMax, outMin, outMax) \
+    {(inMin), (inMax), (outMin), (outMax), FIXED_RATIO((outMax) - (outMin), (inMax) - (inMin), FIXED_MAP_FRAC)}
+
+//FIXED_MAP() at runtime, for ranges that are parameters (params.h); one 32
+//bit division, so outMax - outMin < 2^15
+inline FixedMap fixedMapMake(int16_t inMin, int16_t inMax, int16_t outMin, int16_t outMax)
+{
+    uint32_t span = (uint16_t)(inMax - inMin);
+    FixedMap m = {inMin, inMax, outMin, outMax, (int32_t)((((uint32_t)(outMax - outMin) << FIXED_MAP_FRAC) + span - 1) / span)};
+    return m;
+}
+
+//No 64 bit math: the product is at most (outMax - outMin) * 2^16 + (inMax - inMin)
+inline int16_t fixedMap(const FixedMap& m, int16_t x)
+{
+    if (x <= m.inMin) return m.outMin;
+    if (x >= m.inMax) return m.outMax;
+    return m.outMin + (int16_t)(((uint32_t)(x - m.inMin) * (uint32_t)m.scale) >> FIXED_MAP_FRAC);
+}
+
+#endif
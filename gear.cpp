@@ -0,0 +1,77 @@
+//------------------------------------------------------------------------------
+// Gear detection
+//------------------------------------------------------------------------------
+
+#include "gear.h"
+
+static void select(GearDetector* g, uint8_t gear)
+{
+    const GearConfig* c = g->config;
+    uint16_t center = c->centers[gear];
+    uint16_t reach  = c->width + c->hysteresis;
+    g->gear     = gear;
+    g->stayLow  = center > reach ? center - reach : 0;
+    g->stayHigh = center + reach;
+    g->pending  = GEAR_NONE;
+    g->count    = 0;
+}
+
+//The gear whose band holds the reading, or GEAR_NONE
+static uint8_t band(const GearDetector* g, uint16_t adc)
+{
+    const GearConfig* c = g->config;
+    for (uint8_t gear = 0; gear <= GEAR_TOP; gear++) {
+        uint16_t center = c->centers[gear];
+        if (adc + c->width >= center && adc <= center + c->width) return gear;
+    }
+    return GEAR_NONE;
+}
+
+void gearBegin(GearDetector* g, const GearConfig* config)
+{
+    memset(g, 0, sizeof(*g));
+    g->config = config;
+
+    //Halfway between neighbouring ratios; first gear up to twice its ratio
+    //(wheelspin), top gear down to half its ratio
+    const uint16_t* r = config->ratios;
+    g->bounds[0] = r[0] * 2;
+    for (uint8_t i = 1; i < GEAR_TOP; i++) g->bounds[i] = (r[i - 1] + r[i]) / 2;
+    g->bounds[GEAR_TOP] = r[GEAR_TOP - 1] / 2;
+
+    select(g, 0);
+}
+
+uint8_t gearByTurns(const GearDetector* g, uint16_t turns)
+{
+    if (turns == 0 || turns > g->bounds[0]) return 0;
+    for (uint8_t gear = 1; gear <= GEAR_TOP; gear++)
+        if (turns > g->bounds[gear]) return gear;
+    return 0;
+}
+
+uint8_t gearUpdate(GearDetector* g, uint16_t adc, uint16_t turns)
+{
+    if (adc >= g->stayLow && adc <= g->stayHigh) {
+        g->pending = GEAR_NONE;
+        g->count   = 0;
+        return g->gear;
+    }
+
+    uint8_t reading = band(g, adc);
+    if (reading != g->pending) {
+        g->pending = reading;
+        g->count   = 0;
+    }
+    if (g->count < 255) g->count++;
+
+    const GearConfig* c = g->config;
+    uint8_t byTurns = gearByTurns(g, turns);
+    uint8_t needed  = c->confirm;
+    if (byTurns != 0) {
+        if (byTurns == reading)     needed = 1;
+        else if (byTurns == g->gear) needed = c->vetoed;
+    }
+    if (g->count >= needed) select(g, reading != GEAR_NONE ? reading : byTurns);
+    return g->gear;
+}
@@ -0,0 +1,60 @@
+//------------------------------------------------------------------------------
+// Gear detection
+//------------------------------------------------------------------------------
+//The gear sensor on gearPin gives one voltage per gear, neutral included. The
+//centers are calibrated on the car (the gear_adc column of log_decode, one
+//gear at a time); a reading within width of a center selects that gear. To
+//leave the selected gear the reading has to move hysteresis counts further,
+//so a reading that sits on the edge of a band does not flicker.
+//
+//A new reading has to hold for confirm control cycles before it is taken.
+//The engine's turns per wheel turn cross-check it: with the clutch out they
+//are the gear's ratio, a little more with the tyres slipping. slip.h counts
+//them over each revolution of the reed switch's wheel, which does not lag
+//like the filtered reed period does (rpm x period reads a gear off
+//accelerating or braking hard). When they say the new reading's gear the
+//change is taken at once; when they still say the old gear, the reading has
+//to hold for vetoed cycles instead. A reading between the bands for confirm
+//cycles gives the gear the turns say, or 0 as in neutral.
+//
+//While the reading stays in the selected gear's band, gearUpdate() is two
+//compares; the band search and the ratio check only run while it is
+//elsewhere.
+
+#ifndef GEAR_H
+#define GEAR_H
+
+#include "hal.h"
+
+const uint8_t GEAR_TOP  = 5;        //as many as SLIP_GEARS
+const uint8_t GEAR_NONE = 0xff;     //a reading between the bands
+
+struct GearConfig {
+    uint16_t centers[GEAR_TOP + 1]; //sensor ADC counts in neutral, first ... top gear
+    uint8_t  width;                 //counts either side of a center that select it
+    uint8_t  hysteresis;            //further counts before the selected gear is left
+    uint8_t  confirm;               //control cycles a new reading has to hold
+    uint8_t  vetoed;                //... when the engine's turns still say the old gear
+    const uint16_t* ratios;         //engine turns per wheel turn x 100, first to top gear
+};
+
+struct GearDetector {
+    const GearConfig* config;
+    uint16_t bounds[GEAR_TOP + 1];  //turns x 100 from above first gear down to below top gear
+    uint16_t stayLow;               //band of the selected gear, hysteresis included
+    uint16_t stayHigh;
+    uint8_t  gear;                  //0 neutral or unknown, 1 to GEAR_TOP
+    uint8_t  pending;               //the reading waiting to be confirmed, or GEAR_NONE
+    uint8_t  count;                 //control cycles it has held
+};
+
+void    gearBegin(GearDetector* g, const GearConfig* config);
+
+//Every control cycle with the raw sensor reading and the engine's turns per
+//wheel turn x 100 (SlipEstimator.turns, 0 when unknown). Returns the gear
+uint8_t gearUpdate(GearDetector* g, uint16_t adc, uint16_t turns);
+
+//The gear with the ratio nearest the turns, 0 when unknown or far off all of them
+uint8_t gearByTurns(const GearDetector* g, uint16_t turns);
+
+#endif
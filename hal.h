@@ -0,0 +1,159 @@
+/*
+
+ ### HARDWARE ABSTRACTION LAYER ###
+
+Every pin, clock, servo and serial access of the car program goes through the
+functions declared here, so that the same setup()/loop() can run in two places:
+
+    Arduino Mega 2560: hal_mega.cpp, thin wrappers around the Arduino core
+                       (compiled only when ARDUINO is defined)
+    Linux host:        host/hal_host.cpp, scripted pin values, a virtual clock
+                       and in-memory serial ports (see host/README.md)
+
+Serial ports are numbered like in the rest of the program: 0 is the USB port
+(Serial), 1 is the RF transceiver (Serial1).
+
+Digital pins read or written every cycle can bypass the Arduino core through
+hal_ports.h, which maps pin numbers to port registers at compile time.
+
+*/
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+#ifdef ARDUINO
+
+#include <Arduino.h>
+
+#define HAL_NOINIT __attribute__((section(".noinit")))
+
+#else
+
+#include <stdlib.h>
+#include <string.h>
+
+//The parts of the Arduino core the car program uses directly
+typedef bool    boolean;
+typedef uint8_t byte;
+
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+
+//Analog pin numbers, same as on the Mega 2560
+#define A0           54
+#define A1           55
+#define A2           56
+#define A3           57
+#define A4           58
+#define A5           59
+#define A6           60
+#define A7           61
+
+//Flash tables are ordinary constants on the host
+#define PROGMEM
+#define pgm_read_byte(address)  (*(const uint8_t*)(address))
+#define pgm_read_word(address)  (*(const uint16_t*)(address))
+
+#define HAL_NOINIT
+
+long  map(long x, long inMin, long inMax, long outMin, long outMax);
+char* itoa(int value, char* str, int base);
+
+#endif
+
+const int HAL_SERIAL_PORTS = 2;  //0 = USB, 1 = transceiver
+
+//Pins
+void     halPinMode(uint8_t pin, uint8_t mode);
+int      halDigitalRead(uint8_t pin);
+void     halDigitalWrite(uint8_t pin, uint8_t value);
+int      halAnalogRead(uint8_t pin);
+void     halAnalogWrite(uint8_t pin, int value);
+
+//Clock
+uint32_t halMillis();
+uint32_t halMicros();
+void     halDelay(uint32_t ms);
+
+//Interrupts. The handler runs in interrupt context: keep it short and share
+//data with the main loop through volatile variables.
+void     halAttachInterrupt(uint8_t pin, void (*handler)(), uint8_t mode);
+void     halNoInterrupts();
+void     halInterrupts();
+
+//Periodic timer interrupt, Timer1 on the Mega (Timer0 runs millis(), Timer3
+//the PWM on pins 2, 3 and 5, Timer5 the Servo library). The handler runs in
+//interrupt context every periodMicros, at most 32767 us, from the call on.
+void     halTimerBegin(uint32_t periodMicros, void (*handler)());
+
+//Watchdog. halWatchdogBegin() arms it: timeoutMillis after the last
+//halWatchdogReset() the handler runs in interrupt context, and the timeout
+//after that resets the MCU, whether the handler could run or not. On the Mega
+//the timeout is rounded down to the watchdog's steps (15, 30, 60, 120, 250,
+//500 ms, 1, 2, 4, 8 s), and the watchdog is off after every reset until
+//halWatchdogBegin().
+void     halWatchdogBegin(uint16_t timeoutMillis, void (*handler)());
+void     halWatchdogReset();
+
+//Variables declared HAL_NOINIT are not cleared at startup, so they keep their
+//value across a watchdog or reset button reset. After power on they hold
+//garbage.
+
+//ADC. halAdcStart() begins one conversion on an analog pin and returns at
+//once; when it completes, the handler gets the 10 bit result in interrupt
+//context and may start the next conversion. Do not mix with halAnalogRead().
+void     halAdcBegin(void (*handler)(uint16_t value));
+void     halAdcStart(uint8_t pin);
+
+//Throttle servo (the car has exactly one)
+void     halServoAttach(uint8_t pin, int minPulse, int maxPulse);
+void     halServoWrite(int angle);
+
+//Serial ports
+void     halSerialBegin(uint8_t port, long baud);
+int      halSerialAvailable(uint8_t port);
+int      halSerialRead(uint8_t port);
+void     halSerialWrite(uint8_t port, uint8_t value);      //blocks while the core's TX buffer is full
+int      halSerialAvailableForWrite(uint8_t port);         //bytes halSerialWrite() takes without blocking
+void     halSerialPrintln(uint8_t port, const char* text);
+void     halSerialPrintln(uint8_t port, long value);
+void     halSerialPrintln(uint8_t port, double value);
+
+//Block storage: an SD card on the SPI port on the Mega, a card image file on
+//the host. halStorageWrite() only starts writing a 512 byte block, each
+//halStoragePoll() then moves it along by at most HAL_STORAGE_SLICE bytes (or
+//one look at the card's busy flag) and says whether the write is done, so a
+//block goes out over several short calls from a background task. The data
+//must stay untouched until then. halStorageRead() waits for the card, it is
+//meant for setup().
+const uint16_t HAL_STORAGE_BLOCK   = 512;
+const uint8_t  HAL_STORAGE_SLICE   = 128;
+const uint8_t  HAL_STORAGE_IDLE    = 0;   //last write done, ready for the next
+const uint8_t  HAL_STORAGE_BUSY    = 1;
+const uint8_t  HAL_STORAGE_FAILED  = 2;   //no card, or it refused a block; stays failed
+
+boolean  halStorageBegin(uint8_t csPin);                       //false if there is no card
+boolean  halStorageRead(uint32_t block, uint8_t* data);        //false if busy or unreadable
+void     halStorageWrite(uint32_t block, const uint8_t* data); //only when halStoragePoll() is IDLE
+uint8_t  halStoragePoll();
+
+//EEPROM, 4 KB on the Mega, an image file on the host. Reads are quick. A
+//byte that changes takes about 3.4 ms to write, in the background: the call
+//returns once the write started, and the next read or write waits for it to
+//finish (unchanged bytes are skipped). A write of n changed bytes so waits
+//(n - 1) x 3.4 ms; write from setup(), on a command, or a byte every few ms.
+const uint16_t HAL_EEPROM_BYTES    = 4096;
+
+void     halEepromRead(uint16_t address, void* data, uint16_t length);
+void     halEepromWrite(uint16_t address, const void* data, uint16_t length);
+
+#endif
@@ -0,0 +1,308 @@
+//------------------------------------------------------------------------------
+// Hardware abstraction layer, Arduino Mega 2560 backend
+//------------------------------------------------------------------------------
+//Thin wrappers around the Arduino core. The host build skips this file.
+
+#ifdef ARDUINO
+
+#include "hal.h"
+#include <Servo.h>    //Give access to the Arduino Servo library
+#include <avr/eeprom.h>
+#include <avr/wdt.h>
+
+static Servo throttleServo;  //This is the instance of our servo
+
+static HardwareSerial* serialPort(uint8_t port)
+{
+    if (port == 1) return &Serial1;
+    return &Serial;
+}
+
+void halPinMode(uint8_t pin, uint8_t mode)       {pinMode(pin, mode);}
+int  halDigitalRead(uint8_t pin)                 {return digitalRead(pin);}
+void halDigitalWrite(uint8_t pin, uint8_t value) {digitalWrite(pin, value);}
+int  halAnalogRead(uint8_t pin)                  {return analogRead(pin);}
+void halAnalogWrite(uint8_t pin, int value)      {analogWrite(pin, value);}
+
+uint32_t halMillis()          {return millis();}
+uint32_t halMicros()          {return micros();}
+void     halDelay(uint32_t ms){delay(ms);}
+
+void halAttachInterrupt(uint8_t pin, void (*handler)(), uint8_t mode)
+{
+    attachInterrupt(digitalPinToInterrupt(pin), handler, mode);
+}
+void halNoInterrupts() {noInterrupts();}
+void halInterrupts()   {interrupts();}
+
+static void (*volatile timerHandler)() = 0;
+
+void halTimerBegin(uint32_t periodMicros, void (*handler)())
+{
+    noInterrupts();
+    timerHandler = handler;
+    TCCR1A = 0;
+    TCCR1B = _BV(WGM12) | _BV(CS11);                                        //CTC on OCR1A, 2 MHz
+    OCR1A  = periodMicros * 2 - 1;
+    TCNT1  = 0;
+    TIMSK1 = _BV(OCIE1A);
+    interrupts();
+}
+
+ISR(TIMER1_COMPA_vect)
+{
+    if (timerHandler) timerHandler();
+}
+
+static void (*volatile watchdogHandler)() = 0;
+
+//A watchdog reset leaves the watchdog running at its shortest timeout, which
+//would reset the board again long before setup(): off before the C runtime
+//starts, in .init3
+void halWatchdogOff() __attribute__((naked, used, section(".init3")));
+void halWatchdogOff()
+{
+    MCUSR = 0;
+    wdt_disable();
+}
+
+void halWatchdogBegin(uint16_t timeoutMillis, void (*handler)())
+{
+    uint8_t prescaler = 0;                                                  //16 ms << prescaler
+    while (prescaler < 9 && (15UL << (prescaler + 1)) <= timeoutMillis) prescaler++;
+    noInterrupts();
+    watchdogHandler = handler;
+    wdt_reset();
+    WDTCSR = _BV(WDCE) | _BV(WDE);                                          //timed sequence, 4 cycles to the next write
+    WDTCSR = _BV(WDIE) | _BV(WDE) | (prescaler & 7) | ((prescaler & 8) ? _BV(WDP3) : 0);
+    interrupts();
+}
+
+void halWatchdogReset() {wdt_reset();}
+
+//The time-out clears WDIE, so the next one resets, handler or not
+ISR(WDT_vect)
+{
+    if (watchdogHandler) watchdogHandler();
+}
+
+static void (*volatile adcHandler)(uint16_t value) = 0;
+
+void halAdcBegin(void (*handler)(uint16_t value))
+{
+    adcHandler = handler;
+    ADCSRA = _BV(ADEN) | _BV(ADIE) | _BV(ADPS2) | _BV(ADPS1) | _BV(ADPS0);  //125 kHz ADC clock, ~104 us per conversion
+}
+
+void halAdcStart(uint8_t pin)
+{
+    uint8_t channel = pin >= A0 ? pin - A0 : pin;
+    ADCSRB = (ADCSRB & ~_BV(MUX5)) | (channel > 7 ? _BV(MUX5) : 0);
+    ADMUX  = _BV(REFS0) | (channel & 7);                                    //AVcc reference, like analogRead()
+    ADCSRA |= _BV(ADSC);
+}
+
+ISR(ADC_vect)
+{
+    uint16_t value = ADC;
+    if (adcHandler) adcHandler(value);
+}
+
+void halServoAttach(uint8_t pin, int minPulse, int maxPulse) {throttleServo.attach(pin, minPulse, maxPulse);}
+void halServoWrite(int angle)                                {throttleServo.write(angle);}
+
+void halSerialBegin(uint8_t port, long baud)      {serialPort(port)->begin(baud);}
+int  halSerialAvailable(uint8_t port)             {return serialPort(port)->available();}
+int  halSerialRead(uint8_t port)                  {return serialPort(port)->read();}
+void halSerialWrite(uint8_t port, uint8_t value)  {serialPort(port)->write(value);}
+int  halSerialAvailableForWrite(uint8_t port)     {return serialPort(port)->availableForWrite();}
+void halSerialPrintln(uint8_t port, const char* text) {serialPort(port)->println(text);}
+void halSerialPrintln(uint8_t port, long value)       {serialPort(port)->println(value);}
+void halSerialPrintln(uint8_t port, double value)     {serialPort(port)->println(value);}
+
+//SD card in SPI mode on the hardware SPI port (MISO 50, MOSI 51, SCK 52), raw
+//blocks without a file system. Commands as in the SD Physical Layer
+//Simplified Specification: CMD0 reset, CMD8 interface condition, ACMD41
+//initialization, CMD58 OCR, CMD16 block length, CMD17/CMD24 single block
+//read and write.
+const uint8_t  SD_WRITE_COMMAND = 0;
+const uint8_t  SD_WRITE_DATA    = 1;
+const uint8_t  SD_WRITE_BUSY    = 2;
+const uint16_t SD_TIMEOUT_MS    = 500;
+
+static uint8_t        cardSelect;
+static boolean        cardHighCapacity;  //SDHC and SDXC are addressed in blocks, older cards in bytes
+static uint8_t        storageState = HAL_STORAGE_FAILED;
+static uint8_t        writeStep;
+static uint32_t       writeBlock;
+static const uint8_t* writeData;
+static uint16_t       writeDone;
+static uint32_t       writeStart;
+
+static uint8_t spiTransfer(uint8_t value)
+{
+    SPDR = value;
+    while (!(SPSR & _BV(SPIF))) ;
+    return SPDR;
+}
+
+static void cardRelease()
+{
+    digitalWrite(cardSelect, HIGH);
+    spiTransfer(0xFF);
+}
+
+//Selects the card and sends a command, returns the R1 response
+static uint8_t cardCommand(uint8_t command, uint32_t argument)
+{
+    digitalWrite(cardSelect, LOW);
+    spiTransfer(0xFF);
+    spiTransfer(0x40 | command);
+    for (int8_t shift = 24; shift >= 0; shift -= 8) spiTransfer(argument >> shift);
+    spiTransfer(command == 0 ? 0x95 : command == 8 ? 0x87 : 0xFF);  //CRC, only checked before CMD59
+    uint8_t response = 0xFF;
+    for (uint8_t i = 0; i < 10 && (response & 0x80); i++) response = spiTransfer(0xFF);
+    return response;
+}
+
+static uint32_t cardAddress(uint32_t block)
+{
+    return cardHighCapacity ? block : block * HAL_STORAGE_BLOCK;
+}
+
+boolean halStorageBegin(uint8_t csPin)
+{
+    cardSelect   = csPin;
+    storageState = HAL_STORAGE_FAILED;
+    pinMode(csPin, OUTPUT);
+    digitalWrite(csPin, HIGH);
+    pinMode(53, OUTPUT);                                    //SS, must be an output for master mode
+    pinMode(52, OUTPUT);
+    pinMode(51, OUTPUT);
+    pinMode(50, INPUT);
+    SPCR = _BV(SPE) | _BV(MSTR) | _BV(SPR1) | _BV(SPR0);   //125 kHz for the initialization
+    SPSR = 0;
+    for (uint8_t i = 0; i < 10; i++) spiTransfer(0xFF);    //at least 74 clocks, deselected
+
+    uint32_t start = millis();
+    while (cardCommand(0, 0) != 0x01) {
+        if (millis() - start > SD_TIMEOUT_MS) {cardRelease(); return false;}
+    }
+    boolean version2 = (cardCommand(8, 0x1AA) == 0x01);
+    if (version2) for (uint8_t i = 0; i < 4; i++) spiTransfer(0xFF);
+
+    uint8_t response;
+    do {
+        cardCommand(55, 0);
+        response = cardCommand(41, version2 ? 0x40000000UL : 0);
+        if (millis() - start > SD_TIMEOUT_MS) {cardRelease(); return false;}
+    } while (response != 0);
+
+    cardHighCapacity = false;
+    if (version2 && cardCommand(58, 0) == 0) {
+        cardHighCapacity = (spiTransfer(0xFF) & 0x40) != 0;
+        for (uint8_t i = 0; i < 3; i++) spiTransfer(0xFF);
+    }
+    if (!cardHighCapacity && cardCommand(16, HAL_STORAGE_BLOCK) != 0) {cardRelease(); return false;}
+    cardRelease();
+
+    SPCR = _BV(SPE) | _BV(MSTR);                            //8 MHz from here on
+    SPSR = _BV(SPI2X);
+    storageState = HAL_STORAGE_IDLE;
+    return true;
+}
+
+boolean halStorageRead(uint32_t block, uint8_t* data)
+{
+    if (storageState != HAL_STORAGE_IDLE) return false;
+    boolean ok = false;
+    if (cardCommand(17, cardAddress(block)) == 0) {
+        uint32_t start = millis();
+        uint8_t  token;
+        while ((token = spiTransfer(0xFF)) == 0xFF && millis() - start < SD_TIMEOUT_MS) ;
+        if (token == 0xFE) {
+            for (uint16_t i = 0; i < HAL_STORAGE_BLOCK; i++) data[i] = spiTransfer(0xFF);
+            spiTransfer(0xFF);                              //CRC
+            spiTransfer(0xFF);
+            ok = true;
+        }
+    }
+    cardRelease();
+    return ok;
+}
+
+void halStorageWrite(uint32_t block, const uint8_t* data)
+{
+    if (storageState != HAL_STORAGE_IDLE) return;
+    writeBlock   = block;
+    writeData    = data;
+    writeDone    = 0;
+    writeStep    = SD_WRITE_COMMAND;
+    writeStart   = millis();
+    storageState = HAL_STORAGE_BUSY;
+}
+
+//The card stays selected from the command to the end of the busy phase;
+//nothing else is on the SPI port
+uint8_t halStoragePoll()
+{
+    if (storageState != HAL_STORAGE_BUSY) return storageState;
+
+    if (writeStep == SD_WRITE_COMMAND) {
+        if (cardCommand(24, cardAddress(writeBlock)) != 0) {
+            cardRelease();
+            return storageState = HAL_STORAGE_FAILED;
+        }
+        spiTransfer(0xFE);                                  //start block token
+        writeStep = SD_WRITE_DATA;
+    }
+    else if (writeStep == SD_WRITE_DATA) {
+        uint16_t end = writeDone + HAL_STORAGE_SLICE;
+        if (end > HAL_STORAGE_BLOCK) end = HAL_STORAGE_BLOCK;
+        const uint8_t* p = writeData + writeDone;
+        for (uint16_t i = writeDone; i < end; i++) {
+            SPDR = *p++;
+            while (!(SPSR & _BV(SPIF))) ;
+        }
+        writeDone = end;
+        if (writeDone == HAL_STORAGE_BLOCK) {
+            spiTransfer(0xFF);                              //CRC
+            spiTransfer(0xFF);
+            if ((spiTransfer(0xFF) & 0x1F) != 0x05) {       //data response: accepted
+                cardRelease();
+                return storageState = HAL_STORAGE_FAILED;
+            }
+            writeStep = SD_WRITE_BUSY;
+        }
+    }
+    else {
+        //The card holds MISO low while it programs the block
+        for (uint8_t i = 0; i < 16; i++) {
+            if (spiTransfer(0xFF) == 0xFF) {
+                cardRelease();
+                return storageState = HAL_STORAGE_IDLE;
+            }
+        }
+        if (millis() - writeStart > SD_TIMEOUT_MS) {
+            cardRelease();
+            return storageState = HAL_STORAGE_FAILED;
+        }
+    }
+    return HAL_STORAGE_BUSY;
+}
+
+//------------------------------------------------------------------------------
+// EEPROM
+//------------------------------------------------------------------------------
+
+void halEepromRead(uint16_t address, void* data, uint16_t length)
+{
+    eeprom_read_block(data, (const void*)address, length);
+}
+
+void halEepromWrite(uint16_t address, const void* data, uint16_t length)
+{
+    eeprom_update_block(data, (void*)address, length);
+}
+
+#endif
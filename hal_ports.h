@@ -0,0 +1,165 @@
+//------------------------------------------------------------------------------
+// Hardware abstraction layer, direct port register I/O
+//------------------------------------------------------------------------------
+//halDigitalRead()/halDigitalWrite() go through the Arduino core, which looks
+//the pin up in three flash tables and checks for a PWM timer on every call:
+//3.5-4.5 us each. The functions below map the pin number to its port register
+//and bit mask at compile time instead (halPinPort()/halPinMask() are
+//constexpr), so with a constant pin they reduce to a few instructions.
+//
+//    HalPortSnapshot in;
+//    halPortsRead(&in);                          //every PINx register, once
+//    clutch = halPinIn(&in, clutchPin) == LOW;   //constant port and mask
+//
+//    HalPortUpdate out;
+//    halPortUpdateBegin(&out);
+//    halPortUpdatePin(&out, sevenSeg0Pin, HIGH); //collects bits per port
+//    halPortUpdateCommit(&out);                  //one write per port touched
+//
+//halFastRead()/halFastWrite() do a single pin. None of these touch PWM
+//timers: keep halDigitalWrite() for pins that may also see halAnalogWrite().
+//Pin modes are still set with halPinMode().
+
+#ifndef HAL_PORTS_H
+#define HAL_PORTS_H
+
+#include "hal.h"
+
+const uint8_t HAL_PORT_A = 0;
+const uint8_t HAL_PORT_B = 1;
+const uint8_t HAL_PORT_C = 2;
+const uint8_t HAL_PORT_D = 3;
+const uint8_t HAL_PORT_E = 4;
+const uint8_t HAL_PORT_F = 5;
+const uint8_t HAL_PORT_G = 6;
+const uint8_t HAL_PORT_H = 7;
+const uint8_t HAL_PORT_J = 8;
+const uint8_t HAL_PORT_K = 9;
+const uint8_t HAL_PORT_L = 10;
+const uint8_t HAL_PORTS  = 11;
+
+const uint8_t HAL_PORT_PINS = 70;           //digital 0-53, analog A0-A15 = 54-69
+
+//Mega 2560 pin number -> port, same mapping as the core's pins_arduino.h
+constexpr uint8_t HAL_PIN_PORT_TABLE[HAL_PORT_PINS] = {
+    HAL_PORT_E, HAL_PORT_E, HAL_PORT_E, HAL_PORT_E, HAL_PORT_G, HAL_PORT_E, HAL_PORT_H, HAL_PORT_H,  // 0- 7
+    HAL_PORT_H, HAL_PORT_H, HAL_PORT_B, HAL_PORT_B, HAL_PORT_B, HAL_PORT_B, HAL_PORT_J, HAL_PORT_J,  // 8-15
+    HAL_PORT_H, HAL_PORT_H, HAL_PORT_D, HAL_PORT_D, HAL_PORT_D, HAL_PORT_D, HAL_PORT_A, HAL_PORT_A,  //16-23
+    HAL_PORT_A, HAL_PORT_A, HAL_PORT_A, HAL_PORT_A, HAL_PORT_A, HAL_PORT_A, HAL_PORT_C, HAL_PORT_C,  //24-31
+    HAL_PORT_C, HAL_PORT_C, HAL_PORT_C, HAL_PORT_C, HAL_PORT_C, HAL_PORT_C, HAL_PORT_D, HAL_PORT_G,  //32-39
+    HAL_PORT_G, HAL_PORT_G, HAL_PORT_L, HAL_PORT_L, HAL_PORT_L, HAL_PORT_L, HAL_PORT_L, HAL_PORT_L,  //40-47
+    HAL_PORT_L, HAL_PORT_L, HAL_PORT_B, HAL_PORT_B, HAL_PORT_B, HAL_PORT_B, HAL_PORT_F, HAL_PORT_F,  //48-55
+    HAL_PORT_F, HAL_PORT_F, HAL_PORT_F, HAL_PORT_F, HAL_PORT_F, HAL_PORT_F, HAL_PORT_K, HAL_PORT_K,  //56-63
+    HAL_PORT_K, HAL_PORT_K, HAL_PORT_K, HAL_PORT_K, HAL_PORT_K, HAL_PORT_K,                          //64-69
+};
+
+//Mega 2560 pin number -> bit number within its port
+constexpr uint8_t HAL_PIN_BIT_TABLE[HAL_PORT_PINS] = {
+    0, 1, 4, 5, 5, 3, 3, 4,   5, 6, 4, 5, 6, 7, 1, 0,   //  0-15
+    1, 0, 3, 2, 1, 0, 0, 1,   2, 3, 4, 5, 6, 7, 7, 6,   // 16-31
+    5, 4, 3, 2, 1, 0, 7, 2,   1, 0, 7, 6, 5, 4, 3, 2,   // 32-47
+    1, 0, 3, 2, 1, 0, 0, 1,   2, 3, 4, 5, 6, 7, 0, 1,   // 48-63
+    2, 3, 4, 5, 6, 7,                                   // 64-69
+};
+
+constexpr uint8_t halPinPort(uint8_t pin) {return HAL_PIN_PORT_TABLE[pin];}
+constexpr uint8_t halPinMask(uint8_t pin) {return (uint8_t)(1 << HAL_PIN_BIT_TABLE[pin]);}
+
+struct HalPortSnapshot {
+    uint8_t value[HAL_PORTS];               //PINx of every port
+};
+
+struct HalPortUpdate {
+    uint8_t mask[HAL_PORTS];                //Bits to write
+    uint8_t value[HAL_PORTS];               //Their new levels
+};
+
+inline int halPinIn(const HalPortSnapshot* in, uint8_t pin)
+{
+    return (in->value[halPinPort(pin)] & halPinMask(pin)) ? HIGH : LOW;
+}
+
+inline void halPortUpdateBegin(HalPortUpdate* out)
+{
+    memset(out, 0, sizeof(*out));
+}
+
+inline void halPortUpdatePin(HalPortUpdate* out, uint8_t pin, uint8_t value)
+{
+    uint8_t port = halPinPort(pin), mask = halPinMask(pin);
+    out->mask[port] |= mask;
+    if (value) out->value[port] |=  mask;
+    else       out->value[port] &= ~mask;
+}
+
+#ifdef ARDUINO
+
+//Register addresses, folded to constants when the port is
+inline volatile uint8_t* halPortInputRegister(uint8_t port)
+{
+    switch (port) {
+    case HAL_PORT_A: return &PINA;  case HAL_PORT_B: return &PINB;  case HAL_PORT_C: return &PINC;
+    case HAL_PORT_D: return &PIND;  case HAL_PORT_E: return &PINE;  case HAL_PORT_F: return &PINF;
+    case HAL_PORT_G: return &PING;  case HAL_PORT_H: return &PINH;  case HAL_PORT_J: return &PINJ;
+    case HAL_PORT_K: return &PINK;  default:         return &PINL;
+    }
+}
+
+inline volatile uint8_t* halPortOutputRegister(uint8_t port)
+{
+    switch (port) {
+    case HAL_PORT_A: return &PORTA; case HAL_PORT_B: return &PORTB; case HAL_PORT_C: return &PORTC;
+    case HAL_PORT_D: return &PORTD; case HAL_PORT_E: return &PORTE; case HAL_PORT_F: return &PORTF;
+    case HAL_PORT_G: return &PORTG; case HAL_PORT_H: return &PORTH; case HAL_PORT_J: return &PORTJ;
+    case HAL_PORT_K: return &PORTK; default:         return &PORTL;
+    }
+}
+
+inline void halPortsRead(HalPortSnapshot* in)
+{
+    in->value[HAL_PORT_A] = PINA;  in->value[HAL_PORT_B] = PINB;  in->value[HAL_PORT_C] = PINC;
+    in->value[HAL_PORT_D] = PIND;  in->value[HAL_PORT_E] = PINE;  in->value[HAL_PORT_F] = PINF;
+    in->value[HAL_PORT_G] = PING;  in->value[HAL_PORT_H] = PINH;  in->value[HAL_PORT_J] = PINJ;
+    in->value[HAL_PORT_K] = PINK;  in->value[HAL_PORT_L] = PINL;
+}
+
+//Ports H, J, K and L are outside the sbi/cbi range, so the read-modify-write
+//runs with interrupts off in case an ISR writes the same port
+inline void halPortUpdateCommit(const HalPortUpdate* out)
+{
+    uint8_t sreg = SREG;
+    cli();
+    for (uint8_t port = 0; port < HAL_PORTS; port++) {
+        if (!out->mask[port]) continue;
+        volatile uint8_t* reg = halPortOutputRegister(port);
+        *reg = (*reg & ~out->mask[port]) | out->value[port];
+    }
+    SREG = sreg;
+}
+
+inline int halFastRead(uint8_t pin)
+{
+    return (*halPortInputRegister(halPinPort(pin)) & halPinMask(pin)) ? HIGH : LOW;
+}
+
+inline void halFastWrite(uint8_t pin, uint8_t value)
+{
+    volatile uint8_t* reg = halPortOutputRegister(halPinPort(pin));
+    uint8_t sreg = SREG;
+    cli();
+    if (value) *reg |=  halPinMask(pin);
+    else       *reg &= ~halPinMask(pin);
+    SREG = sreg;
+}
+
+#else
+
+//host/hal_host.cpp
+void halPortsRead(HalPortSnapshot* in);
+void halPortUpdateCommit(const HalPortUpdate* out);
+int  halFastRead(uint8_t pin);
+void halFastWrite(uint8_t pin, uint8_t value);
+
+#endif
+
+#endif
@@ -0,0 +1,59 @@
+//------------------------------------------------------------------------------
+// bench: host benchmarks of the firmware's building blocks
+//------------------------------------------------------------------------------
+//
+//    bench            run every benchmark
+//    bench name...    run the named ones
+//    bench -l         list them
+
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+volatile uint32_t benchSink;
+
+struct Benchmark {
+    const char* name;
+    const char* about;
+    void      (*run)();
+};
+
+static const Benchmark benchmarks[] = {
+    {"frame",  "binary telemetry frames against the ASCII <ID=value> encoder", benchFrame},
+    {"uplink", "uplink command parser throughput, valid, corrupted and random streams", benchUplink},
+    {"ports",  "digital I/O through the Arduino core against direct port registers", benchPorts},
+    {"sensor", "sensor calibration table lookups against the map() calls they replaced", benchSensor},
+    {"logger", "control task timing with the SD card data logger writing every cycle", benchLogger},
+    {"telemetry", "radio use on a simulated lap, channels sent every period against deadbands", benchTelemetry},
+    {"delta",  "delta frames against plain frames on a simulated lap, size and encode time", benchDelta},
+    {"fixed",  "fixed-point math against double, and against the float and map() code it replaced", benchFixed},
+    {"maps",   "throttle and torque map lookups, and loading a mode's maps from EEPROM", benchMaps},
+    {"launch", "boost button to Kelly PWM latency, launch task against the control and output tasks", benchLaunch},
+    {"slip",   "wheel slip estimate against the plant's on dry and wet laps, traction control, cost", benchSlip},
+    {"gear",   "gear detection on a replayed lap with sensor noise, against the nearest step decode", benchGear},
+    {"conditioning", "switch debouncing and analog filters on a replayed lap with chatter and noise, cost", benchConditioning},
+    {"safety", "safety monitor fault to output latency, main loop running and stalled, hysteresis, cost", benchSafety},
+    {"watchdog", "hung and starved tasks caught by the watchdog supervisor, its record after the reset, cost", benchWatchdog},
+    {"params", "parameter store: tuning over the radio, background EEPROM saves, power cuts, wear", benchParams},
+    {"reed",   "wheel pulses landing while the control task reads its inputs: late stamps, speed dropouts", benchReed},
+};
+const int BENCHMARKS = sizeof(benchmarks) / sizeof(benchmarks[0]);
+
+int main(int argc, char** argv)
+{
+    if (argc == 2 && strcmp(argv[1], "-l") == 0) {
+        for (int b = 0; b < BENCHMARKS; b++) printf("%-12s %s\n", benchmarks[b].name, benchmarks[b].about);
+        return 0;
+    }
+
+    for (int b = 0; b < BENCHMARKS; b++) {
+        bool selected = (argc == 1);
+        for (int a = 1; a < argc; a++) selected |= strcmp(argv[a], benchmarks[b].name) == 0;
+        if (!selected) continue;
+        printf("== %s: %s\n", benchmarks[b].name, benchmarks[b].about);
+        benchmarks[b].run();
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,45 @@
+//------------------------------------------------------------------------------
+// Host benchmarks
+//------------------------------------------------------------------------------
+//Each benchmark is a function registered in the table in bench.cpp. They
+//report host timings and, where the firmware's cost on the Mega matters,
+//virtual clock cycles from the host HAL's cost model.
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <stdint.h>
+
+//Keeps the compiler from optimizing a benchmarked result away
+extern volatile uint32_t benchSink;
+
+//Host nanoseconds per call of f(), over the given number of calls
+template <class F>
+double benchNanos(long calls, F f)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (long i = 0; i < calls; i++) f(i);
+    std::chrono::duration<double, std::nano> spent = std::chrono::steady_clock::now() - start;
+    return spent.count() / calls;
+}
+
+void benchFrame();
+void benchUplink();
+void benchPorts();
+void benchSensor();
+void benchLogger();
+void benchTelemetry();
+void benchDelta();
+void benchFixed();
+void benchMaps();
+void benchLaunch();
+void benchSlip();
+void benchGear();
+void benchConditioning();
+void benchSafety();
+void benchWatchdog();
+void benchParams();
+void benchReed();
+
+#endif
@@ -0,0 +1,232 @@
+//------------------------------------------------------------------------------
+// bench delta: delta frames against plain frames on a simulated lap
+//------------------------------------------------------------------------------
+//Records what goes out on the transceiver port during one simulated autocross
+//lap (plant.h), once with plain frames and once with delta frames, for both
+//channel setups of bench telemetry (every period, and the deadbands of the
+//channel table). The plant is deterministic, so both runs send the same
+//values; the bench checks that the delta stream decodes to exactly the values
+//of the plain one and reports the bytes saved.
+//
+//Then it times encoding and decoding the recorded frames both ways on the
+//host, and drops 2% of the delta frames at random to see how many values are
+//lost until each ID's next whole value.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+#include "telemetry_channels.h"
+#include "telemetry_frame.h"
+
+#include <stdio.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const int    MAX_ID = 40;
+const double STEP   = 0.001;
+const int    DROP_PERCENT = 2;
+
+struct Field {
+    uint8_t id;
+    int16_t value;
+};
+
+struct Frame {
+    uint8_t            sequence;
+    std::vector<Field> fields;
+};
+
+struct Stream {
+    double      seconds;
+    std::string bytes;
+};
+
+static uint32_t rng = 2024;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+//The lap in a child, so each run starts from the firmware's power-on state; the
+//transceiver bytes come back through a pipe
+static Stream record(bool everyPeriod, bool delta)
+{
+    Stream stream = {0, ""};
+    int fds[2];
+    if (pipe(fds) != 0) return stream;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        PlantConfig config;
+        config.mode           = PLANT_AUTOCROSS;
+        config.aggressiveness = 0.8;
+        config.soc            = 1;
+        config.fuel           = 4;
+        config.ambient        = 25;
+        config.grip           = PLANT_DRY_GRIP;
+        config.track          = plantDefaultTrack();
+
+        hostReset();
+        hostSetCostModel(false);
+        PlantState state;
+        plantBegin(&state, &config);
+        hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+        setup();
+        telemetryDelta = delta;
+        if (everyPeriod)
+            for (int id = 0; id <= MAX_ID; id++)
+                if (TelemetryChannel* c = telemetryChannelFind(id)) c->maxAgeMs = c->periodMs;
+
+        std::string out;
+        double length = plantTrackLength(&config);
+        while (state.distance < length && state.time < 300) {
+            for (int i = 0; i < 6; i++) loop();
+            plantStep(&state, &config, STEP);
+            hostAdvanceMicros((uint64_t)(STEP * 1e6));
+            out += hostSerialTakeOutput(1);
+        }
+        bool ok = write(fds[1], &state.time, sizeof(state.time)) == (ssize_t)sizeof(state.time) &&
+                  write(fds[1], out.data(), out.size()) == (ssize_t)out.size();
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        char buffer[4096];
+        ssize_t got = read(fds[0], &stream.seconds, sizeof(stream.seconds));
+        while (got > 0 && (got = read(fds[0], buffer, sizeof(buffer))) > 0) stream.bytes.append(buffer, got);
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    close(fds[0]);
+    return stream;
+}
+
+static std::vector<Frame> decode(const std::string& bytes, FrameDecoder* decoder)
+{
+    std::vector<Frame> frames;
+    frameDecoderReset(decoder);
+    for (size_t i = 0; i < bytes.size(); i++) {
+        if (!framePush(decoder, (uint8_t)bytes[i])) continue;
+        Frame f;
+        f.sequence = decoder->sequence;
+        for (uint8_t n = 0; n < decoder->fieldCount; n++) {
+            Field field = {decoder->ids[n], decoder->values[n]};
+            f.fields.push_back(field);
+        }
+        frames.push_back(f);
+    }
+    return frames;
+}
+
+static bool same(const std::vector<Frame>& a, const std::vector<Frame>& b)
+{
+    if (a.size() != b.size()) return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].sequence != b[i].sequence || a[i].fields.size() != b[i].fields.size()) return false;
+        for (size_t n = 0; n < a[i].fields.size(); n++)
+            if (a[i].fields[n].id != b[i].fields[n].id || a[i].fields[n].value != b[i].fields[n].value) return false;
+    }
+    return true;
+}
+
+//The bytes of each frame; the car's own stream has nothing between frames
+static std::vector<std::string> split(const std::string& bytes)
+{
+    std::vector<std::string> frames;
+    for (size_t start = 0; start + 1 < bytes.size(); start += frames.back().size())
+        frames.push_back(bytes.substr(start, (uint8_t)bytes[start + 1] + 4));
+    return frames;
+}
+
+static void compare(const char* name, bool everyPeriod)
+{
+    Stream plain = record(everyPeriod, false);
+    Stream delta = record(everyPeriod, true);
+    FrameDecoder plainDecoder, deltaDecoder;
+    std::vector<Frame> plainFrames = decode(plain.bytes, &plainDecoder);
+    std::vector<Frame> deltaFrames = decode(delta.bytes, &deltaDecoder);
+
+    unsigned long values = 0;
+    for (size_t i = 0; i < plainFrames.size(); i++) values += plainFrames[i].fields.size();
+    double seconds = plain.seconds;
+    printf("%-14s plain %6.1f bytes/s   delta %6.1f bytes/s   %4.1f%% of plain   %5.2f bytes/value against %4.2f   %s\n",
+           name, plain.bytes.size() / seconds, delta.bytes.size() / seconds,
+           100.0 * delta.bytes.size() / plain.bytes.size(),
+           (double)delta.bytes.size() / values, (double)plain.bytes.size() / values,
+           same(plainFrames, deltaFrames) && deltaDecoder.unresolved == 0 ? "same values" : "<-- DIFFERENT VALUES");
+
+    //Encode and decode the lap's frames again, both ways, timed on the host. The
+    //Mega's cycles are not measured here; counted by hand from the source for
+    //avr-gcc -Os, an estimate: deltaFrameAdd() ~190 for an unchanged value to ~355
+    //for a whole one, most of it in putBits(), whose shifts by a variable count are
+    //loops there, and frameAdd() ~40
+    long passes = 200;
+    TelemetryFrame frame;
+    DeltaEncoder encoder;
+    double plainEncode = benchNanos(passes, [&](long) {
+        for (size_t i = 0; i < plainFrames.size(); i++) {
+            frameBegin(&frame, plainFrames[i].sequence);
+            for (size_t n = 0; n < plainFrames[i].fields.size(); n++)
+                frameAdd(&frame, plainFrames[i].fields[n].id, plainFrames[i].fields[n].value);
+            frameEnd(&frame);
+            benchSink += frame.length;
+        }
+    }) / plainFrames.size();
+    double deltaEncode = benchNanos(passes, [&](long) {
+        deltaEncoderReset(&encoder);
+        for (size_t i = 0; i < plainFrames.size(); i++) {
+            deltaFrameBegin(&frame, plainFrames[i].sequence);
+            for (size_t n = 0; n < plainFrames[i].fields.size(); n++)
+                deltaFrameAdd(&frame, &encoder, plainFrames[i].fields[n].id, plainFrames[i].fields[n].value);
+            frameEnd(&frame);
+            benchSink += frame.length;
+        }
+    }) / plainFrames.size();
+    FrameDecoder decoder;
+    double plainDecode = benchNanos(passes, [&](long) {decode(plain.bytes, &decoder);}) / plainFrames.size();
+    double deltaDecode = benchNanos(passes, [&](long) {decode(delta.bytes, &decoder);}) / plainFrames.size();
+    printf("               encode %5.0f ns/frame plain, %5.0f delta   decode (with copying) %5.0f ns/frame plain, %5.0f delta\n",
+           plainEncode, deltaEncode, plainDecode, deltaDecode);
+
+    //Lose frames at random; what arrives must still decode to the values sent
+    std::vector<std::string> sent = split(delta.bytes);
+    std::string received;
+    unsigned long dropped = 0, deliveredValues = 0;
+    for (size_t i = 0; i < sent.size(); i++) {
+        if (random32() % 100 < (uint32_t)DROP_PERCENT) {dropped++; continue;}
+        received += sent[i];
+        deliveredValues += plainFrames[i].fields.size();
+    }
+    std::vector<Frame> got = decode(received, &decoder);
+    unsigned long gotValues = 0, wrong = 0;
+    size_t p = 0;
+    for (size_t i = 0; i < got.size(); i++) {
+        while (p < plainFrames.size() && plainFrames[p].sequence != got[i].sequence) p++;
+        if (p == plainFrames.size()) {wrong++; break;}
+        for (size_t n = 0; n < got[i].fields.size(); n++) {
+            bool found = false;
+            for (size_t k = 0; k < plainFrames[p].fields.size(); k++)
+                if (plainFrames[p].fields[k].id == got[i].fields[n].id)
+                    found = plainFrames[p].fields[k].value == got[i].fields[n].value;
+            if (!found) wrong++;
+        }
+        gotValues += got[i].fields.size();
+        p++;
+    }
+    printf("               %d%% frames lost (%lu): %lu of %lu values in the frames that arrived resolved, %lu unresolved, %lu wrong%s\n\n",
+           DROP_PERCENT, dropped, gotValues, deliveredValues, (unsigned long)decoder.unresolved, wrong,
+           wrong ? "  <-- FAILED" : "");
+}
+
+void benchDelta()
+{
+    compare("every period", true);
+    compare("deadbands", false);
+}
@@ -0,0 +1,154 @@
+//------------------------------------------------------------------------------
+// bench fixed: fixed-point math against double and the float code it replaced
+//------------------------------------------------------------------------------
+//Checks fixed.h against a double-precision reference on random operands, Q8
+//and Q16, with the largest error in steps of the format (a truncating
+//operation may be off by up to one step, saturation must hit the ends
+//exactly). Then compares the firmware's conversions with what they replaced:
+//
+//    throttle   fixedMap() against map() for every ADC count, servo and Kelly,
+//               and for every input span the throttle scale may be tuned to
+//    velocity   the integer division against the float formula for every reed
+//               period from 20 ms (above 100 mph) to 2 s
+//
+//and times both on the host. On the Mega the float velocity was two
+//int-float conversions, a float divide and a float multiply (roughly 1000
+//cycles in avr-libc); the integer version is one 32 bit division (about 600).
+//map() was a 32 bit multiply and division, fixedMap() two compares, a 16x32
+//multiply and a shift.
+
+#include "bench.h"
+#include "fixed.h"
+#include "hal.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static uint32_t rng = 2024;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+//Same constants as arduino.c
+const int  THROTTLE_SCALE_MIN = 555;
+const int  THROTTLE_SCALE_MAX = 602;
+const int  THROTTLE_SCALE_SPAN_MAX = 255;
+const int  SERVO_MIN_ANGLE    = 0;
+const int  SERVO_MAX_ANGLE    = 160;
+const int  FULL               = 255;
+const float WHEEL_CIRCUMFERENCE_FLOAT = 66;
+const float VELOCITY_SCALAR_FLOAT     = 56.82;
+const uint32_t VELOCITY_DIVIDEND      = 66L * 5682 * 1000 / 100;
+
+static const FixedMap THROTTLE_TO_SERVO = FIXED_MAP(THROTTLE_SCALE_MIN, THROTTLE_SCALE_MAX, SERVO_MIN_ANGLE, SERVO_MAX_ANGLE);
+static const FixedMap THROTTLE_TO_KELLY = FIXED_MAP(THROTTLE_SCALE_MIN, THROTTLE_SCALE_MAX, 0, FULL);
+
+//Largest difference from the reference, in steps of 2^-FRAC
+template <uint8_t FRAC>
+static void accuracy(const char* name)
+{
+    const int ROUNDS = 1000000;
+    double step = ldexp(1.0, -FRAC);
+    double worstAdd = 0, worstMul = 0, worstScale = 0, worstReciprocal = 0;
+    long saturations = 0, wrongSaturations = 0;
+    for (int i = 0; i < ROUNDS; i++) {
+        //Operands over the whole range and, half the time, small ones where the products fit
+        int32_t ra = (int32_t)random32(), rb = (int32_t)random32();
+        if (i & 1) {ra >>= 12; rb >>= 12;}
+        Fixed<FRAC> a = fixedRaw<FRAC>(ra), b = fixedRaw<FRAC>(rb);
+        double da = ra * step, db = rb * step;
+        double high = FIXED_RAW_MAX * step, low = FIXED_RAW_MIN * step;
+
+        double sum = da + db, difference = da - db, product = da * db;
+        double got[3] = {fixedAdd(a, b).raw * step, fixedSub(a, b).raw * step, fixedMul(a, b).raw * step};
+        double want[3] = {sum, difference, product};
+        for (int k = 0; k < 3; k++) {
+            if (want[k] > high || want[k] < low) {
+                saturations++;
+                if (got[k] != (want[k] > high ? high : low)) wrongSaturations++;
+                continue;
+            }
+            double error = fabs(got[k] - want[k]) / step;
+            if (k < 2 && error > worstAdd) worstAdd = error;
+            if (k == 2 && error > worstMul) worstMul = error;
+        }
+
+        int16_t value = (int16_t)random32();
+        double scaled = value * da;
+        if (scaled <= FIXED_RAW_MAX && scaled >= FIXED_RAW_MIN) {
+            double error = fabs(fixedScale(value, a) - floor(scaled));
+            if (error > worstScale) worstScale = error;
+        }
+
+        int32_t divisor = 1 + random32() % 1000;
+        double error = fabs(fixedReciprocal<FRAC>(divisor).raw * step - 1.0 / divisor) / step;
+        if (error > worstReciprocal) worstReciprocal = error;
+    }
+    printf("%-4s add/sub %.2f  mul %.2f  scale %.2f  reciprocal %.2f steps off at most   %ld saturations, %ld wrong%s\n",
+           name, worstAdd, worstMul, worstScale, worstReciprocal, saturations, wrongSaturations,
+           wrongSaturations || worstAdd > 0 || worstMul >= 1 || worstScale >= 1 || worstReciprocal >= 1 ? "  <-- FAILED" : "");
+}
+
+static long mapDifferences(const FixedMap& m)
+{
+    long differences = 0;
+    for (int adc = 0; adc < 1024; adc++) {
+        long expected;
+        if (adc < m.inMin) expected = m.outMin;
+        else if (adc > m.inMax) expected = m.outMax;
+        else expected = (long)(adc - m.inMin) * (m.outMax - m.outMin) / (m.inMax - m.inMin) + m.outMin;
+        if (fixedMap(m, adc) != expected) differences++;
+    }
+    return differences;
+}
+
+static int floatVelocity(uint32_t period)
+{
+    return (WHEEL_CIRCUMFERENCE_FLOAT / (period / 1000.0)) * VELOCITY_SCALAR_FLOAT;
+}
+
+void benchFixed()
+{
+    accuracy<8>("Q8");
+    accuracy<16>("Q16");
+    printf("\n");
+
+    printf("throttle   servo %ld, Kelly %ld of 1024 ADC counts differ from map()\n",
+           mapDifferences(THROTTLE_TO_SERVO), mapDifferences(THROTTLE_TO_KELLY));
+
+    //Tuned over telemetry the scale can sit anywhere in 0-1023, up to
+    //THROTTLE_SCALE_SPAN_MAX wide; only the span matters to the rounding
+    long tuned = 0, wider = 0;
+    for (int span = 1; span <= 1023; span++) {
+        long d = mapDifferences(fixedMapMake(0, span, SERVO_MIN_ANGLE, SERVO_MAX_ANGLE)) +
+                 mapDifferences(fixedMapMake(0, span, 0, FULL));
+        if (span <= THROTTLE_SCALE_SPAN_MAX) tuned += d;
+        else wider += d;
+    }
+    printf("           spans 1-%d: %ld differences from map(), spans %d-1023: %ld\n",
+           THROTTLE_SCALE_SPAN_MAX, tuned, THROTTLE_SCALE_SPAN_MAX + 1, wider);
+
+    long differences = 0, periods = 0, worst = 0;
+    for (uint32_t period = 20000; period <= 2000000; period++, periods++) {
+        long difference = labs((long)(VELOCITY_DIVIDEND / period) - floatVelocity(period));
+        if (difference) differences++;
+        if (difference > worst) worst = difference;
+    }
+    printf("velocity   %ld of %ld reed periods differ from the float formula, by %ld mph at most\n\n",
+           differences, periods, worst);
+
+    const long CALLS = 10 << 20;
+    double mapped = benchNanos(CALLS, [](long i) {
+        benchSink += map(THROTTLE_SCALE_MIN - 10 + (i & 63), THROTTLE_SCALE_MIN, THROTTLE_SCALE_MAX, 0, FULL);
+    });
+    double fixed  = benchNanos(CALLS, [](long i) {benchSink += fixedMap(THROTTLE_TO_KELLY, THROTTLE_SCALE_MIN - 10 + (i & 63));});
+    printf("throttle   map() %5.2f ns   fixedMap() %5.2f ns\n", mapped, fixed);
+    double floats   = benchNanos(CALLS, [](long i) {benchSink += floatVelocity(20000 + i);});
+    double integers = benchNanos(CALLS, [](long i) {benchSink += VELOCITY_DIVIDEND / (uint32_t)(20000 + i);});
+    printf("velocity   float %5.2f ns   integer %5.2f ns\n", floats, integers);
+}
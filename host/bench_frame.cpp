@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// bench frame: binary telemetry frames against the ASCII encoder
+//------------------------------------------------------------------------------
+
+#include "bench.h"
+#include "telemetry_frame.h"
+
+#include <stdio.h>
+
+//The <ID=value,...> encoder the binary frames replaced, kept as the reference
+struct AsciiFrame {
+    char buffer[128];
+    int  length;
+};
+
+static void asciiBegin(AsciiFrame* f)
+{
+    f->buffer[0] = '<';
+    f->length = 1;
+}
+
+static void asciiAdd(AsciiFrame* f, int value, int id)
+{
+    if (f->length > 1) f->buffer[f->length++] = ',';
+    char c[10];
+    itoa(id, c, 10);
+    for (int k = 0; c[k]; k++) f->buffer[f->length++] = c[k];
+    f->buffer[f->length++] = '=';
+    itoa(value, c, 10);
+    for (int k = 0; c[k]; k++) f->buffer[f->length++] = c[k];
+}
+
+static void asciiEnd(AsciiFrame* f)
+{
+    f->buffer[f->length++] = '>';
+    f->buffer[f->length++] = '\n';
+}
+
+//A short interval frame and a short+long interval frame, as runCommunication() sends them
+struct Field {int id; int value;};
+static const Field shortFields[] = {{0, 37}, {3, 2875}, {5, 0}, {6, 0}, {7, 119}};
+static const Field longFields[]  = {{0, 37}, {3, 2875}, {5, 0}, {6, 0}, {7, 119},
+                                    {1, 204}, {10, 0}, {9, 0}, {2, 0}, {13, 2}};
+
+static void compare(const char* name, const Field* fields, int count)
+{
+    const long calls = 2000000;
+
+    AsciiFrame ascii;
+    double asciiNs = benchNanos(calls, [&](long i) {
+        asciiBegin(&ascii);
+        for (int k = 0; k < count; k++) asciiAdd(&ascii, fields[k].value + (int)(i & 1), fields[k].id);
+        asciiEnd(&ascii);
+        benchSink += ascii.length;
+    });
+
+    TelemetryFrame frame;
+    double binaryNs = benchNanos(calls, [&](long i) {
+        frameBegin(&frame, (uint8_t)i);
+        for (int k = 0; k < count; k++) frameAdd(&frame, fields[k].id, fields[k].value + (int)(i & 1));
+        frameEnd(&frame);
+        benchSink += frame.length;
+    });
+
+    FrameDecoder decoder;
+    frameDecoderReset(&decoder);
+    double decodeNs = benchNanos(calls, [&](long) {
+        for (int b = 0; b < frame.length; b++) benchSink += framePush(&decoder, frame.bytes[b]);
+    });
+
+    //8N1: 10 bits per byte
+    printf("%-6s %2d fields  ascii %3d bytes %6.2f ms at 9600  encode %6.1f ns\n",
+           name, count, ascii.length, ascii.length * 10 / 9.6, asciiNs);
+    printf("%-6s %2d fields  frame %3d bytes %6.2f ms at 9600  encode %6.1f ns  decode %6.1f ns  (%.0f%% of ascii bytes)\n",
+           name, count, frame.length, frame.length * 10 / 9.6, binaryNs, decodeNs,
+           100.0 * frame.length / ascii.length);
+}
+
+void benchFrame()
+{
+    compare("short", shortFields, sizeof(shortFields) / sizeof(shortFields[0]));
+    compare("long",  longFields,  sizeof(longFields)  / sizeof(longFields[0]));
+}
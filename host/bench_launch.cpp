@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// bench launch: boost button to Kelly PWM latency
+//------------------------------------------------------------------------------
+//Runs the firmware on the host HAL's cost model, standing in autocross with
+//telemetry on and a card in the data logger, presses a button at random
+//times and measures on the virtual clock how long the Kelly PWM pin takes to
+//follow: to full when pressed, back to 0 when let go. The boost button goes
+//through launchTask(); the assist button, for comparison, through the
+//control task and the next output task as before.
+//
+//A change is timed when the loop() call that wrote the pin returns, so the
+//rest of that task is counted too. Not counted: the Kelly's PWM timer picks a
+//new duty cycle up at the end of its period on the car, up to another 2 ms
+//at ~490 Hz on pin 3.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+#include "profiler.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const int      PRESSES     = 200;
+const uint64_t SETTLE_US   = 500000;
+const uint64_t TIMEOUT_US  = 100000;
+
+static uint32_t rng = 2027;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+static void report(const char* what, std::vector<uint64_t>& us)
+{
+    std::sort(us.begin(), us.end());
+    printf("  %-8s min %5lu  median %5lu  p99 %5lu  max %5lu us\n", what, (unsigned long)us.front(),
+           (unsigned long)us[us.size() / 2], (unsigned long)us[us.size() * 99 / 100], (unsigned long)us.back());
+}
+
+//Press at a random time 20-40 ms ahead, then loop() until the Kelly pin shows it
+static uint64_t react(uint8_t pin, int level, bool full)
+{
+    uint64_t at = hostNowMicros() + 20000 + random32() % 20000;
+    hostSchedulePin(at, pin, level);
+    while ((hostPinOutput(PLANT_KELLY_PIN) == 255) != full && hostNowMicros() < at + TIMEOUT_US) loop();
+    return hostNowMicros() - at;
+}
+
+//In a child, so setup() starts from the firmware's power-on state
+static void run(const char* name, uint8_t button)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        int status;
+        if (pid > 0) waitpid(pid, &status, 0);
+        return;
+    }
+    hostReset();
+    hostSetCostModel(true);
+    hostSetPin(PLANT_BOOST_PIN,     LOW);   //both buttons read HIGH when pressed
+    hostSetPin(PLANT_ASSIST_PIN,    LOW);
+    hostSetPin(PLANT_KELLY_ENABLE,  LOW);
+    hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+    hostSetPin(PLANT_THROTTLE_PIN,  550);   //released, and the radiator at 150 F: in range for the safety monitor
+    hostSetPin(PLANT_RADIATOR_PIN,  512);
+    setup();
+    while (hostNowMicros() < SETTLE_US) loop();
+    profilerReset();
+
+    std::vector<uint64_t> press, release;
+    for (int i = 0; i < PRESSES; i++) {
+        press.push_back(react(button, HIGH, true));
+        release.push_back(react(button, LOW, false));
+    }
+    printf("%s\n", name);
+    report("press", press);
+    report("release", release);
+
+    ProfileStats control, task;
+    profilerStats(PROFILE_CONTROL_PERIOD, &control);
+    profilerStats(PROFILE_LAUNCH, &task);
+    printf("  control period max %lu us, launch task p99 %lu max %lu us\n", (unsigned long)control.max,
+           (unsigned long)task.p99, (unsigned long)task.max);
+    fflush(stdout);
+    _exit(0);
+}
+
+void benchLaunch()
+{
+    char path[] = "/tmp/bench_cardXXXXXX";
+    int  fd = mkstemp(path);
+    if (fd < 0) {perror("bench launch"); return;}
+    close(fd);
+    hostStorageOpen(path);
+
+    run("boost button, launch task", PLANT_BOOST_PIN);
+    run("assist button, control and output tasks", PLANT_ASSIST_PIN);
+
+    hostStorageClose();
+    unlink(path);
+}
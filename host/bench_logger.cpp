@@ -0,0 +1,75 @@
+//------------------------------------------------------------------------------
+// bench logger: control task timing with and without the SD card data logger
+//------------------------------------------------------------------------------
+//Runs the firmware on the host HAL's cost model for a few virtual seconds,
+//once without a card and once with one, and compares the control task's
+//period (start to start, from the profiler) and what the logger's slices
+//cost. The card model takes 20 cycles per SPI byte and 1.5 ms to program a
+//block (hal_host.cpp). Then times the host decoder on the card written.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "logger.h"
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const uint64_t RUN_MICROS = 5000000;
+
+//In a child, so setup() starts from the firmware's power-on state
+static void run(const char* name)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        int status;
+        if (pid > 0) waitpid(pid, &status, 0);
+        return;
+    }
+    hostReset();
+    hostSetPin(A1, 550);    //throttle released, radiator at 150 F: in range for the safety monitor
+    hostSetPin(A3, 512);
+    setup();
+    while (hostNowMicros() < RUN_MICROS) loop();
+
+    ProfileStats period, logger;
+    profilerStats(PROFILE_CONTROL_PERIOD, &period);
+    profilerStats(PROFILE_LOGGER, &logger);
+    printf("%-10s control period min %4lu  p99 %4lu  max %4lu us", name, (unsigned long)period.min,
+           (unsigned long)period.p99, (unsigned long)period.max);
+    if (logActive())
+        printf("   logger slice p99 %3lu max %3lu us, %lu records in %lu blocks, %lu dropped", (unsigned long)logger.p99,
+               (unsigned long)logger.max, (unsigned long)(period.count + 1),
+               (unsigned long)((period.count + 1) / LOG_RECORDS_PER_BLOCK), (unsigned long)logDropped());
+    printf("\n");
+    fflush(stdout);
+    _exit(0);
+}
+
+void benchLogger()
+{
+    hostSetCostModel(true);
+    hostStorageClose();
+    run("no card");
+
+    char path[] = "/tmp/bench_cardXXXXXX";
+    int  fd = mkstemp(path);
+    if (fd < 0) {perror("bench logger"); return;}
+    close(fd);
+    hostStorageOpen(path);
+    run("card");
+    hostStorageClose();
+    printf("\n");
+
+    //The host decoder on what was just written
+    char command[128];
+    snprintf(command, sizeof(command), "build/log_decode %s > /dev/null", path);
+    printf("log_decode to CSV: ");
+    fflush(stdout);
+    if (system(command) != 0) printf("(build/log_decode not found, run from host/)\n");
+    unlink(path);
+}
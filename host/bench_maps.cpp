@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// bench maps: throttle and torque map lookups and loads
+//------------------------------------------------------------------------------
+//Times throttleMapLookup() on the host over random rpm, velocity and pedal
+//values, and counts on the host HAL's virtual clock what loading a mode's
+//two maps from EEPROM costs the control cycle it happens in.
+//
+//The virtual clock only charges HAL calls, not the arithmetic. Counted by
+//hand from the code, a lookup on the Mega is about 300 cycles: the two
+//axis searches are 32 bit subtractions and compares with shift loops (up to
+//~130 cycles for the rpm axis), the interpolation four 16 bit and two
+//16x16->32 bit multiplies on the hardware multiplier. The worst control
+//cycle does two lookups, servo and Kelly, about 40 us of its 1000 us.
+
+#include "bench.h"
+#include "hal_host.h"
+#include "telemetry_frame.h"
+#include "throttle_map.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t rng = 2024;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+//Control period and the Mega's clock, as in arduino.c
+const double CONTROL_PERIOD_US = 1000;
+const double CYCLES_PER_US     = 16;
+const double LOOKUP_CYCLES     = 300;   //hand count, see above
+
+void benchMaps()
+{
+    ThrottleMap servo = {{0, 9}, {0, 5}, {{0}}};
+    ThrottleMap kelly = {{0, 3}, {0, 5}, {{0}}};
+    for (int y = 0; y < MAP_POINTS; y++)
+        for (int x = 0; x < MAP_POINTS; x++) {
+            servo.cells[y][x] = y * 20;
+            kelly.cells[y][x] = y * 31;
+        }
+
+    const long CALLS = 10 << 20;
+    static int16_t rpm[1024], velocity[1024], pedal[1024];
+    for (int i = 0; i < 1024; i++) {
+        rpm[i]      = random32() % 5000;
+        velocity[i] = random32() % 70;
+        pedal[i]    = random32() % 256;
+    }
+    double servoNs = benchNanos(CALLS, [&](long i) {benchSink += throttleMapLookup(&servo, rpm[i & 1023], pedal[i & 1023]);});
+    double kellyNs = benchNanos(CALLS, [&](long i) {benchSink += throttleMapLookup(&kelly, velocity[i & 1023], pedal[i & 1023]);});
+    printf("lookup      servo %5.2f ns   kelly %5.2f ns on the host\n", servoNs, kellyNs);
+
+    //A valid store in EEPROM, set back to erased at the end for the other benchmarks
+    uint8_t image[MAP_STORE_BYTES] = {'Y', 'M', MAP_VERSION, MAP_COUNT};
+    for (int i = 0; i < MAP_COUNT; i++)
+        throttleMapEncode(i % 2 == MAP_SERVO ? &servo : &kelly, image + MAP_HEADER_BYTES + i * MAP_RECORD_BYTES);
+    uint16_t crc = crc16(0xFFFF, image, MAP_HEADER_BYTES);
+    for (int i = 0; i < MAP_COUNT; i++) crc = crc16(crc, image + MAP_HEADER_BYTES + i * MAP_RECORD_BYTES, MAP_RECORD_BYTES);
+    image[MAP_STORE_BYTES - 2] = crc >> 8;
+    image[MAP_STORE_BYTES - 1] = crc & 0xFF;
+    hostReset();
+    hostSetCostModel(false);
+    halEepromWrite(MAP_EEPROM_ADDRESS, image, sizeof(image));
+
+    //A mode change: both maps of the new mode from EEPROM
+    hostSetCostModel(true);
+    uint64_t start = hostNowCycles();
+    throttleMapLoad(throttleMapIndex(1, MAP_SERVO), &servo);
+    throttleMapLoad(throttleMapIndex(1, MAP_KELLY), &kelly);
+    uint64_t load = hostNowCycles() - start;
+    start = hostNowCycles();
+    bool valid = throttleMapsCheck();
+    uint64_t check = hostNowCycles() - start;
+    memset(image, 0xFF, sizeof(image));
+    hostSetCostModel(false);
+    halEepromWrite(MAP_EEPROM_ADDRESS, image, sizeof(image));
+
+    printf("mode change %5lu cycles %6.1f us   %4.1f%% of a control period, once per mode change\n",
+           (unsigned long)load, load / CYCLES_PER_US, load / CYCLES_PER_US / CONTROL_PERIOD_US * 100);
+    printf("setup check %5lu cycles %6.1f us   EEPROM reads only, the CRC comes on top%s\n",
+           (unsigned long)check, check / CYCLES_PER_US, valid ? "" : "  <-- maps not valid");
+    printf("per cycle   2 lookups ~%.0f cycles %5.1f us   %4.1f%% of a control period (hand count)\n",
+           2 * LOOKUP_CYCLES, 2 * LOOKUP_CYCLES / CYCLES_PER_US, 2 * LOOKUP_CYCLES / CYCLES_PER_US / CONTROL_PERIOD_US * 100);
+}
@@ -0,0 +1,215 @@
+//------------------------------------------------------------------------------
+// bench params: the parameter store, over the radio and in EEPROM
+//------------------------------------------------------------------------------
+//Runs the firmware on the host HAL's cost model, standing with telemetry on,
+//and tunes the throttle pot's low end over the uplink: how long the answer
+//takes, a value refused by the bounds, the whole list, then the background
+//save: how long until it is in EEPROM and the longest task run meanwhile,
+//against writing the record in one halEepromWrite(). After a power cycle
+//the value has to be back.
+//
+//Then the store on its own: a power cut after every byte of a save, which
+//has to leave either the old or the new values, never a mix or the initial
+//ones, and the wear over many saves against a single fixed record.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+#include "telemetry_frame.h"
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const int SAVES = 1600;
+
+static void power()
+{
+    hostReset();
+    hostSetCostModel(true);
+    hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+    hostSetPin(PLANT_THROTTLE_PIN,  550);   //released, plausible to the safety monitor
+    hostSetPin(PLANT_RADIATOR_PIN,  512);
+}
+
+static void run(uint64_t us)
+{
+    uint64_t until = hostNowMicros() + us;
+    while (hostNowMicros() < until) loop();
+}
+
+//Sends a command, runs until a frame with the parameter state comes back.
+//Prints what it answered, returns the time it took, 0 for no answer
+static double ask(const char* command, const char* what)
+{
+    hostSerialTakeOutput(1);
+    uint64_t start = hostNowMicros();
+    hostSerialInject(1, command);
+
+    FrameDecoder decoder;
+    frameDecoderReset(&decoder);
+    int frames = 0, pairs = 0, state = -1, last[2] = {-1, -1};
+    uint64_t answered = 0;
+    while (hostNowMicros() < start + 500000) {
+        run(1000);
+        std::string out = hostSerialTakeOutput(1);
+        for (size_t i = 0; i < out.size(); i++) {
+            if (!framePush(&decoder, (uint8_t)out[i])) continue;
+            boolean answer = false;
+            for (int f = 0; f < decoder.fieldCount; f++) {
+                if (decoder.ids[f] == kTelemetryDataCommandParameter)      last[0] = decoder.values[f], pairs++;
+                if (decoder.ids[f] == kTelemetryDataCommandParameterValue) last[1] = decoder.values[f];
+                if (decoder.ids[f] == kTelemetryDataTypeParameterState)    state = decoder.values[f], answer = true;
+            }
+            if (!answer) continue;
+            frames++;
+            answered = hostNowMicros();
+        }
+        if (answered && hostNowMicros() > answered + 100000) break;
+    }
+    if (!answered) {
+        printf("  %-28s %-18s no answer\n", what, command);
+        return 0;
+    }
+    printf("  %-28s %-18s %d pairs in %d frames, last %d=%d, state %d, %5.1f ms\n",
+           what, command, pairs, frames, last[0], last[1], state, (answered - start) / 1000.0);
+    return (answered - start) / 1000.0;
+}
+
+static void overTheRadio()
+{
+    power();
+    setup();
+    run(200000);
+    printf("over the radio, throttle scale min %d at power on\n", param[PARAM_THROTTLE_SCALE_MIN]);
+    ask("<60=0,61=565>", "set it to 565");
+    ask("<60=0,61=700>", "700, over the scale's max");
+    ask("<60=0,61=-3>",  "-3, under its bounds");
+    ask("<60=0,61=300>", "300, a scale over 255 wide");
+    ask("<60=11,61=0>",  "limit velocity 0, a divisor");
+    ask("<62=2>",        "send all");
+
+    //The save, from the set on
+    hostSerialInject(1, "<60=0,61=560>");
+    uint64_t start = hostNowMicros();
+    uint16_t overruns = schedulerOverruns();
+    run(20000);
+    while (paramsState(&parameters) != PARAM_SAVED && hostNowMicros() < start + 5000000) run(1000);
+    uint64_t saved = hostNowMicros() - start;
+    WatchdogRecord after;
+    watchdogLastReset(&after);
+    printf("  saved %.0f ms after the set (%u ms delay, then a byte every 10 ms), %u scheduler overruns meanwhile,\n"
+           "  longest task run %lu us since setup()\n",
+           saved / 1000.0, PARAM_SAVE_DELAY, schedulerOverruns() - overruns, (unsigned long)after.longest);
+
+    //The same record in one write to an erased slot, as a save from the command would be
+    uint8_t record[PARAM_SLOT_BYTES];
+    halEepromRead(PARAM_EEPROM_ADDRESS, record, sizeof(record));
+    uint64_t cycles = hostNowCycles();
+    halEepromWrite(PARAM_EEPROM_ADDRESS + PARAM_SLOTS / 2 * PARAM_SLOT_BYTES, record, PARAM_HEADER_BYTES + 2 * PARAMS + 2);
+    printf("  the record in one halEepromWrite() instead: blocks %.1f ms\n", (hostNowCycles() - cycles) / 16000.0);
+
+    power();
+    uint64_t setupStart = hostNowCycles();
+    setup();
+    printf("  after a power cycle: throttle scale min %d, state %d, setup() %.1f ms\n",
+           param[PARAM_THROTTLE_SCALE_MIN], paramsState(&parameters), (hostNowCycles() - setupStart) / 16000.0);
+}
+
+//The store on its own, on a table like the sketch's
+static ParamSpec specs[PARAMS];
+static int16_t   values[PARAMS];
+
+static void storeBegin(ParamStore* store)
+{
+    paramsBegin(store, specs, values, PARAMS, 1);
+}
+
+static void saveAll(ParamStore* store, int16_t value, uint32_t* ms)
+{
+    for (uint8_t i = 0; i < PARAMS; i++) paramSet(store, i, value + i, *ms);
+    *ms += PARAM_SAVE_DELAY;
+    while (paramsState(store) != PARAM_SAVED) paramsService(store, (*ms)++);
+}
+
+static void powerCuts()
+{
+    ParamStore store;
+    uint32_t ms = 0;
+    uint8_t erased[PARAM_SLOTS * PARAM_SLOT_BYTES];
+    memset(erased, 0xFF, sizeof(erased));
+    hostReset();
+    hostSetCostModel(false);
+    halEepromWrite(PARAM_EEPROM_ADDRESS, erased, sizeof(erased));
+
+    for (uint8_t i = 0; i < PARAMS; i++) specs[i] = {0, -1000, 1000};
+    storeBegin(&store);
+
+    //Cut after k bytes of saving new values, over the old ones; then power on
+    int length = PARAM_HEADER_BYTES + 2 * PARAMS + 2;
+    int oldValues = 0, newValues = 0, other = 0;
+    for (int k = 0; k <= length; k++) {
+        storeBegin(&store);
+        saveAll(&store, 100 + k, &ms);
+        for (uint8_t i = 0; i < PARAMS; i++) paramSet(&store, i, 500 + k + i, ms);
+        ms += PARAM_SAVE_DELAY;
+        for (int b = 0; b < k; b++) paramsService(&store, ms++);
+
+        storeBegin(&store);
+        boolean isOld = true, isNew = true;
+        for (uint8_t i = 0; i < PARAMS; i++) {
+            isOld &= values[i] == 100 + k + i;
+            isNew &= values[i] == 500 + k + i;
+        }
+        if (isOld) oldValues++;
+        else if (isNew) newValues++;
+        else other++;
+    }
+    printf("\npower cut after each of the %d bytes of a save, and before: %d old values, %d new, %d anything else\n",
+           length + 1, oldValues, newValues, other);
+
+    //Wear: the most writes any byte got
+    static uint16_t writes[PARAM_SLOTS * PARAM_SLOT_BYTES];
+    uint8_t before[PARAM_SLOTS * PARAM_SLOT_BYTES], now[PARAM_SLOTS * PARAM_SLOT_BYTES];
+    memset(writes, 0, sizeof(writes));
+    for (int s = 0; s < SAVES; s++) {
+        halEepromRead(PARAM_EEPROM_ADDRESS, before, sizeof(before));
+        saveAll(&store, s % 2 ? 200 : -200, &ms);
+        halEepromRead(PARAM_EEPROM_ADDRESS, now, sizeof(now));
+        for (size_t i = 0; i < sizeof(now); i++) writes[i] += before[i] != now[i];
+    }
+    int most = 0;
+    for (int i = 0; i < PARAM_SLOTS * PARAM_SLOT_BYTES; i++) if (writes[i] > most) most = writes[i];
+    printf("%d saves: at most %d writes to one byte, a single record would take %d; at the 100000 writes\n"
+           "a byte is rated for, %d saves\n", SAVES, most, SAVES, 100000 / most * SAVES);
+
+    //Power-on load, all slots read
+    hostSetCostModel(true);
+    uint64_t cycles = hostNowCycles();
+    storeBegin(&store);
+    printf("paramsBegin() %.2f ms, once from setup()\n", (hostNowCycles() - cycles) / 16000.0);
+
+    hostSetCostModel(false);
+    halEepromWrite(PARAM_EEPROM_ADDRESS, erased, sizeof(erased));
+}
+
+void benchParams()
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        overTheRadio();
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    if (pid > 0) waitpid(pid, &status, 0);
+
+    //On the Mega the parameters cost the hot path ~32 cycles per control
+    //cycle, 0.2% of the CPU at 1 kHz, by hand for avr-gcc -Os: a parameter in
+    //each of the 6 compares is an lds pair (4 cycles) for an ldi pair (2), and
+    //each of the 2 throttle maps loads its FixedMap's 10 bytes from RAM (20)
+    //for immediates (10)
+    powerCuts();
+}
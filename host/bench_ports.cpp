@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+// bench ports: Arduino core pin calls against direct port register access
+//------------------------------------------------------------------------------
+//Counts Mega cycles on the host HAL's virtual clock for the digital I/O of one
+//pass of each task, done both ways:
+//
+//    inputs    the ten switches readInputs() reads every control cycle
+//    display   the eight seven segment bits
+//    relays    engine, high voltage and regen relays, critical LED, module sleep
+//
+//then times the firmware's own readInputs() and sevenSegOut(), and checks on
+//random pin levels that both ways read and write exactly the same bits.
+//
+//halPinIn() and halPortUpdatePin() are inline and cost nothing on the virtual
+//clock; with a constant pin they are two or three instructions on the Mega.
+//
+//None of this is measured on a Mega. Every figure is the cost model's
+//constants (hal_host.cpp) times the calls made: the inputs row is ten
+//COST_DIGITAL_READ against one COST_PORTS_READ, so its ratio is whatever
+//those constants say. On the car, the profiler's read inputs and display
+//stages (the profile dump over telemetry) time readInputs() and
+//sevenSegOut() with micros().
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "hal_ports.h"
+
+#include <stdio.h>
+
+static const uint8_t inputPins[]   = {22, 23, 24, 25, 28, 29, 30, 31, 34, 39};
+static const uint8_t displayPins[] = {44, 45, 46, 47, 40, 41, 42, 43};
+static const uint8_t relayPins[]   = {33, 35, 36, 37, 38};
+
+const int INPUTS  = sizeof(inputPins)   / sizeof(inputPins[0]);
+const int DISPLAY = sizeof(displayPins) / sizeof(displayPins[0]);
+const int RELAYS  = sizeof(relayPins)   / sizeof(relayPins[0]);
+
+
+static uint32_t rng = 2024;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+//Virtual cycles spent in f()
+template <class F>
+static uint64_t cycles(F f)
+{
+    uint64_t start = hostNowCycles();
+    f();
+    return hostNowCycles() - start;
+}
+
+//Runs per second of a task, from its period in the task table
+static int taskHz(void (*run)())
+{
+    int i = 0;
+    while (tasks[i].run != run) i++;
+    return 1000000 / tasks[i].periodMicros;
+}
+
+static void report(const char* name, uint64_t core, uint64_t ports, int hz)
+{
+    printf("%-8s %5lu cycles %6.1f us    %4lu cycles %5.1f us    %5.1fx   %6.1f ms/s saved at %d Hz\n",
+           name, (unsigned long)core, core / 16.0, (unsigned long)ports, ports / 16.0,
+           (double)core / ports, (core - ports) / 16.0 * hz / 1000.0, hz);
+}
+
+void benchPorts()
+{
+    hostReset();
+    for (int i = 0; i < DISPLAY; i++) halPinMode(displayPins[i], OUTPUT);
+    for (int i = 0; i < RELAYS; i++)  halPinMode(relayPins[i], OUTPUT);
+
+    int controlHz = taskHz(controlTask);
+    int outputHz  = taskHz(outputTask);
+    int displayHz = taskHz(sevenSegOut);
+
+    printf("host cost model, the constants in hal_host.cpp, not measured on a Mega\n");
+    printf("         Arduino core                 port registers\n");
+
+    uint64_t core = cycles([] {for (int i = 0; i < INPUTS; i++) benchSink += halDigitalRead(inputPins[i]);});
+    uint64_t fast = cycles([] {
+        HalPortSnapshot in;
+        halPortsRead(&in);
+        for (int i = 0; i < INPUTS; i++) benchSink += halPinIn(&in, inputPins[i]);
+    });
+    report("inputs", core, fast, controlHz);
+    uint64_t saved = (core - fast) * controlHz;
+
+    core = cycles([] {for (int i = 0; i < DISPLAY; i++) halDigitalWrite(displayPins[i], i & 1);});
+    fast = cycles([] {
+        HalPortUpdate out;
+        halPortUpdateBegin(&out);
+        for (int i = 0; i < DISPLAY; i++) halPortUpdatePin(&out, displayPins[i], i & 1);
+        halPortUpdateCommit(&out);
+    });
+    report("display", core, fast, displayHz);
+    saved += (core - fast) * displayHz;
+
+    core = cycles([] {for (int i = 0; i < RELAYS; i++) halDigitalWrite(relayPins[i], HIGH);});
+    fast = cycles([] {for (int i = 0; i < RELAYS; i++) halFastWrite(relayPins[i], HIGH);});
+    report("relays", core, fast, outputHz);
+    saved += (core - fast) * outputHz;
+
+    printf("total    %.1f ms of CPU time per second saved, by the model\n\n", saved / 16000.0);
+
+    //The firmware's own stages, with the ADC snapshot and everything else around the pins
+    printf("readInputs()   %5.1f us per control cycle, by the model\n", cycles(readInputs) / 16.0);
+    printf("sevenSegOut()  %5.1f us per display update, by the model\n\n", cycles(sevenSegOut) / 16.0);
+
+    //Both ways must see and drive the same levels
+    int mismatches = 0;
+    for (int round = 0; round < 10000; round++) {
+        for (int i = 0; i < INPUTS; i++) hostSetPin(inputPins[i], random32() & 1);
+        HalPortSnapshot in;
+        halPortsRead(&in);
+        for (int i = 0; i < INPUTS; i++) {
+            if (halPinIn(&in, inputPins[i]) != halDigitalRead(inputPins[i])) mismatches++;
+            if (halFastRead(inputPins[i])   != halDigitalRead(inputPins[i])) mismatches++;
+        }
+
+        uint8_t bits = (uint8_t)random32();
+        HalPortUpdate out;
+        halPortUpdateBegin(&out);
+        for (int i = 0; i < DISPLAY; i++) halPortUpdatePin(&out, displayPins[i], (bits >> i) & 1);
+        halPortUpdateCommit(&out);
+        for (int i = 0; i < DISPLAY; i++)
+            if (hostPinOutput(displayPins[i]) != ((bits >> i) & 1)) mismatches++;
+    }
+    printf("10000 random pin states, %d mismatches%s\n", mismatches, mismatches ? "  <-- FAILED" : "");
+}
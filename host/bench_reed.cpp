@@ -0,0 +1,94 @@
+//------------------------------------------------------------------------------
+// bench reed: wheel pulses that land while the control task reads its inputs
+//------------------------------------------------------------------------------
+//Runs the firmware on the host HAL's cost model, rolling at a steady 15 mph,
+//and puts every reed pulse a few us into a control cycle: 0 to 39 us after
+//controlTask() starts, one offset per revolution in turn. That is the window
+//in which readInputs() takes the time and drains the reed interrupt's
+//buffer, where a pulse can come out stamped after the time its record
+//carries.
+//
+//Reported: the pulses stamped after their record's time, the control cycles
+//that read 0 mph while the wheel turns at 15, and the longest of those
+//stretches.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const int      REVOLUTIONS = 400;
+const uint32_t PERIOD_US   = 250000;    //15 mph with the 66 inch wheel
+const int      OFFSETS     = 40;        //us into the control cycle
+const uint32_t PULSE_US    = 2000;      //the magnet passing the switch
+
+//Kept by the wrapped control task
+static void   (*original)();
+static uint64_t nextPulse;
+static int      pulses;
+static int      late, stopped, stretch, longest;
+
+static int taskIndex(void (*run)())
+{
+    int i = 0;
+    while (tasks[i].run != run) i++;
+    return i;
+}
+
+//The next pulse goes in at the start of the first control cycle it is due
+//in, its offset after the cycle's start
+static void pulsingControl()
+{
+    uint64_t now = hostNowMicros();
+    if (now >= nextPulse && pulses < REVOLUTIONS) {
+        uint64_t at = now + pulses % OFFSETS;
+        hostSchedulePin(at, PLANT_REED_PIN, LOW);
+        hostSchedulePin(at + PULSE_US, PLANT_REED_PIN, HIGH);
+        nextPulse += PERIOD_US;
+        pulses++;
+    }
+    original();
+
+    for (uint8_t i = 0; i < controlInputs.reedCount; i++)
+        if ((int32_t)(controlInputs.reed[i] - controlInputs.time) > 0) late++;
+
+    //From the fourth pulse on the speed is known
+    if (pulses < 4) return;
+    if (velocity == 0) {
+        stopped++;
+        if (++stretch > longest) longest = stretch;
+    }
+    else stretch = 0;
+}
+
+void benchReed()
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        hostReset();
+        hostSetCostModel(true);
+        hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+        hostSetPin(PLANT_THROTTLE_PIN,  550);   //released, plausible to the safety monitor
+        hostSetPin(PLANT_RADIATOR_PIN,  512);
+        setup();
+        int task = taskIndex(controlTask);
+        original = tasks[task].run;
+        tasks[task].run = pulsingControl;
+        nextPulse = hostNowMicros() + 100000;
+
+        uint64_t until = nextPulse + (uint64_t)REVOLUTIONS * PERIOD_US;
+        while (hostNowMicros() < until) loop();
+        printf("%d reed pulses at 15 mph, each 0-%d us into a control cycle:\n"
+               "  %d stamped after their record's time, %d control cycles at 0 mph, %d of them in a row at most\n",
+               REVOLUTIONS, OFFSETS - 1, late, stopped, longest);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    if (pid > 0) waitpid(pid, &status, 0);
+}
@@ -0,0 +1,44 @@
+//------------------------------------------------------------------------------
+// bench sensor: calibration table lookups against map()
+//------------------------------------------------------------------------------
+//For every ADC count, compares the shipped tables with the map() calls they
+//replaced and times both on the host. Host times only compare the two: on
+//the Mega map() is a 32 bit multiply and a software 32 bit division, the
+//lookup two flash reads, a multiply and shifts.
+
+#include "bench.h"
+#include "sensor_tables.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+struct Sensor {
+    const char*    name;
+    const int16_t* table;
+    uint8_t        bits;
+    long           outMin, outMax;      //the map() this table replaced
+};
+
+static const Sensor sensors[] = {
+    {"rpm",       RPM_TABLE,           RPM_TABLE_BITS,           0,   4000},
+    {"radiator",  RADIATOR_TEMP_TABLE, RADIATOR_TEMP_TABLE_BITS, 300, 0},
+    {"fuel",      FUEL_TABLE,          FUEL_TABLE_BITS,          0,   100},
+};
+
+void benchSensor()
+{
+    const long CALLS = 10 << 20;
+    for (size_t s = 0; s < sizeof(sensors) / sizeof(sensors[0]); s++) {
+        const Sensor& sensor = sensors[s];
+        long worst = 0;
+        for (uint16_t adc = 0; adc < 1024; adc++) {
+            long error = labs(sensorTableLookup(sensor.table, sensor.bits, adc) -
+                              map(adc, 0, 1023, sensor.outMin, sensor.outMax));
+            if (error > worst) worst = error;
+        }
+        double table  = benchNanos(CALLS, [&](long i) {benchSink += sensorTableLookup(sensor.table, sensor.bits, i & 1023);});
+        double mapped = benchNanos(CALLS, [&](long i) {benchSink += map(i & 1023, 0, 1023, sensor.outMin, sensor.outMax);});
+        printf("%-9s table %5.2f ns   map() %5.2f ns   largest difference from map() %ld\n",
+               sensor.name, table, mapped, worst);
+    }
+}
@@ -0,0 +1,174 @@
+//------------------------------------------------------------------------------
+// bench slip: wheel slip estimate against the plant, and traction control
+//------------------------------------------------------------------------------
+//Drives simulated autocross laps (plant.h) and compares the firmware's slip
+//estimate (slip.h) with the plant's true slip every millisecond: how much of
+//the time in gear there is an estimate, how far it is off, and how long after
+//the tyres pass the target slip the firmware starts to cut. The estimate is
+//measured with traction control off, so the tyres spin as they would without
+//it; then the same laps run with it on, for the lap time and the time spent
+//spinning.
+//
+//Last, the cost of a control cycle's slipUpdate() and a reed pulse's
+//slipTurn(), timed on the host.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const double STEP      = 0.001;
+const double SPINNING  = 0.15;     //true slip counted as wheelspin
+
+struct LapResult {
+    double seconds;
+    double spinning;                //s over SPINNING
+    double inGear;                  //s moving with the clutch out, above the firmware's minRpm
+    double estimated;               //s of those with an estimate
+    double errorSum;                //of |estimate - true| while there is one
+    double errorP99;
+    double errorMax;
+    int    onsets;                  //true slip going over the target while in gear
+    int    caught;                  //of those, cut within LATENCY_WINDOW
+    double latencySum;              //s to the cut, of those caught
+    double latencyMax;
+};
+
+const double LATENCY_WINDOW = 0.5;
+
+//A lap in a child, so each starts from the firmware's power-on state
+static LapResult lap(double grip, bool traction)
+{
+    LapResult result = {};
+    int fds[2];
+    if (pipe(fds) != 0) return result;
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        PlantConfig config;
+        config.mode           = PLANT_AUTOCROSS;
+        config.aggressiveness = 0.8;
+        config.soc            = 1;
+        config.fuel           = 4;
+        config.ambient        = 25;
+        config.grip           = grip;
+        config.track          = plantDefaultTrack();
+
+        hostReset();
+        hostSetCostModel(false);
+        PlantState state;
+        plantBegin(&state, &config);
+        setup();
+        telemetrySendSetGlobal(kTelemetryDataCommandTractionControl, traction ? 1 : 0);
+
+        double target  = slip.config->target / 100.0;
+        double onset   = -1;            //time of the last crossing not yet caught
+        bool   above   = false;
+        std::vector<double> errors;
+        double length  = plantTrackLength(&config);
+        while (state.distance < length && state.time < 600) {
+            for (int i = 0; i < 6; i++) loop();
+            plantStep(&state, &config, STEP);
+            hostAdvanceMicros((uint64_t)(STEP * 1e6));
+
+            if (state.slip > SPINNING) result.spinning += STEP;
+            bool counts = state.speed > 2 && state.time >= state.shiftUntil && state.engineRpm >= slip.config->minRpm;
+            if (counts) {
+                result.inGear += STEP;
+                if (slip.valid) {
+                    double error = fabs(slip.slip / 256.0 - state.slip);
+                    result.estimated += STEP;
+                    result.errorSum  += error * STEP;
+                    errors.push_back(error);
+                }
+            }
+
+            if (state.slip > target && counts && !above) {
+                result.onsets++;
+                onset = state.time;
+            }
+            above = state.slip > target && counts;
+            if (onset >= 0 && slip.limit < SLIP_ONE) {
+                double latency = state.time - onset;
+                result.caught++;
+                result.latencySum += latency;
+                result.latencyMax  = std::max(result.latencyMax, latency);
+                onset = -1;
+            }
+            if (onset >= 0 && state.time - onset > LATENCY_WINDOW) onset = -1;
+        }
+        result.seconds = state.time;
+        if (!errors.empty()) {
+            std::sort(errors.begin(), errors.end());
+            result.errorP99 = errors[errors.size() * 99 / 100];
+            result.errorMax = errors.back();
+        }
+        bool ok = write(fds[1], &result, sizeof(result)) == (ssize_t)sizeof(result);
+        _exit(ok ? 0 : 1);
+    }
+    close(fds[1]);
+    if (pid > 0) {
+        if (read(fds[0], &result, sizeof(result)) != (ssize_t)sizeof(result)) result.seconds = 0;
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    close(fds[0]);
+    return result;
+}
+
+static void estimate(const char* name, double grip)
+{
+    LapResult r = lap(grip, false);
+    printf("%-6s grip %.2f, traction control off: %.1f s in gear, an estimate for %.0f%%, off by %.3f on average, p99 %.3f, max %.3f\n",
+           name, grip, r.inGear, 100 * r.estimated / r.inGear, r.errorSum / std::max(r.estimated, STEP), r.errorP99, r.errorMax);
+    if (r.onsets > 0)
+        printf("       %d times over the %d%% target, cut within %.1f s %d times, %.0f ms later on average, %.0f ms at most\n",
+               r.onsets, slip.config->target, LATENCY_WINDOW, r.caught, 1000 * r.latencySum / std::max(r.caught, 1),
+               1000 * r.latencyMax);
+    else printf("       never over the %d%% target\n", slip.config->target);
+}
+
+static void control(const char* name, double grip)
+{
+    LapResult off = lap(grip, false);
+    LapResult on  = lap(grip, true);
+    printf("%-6s grip %.2f: lap %.2f s off, %.2f s on   spinning over %.0f%% for %.2f s off, %.2f s on\n",
+           name, grip, off.seconds, on.seconds, 100 * SPINNING, off.spinning, on.spinning);
+}
+
+void benchSlip()
+{
+    //The firmware's configuration, for the printouts
+    hostReset();
+    setup();
+
+    estimate("dry", PLANT_DRY_GRIP);
+    estimate("wet", 0.35);
+    estimate("ice", 0.2);
+    printf("\n");
+    control("dry", PLANT_DRY_GRIP);
+    control("wet", 0.35);
+    control("ice", 0.2);
+
+    //A revolution every 200 control cycles, about 19 mph; the rpm wanders so
+    //the estimate keeps moving
+    SlipEstimator s;
+    slipBegin(&s, slip.config);
+    double update = benchNanos(20000000, [&](long i) {
+        slipUpdate(&s, (uint32_t)i * 1000, 2500 + (int)(i & 255), 2, false);
+        if (i % 200 == 0) slipTurn(&s, (uint32_t)i * 1000 + 500);
+        benchSink += s.limit;
+    });
+    //Not measured on the Mega. Read off the source for avr-gcc -Os, roughly:
+    //slipUpdate() ~130 cycles (two 16x16 bit multiplies, a 16x8 one, 32 bit
+    //adds and compares), ~8 us a control cycle; slipTurn() ~110 a pulse
+    printf("\nslipUpdate() and 1/200 of a slipTurn() %.1f ns on the host\n", update);
+}
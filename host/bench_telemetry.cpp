@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// bench telemetry: radio bytes per lap with and without the channel deadbands
+//------------------------------------------------------------------------------
+//Drives one simulated autocross lap (plant.h) with the telemetry switch on and
+//decodes what goes out on the transceiver port, twice: with every channel
+//sent each period whatever its value (max age = period, how the fixed fast
+//and slow frames worked), and with the channel table as configured in
+//arduino.c, in the firmware's default delta frames (see bench delta for the
+//plain ones). Reports bytes, frames and values per second and which channels
+//the bytes went to.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+#include "telemetry_channels.h"
+#include "telemetry_frame.h"
+
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+const int    MAX_ID = 40;
+const double STEP   = 0.001;
+
+//In a child, so each run starts from the firmware's power-on state
+static void run(const char* name, bool everyPeriod)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid != 0) {
+        int status;
+        if (pid > 0) waitpid(pid, &status, 0);
+        return;
+    }
+
+    PlantConfig config;
+    config.mode           = PLANT_AUTOCROSS;
+    config.aggressiveness = 0.8;
+    config.soc            = 1;
+    config.fuel           = 4;
+    config.ambient        = 25;
+    config.grip           = PLANT_DRY_GRIP;
+    config.track          = plantDefaultTrack();
+
+    hostReset();
+    hostSetCostModel(false);
+    PlantState state;
+    plantBegin(&state, &config);
+    hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+    setup();
+    if (everyPeriod)
+        for (int id = 0; id <= MAX_ID; id++)
+            if (TelemetryChannel* c = telemetryChannelFind(id)) c->maxAgeMs = c->periodMs;
+
+    FrameDecoder decoder;
+    frameDecoderReset(&decoder);
+    unsigned long bytes = 0, fields = 0, perId[MAX_ID + 1] = {0};
+    double length = plantTrackLength(&config);
+    while (state.distance < length && state.time < 300) {
+        for (int i = 0; i < 6; i++) loop();
+        plantStep(&state, &config, STEP);
+        hostAdvanceMicros((uint64_t)(STEP * 1e6));
+
+        std::string out = hostSerialTakeOutput(1);
+        bytes += out.size();
+        for (size_t i = 0; i < out.size(); i++) {
+            if (!framePush(&decoder, (uint8_t)out[i])) continue;
+            fields += decoder.fieldCount;
+            for (int f = 0; f < decoder.fieldCount; f++) if (decoder.ids[f] <= MAX_ID) perId[decoder.ids[f]]++;
+        }
+    }
+
+    double seconds = state.time;
+    printf("%-14s %6.1f bytes/s  %5.1f frames/s  %6.1f values/s  %4.0f%% of 9600 baud  (%lu frames lost)\n",
+           name, bytes / seconds, decoder.frames / seconds, fields / seconds, bytes / seconds / 960 * 100,
+           (unsigned long)decoder.lostFrames);
+    printf("               values/s by ID:");
+    for (int id = 0; id <= MAX_ID; id++) if (perId[id]) printf(" %d:%.1f", id, perId[id] / seconds);
+    printf("\n");
+    fflush(stdout);
+    _exit(0);
+}
+
+void benchTelemetry()
+{
+    run("every period", true);
+    run("deadbands", false);
+}
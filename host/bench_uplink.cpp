@@ -0,0 +1,108 @@
+//------------------------------------------------------------------------------
+// bench uplink: throughput and fuzzing of the uplink command parser
+//------------------------------------------------------------------------------
+//Three streams of several megabytes each go through uplinkPush():
+//
+//    valid     well formed messages; every command must come out unchanged
+//    corrupt   the same messages with ~1% of the bytes replaced by noise; the
+//              parser must never apply a corrupted message and must pick up
+//              again at the next '<'
+//    random    uniformly random bytes, only checks that nothing breaks
+//
+//Mismatches are counted and printed, the parser's memory is fixed by
+//construction so a run that completes has stayed within its bounds.
+
+#include "bench.h"
+#include "uplink_parser.h"
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+const size_t STREAM_BYTES = 8 << 20;
+
+struct Command {int id; int value;};
+
+static uint32_t rng = 12345;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+//Well formed messages of 1-8 commands, and the commands in order
+static void makeValid(std::string& stream, std::vector<Command>& commands)
+{
+    while (stream.size() < STREAM_BYTES) {
+        int count = 1 + random32() % UPLINK_MAX_COMMANDS;
+        stream += '<';
+        for (int i = 0; i < count; i++) {
+            Command c = {(int)(random32() % 100), (int)(random32() % 65536) - 32768};
+            char text[32];
+            snprintf(text, sizeof(text), "%s%d=%d", i ? "," : "", c.id, c.value);
+            stream += text;
+            commands.push_back(c);
+        }
+        stream += '>';
+    }
+}
+
+static void report(const char* name, size_t bytes, double ns, const UplinkParser& p)
+{
+    printf("%-8s %5.1f MB  %6.1f ns/byte  %7.1f MB/s  %8lu messages  %8lu dropped\n",
+           name, bytes / 1e6, ns, 1e3 / ns, (unsigned long)p.messages, (unsigned long)p.errors);
+}
+
+void benchUplink()
+{
+    std::string          valid;
+    std::vector<Command> commands;
+    makeValid(valid, commands);
+
+    //Valid stream: every command must come back
+    UplinkParser parser;
+    uplinkReset(&parser);
+    size_t next = 0, mismatches = 0;
+    double ns = benchNanos((long)valid.size(), [&](long i) {
+        if (!uplinkPush(&parser, (uint8_t)valid[i])) return;
+        for (uint8_t k = 0; k < parser.count; k++, next++) {
+            if (next >= commands.size() || parser.ids[k] != commands[next].id ||
+                parser.values[k] != commands[next].value) mismatches++;
+        }
+    });
+    report("valid", valid.size(), ns, parser);
+    printf("         %lu commands, %lu mismatches%s\n", (unsigned long)next, (unsigned long)mismatches,
+           next == commands.size() && mismatches == 0 ? "" : "  <-- FAILED");
+
+    //Corrupted stream: a message that contained noise must never be applied
+    std::string corrupt = valid;
+    std::vector<bool> damaged(corrupt.size(), false);
+    for (size_t i = 0; i < corrupt.size(); i++) {
+        if (random32() % 100 != 0) continue;
+        char noise = (char)(random32() & 0xFF);
+        if (noise == corrupt[i]) continue;
+        corrupt[i] = noise;
+        damaged[i] = true;
+    }
+    //Decoded messages are checked against the text between the last '<' and the '>'
+    uplinkReset(&parser);
+    size_t start = 0, applied = 0, bad = 0;
+    ns = benchNanos((long)corrupt.size(), [&](long i) {
+        if (corrupt[i] == '<') start = i;
+        if (!uplinkPush(&parser, (uint8_t)corrupt[i])) return;
+        applied++;
+        for (size_t k = start; k <= (size_t)i; k++) if (damaged[k] && corrupt[k] != '<') {bad++; break;}
+    });
+    report("corrupt", corrupt.size(), ns, parser);
+    printf("         %lu messages applied, %lu of them contained noise that still parsed\n",
+           (unsigned long)applied, (unsigned long)bad);
+
+    //Random bytes
+    std::string noise(STREAM_BYTES, '\0');
+    for (size_t i = 0; i < noise.size(); i++) noise[i] = (char)(random32() & 0xFF);
+    uplinkReset(&parser);
+    ns = benchNanos((long)noise.size(), [&](long i) {benchSink += uplinkPush(&parser, (uint8_t)noise[i]);});
+    report("random", noise.size(), ns, parser);
+}
@@ -0,0 +1,252 @@
+//------------------------------------------------------------------------------
+// bench watchdog: hangs caught by the watchdog supervisor, and its record
+//------------------------------------------------------------------------------
+//Runs the firmware on the host HAL's cost model, standing in autocross with
+//the assist button held (Kelly pin at full) and telemetry on, and makes one
+//task misbehave at a random time:
+//
+//    write     runCommunication() followed by a debug print of n bytes to
+//              the USB port at 9600 baud, which blocks ~1 ms per byte once
+//              the 64 byte TX buffer is full
+//    starved   launchTask() taking 600 us of its 500 us period, so loop()
+//              keeps returning but the tasks after it in the table never run
+//
+//Each hang runs in a child with its own watchdog reset target. Reported:
+//how often the watchdog reset the board, how long after the hang began the
+//Kelly pin went to 0 (the watchdog's interrupt) and the board reset, and
+//the record setup() sent over the radio after the reset, decoded from the
+//transceiver port.
+//
+//Then a minute without hangs, which must not reset, with the record's run
+//count and longest task run, and the supervisor's cost per task run.
+
+#include "bench.h"
+#include "firmware.h"
+#include "hal_host.h"
+#include "plant.h"
+#include "profiler.h"
+#include "telemetry_frame.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const int      HANGS       = 10;
+const uint64_t SETTLE_US   = 300000;
+const uint64_t TIMEOUT_US  = 3000000;
+const uint64_t REPORT_US   = 300000;    //after the reset, for setup()'s report to go out
+const uint64_t CLEAN_US    = 60000000;
+const int      SERIAL_BUFFER = 64;
+const double   BYTE_MS     = 10000.0 / 9600;
+
+static uint32_t rng = 2031;
+static uint32_t random32()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+struct Hang {
+    bool     reset;
+    uint64_t killed;                    //us after the hang began, 0 never
+    uint64_t resetAt;
+    uint8_t  fields;                    //setup()'s report after the reset
+    uint8_t  ids[FRAME_MAX_FIELDS];
+    int16_t  values[FRAME_MAX_FIELDS];
+};
+
+//Kept across the reset's longjmp
+static jmp_buf  resetTarget;
+static Hang     hang;
+static int      hangBytes;              //write: bytes printed, 0 starved
+static uint64_t hangAt;                 //the first run of the task from here on hangs
+static uint64_t hangStart;
+static bool     hung;
+static void   (*original)();
+
+static void watchKelly()
+{
+    if (hang.killed == 0 && hostPinOutput(PLANT_KELLY_PIN) == 0) hang.killed = hostNowMicros() - hangStart;
+}
+
+static void writingCommunication()
+{
+    original();
+    if (hung || hostNowMicros() < hangAt) return;
+    hung      = true;
+    hangStart = hostNowMicros();
+    for (int i = 0; i < hangBytes; i++) {
+        halSerialWrite(0, '.');
+        watchKelly();
+    }
+}
+
+static void starvingLaunch()
+{
+    original();
+    if (hang.reset || hostNowMicros() < hangAt) return;
+    if (!hung) {
+        hung      = true;
+        hangStart = hostNowMicros();
+    }
+    watchKelly();
+    hostAdvanceMicros(600);
+}
+
+static int taskIndex(void (*run)())
+{
+    int i = 0;
+    while (tasks[i].run != run) i++;
+    return i;
+}
+
+static void power()
+{
+    hostReset();
+    hostSetCostModel(true);
+    hostSetPin(PLANT_ASSIST_PIN,    HIGH);  //held: full Kelly
+    hostSetPin(PLANT_KELLY_ENABLE,  LOW);
+    hostSetPin(PLANT_TELEMETRY_PIN, LOW);
+    hostSetPin(PLANT_THROTTLE_PIN,  550);   //released, plausible to the safety monitor
+    hostSetPin(PLANT_RADIATOR_PIN,  512);
+}
+
+//One hang in a child, the result through a pipe
+static Hang runHang(int bytes)
+{
+    int fds[2];
+    Hang result = {};
+    if (pipe(fds) != 0) return result;
+    fflush(stdout);
+    uint32_t seed = random32();
+    pid_t pid = fork();
+    if (pid != 0) {
+        close(fds[1]);
+        if (read(fds[0], &result, sizeof(result)) != sizeof(result)) result = Hang();
+        close(fds[0]);
+        int status;
+        if (pid > 0) waitpid(pid, &status, 0);
+        return result;
+    }
+    close(fds[0]);
+    power();
+    hangBytes = bytes;
+    hangAt    = SETTLE_US + seed % 50000;
+
+    if (setjmp(resetTarget) == 0) {
+        hostWatchdogTarget(&resetTarget);
+        setup();
+        int task = bytes ? taskIndex(runCommunication) : taskIndex(launchTask);
+        original = tasks[task].run;
+        tasks[task].run = bytes ? writingCommunication : starvingLaunch;
+        while (hostNowMicros() < hangAt + TIMEOUT_US) loop();
+    }
+    else {
+        //Back from the reset: the report setup() sends, off the transceiver port
+        hang.reset   = true;
+        hang.resetAt = hostNowMicros() - hangStart;
+        hostSerialTakeOutput(1);
+        setup();
+        uint64_t until = hostNowMicros() + REPORT_US;
+        while (hostNowMicros() < until) loop();
+
+        std::string out = hostSerialTakeOutput(1);
+        FrameDecoder decoder;
+        frameDecoderReset(&decoder);
+        for (size_t i = 0; i < out.size() && hang.fields == 0; i++) {
+            if (!framePush(&decoder, (uint8_t)out[i]) || decoder.ids[0] != kTelemetryDataTypeResetCause) continue;
+            hang.fields = decoder.fieldCount;
+            for (int f = 0; f < decoder.fieldCount; f++) {
+                hang.ids[f]    = decoder.ids[f];
+                hang.values[f] = decoder.values[f];
+            }
+        }
+    }
+    if (write(fds[1], &hang, sizeof(hang)) != sizeof(hang)) _exit(1);
+    _exit(0);
+}
+
+static void report(const char* what, std::vector<uint64_t>& us)
+{
+    if (us.empty()) return;
+    std::sort(us.begin(), us.end());
+    printf("  %-20s min %5.0f  median %5.0f  max %5.0f ms after the hang began\n", what,
+           us.front() / 1000.0, us[us.size() / 2] / 1000.0, us.back() / 1000.0);
+}
+
+static void hangs(const char* name, int bytes)
+{
+    std::vector<uint64_t> killed, reset;
+    Hang first = {};
+    for (int i = 0; i < HANGS; i++) {
+        Hang h = runHang(bytes);
+        if (h.killed) killed.push_back(h.killed);
+        if (h.reset) reset.push_back(h.resetAt);
+        if (h.fields && first.fields == 0) first = h;
+    }
+    if (bytes) printf("%-8s %4d bytes, blocks %4.0f ms: ", name, bytes, (bytes - SERIAL_BUFFER) * BYTE_MS);
+    else       printf("%-8s %-30s", name, "launch task 600 us every run:");
+    printf("%d hangs, %d resets\n", HANGS, (int)reset.size());
+    report("Kelly pin at 0", killed);
+    report("board reset", reset);
+    if (first.fields == 0) return;
+
+    printf("  sent after the reset:");
+    for (int f = 0; f < first.fields; f++) {
+        if (f % 6 == 0) printf("\n    ");
+        printf(" %2d=%-6d", first.ids[f], first.values[f]);
+    }
+    printf("\n");
+}
+
+void benchWatchdog()
+{
+    printf("watchdog timeout 500 ms, the launch task is index %d, communication %d in the task table\n",
+           taskIndex(launchTask), taskIndex(runCommunication));
+    hangs("write", 64 + 140);
+    hangs("write", 64 + 300);
+    hangs("write", 64 + 600);
+    hangs("write", 64 + 2000);
+    hangs("starved", 0);
+    printf("  IDs: 42 cause, 43 resets, 44 task, 45 stage, 46 missing heartbeats, 47 runs/1000,\n"
+           "       48 longest run us, 49 its task, 50-54 analog, 55 switches, 56-58 servo kelly regen, 59 flags\n");
+
+    //A minute of standing with the assist held and telemetry on, in a child
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        power();
+        setup();
+        while (hostNowMicros() < CLEAN_US) loop();
+        WatchdogRecord record;
+        watchdogLastReset(&record);
+        printf("\n60 s without a hang: %u watchdog resets, %lu task runs, longest %lu us in task %d\n",
+               hostWatchdogResets(), (unsigned long)record.runs, (unsigned long)record.longest, record.longestTask);
+        fflush(stdout);
+        _exit(0);
+    }
+    int status;
+    if (pid > 0) waitpid(pid, &status, 0);
+
+    //Per task run, as the scheduler calls it
+    hostReset();
+    double run = benchNanos(20000000, [&](long i) {
+        watchdogEnter((uint8_t)(i & 7), PROFILE_NONE);
+        watchdogLeave((uint32_t)i & 1023);
+    });
+    printf("\nwatchdogEnter() and watchdogLeave() %.1f ns per task run on the host\n", run);
+
+    //Per second, from the task table's periods. On the Mega, by hand from the
+    //source with avr-gcc -Os, a task run costs ~88 cycles: two calls ~16,
+    //watchdogEnter() two stores and a 32 bit increment ~14, watchdogLeave() a
+    //32 bit compare ~10, 1 << task ~4 per shift (7 at most), the or, the
+    //compare and the return ~20. Under 3% of the 16 MHz CPU at these rates.
+    double runs = 0;
+    for (uint8_t i = 0; i < TASKS; i++) runs += 1e6 / tasks[i].periodMicros;
+    printf("%d tasks, %.0f task runs/s by their periods: %.2f ms/s of it on the host\n",
+           TASKS, runs, run * runs / 1e6);
+}
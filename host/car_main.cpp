@@ -0,0 +1,130 @@
+//------------------------------------------------------------------------------
+// car: runs the firmware's setup()/loop() on the Linux host
+//------------------------------------------------------------------------------
+//
+//    car [-n loops] [-t ms] [-s script] [-r pin:file] [-i port:file] [-o port] [-f us] [-L card.img]
+//
+//    -n loops      stop after this many loop() calls          (default 10000, no limit with -t)
+//    -t ms         stop when the virtual clock reaches ms      (default: no limit)
+//    -s script     pin script, lines of "time_us pin value"    (can be repeated)
+//    -r pin:file   pulse train on a pin, one time_us per line (the reed switch is pin 21)
+//    -i port:file  bytes to feed into serial port 0 or 1 before setup()
+//    -o port       serial port whose output goes to stdout     (default 1, the transceiver)
+//    -f us         no Mega cost model, advance the clock by us per loop instead
+//    -L file       SD card image for the data logger (see logger.h)
+//
+//loop() runs one scheduler pass, most of which find no task due and return
+//right away, so -t is the natural way to bound a run. A loop timing summary is
+//printed to stderr at the end. A watchdog reset runs setup() again, like the
+//board does, and the run goes on.
+
+#include "hal_host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <unistd.h>
+#include <string.h>
+#include <string>
+
+const uint32_t PULSE_WIDTH_US = 2000;   //How long a -r pulse holds the pin LOW
+
+void setup();
+void loop();
+
+static bool readFile(const char* path, std::string& out)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    char chunk[4096];
+    size_t n;
+    while ((n = fread(chunk, 1, sizeof(chunk), f)) > 0) out.append(chunk, n);
+    fclose(f);
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: car [-n loops] [-t ms] [-s script] [-r pin:file] [-i port:file] [-o port] [-f us] [-L card.img]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long loops      = 0;
+    uint64_t      limitMs    = 0;
+    int           outputPort = 1;
+    uint64_t      fixedStep  = 0;
+
+    hostReset();
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:s:r:i:o:f:L:")) != -1) {
+        switch (opt) {
+        case 'n': loops = strtoul(optarg, NULL, 10); break;
+        case 't': limitMs = strtoull(optarg, NULL, 10); break;
+        case 's':
+            if (!hostLoadScript(optarg)) {fprintf(stderr, "car: cannot load script %s\n", optarg); return 1;}
+            break;
+        case 'r': {
+            char* file = strchr(optarg, ':');
+            if (!file || !hostLoadPulseTrain(file + 1, (uint8_t)atoi(optarg), PULSE_WIDTH_US)) {
+                fprintf(stderr, "car: bad pulse train %s\n", optarg);
+                return 1;
+            }
+            break;
+        }
+        case 'i': {
+            std::string bytes;
+            if ((optarg[0] != '0' && optarg[0] != '1') || optarg[1] != ':' || !readFile(optarg + 2, bytes)) {
+                fprintf(stderr, "car: bad serial input %s\n", optarg);
+                return 1;
+            }
+            hostSerialInject(optarg[0] - '0', bytes);
+            break;
+        }
+        case 'o': outputPort = atoi(optarg); break;
+        case 'f':
+            fixedStep = strtoull(optarg, NULL, 10);
+            hostSetCostModel(false);
+            break;
+        case 'L':
+            if (!hostStorageOpen(optarg)) {fprintf(stderr, "car: cannot open card image %s\n", optarg); return 1;}
+            break;
+        default:  usage();
+        }
+    }
+    if (optind != argc || outputPort < 0 || outputPort >= HAL_SERIAL_PORTS) usage();
+    if (loops == 0) loops = limitMs ? ULONG_MAX : 10000;
+
+    //Static, so they keep their values across the longjmp of a watchdog reset
+    static uint64_t      start    = 0;
+    static uint64_t      previous = 0;
+    static uint64_t      longest  = 0;
+    static unsigned long n        = 0;
+    static jmp_buf       reset;
+    if (setjmp(reset) != 0) fprintf(stderr, "car: watchdog reset at %.3f s virtual\n", hostNowMicros() / 1e6);
+    hostWatchdogTarget(&reset);
+
+    setup();
+
+    if (hostWatchdogResets() == 0) start = hostNowCycles();
+    previous = hostNowCycles();
+    while (n < loops && (limitMs == 0 || hostNowMicros() < limitMs * 1000)) {
+        loop();
+        n++;
+        if (fixedStep) hostAdvanceMicros(fixedStep);
+        uint64_t t = hostNowCycles();
+        if (t - previous > longest) longest = t - previous;
+        previous = t;
+
+        std::string out = hostSerialTakeOutput(outputPort);
+        fwrite(out.data(), 1, out.size(), stdout);
+    }
+
+    double cyclesPerUs = HOST_CPU_HZ / 1e6;
+    fprintf(stderr, "%lu loops, %.3f s virtual, mean loop %.1f us, longest %.1f us\n",
+            n, (hostNowCycles() - start) / (double)HOST_CPU_HZ,
+            n ? (hostNowCycles() - start) / cyclesPerUs / n : 0.0, longest / cyclesPerUs);
+    return 0;
+}
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+// Firmware entry points and state used by the host programs
+//------------------------------------------------------------------------------
+//arduino.c has no header of its own, being the sketch; host programs that
+//drive parts of it directly declare them here. Keep in step with arduino.c.
+
+#ifndef FIRMWARE_H
+#define FIRMWARE_H
+
+#include "hal.h"
+#include "input_record.h"
+#include "energy.h"
+#include "launch.h"
+#include "slip.h"
+#include "gear.h"
+#include "conditioning.h"
+#include "safety.h"
+#include "scheduler.h"
+#include "watchdog.h"
+#include "params.h"
+
+//Sketch
+void setup();
+void loop();
+
+//Control chain, in the order controlTask() and outputTask() run it
+void readInputs();
+void applyInputs(const InputRecord* in);
+void processInputs();
+void runSecurityBlock();
+void runTheCar();
+void writeOutputs();
+void sevenSegOut();
+
+//Tasks, and the table the scheduler runs them from
+void launchTask();
+void controlTask();
+void outputTask();
+void runCommunication();
+extern Task tasks[];
+extern const uint8_t TASKS;
+
+extern InputRecord   controlInputs;
+extern int           velocity;
+extern unsigned long currentTime;
+extern boolean       endloop;
+
+//Outputs
+extern int     servoOut;
+extern int     kellyOut;
+extern int     regenOut;
+extern boolean engineOn;
+extern boolean hiVoltageEnable;
+extern boolean regenEnable;
+extern boolean criticalCycle;
+
+//Telemetry
+extern boolean telemetryDelta;
+int            telemetrySendSetGlobal(int id, int val);  //Applies one received command
+
+//Commands, as in arduino.c section 1.3
+const int kTelemetryDataCommandBatteryLevel      = 36;
+const int kTelemetryDataCommandEnduranceDistance = 37;
+const int kTelemetryDataCommandEnergyManager     = 38;
+const int kTelemetryDataCommandTractionControl   = 41;
+
+//Endurance energy plan
+extern EnergyManager energy;
+
+//Boost button and launch control
+extern LaunchControl launch;
+
+//Traction control
+extern SlipEstimator slip;
+extern int           gear;
+extern GearDetector  gearDetector;
+
+//Input conditioning
+extern SwitchFilter  switchFilter;
+extern AnalogFilter  analogFilter;
+
+//Safety monitor
+extern SafetyMonitor safety;
+
+//Parameter store, as in arduino.c sections 1.3 and 1.4
+extern ParamStore parameters;
+extern int16_t    param[];
+const uint8_t PARAM_THROTTLE_SCALE_MIN = 0;
+const uint8_t PARAMS                   = 16;
+const int kTelemetryDataCommandParameter      = 60;
+const int kTelemetryDataCommandParameterValue = 61;
+const int kTelemetryDataTypeParameterState    = 63;
+
+//Watchdog's report after a reset, as in arduino.c section 1.3 (IDs 42-59)
+const int kTelemetryDataTypeResetCause = 42;
+const int kTelemetryDataTypeResetFlags = 59;
+
+#endif
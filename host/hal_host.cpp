@@ -0,0 +1,778 @@
+//------------------------------------------------------------------------------
+// Hardware abstraction layer, Linux host backend
+//------------------------------------------------------------------------------
+
+#include "hal_host.h"
+#include "hal_ports.h"
+
+#include <stdio.h>
+#include <setjmp.h>
+#include <deque>
+#include <map>
+
+//Approximate cost of each Arduino core call on the Mega 2560, in CPU cycles
+const uint32_t COST_PIN_MODE      =   64;
+const uint32_t COST_DIGITAL_READ  =   56;   //~3.5 us, pin lookup tables
+const uint32_t COST_DIGITAL_WRITE =   72;   //~4.5 us, lookup tables + PWM timer check
+const uint32_t COST_ANALOG_READ   = 1792;   //~112 us, 13 ADC clocks at 125 kHz
+const uint32_t COST_ANALOG_WRITE  =   96;
+const uint32_t COST_CLOCK_READ    =   56;
+const uint32_t COST_SERVO_WRITE   =  160;
+const uint32_t COST_SERIAL_CALL   =   80;   //available(), read(), write() into a free buffer
+const uint32_t COST_INTERRUPT     =   90;   //entry, register saves and attachInterrupt() dispatch
+const uint32_t ADC_CONVERSION     = 1664;   //13 ADC clocks at 125 kHz, without analogRead()'s overhead
+const uint32_t COST_PORTS_READ    =   24;   //11 PINx loads into the snapshot
+const uint32_t COST_PORT_COMMIT   =   40;   //SREG save, the port loop and one RMW per port touched
+const uint32_t COST_PORT_WRITE    =    8;   //  plus this per port touched
+const uint32_t COST_FAST_READ     =    3;
+const uint32_t COST_FAST_WRITE    =    8;   //RMW with interrupts off, for the ports outside sbi/cbi range
+const uint32_t COST_SPI_BYTE      =   20;   //16 cycles at 8 MHz SPI plus the loop
+const uint32_t COST_CARD_COMMAND  =  400;   //chip select, 6 command bytes and the R1 response
+const uint32_t CARD_BUSY_MICROS   = 1500;   //an SD card programming one block, typically 0.5-3 ms
+const uint32_t CARD_BLOCKS        = 1UL << 22;  //a 2 GB card
+const uint32_t COST_EEPROM_READ   =   10;   //per byte, eeprom_read_block()
+const uint32_t EEPROM_WRITE_MICROS = 3400;  //per byte that changes, the next access waits for it
+
+const int SERIAL_TX_BUFFER = 64;            //Same as the Arduino core on the Mega
+
+struct HostSerial {
+    long                baud;
+    std::deque<uint8_t> rx;
+    std::string         output;             //Everything the firmware wrote, in order
+    int                 txQueued;           //Bytes still waiting in the core's TX buffer
+    uint64_t            nextDrain;          //Cycle at which the UART finishes the next byte
+};
+
+static int      pinInput[HOST_PINS];
+static int      pinOutput[HOST_PINS];
+static uint8_t  pinModes[HOST_PINS];
+static int      servoAngle = 0;
+static uint64_t now        = 0;
+static bool     costModel  = true;
+
+static void   (*pinHandlers[HOST_PINS])();
+static uint8_t  pinEdges[HOST_PINS];
+static bool     pinPending[HOST_PINS];
+static bool     interruptsOn = true;
+static bool     inInterrupt  = false;
+
+static void   (*timerHandler)() = 0;
+static uint64_t timerPeriod  = 0;
+static uint64_t timerNext    = 0;
+static bool     timerPending = false;
+
+static void   (*watchdogHandler)() = 0;
+static bool     watchdogOn      = false;
+static bool     watchdogFired   = false;    //the interrupt came, the next timeout resets
+static bool     watchdogPending = false;
+static uint64_t watchdogTimeout = 0;
+static uint64_t watchdogNext    = 0;
+static jmp_buf* watchdogTarget  = 0;
+static unsigned watchdogResets  = 0;
+
+static void   (*adcHandler)(uint16_t value) = 0;
+static bool     adcBusy    = false;
+static uint8_t  adcPin     = 0;
+static uint64_t adcDone    = 0;
+static bool     adcPending = false;
+static uint16_t adcResult  = 0;
+
+static FILE*        card = 0;              //hostStorageOpen(), none by default
+static uint8_t      cardState = HAL_STORAGE_FAILED;
+static uint8_t      cardStep;               //0 command, 1 data, 2 busy
+static uint32_t     cardBlock;
+static const uint8_t* cardData;
+static uint16_t     cardDone;
+static uint64_t     cardBusyUntil;
+
+static uint8_t      eeprom[HAL_EEPROM_BYTES];
+static bool         eepromErased = false;   //filled with 0xFF on first use, like a new chip
+static uint64_t     eepromReady  = 0;       //the byte being written is done, cycles
+static FILE*        eepromFile = 0;         //hostEepromOpen(), none by default
+
+static HostSerial                          ports[HAL_SERIAL_PORTS];
+static std::multimap<uint64_t, std::pair<uint8_t, int> > pinEvents;
+
+static void charge(uint32_t cycles);
+static void watchdogReset();
+
+static void runInterrupt(uint8_t pin)
+{
+    inInterrupt = true;
+    charge(COST_INTERRUPT);
+    pinHandlers[pin]();
+    inInterrupt = false;
+}
+
+static void runAdcInterrupt()
+{
+    inInterrupt = true;
+    charge(COST_INTERRUPT);
+    adcHandler(adcResult);
+    inInterrupt = false;
+}
+
+static void runWatchdogInterrupt()
+{
+    inInterrupt = true;
+    charge(COST_INTERRUPT);
+    watchdogHandler();
+    inInterrupt = false;
+}
+
+static void runTimerInterrupt()
+{
+    inInterrupt = true;
+    charge(COST_INTERRUPT);
+    timerHandler();
+    inInterrupt = false;
+}
+
+//The watchdog before the timer before the ADC, as in the Mega's interrupt priorities
+static void runPendingInterrupts()
+{
+    if (watchdogPending && interruptsOn && !inInterrupt) {
+        watchdogPending = false;
+        runWatchdogInterrupt();
+    }
+    if (timerPending && interruptsOn && !inInterrupt) {
+        timerPending = false;
+        runTimerInterrupt();
+    }
+    if (adcPending && interruptsOn && !inInterrupt) {
+        adcPending = false;
+        runAdcInterrupt();
+    }
+    for (int pin = 0; pin < HOST_PINS; pin++) {
+        if (!interruptsOn || inInterrupt) return;
+        if (pinPending[pin]) {
+            pinPending[pin] = false;
+            runInterrupt(pin);
+        }
+    }
+}
+
+//Drives an input pin, raising its interrupt on a matching edge
+static void setInput(uint8_t pin, int value)
+{
+    bool wasHigh = pinInput[pin] != 0;
+    bool isHigh  = value != 0;
+    pinInput[pin] = value;
+
+    if (!pinHandlers[pin] || wasHigh == isHigh) return;
+    uint8_t edge = pinEdges[pin];
+    if (edge == CHANGE || (edge == RISING && isHigh) || (edge == FALLING && !isHigh)) {
+        pinPending[pin] = true;
+        runPendingInterrupts();
+    }
+}
+
+static uint64_t cyclesPerByte(const HostSerial& s)
+{
+    return (uint64_t)HOST_CPU_HZ * 10 / (s.baud > 0 ? s.baud : 9600);  //8N1 = 10 bits
+}
+
+//Cycle of the next thing that happens outside the firmware, or UINT64_MAX
+static uint64_t nextEvent()
+{
+    uint64_t next = UINT64_MAX;
+    if (!pinEvents.empty()) next = pinEvents.begin()->first;
+    for (int p = 0; p < HAL_SERIAL_PORTS; p++)
+        if (ports[p].txQueued > 0 && ports[p].nextDrain < next) next = ports[p].nextDrain;
+    if (adcBusy && adcDone < next) next = adcDone;
+    if (timerHandler && timerNext < next) next = timerNext;
+    if (watchdogOn && watchdogNext < next) next = watchdogNext;
+    return next;
+}
+
+//Moves the virtual clock to target, firing every event due on the way
+static void advanceTo(uint64_t target)
+{
+    for (;;) {
+        uint64_t next = nextEvent();
+        if (next > target) break;
+        if (next > now) now = next;
+
+        while (!pinEvents.empty() && pinEvents.begin()->first <= now) {
+            std::pair<uint8_t, int> event = pinEvents.begin()->second;
+            pinEvents.erase(pinEvents.begin());
+            setInput(event.first, event.second);
+        }
+        if (timerHandler && timerNext <= now) {
+            timerNext   += timerPeriod;
+            timerPending = true;
+            runPendingInterrupts();
+        }
+        if (watchdogOn && watchdogNext <= now) {
+            if (watchdogFired) watchdogReset();
+            watchdogFired   = true;
+            watchdogNext   += watchdogTimeout;
+            watchdogPending = watchdogHandler != 0;
+            runPendingInterrupts();
+        }
+        if (adcBusy && adcDone <= now) {
+            int v = pinInput[adcPin];
+            adcResult  = v < 0 ? 0 : (v > 1023 ? 1023 : v);
+            adcBusy    = false;
+            adcPending = adcHandler != 0;
+            runPendingInterrupts();
+        }
+        for (int p = 0; p < HAL_SERIAL_PORTS; p++) {
+            HostSerial& s = ports[p];
+            while (s.txQueued > 0 && s.nextDrain <= now) {
+                s.txQueued--;
+                s.nextDrain += cyclesPerByte(s);
+            }
+        }
+    }
+    if (target > now) now = target;
+}
+
+//Interrupt handlers run with interrupts off, their time passes without events
+static void charge(uint32_t cycles)
+{
+    if (!costModel) return;
+    if (inInterrupt) now += cycles;
+    else advanceTo(now + cycles);
+}
+
+static bool validPin(uint8_t pin) {return pin < HOST_PINS;}
+
+//------------------------------------------------------------------------------
+// Arduino core replacements
+//------------------------------------------------------------------------------
+
+long map(long x, long inMin, long inMax, long outMin, long outMax)
+{
+    return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+char* itoa(int value, char* str, int base)
+{
+    char     digits[sizeof(int) * 8 + 1];
+    int      n = 0;
+    bool     negative = (value < 0 && base == 10);
+    unsigned v = negative ? 0u - (unsigned)value : (unsigned)value;
+    do {
+        int d = v % base;
+        digits[n++] = d < 10 ? '0' + d : 'a' + d - 10;
+        v /= base;
+    } while (v > 0);
+    char* out = str;
+    if (negative) *out++ = '-';
+    while (n > 0) *out++ = digits[--n];
+    *out = '\0';
+    return str;
+}
+
+//------------------------------------------------------------------------------
+// hal.h
+//------------------------------------------------------------------------------
+
+void halPinMode(uint8_t pin, uint8_t mode)
+{
+    charge(COST_PIN_MODE);
+    if (validPin(pin)) pinModes[pin] = mode;
+}
+
+int halDigitalRead(uint8_t pin)
+{
+    charge(COST_DIGITAL_READ);
+    if (!validPin(pin)) return LOW;
+    if (pinModes[pin] == OUTPUT) return pinOutput[pin] ? HIGH : LOW;
+    return pinInput[pin] ? HIGH : LOW;
+}
+
+void halDigitalWrite(uint8_t pin, uint8_t value)
+{
+    charge(COST_DIGITAL_WRITE);
+    if (validPin(pin)) pinOutput[pin] = value ? HIGH : LOW;
+}
+
+int halAnalogRead(uint8_t pin)
+{
+    charge(COST_ANALOG_READ);
+    if (!validPin(pin)) return 0;
+    int v = pinInput[pin];
+    return v < 0 ? 0 : (v > 1023 ? 1023 : v);
+}
+
+void halAnalogWrite(uint8_t pin, int value)
+{
+    charge(COST_ANALOG_WRITE);
+    if (validPin(pin)) pinOutput[pin] = value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+uint32_t halMillis()
+{
+    charge(COST_CLOCK_READ);
+    return (uint32_t)(now / (HOST_CPU_HZ / 1000));
+}
+
+uint32_t halMicros()
+{
+    charge(COST_CLOCK_READ);
+    return (uint32_t)(now / (HOST_CPU_HZ / 1000000));
+}
+
+void halDelay(uint32_t ms)
+{
+    advanceTo(now + (uint64_t)ms * (HOST_CPU_HZ / 1000));
+}
+
+void halAttachInterrupt(uint8_t pin, void (*handler)(), uint8_t mode)
+{
+    if (!validPin(pin)) return;
+    pinHandlers[pin] = handler;
+    pinEdges[pin]    = mode;
+}
+
+void halNoInterrupts()
+{
+    interruptsOn = false;
+}
+
+void halInterrupts()
+{
+    interruptsOn = true;
+    runPendingInterrupts();
+}
+
+void halTimerBegin(uint32_t periodMicros, void (*handler)())
+{
+    timerHandler = handler;
+    timerPeriod  = (uint64_t)periodMicros * (HOST_CPU_HZ / 1000000);
+    timerNext    = now + timerPeriod;
+    timerPending = false;
+}
+
+void halWatchdogBegin(uint16_t timeoutMillis, void (*handler)())
+{
+    uint32_t steps[] = {15, 30, 60, 120, 250, 500, 1000, 2000, 4000, 8000};
+    int      step    = 0;
+    while (step < 9 && steps[step + 1] <= timeoutMillis) step++;
+    watchdogHandler = handler;
+    watchdogTimeout = (uint64_t)steps[step] * (HOST_CPU_HZ / 1000);
+    watchdogNext    = now + watchdogTimeout;
+    watchdogOn      = true;
+    watchdogFired   = false;
+    watchdogPending = false;
+}
+
+void halWatchdogReset()
+{
+    if (watchdogOn) watchdogNext = now + watchdogTimeout;
+}
+
+void halAdcBegin(void (*handler)(uint16_t value))
+{
+    adcHandler = handler;
+}
+
+void halAdcStart(uint8_t pin)
+{
+    if (!validPin(pin)) return;
+    adcPin  = pin;
+    adcBusy = true;
+    adcDone = now + ADC_CONVERSION;
+}
+
+void halServoAttach(uint8_t pin, int minPulse, int maxPulse)
+{
+    (void)pin; (void)minPulse; (void)maxPulse;
+    charge(COST_SERVO_WRITE);
+}
+
+void halServoWrite(int angle)
+{
+    charge(COST_SERVO_WRITE);
+    servoAngle = angle < 0 ? 0 : (angle > 180 ? 180 : angle);
+}
+
+void halSerialBegin(uint8_t port, long baud)
+{
+    if (port < HAL_SERIAL_PORTS) ports[port].baud = baud;
+}
+
+int halSerialAvailable(uint8_t port)
+{
+    charge(COST_SERIAL_CALL);
+    return port < HAL_SERIAL_PORTS ? (int)ports[port].rx.size() : 0;
+}
+
+int halSerialRead(uint8_t port)
+{
+    charge(COST_SERIAL_CALL);
+    if (port >= HAL_SERIAL_PORTS || ports[port].rx.empty()) return -1;
+    int value = ports[port].rx.front();
+    ports[port].rx.pop_front();
+    return value;
+}
+
+void halSerialWrite(uint8_t port, uint8_t value)
+{
+    if (port >= HAL_SERIAL_PORTS) return;
+    HostSerial& s = ports[port];
+
+    //Like the Arduino core, block until the UART frees a slot in the TX buffer
+    if (costModel)
+        while (s.txQueued >= SERIAL_TX_BUFFER) advanceTo(s.nextDrain);
+    charge(COST_SERIAL_CALL);
+
+    if (costModel) {
+        if (s.txQueued == 0) s.nextDrain = now + cyclesPerByte(s);
+        s.txQueued++;
+    }
+    s.output.push_back((char)value);
+}
+
+int halSerialAvailableForWrite(uint8_t port)
+{
+    charge(COST_SERIAL_CALL);
+    if (port >= HAL_SERIAL_PORTS) return 0;
+    return SERIAL_TX_BUFFER - ports[port].txQueued;
+}
+
+static void serialPrintText(uint8_t port, const char* text)
+{
+    while (*text) halSerialWrite(port, (uint8_t)*text++);
+    halSerialWrite(port, '\r');
+    halSerialWrite(port, '\n');
+}
+
+void halSerialPrintln(uint8_t port, const char* text) {serialPrintText(port, text);}
+
+void halSerialPrintln(uint8_t port, long value)
+{
+    char text[24];
+    snprintf(text, sizeof(text), "%ld", value);
+    serialPrintText(port, text);
+}
+
+void halSerialPrintln(uint8_t port, double value)
+{
+    char text[48];
+    snprintf(text, sizeof(text), "%.2f", value);  //Print::println(double) uses 2 digits
+    serialPrintText(port, text);
+}
+
+//Block storage, a card image file: block n at offset n * 512, unwritten
+//blocks read as zeros
+boolean halStorageBegin(uint8_t csPin)
+{
+    charge(COST_CARD_COMMAND * 8);
+    cardState = card ? HAL_STORAGE_IDLE : HAL_STORAGE_FAILED;
+    return card != 0;
+}
+
+boolean halStorageRead(uint32_t block, uint8_t* data)
+{
+    charge(COST_CARD_COMMAND + HAL_STORAGE_BLOCK * COST_SPI_BYTE);
+    if (cardState != HAL_STORAGE_IDLE || block >= CARD_BLOCKS) return false;
+    memset(data, 0, HAL_STORAGE_BLOCK);
+    fseek(card, (long)block * HAL_STORAGE_BLOCK, SEEK_SET);
+    size_t got = fread(data, 1, HAL_STORAGE_BLOCK, card);
+    (void)got;
+    return true;
+}
+
+void halStorageWrite(uint32_t block, const uint8_t* data)
+{
+    if (cardState != HAL_STORAGE_IDLE) return;
+    cardBlock = block;
+    cardData  = data;
+    cardDone  = 0;
+    cardStep  = 0;
+    cardState = HAL_STORAGE_BUSY;
+}
+
+uint8_t halStoragePoll()
+{
+    if (cardState != HAL_STORAGE_BUSY) return cardState;
+
+    if (cardStep == 0) {
+        charge(COST_CARD_COMMAND);
+        if (cardBlock >= CARD_BLOCKS) return cardState = HAL_STORAGE_FAILED;
+        cardStep = 1;
+    }
+    else if (cardStep == 1) {
+        uint16_t slice = HAL_STORAGE_BLOCK - cardDone < HAL_STORAGE_SLICE ? HAL_STORAGE_BLOCK - cardDone : HAL_STORAGE_SLICE;
+        charge(slice * COST_SPI_BYTE);
+        cardDone += slice;
+        if (cardDone == HAL_STORAGE_BLOCK) {
+            charge(3 * COST_SPI_BYTE);
+            fseek(card, (long)cardBlock * HAL_STORAGE_BLOCK, SEEK_SET);
+            if (fwrite(cardData, 1, HAL_STORAGE_BLOCK, card) != HAL_STORAGE_BLOCK) return cardState = HAL_STORAGE_FAILED;
+            cardBusyUntil = now + (uint64_t)CARD_BUSY_MICROS * (HOST_CPU_HZ / 1000000);
+            cardStep = 2;
+        }
+    }
+    else {
+        if (now < cardBusyUntil) {
+            charge(16 * COST_SPI_BYTE);
+            return HAL_STORAGE_BUSY;
+        }
+        charge(COST_SPI_BYTE);
+        return cardState = HAL_STORAGE_IDLE;
+    }
+    return HAL_STORAGE_BUSY;
+}
+
+//EEPROM: survives hostReset(), like the chip; written through to the image file if one is open
+static void eepromErase()
+{
+    if (eepromErased) return;
+    memset(eeprom, 0xFF, sizeof(eeprom));
+    eepromErased = true;
+}
+
+//eeprom_read_block() and eeprom_update_byte() first wait for the last write
+static void eepromWait()
+{
+    if (costModel && now < eepromReady) advanceTo(eepromReady);
+}
+
+void halEepromRead(uint16_t address, void* data, uint16_t length)
+{
+    eepromErase();
+    eepromWait();
+    charge(COST_EEPROM_READ * length);
+    uint8_t* out = (uint8_t*)data;
+    for (uint16_t i = 0; i < length; i++) out[i] = eeprom[(address + i) % HAL_EEPROM_BYTES];
+}
+
+void halEepromWrite(uint16_t address, const void* data, uint16_t length)
+{
+    eepromErase();
+    const uint8_t* in = (const uint8_t*)data;
+    for (uint16_t i = 0; i < length; i++) {
+        uint16_t a = (address + i) % HAL_EEPROM_BYTES;
+        eepromWait();
+        charge(COST_EEPROM_READ);
+        if (eeprom[a] == in[i]) continue;
+        eeprom[a] = in[i];
+        if (costModel) eepromReady = now + EEPROM_WRITE_MICROS * (HOST_CPU_HZ / 1000000);
+    }
+    if (eepromFile) {
+        fseek(eepromFile, 0, SEEK_SET);
+        if (fwrite(eeprom, 1, sizeof(eeprom), eepromFile) == sizeof(eeprom)) fflush(eepromFile);
+    }
+}
+
+//------------------------------------------------------------------------------
+// hal_ports.h
+//------------------------------------------------------------------------------
+
+//What the PINx bit of a pin reads: the driven level for outputs
+static bool pinLevel(uint8_t pin)
+{
+    if (pinModes[pin] == OUTPUT) return pinOutput[pin] != 0;
+    return pinInput[pin] != 0;
+}
+
+void halPortsRead(HalPortSnapshot* in)
+{
+    charge(COST_PORTS_READ);
+    memset(in, 0, sizeof(*in));
+    for (uint8_t pin = 0; pin < HAL_PORT_PINS; pin++)
+        if (pinLevel(pin)) in->value[halPinPort(pin)] |= halPinMask(pin);
+}
+
+void halPortUpdateCommit(const HalPortUpdate* out)
+{
+    uint32_t cycles = COST_PORT_COMMIT;
+    for (uint8_t port = 0; port < HAL_PORTS; port++)
+        if (out->mask[port]) cycles += COST_PORT_WRITE;
+    charge(cycles);
+
+    for (uint8_t pin = 0; pin < HAL_PORT_PINS; pin++) {
+        uint8_t port = halPinPort(pin), mask = halPinMask(pin);
+        if (out->mask[port] & mask) pinOutput[pin] = (out->value[port] & mask) ? HIGH : LOW;
+    }
+}
+
+int halFastRead(uint8_t pin)
+{
+    charge(COST_FAST_READ);
+    if (pin >= HAL_PORT_PINS) return LOW;
+    return pinLevel(pin) ? HIGH : LOW;
+}
+
+void halFastWrite(uint8_t pin, uint8_t value)
+{
+    charge(COST_FAST_WRITE);
+    if (pin < HAL_PORT_PINS) pinOutput[pin] = value ? HIGH : LOW;
+}
+
+//------------------------------------------------------------------------------
+// hal_host.h
+//------------------------------------------------------------------------------
+
+//The MCU's side: outputs, interrupts and peripherals as after a reset
+static void resetMcu()
+{
+    for (int pin = 0; pin < HOST_PINS; pin++) {
+        pinOutput[pin] = LOW;
+        pinModes[pin]  = INPUT;
+        pinHandlers[pin] = 0;
+        pinPending[pin]  = false;
+    }
+    interruptsOn = true;
+    inInterrupt  = false;
+    timerHandler = 0;
+    timerPending = false;
+    watchdogOn      = false;
+    watchdogPending = false;
+    adcHandler   = 0;
+    adcBusy      = false;
+    adcPending   = false;
+    servoAngle = 0;
+    cardState  = HAL_STORAGE_FAILED;
+    for (int p = 0; p < HAL_SERIAL_PORTS; p++) {
+        ports[p].baud      = 0;
+        ports[p].rx.clear();
+        ports[p].txQueued  = 0;
+        ports[p].nextDrain = 0;
+    }
+}
+
+void hostReset()
+{
+    resetMcu();
+    for (int pin = 0; pin < HOST_PINS; pin++) pinInput[pin] = pin < A0 ? HIGH : 0;
+    for (int p = 0; p < HAL_SERIAL_PORTS; p++) ports[p].output.clear();
+    now = 0;
+    eepromReady = 0;
+    pinEvents.clear();
+    watchdogTarget = 0;
+    watchdogResets = 0;
+}
+
+//The watchdog's second timeout: the MCU resets wherever the firmware is
+static void watchdogReset()
+{
+    watchdogResets++;
+    if (!watchdogTarget) {
+        fprintf(stderr, "watchdog reset at %.6f s virtual, no hostWatchdogTarget()\n", now / (double)HOST_CPU_HZ);
+        exit(3);
+    }
+    resetMcu();
+    longjmp(*watchdogTarget, 1);
+}
+
+void hostSetPin(uint8_t pin, int value)
+{
+    if (validPin(pin)) setInput(pin, value);
+}
+
+void hostSchedulePin(uint64_t atMicros, uint8_t pin, int value)
+{
+    if (!validPin(pin)) return;
+    uint64_t at = atMicros * (HOST_CPU_HZ / 1000000);
+    if (at <= now) setInput(pin, value);
+    else pinEvents.insert(std::make_pair(at, std::make_pair(pin, value)));
+}
+
+//Script lines are "time_us pin value", pins either as numbers or A0-A7.
+//Blank lines and lines starting with # are ignored.
+bool hostLoadScript(const char* path)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+
+    char line[128];
+    int  lineNumber = 0;
+    bool ok = true;
+    while (fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        char* p = line;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == '#' || *p == '\n' || *p == '\r' || *p == '\0') continue;
+
+        unsigned long long at;
+        char pinName[16];
+        int  value;
+        if (sscanf(p, "%llu %15s %d", &at, pinName, &value) != 3) {
+            fprintf(stderr, "%s:%d: expected \"time_us pin value\"\n", path, lineNumber);
+            ok = false;
+            continue;
+        }
+        int pin = (pinName[0] == 'A') ? A0 + atoi(pinName + 1) : atoi(pinName);
+        hostSchedulePin(at, (uint8_t)pin, value);
+    }
+    fclose(f);
+    return ok;
+}
+
+//One timestamp in microseconds per line: the pin goes LOW at that time and back
+//HIGH widthMicros later, like the reed switch passing the wheel magnet
+bool hostLoadPulseTrain(const char* path, uint8_t pin, uint32_t widthMicros)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+
+    char line[64];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        unsigned long long at;
+        if (sscanf(line, "%llu", &at) != 1) continue;
+        hostSchedulePin(at, pin, LOW);
+        hostSchedulePin(at + widthMicros, pin, HIGH);
+    }
+    fclose(f);
+    return true;
+}
+
+int hostPinOutput(uint8_t pin) {return validPin(pin) ? pinOutput[pin] : 0;}
+int hostServoAngle()           {return servoAngle;}
+
+void hostSerialInject(uint8_t port, const std::string& bytes)
+{
+    if (port >= HAL_SERIAL_PORTS) return;
+    for (size_t i = 0; i < bytes.size(); i++) ports[port].rx.push_back((uint8_t)bytes[i]);
+}
+
+std::string hostSerialTakeOutput(uint8_t port)
+{
+    if (port >= HAL_SERIAL_PORTS) return std::string();
+    std::string out;
+    out.swap(ports[port].output);
+    return out;
+}
+
+bool hostStorageOpen(const char* path)
+{
+    if (card) fclose(card);
+    card = fopen(path, "r+b");
+    if (!card) card = fopen(path, "w+b");
+    return card != 0;
+}
+
+void hostStorageClose()
+{
+    if (card) fclose(card);
+    card = 0;
+}
+
+bool hostEepromOpen(const char* path)
+{
+    eepromErase();
+    if (eepromFile) fclose(eepromFile);
+    eepromFile = fopen(path, "r+b");
+    if (eepromFile) {
+        memset(eeprom, 0xFF, sizeof(eeprom));
+        size_t got = fread(eeprom, 1, sizeof(eeprom), eepromFile);
+        (void)got;
+        return true;
+    }
+    eepromFile = fopen(path, "w+b");
+    return eepromFile != 0;
+}
+
+void     hostWatchdogTarget(jmp_buf* target) {watchdogTarget = target;}
+unsigned hostWatchdogResets()               {return watchdogResets;}
+
+uint64_t hostNowCycles()             {return now;}
+uint64_t hostNowMicros()             {return now / (HOST_CPU_HZ / 1000000);}
+void     hostAdvanceMicros(uint64_t us) {advanceTo(now + us * (HOST_CPU_HZ / 1000000));}
+void     hostSetCostModel(bool enabled) {costModel = enabled;}
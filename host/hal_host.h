@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+// Hardware abstraction layer, Linux host backend
+//------------------------------------------------------------------------------
+//Besides implementing hal.h, the host backend exposes the controls below so a
+//host program can play the part of the car around the firmware: drive input
+//pins (now or at a scripted time), feed and collect serial bytes, look at the
+//outputs and move the virtual clock.
+//
+//The virtual clock counts CPU cycles of a 16 MHz Mega. Every HAL call charges
+//roughly what it costs on the car (analogRead ~112 us, digitalWrite a few us,
+//a serial write blocks while the 64 byte TX buffer is full, ...), so loop
+//timing measured on the host follows the car's. hostSetCostModel(false) turns
+//the charges off for runs that only care about behaviour.
+
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+#include "hal.h"
+#include <setjmp.h>
+#include <string>
+
+const int      HOST_PINS   = 70;          //Mega 2560: digital 0-53, analog A0-A15 = 54-69
+const uint32_t HOST_CPU_HZ = 16000000UL;
+
+//Puts every pin, the clock and the serial ports back to power-on state.
+//Digital inputs idle HIGH (the car's switches pull LOW when active), analog
+//inputs read 0.
+void        hostReset();
+
+//Pins. Input changes raise the interrupt attached to the pin, if any.
+void        hostSetPin(uint8_t pin, int value);                       //digital HIGH/LOW or analog 0-1023
+void        hostSchedulePin(uint64_t atMicros, uint8_t pin, int value);
+bool        hostLoadScript(const char* path);                         //lines of "time_us pin value"
+bool        hostLoadPulseTrain(const char* path, uint8_t pin, uint32_t widthMicros);
+int         hostPinOutput(uint8_t pin);                               //last digitalWrite/analogWrite value
+int         hostServoAngle();
+
+//Serial ports
+void        hostSerialInject(uint8_t port, const std::string& bytes);
+std::string hostSerialTakeOutput(uint8_t port);
+
+//SD card, a raw image of 512 byte blocks; without one halStorageBegin()
+//finds no card. The card stays attached across hostReset().
+bool        hostStorageOpen(const char* path);                        //created if missing
+void        hostStorageClose();
+
+//EEPROM image of HAL_EEPROM_BYTES bytes, loaded now and written through on
+//every halEepromWrite(); created if missing. Without one the EEPROM starts
+//erased (all 0xFF). Contents survive hostReset().
+bool        hostEepromOpen(const char* path);
+
+//Watchdog reset. With a target, the reset puts the firmware's side of the
+//HAL back to power-on state (pins, interrupts and peripherals, but not the
+//clock, the input pins or scheduled events) and longjmps there, where the
+//host program calls setup() again. The firmware's globals keep their values,
+//as HAL_NOINIT ones do on the car; setup() sets up the others. Without a
+//target the program exits with an error. hostReset() clears the target.
+void        hostWatchdogTarget(jmp_buf* target);
+unsigned    hostWatchdogResets();                                     //since hostReset()
+
+//Virtual clock
+uint64_t    hostNowCycles();
+uint64_t    hostNowMicros();
+void        hostAdvanceMicros(uint64_t us);
+void        hostSetCostModel(bool enabled);
+
+#endif
@@ -0,0 +1,46 @@
+//------------------------------------------------------------------------------
+// Input trace files
+//------------------------------------------------------------------------------
+
+#include "input_trace.h"
+
+#include <string.h>
+
+static const char MAGIC[4] = {'Y', 'F', 'I', 'T'};
+
+FILE* inputTraceCreate(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+    if (!f) return 0;
+    uint8_t header[8] = {0};
+    memcpy(header, MAGIC, 4);
+    header[4] = INPUT_TRACE_VERSION;
+    header[5] = INPUT_RECORD_BYTES;
+    fwrite(header, 1, sizeof(header), f);
+    return f;
+}
+
+void inputTraceWrite(FILE* f, const InputRecord* record)
+{
+    uint8_t bytes[INPUT_RECORD_BYTES];
+    inputRecordEncode(record, bytes);
+    fwrite(bytes, 1, sizeof(bytes), f);
+}
+
+bool inputTraceLoad(const char* path, std::vector<InputRecord>& records)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t header[8];
+    bool ok = fread(header, 1, sizeof(header), f) == sizeof(header) && memcmp(header, MAGIC, 4) == 0 &&
+              header[4] == INPUT_TRACE_VERSION && header[5] == INPUT_RECORD_BYTES;
+
+    uint8_t bytes[INPUT_RECORD_BYTES];
+    InputRecord record;
+    while (ok && fread(bytes, 1, sizeof(bytes), f) == sizeof(bytes)) {
+        inputRecordDecode(bytes, &record);
+        records.push_back(record);
+    }
+    fclose(f);
+    return ok;
+}
@@ -0,0 +1,22 @@
+//------------------------------------------------------------------------------
+// Input trace files
+//------------------------------------------------------------------------------
+//A recorded stream of control input records (input_record.h), one per control
+//cycle: an 8 byte header, "YFIT", a version byte, the record size and two
+//reserved bytes, then the records back to back.
+
+#ifndef INPUT_TRACE_H
+#define INPUT_TRACE_H
+
+#include "input_record.h"
+
+#include <stdio.h>
+#include <vector>
+
+const uint8_t INPUT_TRACE_VERSION = 1;
+
+FILE* inputTraceCreate(const char* path);
+void  inputTraceWrite(FILE* f, const InputRecord* record);
+bool  inputTraceLoad(const char* path, std::vector<InputRecord>& records);
+
+#endif
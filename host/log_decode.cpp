@@ -0,0 +1,263 @@
+//------------------------------------------------------------------------------
+// log_decode: turns the data logger's SD card into CSV, columns or input traces
+//------------------------------------------------------------------------------
+//
+//    log_decode [-l] [-n session] [-d dir] [-r inputs.bin] card.img
+//
+//    -l            list the sessions on the card
+//    -n session    session to decode                    (default: the last one)
+//    -d dir        one file per column in dir, raw little endian arrays named
+//                  after the field and its type, e.g. rpm.i16, time_us.u32
+//    -r file       the session's raw inputs as an input trace, for replay
+//
+//Without -d or -r the session goes to stdout as CSV, one line per control
+//cycle, array fields as name0, name1 ... The image is read from block 0 up to
+//the first block that is not the logger's (see logger.h); the record layout
+//comes from each session's header block, so older logs decode with the
+//fields they were written with.
+//
+//Read a card with dd if=/dev/sdX of=card.img bs=512, or only the part in use
+//with count= set to first_block + blocks of the last session in -l.
+
+#include "input_trace.h"
+#include "logger.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+struct Session {
+    uint16_t              number;
+    uint32_t              firstBlock;
+    uint32_t              blocks;          //Data blocks
+    uint32_t              records;
+    uint32_t              firstTime;       //time_us of the first and last record
+    uint32_t              lastTime;
+    uint8_t               recordBytes;
+    std::vector<LogField> fields;
+    std::vector<uint8_t>  data;            //Records back to back, read with -n
+};
+
+static uint32_t get32(const uint8_t* p) {return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;}
+
+static int typeBytes(uint8_t type)
+{
+    switch (type) {
+    case LOG_U8:  return 1;
+    case LOG_I16:
+    case LOG_U16: return 2;
+    case LOG_U32: return 4;
+    }
+    return 0;
+}
+
+static const char* typeName(uint8_t type)
+{
+    switch (type) {
+    case LOG_U8:  return "u8";
+    case LOG_I16: return "i16";
+    case LOG_U16: return "u16";
+    }
+    return "u32";
+}
+
+//Sessions up to the end of the log; the records of only the one wanted
+static bool readCard(const char* path, int wanted, std::vector<Session>& sessions)
+{
+    FILE* f = fopen(path, "rb");
+    if (!f) return false;
+    uint8_t  block[HAL_STORAGE_BLOCK];
+    uint32_t address = 0;
+    while (fread(block, 1, sizeof(block), f) == sizeof(block)) {
+        if (block[0] != 'Y' || block[1] != 'L' || get32(block + 4) != address) break;
+        uint16_t number = block[8] | block[9] << 8;
+
+        if (block[2] == LOG_BLOCK_HEADER) {
+            Session s;
+            s.number      = number;
+            s.firstBlock  = address;
+            s.blocks      = 0;
+            s.records     = 0;
+            s.firstTime   = 0;
+            s.lastTime    = 0;
+            s.recordBytes = block[LOG_BLOCK_HEAD_BYTES + 1];
+            uint8_t count = block[LOG_BLOCK_HEAD_BYTES + 3];
+            const uint8_t* p = block + LOG_BLOCK_HEAD_BYTES + 4;
+            for (uint8_t i = 0; i < count && p + sizeof(LogField) <= block + sizeof(block); i++, p += sizeof(LogField)) {
+                LogField field;
+                memcpy(&field, p, sizeof(field));
+                field.name[LOG_FIELD_NAME - 1] = 0;
+                s.fields.push_back(field);
+            }
+            sessions.push_back(s);
+        }
+        else if (!sessions.empty() && sessions.back().number == number) {
+            Session& s = sessions.back();
+            uint8_t records = block[3];
+            if (records == 0 || records * s.recordBytes > HAL_STORAGE_BLOCK - LOG_BLOCK_HEAD_BYTES) break;
+            if (s.blocks == 0) s.firstTime = get32(block + LOG_BLOCK_HEAD_BYTES);
+            s.lastTime = get32(block + LOG_BLOCK_HEAD_BYTES + (records - 1) * s.recordBytes);
+            s.blocks++;
+            s.records += records;
+            if (s.number == wanted)
+                s.data.insert(s.data.end(), block + LOG_BLOCK_HEAD_BYTES,
+                              block + LOG_BLOCK_HEAD_BYTES + records * s.recordBytes);
+        }
+        address++;
+    }
+    fclose(f);
+    return true;
+}
+
+//Appends a decimal number, faster than printf for millions of values
+static char* putInt(char* out, long v)
+{
+    char digits[12];
+    int  n = 0;
+    unsigned long u = v < 0 ? -(unsigned long)v : v;
+    if (v < 0) *out++ = '-';
+    do {digits[n++] = '0' + u % 10; u /= 10;} while (u);
+    while (n) *out++ = digits[--n];
+    return out;
+}
+
+static long fieldValue(const uint8_t* p, uint8_t type)
+{
+    switch (type) {
+    case LOG_U8:  return p[0];
+    case LOG_I16: return (int16_t)(p[0] | p[1] << 8);
+    case LOG_U16: return (uint16_t)(p[0] | p[1] << 8);
+    }
+    return get32(p);
+}
+
+static void writeCsv(const Session& s)
+{
+    std::string line;
+    for (size_t f = 0; f < s.fields.size(); f++) {
+        for (int i = 0; i < s.fields[f].count; i++) {
+            if (!line.empty()) line += ',';
+            line += s.fields[f].name;
+            if (s.fields[f].count > 1) line += std::to_string(i);
+        }
+    }
+    printf("%s\n", line.c_str());
+
+    std::vector<char> buffer(1 << 16);
+    char* out = &buffer[0];
+    for (const uint8_t* r = s.data.data(); r < s.data.data() + s.data.size(); r += s.recordBytes) {
+        const uint8_t* p = r;
+        for (size_t f = 0; f < s.fields.size(); f++) {
+            for (int i = 0; i < s.fields[f].count; i++) {
+                out = putInt(out, fieldValue(p, s.fields[f].type));
+                *out++ = ',';
+                p += typeBytes(s.fields[f].type);
+            }
+        }
+        out[-1] = '\n';
+        if (out - &buffer[0] > (long)buffer.size() - 1024) {
+            fwrite(&buffer[0], 1, out - &buffer[0], stdout);
+            out = &buffer[0];
+        }
+    }
+    fwrite(&buffer[0], 1, out - &buffer[0], stdout);
+}
+
+static bool writeColumns(const Session& s, const char* dir)
+{
+    size_t offset = 0;
+    for (size_t f = 0; f < s.fields.size(); f++) {
+        int width = typeBytes(s.fields[f].type) * s.fields[f].count;
+        std::string path = std::string(dir) + "/" + s.fields[f].name + "." + typeName(s.fields[f].type);
+        FILE* out = fopen(path.c_str(), "wb");
+        if (!out) {perror(path.c_str()); return false;}
+        std::vector<uint8_t> column(s.records * (size_t)width);
+        for (uint32_t r = 0; r < s.records; r++)
+            memcpy(&column[r * (size_t)width], &s.data[r * (size_t)s.recordBytes + offset], width);
+        fwrite(column.data(), 1, column.size(), out);
+        fclose(out);
+        offset += width;
+    }
+    return true;
+}
+
+static bool writeInputs(const Session& s, const char* path)
+{
+    if (s.recordBytes < INPUT_RECORD_BYTES || s.fields.empty() || strcmp(s.fields[0].name, "time_us") != 0) {
+        fprintf(stderr, "log_decode: session %u records do not start with the raw inputs\n", s.number);
+        return false;
+    }
+    FILE* out = inputTraceCreate(path);
+    if (!out) {perror(path); return false;}
+    InputRecord record;
+    for (uint32_t r = 0; r < s.records; r++) {
+        inputRecordDecode(&s.data[r * (size_t)s.recordBytes], &record);
+        inputTraceWrite(out, &record);
+    }
+    fclose(out);
+    return true;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: log_decode [-l] [-n session] [-d dir] [-r inputs.bin] card.img\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    bool        list = false;
+    int         wanted = -1;
+    const char* columnDir = 0;
+    const char* inputsPath = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "ln:d:r:")) != -1) {
+        switch (opt) {
+        case 'l': list = true; break;
+        case 'n': wanted = atoi(optarg); break;
+        case 'd': columnDir = optarg; break;
+        case 'r': inputsPath = optarg; break;
+        default:  usage();
+        }
+    }
+    if (argc - optind != 1) usage();
+    const char* path = argv[optind];
+
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Session> sessions;
+    if (!readCard(path, -1, sessions)) {perror(path); return 1;}
+    if (sessions.empty()) {fprintf(stderr, "log_decode: no log on %s\n", path); return 1;}
+
+    if (list) {
+        printf("session,first_block,blocks,records,seconds\n");
+        for (size_t i = 0; i < sessions.size(); i++) {
+            const Session& s = sessions[i];
+            printf("%u,%lu,%lu,%lu,%.3f\n", s.number, (unsigned long)s.firstBlock, (unsigned long)s.blocks + 1,
+                   (unsigned long)s.records, (s.lastTime - s.firstTime) / 1e6);
+        }
+        return 0;
+    }
+
+    if (wanted < 0) wanted = sessions.back().number;
+    sessions.clear();
+    readCard(path, wanted, sessions);
+    const Session* session = 0;
+    for (size_t i = 0; i < sessions.size(); i++) if (sessions[i].number == wanted) session = &sessions[i];
+    if (!session) {fprintf(stderr, "log_decode: no session %d on %s\n", wanted, path); return 1;}
+
+    bool ok = true;
+    if (columnDir)  ok &= writeColumns(*session, columnDir);
+    if (inputsPath) ok &= writeInputs(*session, inputsPath);
+    if (!columnDir && !inputsPath) writeCsv(*session);
+    fflush(stdout);
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    fprintf(stderr, "session %u: %lu records in %.3f s, %.1f M records/s\n", session->number,
+            (unsigned long)session->records, seconds, seconds > 0 ? session->records / seconds / 1e6 : 0);
+    return ok ? 0 : 1;
+}
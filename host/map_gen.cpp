@@ -0,0 +1,323 @@
+//------------------------------------------------------------------------------
+// map_gen: builds and checks the throttle and torque maps for the EEPROM
+//------------------------------------------------------------------------------
+//
+//    map_gen -g [-t torque.csv] > throttle_maps.csv
+//    map_gen [-o maps.bin] throttle_maps.csv
+//    map_gen -d maps.bin > throttle_maps.csv
+//
+//    -g            generate the default maps as CSV
+//    -t file       engine torque curve for -g, "rpm,nm" lines (default
+//                  ../calibration/engine_torque.csv)
+//    -o file       write the EEPROM image (default: only check)
+//    -d file       check an EEPROM image and print its maps as CSV
+//
+//The CSV has one block per map, a header line then MAP_POINTS rows of
+//MAP_POINTS values, one row per pedal point from the lowest:
+//
+//    map,autocross,servo,rpm,0,9,pedal,0,5
+//
+//mode, output, then the name, min and shift of the x and y axis (points at
+//min + i * 2^shift). Every mode needs its servo and its kelly map. The
+//defaults are:
+//
+//    servo, autocross   pedal to servo angle scaled by peak / actual engine
+//                       torque at that rpm, so the pedal asks for a share of
+//                       the peak torque at any rpm (within what the engine has)
+//    servo, endurance   pedal straight to servo angle, as without maps
+//    servo, electric    0, the engine is off
+//    kelly, all modes   pedal straight to PWM
+//
+//Every map is checked before it is written: values in range (servo up to
+//SERVO_MAX_ANGLE, kelly up to 255), 0 with the pedal released, never less
+//output for more pedal, the pedal axis covering 0-255, and the firmware's
+//throttleMapLookup() against exact bilinear interpolation over both axes,
+//within a count.
+//
+//make -C host maps builds build/maps.bin from ../calibration/throttle_maps.csv.
+
+#include "throttle_map.h"
+#include "telemetry_frame.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+//As in arduino.c
+const int SERVO_MAX_ANGLE = 160;
+const int FULL            = 255;
+const int PEDAL_MAX       = 255;     //throttleKelly, the pedal input of the maps
+
+//Rounding plus the 8 bit position in a cell (see throttle_map.h)
+const double MAX_ERROR    = 1.0;
+
+static const char* modeNames[MAP_MODES] = {"autocross", "endurance", "electric", "electricregen"};
+static const char* kindNames[2]         = {"servo", "kelly"};
+static const char* xAxisNames[2]        = {"rpm", "velocity"};
+
+typedef std::vector<std::pair<double, double> > Curve;
+
+static bool readCurve(const char* path, Curve& curve)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[256];
+    double x, y;
+    while (fgets(line, sizeof(line), f))
+        if (line[0] != '#' && sscanf(line, "%lf , %lf", &x, &y) == 2) curve.push_back(std::make_pair(x, y));
+    fclose(f);
+    return curve.size() >= 2;
+}
+
+static double evaluate(const Curve& curve, double x)
+{
+    if (x <= curve.front().first) return curve.front().second;
+    for (size_t i = 1; i < curve.size(); i++)
+        if (x <= curve[i].first)
+            return curve[i - 1].second + (curve[i].second - curve[i - 1].second) *
+                   (x - curve[i - 1].first) / (curve[i].first - curve[i - 1].first);
+    return curve.back().second;
+}
+
+static int clampRound(double value, int high)
+{
+    int v = (int)floor(value + 0.5);
+    return v < 0 ? 0 : (v > high ? high : v);
+}
+
+static void printHeader()
+{
+    printf("# Throttle and torque maps, see throttle_map.h and host/map_gen.cpp\n");
+    printf("# map,mode,output,x_axis,x_min,x_shift,y_axis,y_min,y_shift then one row per pedal point\n");
+}
+
+static void printMap(int index, const ThrottleMap& m)
+{
+    int kind = index % 2;
+    printf("map,%s,%s,%s,%d,%d,pedal,%d,%d\n", modeNames[index / 2], kindNames[kind], xAxisNames[kind],
+           m.x.min, m.x.shift, m.y.min, m.y.shift);
+    for (int y = 0; y < MAP_POINTS; y++)
+        for (int x = 0; x < MAP_POINTS; x++) printf("%d%s", m.cells[y][x], x + 1 < MAP_POINTS ? "," : "\n");
+}
+
+static int generate(const char* torquePath)
+{
+    Curve torque;
+    if (!readCurve(torquePath, torque)) {
+        fprintf(stderr, "map_gen: cannot read two or more points from %s\n", torquePath);
+        return 1;
+    }
+
+    ThrottleMap servo = {{0, 9}, {0, 5}, {{0}}};        //0-4096 rpm, pedal 0-256
+    ThrottleMap kelly = {{0, 3}, {0, 5}, {{0}}};        //0-64 mph
+    double peak = 0;
+    for (int x = 0; x < MAP_POINTS; x++) peak = fmax(peak, evaluate(torque, x << servo.x.shift));
+
+    printHeader();
+    for (int mode = 1; mode <= MAP_MODES; mode++) {
+        for (int y = 0; y < MAP_POINTS; y++) {
+            double pedal = fmin(1.0, (double)(y << servo.y.shift) / PEDAL_MAX);
+            for (int x = 0; x < MAP_POINTS; x++) {
+                //Below a quarter of the peak (engine stopped, idling) there is nothing to even out
+                double available = fmax(evaluate(torque, x << servo.x.shift), peak / 4);
+                double share = (mode == 1) ? pedal * peak / available : pedal;
+                servo.cells[y][x] = mode <= 2 ? clampRound(share * SERVO_MAX_ANGLE, SERVO_MAX_ANGLE) : 0;
+                kelly.cells[y][x] = clampRound(pedal * FULL, FULL);
+            }
+        }
+        printMap(throttleMapIndex(mode, MAP_SERVO), servo);
+        printMap(throttleMapIndex(mode, MAP_KELLY), kelly);
+    }
+    return 0;
+}
+
+static bool readMaps(const char* path, ThrottleMap* maps)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) {fprintf(stderr, "map_gen: cannot open %s\n", path); return false;}
+    bool seen[MAP_COUNT] = {false};
+    char line[512];
+    int  current = -1, row = 0, lineNumber = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), f)) {
+        lineNumber++;
+        if (line[0] == '#' || line[0] == '\n') continue;
+        char mode[32], kind[32], xName[32], yName[32];
+        int  xMin, xShift, yMin, yShift;
+        if (sscanf(line, "map,%31[^,],%31[^,],%31[^,],%d,%d,%31[^,],%d,%d", mode, kind, xName, &xMin, &xShift,
+                   yName, &yMin, &yShift) == 8) {
+            if (current >= 0 && row != MAP_POINTS) break;
+            int m = -1, k = -1;
+            for (int i = 0; i < MAP_MODES; i++) if (strcmp(mode, modeNames[i]) == 0) m = i + 1;
+            for (int i = 0; i < 2; i++) if (strcmp(kind, kindNames[i]) == 0) k = i;
+            if (m < 0 || k < 0 || xShift < 0 || yShift < 0 || xShift > MAP_MAX_SHIFT || yShift > MAP_MAX_SHIFT) {ok = false; break;}
+            current = throttleMapIndex(m, k);
+            seen[current] = true;
+            maps[current].x.min = xMin;  maps[current].x.shift = xShift;
+            maps[current].y.min = yMin;  maps[current].y.shift = yShift;
+            row = 0;
+            continue;
+        }
+        if (current < 0 || row >= MAP_POINTS) {ok = false; break;}
+        char* p = line;
+        for (int x = 0; x < MAP_POINTS && ok; x++) {
+            char* end;
+            long v = strtol(p, &end, 10);
+            if (end == p || v < 0 || v > 255) ok = false;
+            maps[current].cells[row][x] = (uint8_t)v;
+            p = end + (*end == ',');
+        }
+        row++;
+    }
+    fclose(f);
+    if (!ok || (current >= 0 && row != MAP_POINTS)) {
+        fprintf(stderr, "map_gen: %s:%d: not a map header or a row of %d values 0-255\n", path, lineNumber, MAP_POINTS);
+        return false;
+    }
+    for (int i = 0; i < MAP_COUNT; i++) {
+        if (!seen[i]) {
+            fprintf(stderr, "map_gen: %s has no %s %s map\n", path, modeNames[i / 2], kindNames[i % 2]);
+            return false;
+        }
+    }
+    return true;
+}
+
+//Exact bilinear interpolation of the cells, for comparison
+static double bilinear(const ThrottleMap& m, double x, double y)
+{
+    double fx = (x - m.x.min) / (1 << m.x.shift), fy = (y - m.y.min) / (1 << m.y.shift);
+    fx = fmin(fmax(fx, 0), MAP_POINTS - 1);
+    fy = fmin(fmax(fy, 0), MAP_POINTS - 1);
+    int ix = fmin((int)fx, MAP_POINTS - 2), iy = fmin((int)fy, MAP_POINTS - 2);
+    fx -= ix;
+    fy -= iy;
+    double bottom = m.cells[iy][ix] * (1 - fx) + m.cells[iy][ix + 1] * fx;
+    double top    = m.cells[iy + 1][ix] * (1 - fx) + m.cells[iy + 1][ix + 1] * fx;
+    return bottom * (1 - fy) + top * fy;
+}
+
+static bool check(int index, const ThrottleMap& m)
+{
+    const char* name = kindNames[index % 2];
+    int  high = index % 2 == MAP_SERVO ? SERVO_MAX_ANGLE : FULL;
+    bool ok   = true;
+    if (m.y.min > 0 || m.y.min + ((MAP_POINTS - 1) << m.y.shift) < PEDAL_MAX) {
+        fprintf(stderr, "map_gen: %s %s: the pedal axis does not cover 0-%d\n", modeNames[index / 2], name, PEDAL_MAX);
+        ok = false;
+    }
+    for (int x = 0; x < MAP_POINTS; x++) {
+        if (throttleMapLookup(&m, m.x.min + (x << m.x.shift), 0) != 0) {
+            fprintf(stderr, "map_gen: %s %s: output with the pedal released at x point %d\n", modeNames[index / 2], name, x);
+            ok = false;
+        }
+        for (int y = 0; y < MAP_POINTS; y++) {
+            if (m.cells[y][x] > high) {
+                fprintf(stderr, "map_gen: %s %s: %d is above %d\n", modeNames[index / 2], name, m.cells[y][x], high);
+                ok = false;
+            }
+            if (y > 0 && m.cells[y][x] < m.cells[y - 1][x]) {
+                fprintf(stderr, "map_gen: %s %s: less output for more pedal at x point %d\n", modeNames[index / 2], name, x);
+                ok = false;
+            }
+        }
+    }
+
+    //Every pedal value over every x value of the axis and a bit beyond both ends
+    double worst = 0;
+    int    span  = (MAP_POINTS - 1) << m.x.shift;
+    int    step  = span > 4096 ? span / 4096 : 1;
+    for (int x = m.x.min - span / 8; x <= m.x.min + span + span / 8; x += step)
+        for (int y = 0; y <= PEDAL_MAX; y++)
+            worst = fmax(worst, fabs(throttleMapLookup(&m, x, y) - bilinear(m, x, y)));
+    fprintf(stderr, "%-13s %-5s  %-8s %5d-%-5d  pedal %d-%d  interpolation max error %.2f%s\n", modeNames[index / 2], name,
+            xAxisNames[index % 2], m.x.min, m.x.min + span, m.y.min, m.y.min + ((MAP_POINTS - 1) << m.y.shift), worst,
+            worst > MAX_ERROR ? "  <-- too far off" : "");
+    return ok && worst <= MAX_ERROR;
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: map_gen -g [-t torque.csv] > maps.csv\n"
+                    "       map_gen [-o maps.bin] maps.csv\n"
+                    "       map_gen -d maps.bin > maps.csv\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    bool        generating = false;
+    const char* torquePath = "../calibration/engine_torque.csv";
+    const char* outPath = 0;
+    const char* dumpPath = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "gt:o:d:")) != -1) {
+        switch (opt) {
+        case 'g': generating = true; break;
+        case 't': torquePath = optarg; break;
+        case 'o': outPath = optarg; break;
+        case 'd': dumpPath = optarg; break;
+        default:  usage();
+        }
+    }
+    if (generating) {
+        if (optind != argc || outPath || dumpPath) usage();
+        return generate(torquePath);
+    }
+
+    ThrottleMap maps[MAP_COUNT];
+    if (dumpPath) {
+        if (optind != argc || outPath) usage();
+        uint8_t image[MAP_STORE_BYTES];
+        FILE* f = fopen(dumpPath, "rb");
+        if (!f || fread(image, 1, sizeof(image), f) != sizeof(image)) {
+            fprintf(stderr, "map_gen: cannot read %u bytes from %s\n", MAP_STORE_BYTES, dumpPath);
+            return 1;
+        }
+        fclose(f);
+        uint16_t crc = 0xFFFF;
+        for (int i = 0; i < MAP_STORE_BYTES - 2; i++) crc = crc16(crc, image + i, 1);
+        if (image[0] != 'Y' || image[1] != 'M' || image[2] != MAP_VERSION || image[3] != MAP_COUNT ||
+            image[MAP_STORE_BYTES - 2] != (crc >> 8) || image[MAP_STORE_BYTES - 1] != (crc & 0xFF)) {
+            fprintf(stderr, "map_gen: %s holds no valid maps (header or CRC)\n", dumpPath);
+            return 1;
+        }
+        bool ok = true;
+        printHeader();
+        for (int i = 0; i < MAP_COUNT; i++) {
+            throttleMapDecode(image + MAP_HEADER_BYTES + i * MAP_RECORD_BYTES, &maps[i]);
+            ok = check(i, maps[i]) && ok;
+            printMap(i, maps[i]);
+        }
+        return ok ? 0 : 1;
+    }
+
+    if (optind != argc - 1) usage();
+    if (!readMaps(argv[optind], maps)) return 1;
+    bool ok = true;
+    for (int i = 0; i < MAP_COUNT; i++) ok = check(i, maps[i]) && ok;
+    if (!ok) {
+        fprintf(stderr, "map_gen: %s failed the checks, nothing written\n", argv[optind]);
+        return 1;
+    }
+    if (!outPath) return 0;
+
+    uint8_t image[MAP_STORE_BYTES] = {'Y', 'M', MAP_VERSION, MAP_COUNT};
+    for (int i = 0; i < MAP_COUNT; i++) throttleMapEncode(&maps[i], image + MAP_HEADER_BYTES + i * MAP_RECORD_BYTES);
+    uint16_t crc = 0xFFFF;
+    for (int i = 0; i < MAP_STORE_BYTES - 2; i++) crc = crc16(crc, image + i, 1);
+    image[MAP_STORE_BYTES - 2] = crc >> 8;
+    image[MAP_STORE_BYTES - 1] = crc & 0xFF;
+    FILE* f = fopen(outPath, "wb");
+    if (!f || fwrite(image, 1, sizeof(image), f) != sizeof(image) || fclose(f) != 0) {
+        fprintf(stderr, "map_gen: cannot write %s\n", outPath);
+        return 1;
+    }
+    fprintf(stderr, "%s: %u bytes at EEPROM address %u\n", outPath, MAP_STORE_BYTES, MAP_EEPROM_ADDRESS);
+    return 0;
+}
@@ -0,0 +1,279 @@
+//------------------------------------------------------------------------------
+// Vehicle plant model for closed-loop host runs
+//------------------------------------------------------------------------------
+
+#include "plant.h"
+#include "hal_host.h"
+
+#include <math.h>
+#include <stdio.h>
+
+//Car
+const double MASS           = 320;          //kg with the driver
+const double WHEEL_RADIUS   = 66 * 0.0254 / (2 * M_PI);  //66 inch circumference, as in arduino.c
+const double CDA            = 0.9;          //m^2, drag coefficient times frontal area
+const double ROLLING        = 0.015;
+const double SLIP_AT_PEAK   = 0.1;          //driven wheel slip at which the tyres grip the most
+const double SPIN_SLIP      = 0.5;          //slip gained per torque beyond the grip, as a share of it
+const double SPIN_GRIP      = 0.8;          //share of the grip a spinning tyre keeps
+const double DRIVELINE      = 0.9;          //efficiency from crank or motor to the wheel
+const double G              = 9.81;
+const double AIR            = 1.2;          //kg/m^3
+
+//Gas engine
+const double GEARS[]        = {2.9, 2.1, 1.6, 1.3, 1.1};
+const int    GEAR_COUNT     = sizeof(GEARS) / sizeof(GEARS[0]);
+const double FINAL_DRIVE    = 3.2;
+const double IDLE_RPM       = 1200;
+const double LAUNCH_RPM     = 2000;         //the clutch slips below this
+const double REV_LIMIT      = 4500;
+const double UPSHIFT_RPM    = 4000;
+const double DOWNSHIFT_RPM  = 2000;
+const double SHIFT_TIME     = 0.2;          //s with the clutch in
+const double SERVO_FULL     = 160;          //servo angle for wide open throttle, SERVO_MAX_ANGLE
+const double ENGINE_EFFICIENCY = 0.25;
+const double FUEL_ENERGY    = 43e6;         //J/kg
+const double IDLE_FUEL      = 0.1e-3;       //kg/s
+const double TANK           = 5.0;          //kg, a full fuel sender
+
+//Torque curve, Nm every 500 rpm from 0
+const double TORQUE[]       = {0, 8, 14, 18, 21, 23, 24, 25, 24, 20};
+const int    TORQUE_POINTS  = sizeof(TORQUE) / sizeof(TORQUE[0]);
+
+//Kelly motor and battery
+const double MOTOR_RATIO    = 4.0;
+const double MOTOR_TORQUE   = 40;           //Nm at full PWM
+const double MOTOR_POWER    = 12e3;         //W
+const double REGEN_TORQUE   = 30;           //Nm at full regen PWM
+const double MOTOR_EFFICIENCY = 0.88;
+const double REGEN_EFFICIENCY = 0.7;
+const double BATTERY        = 1.2 * 3.6e6;  //J, 1.2 kWh
+const double LOW_BATTERY    = 0.15;         //state of charge that pulls the low battery line
+
+//Radiator
+const double COOLANT        = 20e3;         //J/K
+const double COOLING        = 20;           //W/K standing
+const double COOLING_SPEED  = 6;            //W/K per m/s of air
+
+//Driver
+const double LOOKAHEAD      = 150;          //m
+const double REED_PULSE     = 0.002;        //s the reed switch stays closed
+
+//Firmware calibration, inverted (calibration/*.csv and THROTTLE_SCALE_* in arduino.c)
+const double RPM_FULL_SCALE = 4000;
+const double TEMP_FULL_SCALE = 300;         //°F at ADC 0
+const int    THROTTLE_MIN   = 555;
+const int    THROTTLE_MAX   = 602;
+
+static int adc(double fraction)
+{
+    if (fraction < 0) fraction = 0;
+    if (fraction > 1) fraction = 1;
+    return (int)floor(fraction * 1023 + 0.5);
+}
+
+static double clamp01(double x) {return x < 0 ? 0 : (x > 1 ? 1 : x);}
+
+static double engineTorque(double rpm)
+{
+    double x = rpm / 500;
+    int    i = (int)x;
+    if (i >= TORQUE_POINTS - 1) return rpm > REV_LIMIT ? 0 : TORQUE[TORQUE_POINTS - 1];
+    return TORQUE[i] + (TORQUE[i + 1] - TORQUE[i]) * (x - i);
+}
+
+std::vector<TrackSegment> plantDefaultTrack()
+{
+    //An autocross-like lap of about 800 m: straights, a slalom, hairpins, sweepers
+    static const double MPH = 0.44704;
+    static const TrackSegment lap[] = {
+        {120, 40 * MPH}, {25, 18 * MPH}, {60, 35 * MPH}, {15, 14 * MPH},
+        {40, 22 * MPH},  {40, 22 * MPH}, {40, 22 * MPH}, {90, 38 * MPH},
+        {20, 12 * MPH},  {70, 33 * MPH}, {35, 25 * MPH}, {150, 45 * MPH},
+        {30, 16 * MPH},  {65, 30 * MPH},
+    };
+    return std::vector<TrackSegment>(lap, lap + sizeof(lap) / sizeof(lap[0]));
+}
+
+bool plantLoadTrack(const char* path, std::vector<TrackSegment>& track)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    track.clear();
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        TrackSegment s;
+        double mph;
+        if (line[0] == '#' || sscanf(line, "%lf , %lf", &s.length, &mph) != 2) continue;
+        s.maxSpeed = mph * 0.44704;
+        if (s.length > 0 && s.maxSpeed > 0) track.push_back(s);
+    }
+    fclose(f);
+    return !track.empty();
+}
+
+double plantTrackLength(const PlantConfig* config)
+{
+    double length = 0;
+    for (size_t i = 0; i < config->track.size(); i++) length += config->track[i].length;
+    return length;
+}
+
+//Fastest speed the driver wants now: the segment limits ahead, less the
+//distance to brake down to them. On a slippery track the corners are taken
+//as much slower as the grip allows
+static double targetSpeed(const PlantState* s, const PlantConfig* c)
+{
+    double lapLength = plantTrackLength(c);
+    double position  = fmod(s->distance, lapLength);
+    double margin    = (0.8 + 0.2 * c->aggressiveness) * sqrt(c->grip / PLANT_DRY_GRIP);
+    double braking   = c->grip * G * (0.5 + 0.4 * c->aggressiveness);
+
+    double start = 0, target = 1e9;
+    size_t n = c->track.size();
+    for (size_t k = 0; k < 2 * n && start - position < LOOKAHEAD; k++) {
+        const TrackSegment& seg = c->track[k % n];
+        double end = start + seg.length;
+        if (end > position) {
+            double ahead = start > position ? start - position : 0;
+            double v     = sqrt(pow(seg.maxSpeed * margin, 2) + 2 * braking * ahead);
+            if (v < target) target = v;
+        }
+        start = end;
+    }
+    return target;
+}
+
+static void setSwitch(uint8_t pin, bool active)
+{
+    hostSetPin(pin, active ? LOW : HIGH);   //the car's switches pull LOW when active
+}
+
+static void writeInputs(const PlantState* s, const PlantConfig* c)
+{
+    hostSetPin(PLANT_THROTTLE_PIN, THROTTLE_MIN - 5 + (int)(s->throttlePedal * (THROTTLE_MAX - THROTTLE_MIN + 10)));
+    hostSetPin(PLANT_RPM_PIN,      adc(s->engineRpm / RPM_FULL_SCALE));
+    hostSetPin(PLANT_RADIATOR_PIN, adc((TEMP_FULL_SCALE - (s->radiator * 1.8 + 32)) / TEMP_FULL_SCALE));
+    hostSetPin(PLANT_FUEL_PIN,     adc(s->fuel / TANK));
+    hostSetPin(PLANT_GEAR_PIN,     s->time < s->shiftUntil ? 0 : s->gear * 170);
+    setSwitch(PLANT_BRAKE_PIN,       s->brakePedal > 0);
+    setSwitch(PLANT_CLUTCH_PIN,      s->time < s->shiftUntil);
+    setSwitch(PLANT_HV_LOW_BATT_PIN, s->soc < LOW_BATTERY);
+    (void)c;
+}
+
+void plantBegin(PlantState* s, const PlantConfig* c)
+{
+    *s = PlantState();
+    s->gear     = 1;
+    s->soc      = c->soc;
+    s->fuel     = c->fuel;
+    s->radiator = c->ambient + 60;          //warmed up on the grid
+    s->maxRadiator = s->radiator;
+
+    setSwitch(PLANT_SERVO_ENABLE,   true);
+    setSwitch(PLANT_KELLY_ENABLE,   true);
+    setSwitch(PLANT_BMS_FAULT_PIN,  false);
+    setSwitch(PLANT_TELEMETRY_PIN,  false);
+    hostSetPin(PLANT_ASSIST_PIN,    LOW);   //the assist and boost buttons read HIGH when pressed
+    hostSetPin(PLANT_BOOST_PIN,     LOW);
+    setSwitch(PLANT_MODE_ENDURANCE, c->mode == PLANT_ENDURANCE || c->mode == PLANT_ELECTRICREGEN);
+    setSwitch(PLANT_MODE_ELECTRIC,  c->mode == PLANT_ELECTRIC  || c->mode == PLANT_ELECTRICREGEN);
+    hostSetPin(PLANT_REED_PIN,      HIGH);
+    writeInputs(s, c);
+}
+
+void plantStep(PlantState* s, const PlantConfig* c, double dt)
+{
+    //Driver: pedals from the speed error, shifts at fixed rpm
+    double target = targetSpeed(s, c);
+    double error  = target - s->speed;
+    double gain   = 0.4 + 0.8 * c->aggressiveness;
+    s->throttlePedal = clamp01(error * gain);
+    s->brakePedal    = error < -0.3 ? clamp01(-error * gain * 0.5) : 0;
+
+    bool   shifting   = s->time < s->shiftUntil;
+    double wheelRpm   = s->speed * (1 + s->slip) / WHEEL_RADIUS * 60 / (2 * M_PI);   //driven
+    double ratio      = GEARS[s->gear - 1] * FINAL_DRIVE;
+    if (!shifting && wheelRpm * ratio > UPSHIFT_RPM && s->gear < GEAR_COUNT) {
+        s->gear++;
+        s->shiftUntil = s->time + SHIFT_TIME;
+    }
+    else if (!shifting && wheelRpm * ratio < DOWNSHIFT_RPM && s->gear > 1) {
+        s->gear--;
+        s->shiftUntil = s->time + SHIFT_TIME;
+    }
+    shifting = s->time < s->shiftUntil;
+    ratio    = GEARS[s->gear - 1] * FINAL_DRIVE;
+
+    //Gas engine, from the servo and the engine relay
+    bool   engineOn = hostPinOutput(PLANT_ENGINE_ENABLE) == HIGH;
+    double opening  = clamp01(hostServoAngle() / SERVO_FULL);
+    double rpm      = wheelRpm * ratio;
+    if (rpm < LAUNCH_RPM) rpm = opening > 0.05 ? LAUNCH_RPM : (rpm < IDLE_RPM ? IDLE_RPM : rpm);
+    if (!engineOn) rpm = 0;
+    double crank    = engineOn ? opening * engineTorque(rpm) : 0;
+    double wheel    = shifting ? 0 : crank * ratio;
+    double shaft    = crank * rpm * 2 * M_PI / 60;
+    if (engineOn) {
+        double burnt = (shaft / (ENGINE_EFFICIENCY * FUEL_ENERGY) + IDLE_FUEL) * dt;
+        if (burnt > s->fuel) burnt = s->fuel;
+        s->fuel     -= burnt;
+        s->fuelUsed += burnt;
+        if (s->fuel <= 0) wheel = 0, shaft = 0;
+    }
+    s->engineRpm = rpm;
+
+    //Kelly motor and regen, behind the high voltage relay
+    bool   hv       = hostPinOutput(PLANT_HV_ENABLE) == HIGH && s->soc > 0;
+    double motorW   = s->speed * (1 + s->slip) / WHEEL_RADIUS * MOTOR_RATIO;   //rad/s
+    double motor    = hv ? MOTOR_TORQUE * hostPinOutput(PLANT_KELLY_PIN) / 255.0 : 0;
+    if (motor * motorW > MOTOR_POWER) motor = MOTOR_POWER / motorW;
+    double regen    = hv && hostPinOutput(PLANT_REGEN_ENABLE) == HIGH ? REGEN_TORQUE * hostPinOutput(PLANT_REGEN_PIN) / 255.0 : 0;
+    if (s->speed < 1) regen = 0;
+    double drawn    = motor * motorW / MOTOR_EFFICIENCY * dt;
+    double returned = regen * motorW * REGEN_EFFICIENCY * dt;
+    s->batteryOut  += drawn;
+    s->regenIn     += returned;
+    s->soc         += (returned - drawn) / BATTERY;
+    if (s->soc < 0) s->soc = 0;
+    if (s->soc > 1) s->soc = 1;
+
+    //Forces at the wheel, the tyres limit both drive and braking. Drive beyond
+    //the grip spins the driven wheel up, and a spinning tyre pushes less
+    double drive = ((wheel + motor * MOTOR_RATIO) * DRIVELINE - regen * MOTOR_RATIO) / WHEEL_RADIUS;
+    double brake = s->brakePedal * c->grip * MASS * G;
+    double grip  = c->grip * MASS * G;
+    if (drive > grip) {
+        s->slip = SLIP_AT_PEAK + SPIN_SLIP * (drive - grip) / grip;
+        drive   = grip * (1 - (1 - SPIN_GRIP) * clamp01((s->slip - SLIP_AT_PEAK) / SPIN_SLIP));
+    }
+    else s->slip = drive > 0 ? SLIP_AT_PEAK * drive / grip : 0;
+    if (drive - brake < -grip) brake = drive + grip;
+    double resist = 0.5 * AIR * CDA * s->speed * s->speed + ROLLING * MASS * G;
+    double accel  = (drive - brake - (s->speed > 0 ? resist : 0)) / MASS;
+
+    double before = s->wheelTurns;
+    s->speed += accel * dt;
+    if (s->speed < 0) s->speed = 0;
+    s->distance   += s->speed * dt;
+    s->wheelTurns += s->speed * dt / (2 * M_PI * WHEEL_RADIUS);
+    if (s->speed > s->topSpeed) s->topSpeed = s->speed;
+
+    //One reed pulse per wheel revolution, at its time inside the step
+    uint64_t now = hostNowMicros();
+    for (double turn = floor(before) + 1; turn <= s->wheelTurns; turn++) {
+        uint64_t at = now + (uint64_t)((turn - before) / (s->wheelTurns - before) * dt * 1e6);
+        hostSchedulePin(at, PLANT_REED_PIN, LOW);
+        hostSchedulePin(at + (uint64_t)(REED_PULSE * 1e6), PLANT_REED_PIN, HIGH);
+    }
+
+    //Radiator: the coolant takes about as much heat as the crank delivers
+    double cooling = (COOLING + COOLING_SPEED * s->speed) * (s->radiator - c->ambient);
+    s->radiator += (shaft - cooling) / COOLANT * dt;
+    if (s->radiator > s->maxRadiator) s->maxRadiator = s->radiator;
+
+    if (hostPinOutput(PLANT_CRITICAL_PIN) == HIGH) s->criticalTime += dt;
+    s->time += dt;
+    writeInputs(s, c);
+}
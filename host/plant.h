@@ -0,0 +1,111 @@
+//------------------------------------------------------------------------------
+// Vehicle plant model for closed-loop host runs
+//------------------------------------------------------------------------------
+//The car around the firmware: a driver following a track, the gas engine
+//with its torque curve and gearbox, the Kelly motor and its battery, regen,
+//brakes, the wheel with its reed switch and the radiator. plantStep() reads
+//the firmware's outputs from the host HAL (servo angle, Kelly and regen PWM,
+//relays), moves the car by one step and drives the input pins the firmware
+//reads (throttle pot, rpm, radiator and fuel senders, reed pulses, brake,
+//clutch, mode selector, battery low).
+//
+//The model is deliberately simple, a point mass with one driven wheel and
+//the reed switch on an undriven one, and its constants are in plant.cpp.
+//The driven wheel slips a little as it pushes the car and spins up once the
+//torque is more than the tyres grip. The senders go through the inverse of the
+//firmware's calibration (calibration/*.csv as shipped), so the firmware
+//reads back the model's values.
+
+#ifndef PLANT_H
+#define PLANT_H
+
+#include <stdint.h>
+#include <vector>
+
+//Pins, same as the #defines in arduino.c section 1.1
+const uint8_t PLANT_RPM_PIN         = 54;   //A0
+const uint8_t PLANT_THROTTLE_PIN    = 55;   //A1
+const uint8_t PLANT_GEAR_PIN        = 56;   //A2
+const uint8_t PLANT_RADIATOR_PIN    = 57;   //A3
+const uint8_t PLANT_FUEL_PIN        = 58;   //A4
+const uint8_t PLANT_REED_PIN        = 21;
+const uint8_t PLANT_HV_LOW_BATT_PIN = 22;
+const uint8_t PLANT_BMS_FAULT_PIN   = 23;
+const uint8_t PLANT_CLUTCH_PIN      = 24;
+const uint8_t PLANT_BRAKE_PIN       = 25;
+const uint8_t PLANT_BOOST_PIN       = 27;
+const uint8_t PLANT_SERVO_ENABLE    = 28;
+const uint8_t PLANT_KELLY_ENABLE    = 29;
+const uint8_t PLANT_MODE_ENDURANCE  = 30;
+const uint8_t PLANT_TELEMETRY_PIN   = 31;
+const uint8_t PLANT_ASSIST_PIN      = 34;
+const uint8_t PLANT_MODE_ELECTRIC   = 39;
+const uint8_t PLANT_KELLY_PIN       = 3;
+const uint8_t PLANT_REGEN_PIN       = 4;
+const uint8_t PLANT_CRITICAL_PIN    = 33;
+const uint8_t PLANT_REGEN_ENABLE    = 35;
+const uint8_t PLANT_ENGINE_ENABLE   = 36;
+const uint8_t PLANT_HV_ENABLE       = 37;
+
+//The firmware's modes, as set on the mode selector
+const int PLANT_AUTOCROSS     = 1;
+const int PLANT_ENDURANCE     = 2;
+const int PLANT_ELECTRIC      = 3;
+const int PLANT_ELECTRICREGEN = 4;
+
+const double PLANT_DRY_GRIP   = 1.3;  //tyre friction coefficient the track's speeds are for
+
+struct TrackSegment {
+    double length;                  //m
+    double maxSpeed;                //m/s the grip allows through it
+};
+
+struct PlantConfig {
+    int    mode;                    //PLANT_AUTOCROSS ...
+    double aggressiveness;          //0-1, how close to the grip limit the driver goes
+    double soc;                     //initial battery state of charge, 0-1
+    double fuel;                    //initial fuel, kg
+    double ambient;                 //°C
+    double grip;                    //tyre friction coefficient, PLANT_DRY_GRIP in the dry
+    std::vector<TrackSegment> track;
+};
+
+struct PlantState {
+    double time;                    //s since plantBegin()
+    double distance;                //m along the track, all laps
+    double speed;                   //m/s
+    double wheelTurns;              //undriven wheel revolutions, for the reed switch
+    double slip;                    //driven wheel speed over the car's, less 1
+    int    gear;                    //1-5
+    double engineRpm;
+    double shiftUntil;              //the clutch is held in until this time
+    double soc;
+    double fuel;                    //kg left
+    double radiator;                //°C
+
+    //What the driver does this step
+    double throttlePedal;           //0-1
+    double brakePedal;              //0-1
+
+    //Totals
+    double topSpeed;                //m/s
+    double maxRadiator;             //°C
+    double fuelUsed;                //kg
+    double batteryOut;              //J drawn by the Kelly
+    double regenIn;                 //J put back by regen
+    double criticalTime;            //s with the critical LED on
+};
+
+std::vector<TrackSegment> plantDefaultTrack();
+bool                      plantLoadTrack(const char* path, std::vector<TrackSegment>& track);  //"length_m,max_mph" lines
+double                    plantTrackLength(const PlantConfig* config);
+
+//Sets the switches and senders, before the firmware's setup()
+void plantBegin(PlantState* state, const PlantConfig* config);
+
+//Moves the car by dt seconds with the outputs the firmware has set, then sets
+//the inputs for the end of the step; reed edges inside the step are scheduled
+//at their exact time. Call before advancing the host clock by dt.
+void plantStep(PlantState* state, const PlantConfig* config, double dt);
+
+#endif
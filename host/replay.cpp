@@ -0,0 +1,161 @@
+//------------------------------------------------------------------------------
+// replay: runs the control chain on recorded inputs
+//------------------------------------------------------------------------------
+//
+//    replay [-s] inputs.bin ...
+//    replay -i inputs.bin
+//
+//    -s   summary only: records, a hash of all outputs and replay speed
+//    -i   print the recorded inputs as CSV instead of replaying them
+//
+//An input trace (input_trace.h) holds the raw inputs of every control cycle,
+//as readInputs() took them: analog counts, switch levels and the reed pulses
+//the interrupt accepted. sim -r writes them. Each file is replayed from the
+//firmware's power-on state: setup(), then for every record the chain
+//controlTask() and outputTask() run, with applyInputs() in place of
+//readInputs(), and one CSV line of the outputs per record:
+//
+//    time_us,servo,kelly,regen,engine,hv,regen_enable,critical
+//
+//Nothing depends on the host clock, so a trace always replays to the same
+//outputs; the -s hash makes comparing two firmware versions on a whole trace
+//a one line diff.
+//
+//readInputs() takes the reed pulses before the time, so no pulse comes after
+//its record's time. Traces recorded before it did can hold such records;
+//they are replayed as recorded, and counted on stderr.
+
+#include "firmware.h"
+#include "hal_host.h"
+#include "input_trace.h"
+
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+struct Outputs {
+    int32_t servo;
+    int32_t kelly;
+    int32_t regen;
+    uint8_t engine;
+    uint8_t hv;
+    uint8_t regenEnable;
+    uint8_t critical;
+};
+
+//FNV-1a, 64 bit
+static uint64_t hashBytes(uint64_t hash, const void* data, size_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static void printInputs(const std::vector<InputRecord>& records)
+{
+    printf("time_us,rpm,throttle,gear,radiator,fuel,switches,reed_count,reed0,reed1\n");
+    for (size_t i = 0; i < records.size(); i++) {
+        const InputRecord& r = records[i];
+        printf("%lu,%u,%u,%u,%u,%u,0x%04x,%u", (unsigned long)r.time, r.analog[ADC_RPM], r.analog[ADC_THROTTLE],
+               r.analog[ADC_GEAR], r.analog[ADC_RADIATOR], r.analog[ADC_FUEL], r.switches, r.reedCount);
+        for (int p = 0; p < INPUT_REED_MAX; p++)
+            if (p < r.reedCount) printf(",%lu", (unsigned long)r.reed[p]);
+            else printf(",");
+        printf("\n");
+    }
+}
+
+static void replay(const char* path, const std::vector<InputRecord>& records, bool summary)
+{
+    hostReset();
+    hostSetCostModel(false);
+    setup();
+
+    if (!summary) printf("time_us,servo,kelly,regen,engine,hv,regen_enable,critical\n");
+    uint64_t hash  = 14695981039346656037ULL;
+    unsigned long late = 0;
+    auto     start = std::chrono::steady_clock::now();
+
+    for (size_t i = 0; i < records.size(); i++) {
+        const InputRecord& r = records[i];
+        for (uint8_t p = 0; p < r.reedCount; p++)
+            if ((int32_t)(r.reed[p] - r.time) > 0) {late++; break;}
+        currentTime = r.time / 1000;
+        endloop     = false;
+        applyInputs(&r);
+        processInputs();
+        runSecurityBlock();
+        if (endloop == false) runTheCar();
+        if (endloop == false) writeOutputs();
+
+        Outputs out = {servoOut, kellyOut, regenOut, engineOn, hiVoltageEnable, regenEnable, criticalCycle};
+        hash = hashBytes(hash, &out, sizeof(out));
+        if (!summary)
+            printf("%lu,%d,%d,%d,%d,%d,%d,%d\n", (unsigned long)r.time, out.servo, out.kelly, out.regen,
+                   out.engine, out.hv, out.regenEnable, out.critical);
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (summary) printf("%s,%lu,%016llx\n", path, (unsigned long)records.size(), (unsigned long long)hash);
+    fprintf(stderr, "%s: %lu records, %.2f s of driving, replayed at %.2f M records/s\n", path,
+            (unsigned long)records.size(), records.empty() ? 0 : (records.back().time - records.front().time) / 1e6,
+            seconds > 0 ? records.size() / seconds / 1e6 : 0);
+    if (late) fprintf(stderr, "%s: %lu records with a reed pulse stamped after the record's time\n", path, late);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: replay [-s] inputs.bin ...\n       replay -i inputs.bin\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    bool summary = false, inputs = false;
+    int  opt;
+    while ((opt = getopt(argc, argv, "si")) != -1) {
+        switch (opt) {
+        case 's': summary = true; break;
+        case 'i': inputs = true; break;
+        default:  usage();
+        }
+    }
+    if (optind == argc || (inputs && (summary || argc - optind != 1))) usage();
+
+    if (summary) printf("trace,records,output_hash\n");
+    fflush(stdout);
+
+    for (int a = optind; a < argc; a++) {
+        std::vector<InputRecord> records;
+        if (!inputTraceLoad(argv[a], records)) {
+            fprintf(stderr, "replay: %s is not an input trace\n", argv[a]);
+            return 1;
+        }
+        if (inputs) {
+            printInputs(records);
+            continue;
+        }
+
+        //A child per trace, so each one starts from the firmware's power-on state
+        pid_t pid = fork();
+        if (pid < 0) {perror("replay: fork"); return 1;}
+        if (pid == 0) {
+            replay(argv[a], records, summary);
+            fflush(stdout);
+            _exit(0);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "replay: %s failed\n", argv[a]);
+            return 1;
+        }
+    }
+    return 0;
+}
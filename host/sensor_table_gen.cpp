@@ -0,0 +1,134 @@
+//------------------------------------------------------------------------------
+// sensor_table_gen: builds sensor_tables.h from calibration CSVs
+//------------------------------------------------------------------------------
+//
+//    sensor_table_gen NAME=file.csv[:bits] ... > sensor_tables.h
+//
+//Each CSV has one calibration point per line, "adc,value", with the ADC count
+//0-1023 and the value in the sensor's engineering unit. Blank lines, lines
+//starting with '#' and a header line are skipped. Between points the sender
+//is taken to be linear, beyond the first and last point the end segments are
+//extended.
+//
+//The curve is sampled into a table of 2^bits segments (default 4, 16
+//segments) named NAME_TABLE, with NAME_TABLE_BITS. For every ADC count the
+//table is checked against the CSV curve with the firmware's own
+//sensorTableLookup(); the largest error goes into the header and to stderr,
+//more bits buy a closer fit on strongly curved senders.
+//
+//make -C host tables regenerates ../sensor_tables.h from ../calibration.
+
+#include "sensor_table.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+const int DEFAULT_BITS = 4;
+const int ADC_COUNTS   = 1 << SENSOR_ADC_BITS;
+
+typedef std::vector<std::pair<double, double> > Curve;
+
+static bool readCurve(const char* path, Curve& curve)
+{
+    FILE* f = fopen(path, "r");
+    if (!f) return false;
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        double adc, value;
+        if (line[0] == '#' || sscanf(line, "%lf , %lf", &adc, &value) != 2) continue;
+        curve.push_back(std::make_pair(adc, value));
+    }
+    fclose(f);
+    std::sort(curve.begin(), curve.end());
+    return curve.size() >= 2;
+}
+
+//Piecewise-linear through the points, end segments extended
+static double evaluate(const Curve& curve, double x)
+{
+    size_t i = 1;
+    while (i < curve.size() - 1 && x > curve[i].first) i++;
+    double x0 = curve[i - 1].first, y0 = curve[i - 1].second;
+    double x1 = curve[i].first,     y1 = curve[i].second;
+    if (x1 == x0) return y1;
+    return y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sensor_table_gen NAME=file.csv[:bits] ... > sensor_tables.h\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2) usage();
+
+    printf("//------------------------------------------------------------------------------\n");
+    printf("// Sensor linearization tables\n");
+    printf("//------------------------------------------------------------------------------\n");
+    printf("//Generated by host/sensor_table_gen from the CSVs in calibration/, do not edit:\n");
+    printf("//change the CSVs and run make -C host tables. See sensor_table.h.\n\n");
+    printf("#ifndef SENSOR_TABLES_H\n#define SENSOR_TABLES_H\n\n#include \"sensor_table.h\"\n");
+
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        size_t equals = arg.find('=');
+        if (equals == std::string::npos || equals == 0) usage();
+        std::string name = arg.substr(0, equals);
+        std::string path = arg.substr(equals + 1);
+        int bits = DEFAULT_BITS;
+        size_t colon = path.rfind(':');
+        if (colon != std::string::npos) {
+            bits = atoi(path.c_str() + colon + 1);
+            path = path.substr(0, colon);
+        }
+        if (bits < 1 || bits > SENSOR_ADC_BITS) {
+            fprintf(stderr, "sensor_table_gen: %s: bits must be 1-%d\n", name.c_str(), SENSOR_ADC_BITS);
+            return 1;
+        }
+
+        Curve curve;
+        if (!readCurve(path.c_str(), curve)) {
+            fprintf(stderr, "sensor_table_gen: cannot read two or more points from %s\n", path.c_str());
+            return 1;
+        }
+
+        int points = (1 << bits) + 1;
+        int width  = ADC_COUNTS >> bits;
+        std::vector<int16_t> table(points);
+        for (int p = 0; p < points; p++) {
+            double y = floor(evaluate(curve, (double)p * width) + 0.5);
+            if (y < -32768 || y > 32767) {
+                fprintf(stderr, "sensor_table_gen: %s does not fit 16 bits at ADC %d\n", name.c_str(), p * width);
+                return 1;
+            }
+            table[p] = (int16_t)y;
+        }
+
+        double worst = 0;
+        int    worstAdc = 0;
+        for (int adc = 0; adc < ADC_COUNTS; adc++) {
+            double error = fabs(sensorTableLookup(&table[0], bits, adc) - evaluate(curve, adc));
+            if (error > worst) {worst = error; worstAdc = adc;}
+        }
+        fprintf(stderr, "%-16s %2lu points, %3d segments, max error %.2f at ADC %d\n",
+                name.c_str(), (unsigned long)curve.size(), 1 << bits, worst, worstAdc);
+
+        std::string shown = path.compare(0, 3, "../") == 0 ? path.substr(3) : path;
+        printf("\n//%s, %lu calibration points, max error %.2f\n", shown.c_str(), (unsigned long)curve.size(), worst);
+        printf("const uint8_t %s_TABLE_BITS = %d;\n", name.c_str(), bits);
+        printf("const int16_t %s_TABLE[%d] PROGMEM = {", name.c_str(), points);
+        for (int p = 0; p < points; p++) printf("%s%d%s", p % 8 ? " " : "\n    ", table[p], p + 1 < points ? "," : "");
+        printf("\n};\n");
+    }
+
+    printf("\n#endif\n");
+    return 0;
+}
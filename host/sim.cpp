@@ -0,0 +1,305 @@
+//------------------------------------------------------------------------------
+// sim: closed-loop lap simulation of the firmware against the plant model
+//------------------------------------------------------------------------------
+//
+//    sim [-m modes] [-a aggressiveness] [-s soc] [-f fuel] [-l laps] [-e] [-b s] [-g grip] [-n] [-t track.csv] [-j jobs] [-p trace.csv] [-r inputs.bin] [-L card.img] [-E eeprom.bin]
+//
+//    -m modes      autocross,endurance,electric,electricregen or all  (default all)
+//    -a list       driver aggressiveness, 0-1                         (default 0.8)
+//    -s list       initial battery state of charge, 0-1               (default 1)
+//    -f list       initial fuel, kg (a full tank is 5)                (default 4)
+//    -l laps       laps per scenario                                  (default 1)
+//    -e            endurance with the fixed assist and regen instead of the
+//                  energy plan (kTelemetryDataCommandEnergyManager=0)
+//    -b s          the driver holds the boost button for the first s seconds,
+//                  a launch from the line (default 0, never)
+//    -g grip       tyre friction coefficient, e.g. 0.35 in the wet      (default 1.3)
+//    -n            traction control off (kTelemetryDataCommandTractionControl=0)
+//    -t file       track, lines of "length_m,max_mph"                 (default: built-in autocross)
+//    -j jobs       scenarios run in parallel                          (default 1)
+//    -p file       write a 10 Hz trace of the run, single scenario only
+//    -r file       record the firmware's inputs of every control cycle for replay,
+//                  single scenario only (see input_trace.h)
+//    -L file       SD card image for the data logger, single scenario only; each
+//                  run appends a session (see logger.h, log_decode)
+//    -E file       EEPROM image, e.g. the throttle maps from map_gen (default: erased)
+//
+//Lists are comma separated values or from:to:step ranges. Every combination
+//of mode, aggressiveness, state of charge and fuel is one scenario, one CSV
+//line on stdout with lap time and energy use. A scenario that runs out of
+//fuel or battery on the way has no lap time.
+//
+//Before the start the pit tells the car its charge and the distance, as
+//over telemetry (<36=soc,37=meters>), so the endurance plan covers the whole
+//run. soc_error is the largest difference between the firmware's battery
+//estimate and the plant's state of charge along the run, in percent.
+//
+//Each scenario runs setup() and loop() in a forked child, so every one
+//starts from the firmware's power-on state. Time is virtual: the plant moves
+//in 1 ms steps and the HAL cost model is off, so runs are much faster than
+//real time. See plant.h for the model.
+
+#include "firmware.h"
+#include "hal_host.h"
+#include "input_trace.h"
+#include "plant.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <vector>
+
+const double STEP          = 0.001;    //s, the control task period
+const int    LOOPS_PER_STEP = 6;       //scheduler passes, one per task that may be due
+const double TIME_LIMIT    = 300;      //s per lap before a run counts as not finished
+const double STALL_LIMIT   = 10;       //s standing still, after which it does not finish either
+const double TRACE_PERIOD  = 0.1;      //s
+
+static const char* modeNames[] = {"", "autocross", "endurance", "electric", "electricregen"};
+
+struct Result {
+    double lapTime;                    //s per lap, 0 when not finished
+    double topSpeed;                   //mph
+    double fuelUsed;                   //g
+    double batteryOut;                 //kJ
+    double regenIn;                    //kJ
+    double soc;                        //at the end
+    double maxRadiator;                //°F
+    double criticalTime;               //s
+    double socError;                   //percent, largest
+};
+
+static bool parseList(const char* text, std::vector<double>& values)
+{
+    values.clear();
+    double from, to, step;
+    if (sscanf(text, "%lf:%lf:%lf", &from, &to, &step) == 3) {
+        if (step <= 0) return false;
+        for (double v = from; v <= to + step / 1e6; v += step) values.push_back(v);
+        return !values.empty();
+    }
+    std::string s = text;
+    size_t start = 0;
+    while (start <= s.size()) {
+        size_t comma = s.find(',', start);
+        if (comma == std::string::npos) comma = s.size();
+        char* end;
+        std::string item = s.substr(start, comma - start);
+        double v = strtod(item.c_str(), &end);
+        if (item.empty() || *end) return false;
+        values.push_back(v);
+        start = comma + 1;
+    }
+    return !values.empty();
+}
+
+static bool parseModes(const char* text, std::vector<int>& modes)
+{
+    modes.clear();
+    std::string s = std::string(text) + ",";
+    size_t start = 0, comma;
+    while ((comma = s.find(',', start)) != std::string::npos) {
+        std::string name = s.substr(start, comma - start);
+        start = comma + 1;
+        if (name == "all") {
+            for (int m = PLANT_AUTOCROSS; m <= PLANT_ELECTRICREGEN; m++) modes.push_back(m);
+            continue;
+        }
+        int found = 0;
+        for (int m = PLANT_AUTOCROSS; m <= PLANT_ELECTRICREGEN; m++) if (name == modeNames[m]) found = m;
+        if (!found) return false;
+        modes.push_back(found);
+    }
+    return !modes.empty();
+}
+
+static Result run(const PlantConfig& config, int laps, bool managed, bool traction, double boost, FILE* trace, FILE* inputs)
+{
+    hostReset();
+    hostSetCostModel(false);
+
+    PlantState state;
+    plantBegin(&state, &config);
+    setup();
+
+    double length    = plantTrackLength(&config) * laps;
+    telemetrySendSetGlobal(kTelemetryDataCommandBatteryLevel, (int)floor(config.soc * 100 + 0.5));
+    telemetrySendSetGlobal(kTelemetryDataCommandEnduranceDistance, (int)length);
+    telemetrySendSetGlobal(kTelemetryDataCommandEnergyManager, managed ? 1 : 0);
+    telemetrySendSetGlobal(kTelemetryDataCommandTractionControl, traction ? 1 : 0);
+
+    double nextTrace = 0;
+    double moving    = 0;
+    double socError  = 0;
+    int64_t recorded = -1;            //time of the last input record written
+    if (trace) fprintf(trace, "time,distance,mph,gear,rpm,pedal,brake,servo,kelly,regen,soc,radiator_f,slip,slip_estimate\n");
+
+    while (state.distance < length && state.time < TIME_LIMIT * laps && state.time - moving < STALL_LIMIT) {
+        hostSetPin(PLANT_BOOST_PIN, state.time < boost ? HIGH : LOW);
+        for (int i = 0; i < LOOPS_PER_STEP; i++) loop();
+        if (inputs && (int64_t)controlInputs.time != recorded) {
+            inputTraceWrite(inputs, &controlInputs);
+            recorded = controlInputs.time;
+        }
+        plantStep(&state, &config, STEP);
+        hostAdvanceMicros((uint64_t)(STEP * 1e6));
+        if (state.speed > 0.1) moving = state.time;
+        double error = fabs(energy.battery * 100.0 / energy.config->batteryJoules - state.soc * 100);
+        if (error > socError) socError = error;
+
+        if (trace && state.time >= nextTrace) {
+            nextTrace += TRACE_PERIOD;
+            fprintf(trace, "%.2f,%.1f,%.1f,%d,%.0f,%.2f,%.2f,%d,%d,%d,%.4f,%.1f,%.3f,%.3f\n",
+                    state.time, state.distance, state.speed / 0.44704, state.gear, state.engineRpm,
+                    state.throttlePedal, state.brakePedal, hostServoAngle(), hostPinOutput(PLANT_KELLY_PIN),
+                    hostPinOutput(PLANT_REGEN_ENABLE) ? hostPinOutput(PLANT_REGEN_PIN) : 0,
+                    state.soc, state.radiator * 1.8 + 32, state.slip, slip.slip / 256.0);
+        }
+    }
+
+    Result r;
+    r.lapTime      = state.distance >= length ? state.time / laps : 0;
+    r.topSpeed     = state.topSpeed / 0.44704;
+    r.fuelUsed     = state.fuelUsed * 1e3;
+    r.batteryOut   = state.batteryOut / 1e3;
+    r.regenIn      = state.regenIn / 1e3;
+    r.soc          = state.soc;
+    r.maxRadiator  = state.maxRadiator * 1.8 + 32;
+    r.criticalTime = state.criticalTime;
+    r.socError     = socError;
+    return r;
+}
+
+struct Job {
+    PlantConfig config;
+    pid_t       pid;
+    int         fd;
+};
+
+static void finish(Job& job)
+{
+    Result r;
+    memset(&r, 0, sizeof(r));
+    ssize_t got = read(job.fd, &r, sizeof(r));
+    close(job.fd);
+    int status;
+    waitpid(job.pid, &status, 0);
+    if (got != (ssize_t)sizeof(r)) {
+        fprintf(stderr, "sim: %s scenario failed\n", modeNames[job.config.mode]);
+        memset(&r, 0, sizeof(r));
+    }
+    printf("%s,%.2f,%.2f,%.2f,%.2f,%.1f,%.2f,%.1f,%.1f,%.4f,%.1f,%.2f,%.1f\n", modeNames[job.config.mode],
+           job.config.aggressiveness, job.config.soc, job.config.fuel, r.lapTime, r.topSpeed, r.fuelUsed,
+           r.batteryOut, r.regenIn, r.soc, r.maxRadiator, r.criticalTime, r.socError);
+    fflush(stdout);
+}
+
+static void usage()
+{
+    fprintf(stderr, "usage: sim [-m modes] [-a aggressiveness] [-s soc] [-f fuel] [-l laps] [-e] [-b s] [-g grip] [-n] [-t track.csv] [-j jobs] [-p trace.csv] [-r inputs.bin] [-L card.img] [-E eeprom.bin]\n");
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<int>    modes;
+    std::vector<double> aggressiveness(1, 0.8), socs(1, 1.0), fuels(1, 4.0);
+    int                 laps  = 1;
+    bool                managed = true;
+    double              boost   = 0;
+    bool                traction = true;
+    int                 jobs  = 1;
+    const char*         tracePath = 0;
+    const char*         inputsPath = 0;
+    const char*         cardPath = 0;
+    const char*         eepromPath = 0;
+    PlantConfig         base;
+    base.ambient = 25;
+    base.grip    = PLANT_DRY_GRIP;
+    base.track   = plantDefaultTrack();
+    parseModes("all", modes);
+
+    int opt;
+    while ((opt = getopt(argc, argv, "m:a:s:f:l:eb:g:nt:j:p:r:L:E:")) != -1) {
+        switch (opt) {
+        case 'm': if (!parseModes(optarg, modes)) usage(); break;
+        case 'a': if (!parseList(optarg, aggressiveness)) usage(); break;
+        case 's': if (!parseList(optarg, socs)) usage(); break;
+        case 'f': if (!parseList(optarg, fuels)) usage(); break;
+        case 'l': laps = atoi(optarg); break;
+        case 'e': managed = false; break;
+        case 'b': boost = atof(optarg); break;
+        case 'g': base.grip = atof(optarg); break;
+        case 'n': traction = false; break;
+        case 't':
+            if (!plantLoadTrack(optarg, base.track)) {fprintf(stderr, "sim: cannot load track %s\n", optarg); return 1;}
+            break;
+        case 'j': jobs = atoi(optarg); break;
+        case 'p': tracePath = optarg; break;
+        case 'r': inputsPath = optarg; break;
+        case 'L': cardPath = optarg; break;
+        case 'E': eepromPath = optarg; break;
+        default:  usage();
+        }
+    }
+    if (optind != argc || laps < 1 || jobs < 1) usage();
+
+    std::vector<PlantConfig> scenarios;
+    for (size_t m = 0; m < modes.size(); m++)
+        for (size_t a = 0; a < aggressiveness.size(); a++)
+            for (size_t s = 0; s < socs.size(); s++)
+                for (size_t f = 0; f < fuels.size(); f++) {
+                    PlantConfig c = base;
+                    c.mode           = modes[m];
+                    c.aggressiveness = aggressiveness[a];
+                    c.soc            = socs[s];
+                    c.fuel           = fuels[f];
+                    scenarios.push_back(c);
+                }
+
+    if ((tracePath || inputsPath || cardPath) && scenarios.size() != 1) {
+        fprintf(stderr, "sim: -p, -r and -L need a single scenario\n");
+        return 1;
+    }
+
+    printf("mode,aggressiveness,soc_start,fuel_start_kg,lap_s,top_mph,fuel_g,battery_kj,regen_kj,soc_end,max_radiator_f,critical_s,soc_error\n");
+    fflush(stdout);
+
+    //Children report their Result through a pipe; results are printed in scenario order
+    std::vector<Job> running;
+    for (size_t i = 0; i < scenarios.size(); i++) {
+        if ((int)running.size() >= jobs) {
+            finish(running.front());
+            running.erase(running.begin());
+        }
+        int fds[2];
+        if (pipe(fds) != 0) {perror("sim: pipe"); return 1;}
+        pid_t pid = fork();
+        if (pid < 0) {perror("sim: fork"); return 1;}
+        if (pid == 0) {
+            close(fds[0]);
+            FILE* trace = tracePath ? fopen(tracePath, "w") : 0;
+            FILE* inputs = inputsPath ? inputTraceCreate(inputsPath) : 0;
+            if (inputsPath && !inputs) {perror("sim: cannot create input trace"); _exit(1);}
+            if (cardPath && !hostStorageOpen(cardPath)) {perror("sim: cannot open card image"); _exit(1);}
+            if (eepromPath && !hostEepromOpen(eepromPath)) {perror("sim: cannot open EEPROM image"); _exit(1);}
+            Result r = run(scenarios[i], laps, managed, traction, boost, trace, inputs);
+            if (trace) fclose(trace);
+            if (inputs) fclose(inputs);
+            ssize_t written = write(fds[1], &r, sizeof(r));
+            _exit(written == (ssize_t)sizeof(r) ? 0 : 1);
+        }
+        close(fds[1]);
+        Job job = {scenarios[i], pid, fds[0]};
+        running.push_back(job);
+    }
+    while (!running.empty()) {
+        finish(running.front());
+        running.erase(running.begin());
+    }
+    return 0;
+}
@@ -0,0 +1,49 @@
+//------------------------------------------------------------------------------
+// telemetry_decode: binary telemetry frames to text
+//------------------------------------------------------------------------------
+//
+//    car -n 20000 -s drive.txt | telemetry_decode [-c]
+//
+//Reads the byte stream from stdin and prints one line per valid frame, in the
+//old <ID=value,...> notation, or with -c as "sequence,id,value" CSV rows.
+//Plain and delta frames are both understood; differences that arrive after a
+//lost frame, before the next whole value of their ID, are not printed.
+//Frame, CRC error, lost frame and unresolved difference counts go to stderr
+//at the end.
+
+#include "telemetry_frame.h"
+
+#include <stdio.h>
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+    bool csv = (argc == 2 && strcmp(argv[1], "-c") == 0);
+    if (argc > 2 || (argc == 2 && !csv)) {
+        fprintf(stderr, "usage: telemetry_decode [-c] < stream\n");
+        return 2;
+    }
+
+    FrameDecoder decoder;
+    frameDecoderReset(&decoder);
+
+    if (csv) printf("sequence,id,value\n");
+    int c;
+    while ((c = getchar()) != EOF) {
+        if (!framePush(&decoder, (uint8_t)c)) continue;
+        if (csv) {
+            for (uint8_t i = 0; i < decoder.fieldCount; i++)
+                printf("%u,%u,%d\n", decoder.sequence, decoder.ids[i], decoder.values[i]);
+        } else {
+            putchar('<');
+            for (uint8_t i = 0; i < decoder.fieldCount; i++)
+                printf("%s%u=%d", i ? "," : "", decoder.ids[i], decoder.values[i]);
+            printf(">\n");
+        }
+    }
+
+    fprintf(stderr, "%lu frames, %lu CRC errors, %lu lost, %lu unresolved\n",
+            (unsigned long)decoder.frames, (unsigned long)decoder.crcErrors,
+            (unsigned long)decoder.lostFrames, (unsigned long)decoder.unresolved);
+    return 0;
+}
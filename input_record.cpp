@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+// Control input records
+//------------------------------------------------------------------------------
+
+#include "input_record.h"
+
+static uint8_t* put16(uint8_t* out, uint16_t v)
+{
+    out[0] = v & 0xFF;
+    out[1] = v >> 8;
+    return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t v)
+{
+    return put16(put16(out, v & 0xFFFF), v >> 16);
+}
+
+static uint16_t get16(const uint8_t* in) {return in[0] | (uint16_t)in[1] << 8;}
+static uint32_t get32(const uint8_t* in) {return get16(in) | (uint32_t)get16(in + 2) << 16;}
+
+void inputRecordEncode(const InputRecord* r, uint8_t* out)
+{
+    out = put32(out, r->time);
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++) out = put16(out, r->analog[i]);
+    out = put16(out, r->switches);
+    *out++ = r->reedCount;
+    for (uint8_t i = 0; i < INPUT_REED_MAX; i++) out = put32(out, i < r->reedCount ? r->reed[i] : 0);
+}
+
+void inputRecordDecode(const uint8_t* in, InputRecord* r)
+{
+    r->time = get32(in);
+    in += 4;
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++, in += 2) r->analog[i] = get16(in);
+    r->switches  = get16(in);
+    in += 2;
+    r->reedCount = *in++;
+    if (r->reedCount > INPUT_REED_MAX) r->reedCount = INPUT_REED_MAX;
+    for (uint8_t i = 0; i < INPUT_REED_MAX; i++, in += 4) r->reed[i] = get32(in);
+}
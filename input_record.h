@@ -0,0 +1,48 @@
+//------------------------------------------------------------------------------
+// Control input records
+//------------------------------------------------------------------------------
+//Everything one control cycle reads from the car, as raw as it was read: the
+//ADC snapshot, the digital pin levels and the reed pulses taken from the
+//interrupt. readInputs() fills one record and applyInputs() turns it into the
+//program's input variables, so a recorded stream of records fed to
+//applyInputs() replays the control code bit for bit (host/replay).
+//
+//Records are serialized little endian in INPUT_RECORD_BYTES.
+
+#ifndef INPUT_RECORD_H
+#define INPUT_RECORD_H
+
+#include "hal.h"
+#include "adc_sampler.h"
+
+const uint8_t INPUT_REED_MAX = 2;          //Reed pulses per record, more wait for the next one
+
+//Bits of switches: pin levels, 1 = HIGH
+const uint16_t INPUT_HV_LOW_BATT    = 1 << 0;
+const uint16_t INPUT_BMS_FAULT      = 1 << 1;
+const uint16_t INPUT_CLUTCH         = 1 << 2;
+const uint16_t INPUT_ASSIST         = 1 << 3;
+const uint16_t INPUT_SERVO_ENABLE   = 1 << 4;
+const uint16_t INPUT_KELLY_ENABLE   = 1 << 5;
+const uint16_t INPUT_BRAKE          = 1 << 6;
+const uint16_t INPUT_MODE_ENDURANCE = 1 << 7;
+const uint16_t INPUT_MODE_ELECTRIC  = 1 << 8;
+const uint16_t INPUT_TELEMETRY      = 1 << 9;
+const uint16_t INPUT_REED           = 1 << 10;
+const uint16_t INPUT_BOOST          = 1 << 11;
+const uint16_t INPUT_REED_LOST      = 1 << 15;  //Not a pin: reed pulses were lost before this record
+
+struct InputRecord {
+    uint32_t time;                          //micros() when the inputs were read
+    uint16_t analog[ADC_CHANNELS];          //Indexed by ADC_*
+    uint16_t switches;                      //INPUT_* bits
+    uint8_t  reedCount;
+    uint32_t reed[INPUT_REED_MAX];          //Pulse timestamps, oldest first, none after time
+};
+
+const uint8_t INPUT_RECORD_BYTES = 4 + 2 * ADC_CHANNELS + 2 + 1 + 4 * INPUT_REED_MAX;
+
+void inputRecordEncode(const InputRecord* record, uint8_t* out);
+void inputRecordDecode(const uint8_t* in, InputRecord* record);
+
+#endif
@@ -0,0 +1,43 @@
+//------------------------------------------------------------------------------
+// Launch control and boost
+//------------------------------------------------------------------------------
+
+#include "launch.h"
+
+void launchBegin(LaunchControl* l, const LaunchConfig* config)
+{
+    memset(l, 0, sizeof(*l));
+    l->config = config;
+}
+
+boolean launchStep(LaunchControl* l, uint32_t micros, boolean boost, boolean clutch, boolean brake, int mph)
+{
+    const LaunchConfig* c = l->config;
+    uint8_t state = l->state;
+
+    if (boost == false) state = LAUNCH_OFF;
+    else switch (state) {
+        case LAUNCH_OFF:
+            //Waiting at the line may well be on the brake
+            if (clutch && mph == 0) state = LAUNCH_STAGED;
+            else                    state = brake ? LAUNCH_LOCKED : LAUNCH_BOOST;
+            break;
+        case LAUNCH_STAGED:
+            if (!clutch && !brake) state = LAUNCH_SLIP;
+            break;
+        case LAUNCH_SLIP:
+            if (brake) state = LAUNCH_LOCKED;
+            else if (mph >= c->slipEndMph || micros - l->since >= (uint32_t)c->slipMaxMillis * 1000) state = LAUNCH_BOOST;
+            break;
+        case LAUNCH_BOOST:
+            if (brake) state = LAUNCH_LOCKED;
+            break;
+    }
+    if (state != l->state) l->since = micros;
+
+    uint8_t pwm = (state == LAUNCH_SLIP || state == LAUNCH_BOOST) ? LAUNCH_FULL_PWM : 0;
+    boolean changed = state != l->state || pwm != l->pwm;
+    l->state = state;
+    l->pwm   = pwm;
+    return changed;
+}
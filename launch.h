@@ -0,0 +1,62 @@
+//------------------------------------------------------------------------------
+// Launch control and boost
+//------------------------------------------------------------------------------
+//While the boost button is held the motor gets full Kelly PWM, whatever the
+//mode, and keeps it with the clutch in. At a standstill with the clutch in
+//the button stages a launch instead: the motor waits at 0 while the driver
+//brings up the engine, and when the clutch is let out it holds full PWM for
+//as long as the clutch slips, then carries on as boost.
+//
+//    OFF     ---button, stopped, clutch in-->  STAGED   Kelly 0
+//    OFF     ---button otherwise-------------> BOOST    full Kelly
+//    STAGED  ---clutch out, brake off--------> SLIP     full Kelly
+//    SLIP    ---slipEndMph or slipMaxMillis--> BOOST
+//    SLIP, BOOST ---brake-------------------> LOCKED   the mode decides
+//    any     ---button released--------------> OFF
+//
+//Wheelspin is left to the traction control (slip.h), which cuts the PWM
+//given here like any other.
+//
+//launchStep() is meant for a task of its own, at a higher rate and priority
+//than the control task, with the button, clutch and brake read from the pins
+//there and then.
+
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include "hal.h"
+
+const uint8_t LAUNCH_FULL_PWM = 255;
+
+const uint8_t LAUNCH_OFF    = 0;
+const uint8_t LAUNCH_STAGED = 1;
+const uint8_t LAUNCH_SLIP   = 2;
+const uint8_t LAUNCH_BOOST  = 3;
+const uint8_t LAUNCH_LOCKED = 4;   //braked during the boost, until the button is let go
+
+struct LaunchConfig {
+    uint8_t  slipEndMph;            //the clutch has caught up with the engine by this speed
+    uint16_t slipMaxMillis;         //or after this long
+};
+
+struct LaunchControl {
+    const LaunchConfig* config;
+    uint8_t  state;                 //LAUNCH_*
+    uint8_t  pwm;                   //for the Kelly while launchActive()
+    uint32_t since;                 //micros the state was entered
+};
+
+void    launchBegin(LaunchControl* l, const LaunchConfig* config);
+
+//Every run of the launch task. boost, clutch and brake are true when pressed.
+//Returns true when the state or the PWM changed, the outputs should be
+//written right away
+boolean launchStep(LaunchControl* l, uint32_t micros, boolean boost, boolean clutch, boolean brake, int mph);
+
+//The launch control owns the Kelly output: staged, slipping or boosting
+inline boolean launchActive(const LaunchControl* l)
+{
+    return l->state == LAUNCH_STAGED || l->state == LAUNCH_SLIP || l->state == LAUNCH_BOOST;
+}
+
+#endif
@@ -0,0 +1,200 @@
+//------------------------------------------------------------------------------
+// On-car data logger
+//------------------------------------------------------------------------------
+
+#include "logger.h"
+
+const uint8_t LOGGER_OFF    = 0;   //no card
+const uint8_t LOGGER_ON     = 1;
+const uint8_t LOGGER_FAILED = 2;   //the card stopped taking blocks
+
+//Record layout, in logEncode() order. The ADC fields follow the ADC_* order.
+static const LogField FIELDS[] PROGMEM = {
+    {"time_us",  LOG_U32, 1},
+    {"rpm_adc",  LOG_U16, 1},
+    {"fuel_adc", LOG_U16, 1},
+    {"thr_adc",  LOG_U16, 1},
+    {"rad_adc",  LOG_U16, 1},
+    {"gear_adc", LOG_U16, 1},
+    {"switches", LOG_U16, 1},
+    {"reed_n",   LOG_U8,  1},
+    {"reed",     LOG_U32, INPUT_REED_MAX},
+    {"rpm",      LOG_I16, 1},
+    {"velocity", LOG_I16, 1},
+    {"throttle", LOG_I16, 1},
+    {"rad_temp", LOG_I16, 1},
+    {"fuel",     LOG_I16, 1},
+    {"gear",     LOG_U8,  1},
+    {"mode",     LOG_U8,  1},
+    {"servo",    LOG_I16, 1},
+    {"kelly",    LOG_I16, 1},
+    {"regen",    LOG_I16, 1},
+    {"flags",    LOG_U8,  1},
+};
+const uint8_t FIELD_COUNT = sizeof(FIELDS) / sizeof(FIELDS[0]);
+
+static uint8_t  blocks[2][HAL_STORAGE_BLOCK];
+static uint8_t  state = LOGGER_OFF;
+static uint16_t session;
+static uint32_t nextBlock;          //Address of the next block to queue
+static uint8_t  filling;            //Block receiving records
+static uint8_t  records;            //Records in it
+static int8_t   outBlock = -1;      //Block waiting for or being written to the card, -1 for none
+static uint32_t outAddress;
+static boolean  outStarted;
+static uint32_t dropped;
+
+static uint8_t* put16(uint8_t* out, uint16_t v)
+{
+    out[0] = v & 0xFF;
+    out[1] = v >> 8;
+    return out + 2;
+}
+
+static uint8_t* put32(uint8_t* out, uint32_t v)
+{
+    return put16(put16(out, v & 0xFFFF), v >> 16);
+}
+
+static uint32_t get32(const uint8_t* in)
+{
+    return in[0] | (uint32_t)in[1] << 8 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 24;
+}
+
+static void blockHead(uint8_t* block, uint8_t type, uint8_t count, uint32_t address)
+{
+    block[0] = 'Y';
+    block[1] = 'L';
+    block[2] = type;
+    block[3] = count;
+    put32(block + 4, address);
+    put16(block + 8, session);
+    block[10] = 0;
+    block[11] = 0;
+}
+
+//A block of ours, at the address it was written to
+static boolean readOurs(uint32_t address, uint8_t* block)
+{
+    return halStorageRead(address, block) && block[0] == 'Y' && block[1] == 'L' && get32(block + 4) == address;
+}
+
+//First block that is not ours, and the session of the one before it
+static uint32_t findEnd(uint16_t* lastSession)
+{
+    uint8_t* block = blocks[0];
+    *lastSession = 0;
+    if (!readOurs(0, block)) return 0;
+
+    //Double until past the end, then bisect: ours at low, not at high
+    uint32_t low = 0, high = 1;
+    while (high < 0x80000000UL && readOurs(high, block)) {
+        low  = high;
+        high *= 2;
+    }
+    while (high - low > 1) {
+        uint32_t middle = low + (high - low) / 2;
+        if (readOurs(middle, block)) low = middle;
+        else high = middle;
+    }
+    readOurs(low, block);
+    *lastSession = block[8] | (uint16_t)block[9] << 8;
+    return high;
+}
+
+boolean logBegin(uint8_t csPin)
+{
+    state    = LOGGER_OFF;
+    outBlock = -1;
+    dropped  = 0;
+    if (!halStorageBegin(csPin)) return false;
+
+    uint16_t lastSession;
+    uint32_t end = findEnd(&lastSession);
+    session = lastSession + 1;
+
+    //Header block, describing the records
+    uint8_t* block = blocks[0];
+    memset(block, 0, HAL_STORAGE_BLOCK);
+    blockHead(block, LOG_BLOCK_HEADER, 0, end);
+    uint8_t* p = block + LOG_BLOCK_HEAD_BYTES;
+    *p++ = LOG_VERSION;
+    *p++ = LOG_RECORD_BYTES;
+    *p++ = LOG_RECORDS_PER_BLOCK;
+    *p++ = FIELD_COUNT;
+    const uint8_t* field = (const uint8_t*)FIELDS;
+    for (uint16_t i = 0; i < sizeof(FIELDS); i++) *p++ = pgm_read_byte(field + i);
+
+    halStorageWrite(end, block);
+    uint8_t status;
+    while ((status = halStoragePoll()) == HAL_STORAGE_BUSY) halDelay(1);
+    if (status != HAL_STORAGE_IDLE) return false;
+
+    nextBlock = end + 1;
+    filling   = 0;
+    records   = 0;
+    state     = LOGGER_ON;
+    return true;
+}
+
+void logEncode(const LogRecord* r, uint8_t* out)
+{
+    inputRecordEncode(&r->inputs, out);
+    out += INPUT_RECORD_BYTES;
+    out = put16(out, r->rpm);
+    out = put16(out, r->velocity);
+    out = put16(out, r->throttle);
+    out = put16(out, r->radiatorTemp);
+    out = put16(out, r->fuel);
+    *out++ = r->gear;
+    *out++ = r->mode;
+    out = put16(out, r->servoOut);
+    out = put16(out, r->kellyOut);
+    out = put16(out, r->regenOut);
+    *out = r->flags;
+}
+
+void logAppend(const LogRecord* record)
+{
+    if (state == LOGGER_OFF) return;
+    if (state == LOGGER_FAILED) {dropped++; return;}
+
+    uint8_t* block = blocks[filling];
+    logEncode(record, block + LOG_BLOCK_HEAD_BYTES + records * LOG_RECORD_BYTES);
+    if (++records < LOG_RECORDS_PER_BLOCK) return;
+
+    if (outBlock >= 0) {
+        //The card is still busy with the other block: lose this one, keep the log contiguous
+        dropped += records;
+        records = 0;
+        return;
+    }
+    memset(block + LOG_BLOCK_HEAD_BYTES + records * LOG_RECORD_BYTES, 0,
+           HAL_STORAGE_BLOCK - LOG_BLOCK_HEAD_BYTES - records * LOG_RECORD_BYTES);
+    blockHead(block, LOG_BLOCK_DATA, records, nextBlock);
+    outBlock   = filling;
+    outAddress = nextBlock++;
+    outStarted = false;
+    filling ^= 1;
+    records  = 0;
+}
+
+void logService()
+{
+    if (state != LOGGER_ON || outBlock < 0) return;
+    if (!outStarted) {
+        halStorageWrite(outAddress, blocks[outBlock]);
+        outStarted = true;
+    }
+    uint8_t status = halStoragePoll();
+    if (status == HAL_STORAGE_BUSY) return;
+    if (status == HAL_STORAGE_FAILED) {
+        state = LOGGER_FAILED;
+        dropped += LOG_RECORDS_PER_BLOCK + records;
+    }
+    outBlock = -1;
+}
+
+boolean  logActive()  {return state == LOGGER_ON;}
+uint16_t logSession() {return session;}
+uint32_t logDropped() {return dropped;}
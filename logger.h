@@ -0,0 +1,91 @@
+//------------------------------------------------------------------------------
+// On-car data logger
+//------------------------------------------------------------------------------
+//Writes every control cycle to the SD card as a fixed size binary record: the
+//raw inputs (input_record.h), the values derived from them, the mode and the
+//outputs. logAppend() only encodes the record into one of two RAM blocks;
+//logService(), run as a background task, writes full blocks a slice per call
+//(see halStoragePoll() in hal.h) while the other one fills, so the control
+//task never waits for the card.
+//
+//The card holds raw 512 byte blocks, no file system. Every block starts with
+//
+//    'Y' 'L'  type  records  block(4)  session(2)  reserved(2)
+//
+//block being the block's own address. A session, one power-up, starts with a
+//header block that describes the record layout (LogField, name, type and
+//count of every field in order), then data blocks of LOG_RECORDS_PER_BLOCK
+//records. logBegin() finds the end of the earlier sessions by looking for
+//the first block that is not ours, so a new card must start out blank (zeros).
+//host/log_decode turns a card image back into CSV or input traces.
+//
+//A block the card cannot take while the other one is still being written is
+//lost as a whole; logDropped() counts the records in it.
+
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include "hal.h"
+#include "input_record.h"
+
+const uint8_t LOG_VERSION           = 1;
+const uint8_t LOG_BLOCK_HEADER      = 0;
+const uint8_t LOG_BLOCK_DATA        = 1;
+const uint8_t LOG_BLOCK_HEAD_BYTES  = 12;
+
+//Field types in the header block
+const uint8_t LOG_U8                = 1;
+const uint8_t LOG_I16               = 2;
+const uint8_t LOG_U16               = 3;
+const uint8_t LOG_U32               = 4;
+const uint8_t LOG_FIELD_NAME        = 10;   //Including the terminating zero
+
+struct LogField {
+    char    name[LOG_FIELD_NAME];
+    uint8_t type;                           //LOG_U8 ...
+    uint8_t count;                          //Array length, 1 for a plain value
+};
+
+//Bits of LogRecord.flags
+const uint8_t LOG_ENGINE_ON         = 1 << 0;
+const uint8_t LOG_HV_ENABLE         = 1 << 1;
+const uint8_t LOG_REGEN_ENABLE      = 1 << 2;
+const uint8_t LOG_ENGINE_ENABLE     = 1 << 3;
+const uint8_t LOG_CRITICAL          = 1 << 4;
+const uint8_t LOG_ASSISTING         = 1 << 5;
+const uint8_t LOG_BRAKE             = 1 << 6;
+const uint8_t LOG_ENDLOOP           = 1 << 7;
+
+struct LogRecord {
+    InputRecord inputs;                     //Encoded first, so the records start with an input record
+    int16_t     rpm;
+    int16_t     velocity;                   //mph
+    int16_t     throttle;                   //servo degrees
+    int16_t     radiatorTemp;               //°F
+    int16_t     fuel;                       //percent
+    uint8_t     gear;
+    uint8_t     mode;
+    int16_t     servoOut;
+    int16_t     kellyOut;
+    int16_t     regenOut;
+    uint8_t     flags;                      //LOG_* bits
+};
+
+const uint8_t LOG_RECORD_BYTES      = INPUT_RECORD_BYTES + 5 * 2 + 2 + 3 * 2 + 1;
+const uint8_t LOG_RECORDS_PER_BLOCK = (HAL_STORAGE_BLOCK - LOG_BLOCK_HEAD_BYTES) / LOG_RECORD_BYTES;
+
+//Looks for the card, finds the end of the log and writes the header of a new
+//session. Waits for the card, call from setup(). False without a card, the
+//logger then stays off.
+boolean  logBegin(uint8_t csPin);
+
+void     logAppend(const LogRecord* record);  //once per control cycle
+void     logService();                        //background task, at least once per millisecond
+
+boolean  logActive();
+uint16_t logSession();
+uint32_t logDropped();                        //Records lost to a busy or failed card
+
+void     logEncode(const LogRecord* record, uint8_t* out);
+
+#endif
@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------------
+// Parameter store
+//------------------------------------------------------------------------------
+
+#include "params.h"
+#include "telemetry_frame.h"   //crc16()
+
+static uint16_t slotAddress(uint8_t slot)
+{
+    return PARAM_EEPROM_ADDRESS + slot * PARAM_SLOT_BYTES;
+}
+
+//A slot's record if it is valid and of this version: its value count, else -1
+static int8_t readSlot(const ParamStore* store, uint8_t slot, uint8_t* record)
+{
+    halEepromRead(slotAddress(slot), record, PARAM_HEADER_BYTES);
+    uint8_t count = record[3];
+    if (record[0] != 'Y' || record[1] != 'P' || record[2] != store->version || count > PARAM_MAX) return -1;
+
+    uint8_t length = PARAM_HEADER_BYTES + 2 * count + 2;
+    halEepromRead(slotAddress(slot) + PARAM_HEADER_BYTES, record + PARAM_HEADER_BYTES, length - PARAM_HEADER_BYTES);
+    uint16_t crc = crc16(0xFFFF, record, length - 2);
+    if (record[length - 2] != (crc >> 8) || record[length - 1] != (crc & 0xFF)) return -1;
+    return count;
+}
+
+static uint16_t recordSequence(const uint8_t* record)
+{
+    return record[4] | ((uint16_t)record[5] << 8);
+}
+
+void paramsBegin(ParamStore* store, const ParamSpec* specs, int16_t* values, uint8_t count, uint8_t version)
+{
+    store->specs   = specs;
+    store->values  = values;
+    store->count   = count;
+    store->version = version;
+    store->stored  = false;
+    store->changed = false;
+    store->length  = 0;
+    store->written = 0;
+    store->slot    = PARAM_SLOTS - 1;   //the first save goes to slot 0
+    store->sequence = 0;
+    for (uint8_t i = 0; i < count; i++) values[i] = specs[i].initial;
+
+    //The newest valid slot, sequence numbers compared across their wrap
+    uint8_t newest[PARAM_SLOT_BYTES];
+    int8_t  newestCount = -1;
+    for (uint8_t slot = 0; slot < PARAM_SLOTS; slot++) {
+        int8_t found = readSlot(store, slot, store->record);
+        if (found < 0) continue;
+        uint16_t sequence = recordSequence(store->record);
+        if (newestCount >= 0 && (int16_t)(sequence - store->sequence) <= 0) continue;
+        memcpy(newest, store->record, PARAM_SLOT_BYTES);
+        newestCount     = found;
+        store->slot     = slot;
+        store->sequence = sequence;
+    }
+    if (newestCount < 0) return;
+
+    store->stored = true;
+    for (uint8_t i = 0; i < count && i < newestCount; i++) {
+        const uint8_t* v = newest + PARAM_HEADER_BYTES + 2 * i;
+        int16_t value = (int16_t)(v[0] | ((uint16_t)v[1] << 8));
+        if (value >= specs[i].min && value <= specs[i].max) values[i] = value;
+    }
+}
+
+boolean paramSet(ParamStore* store, uint8_t id, int16_t value, uint32_t nowMs)
+{
+    if (id >= store->count) return false;
+    const ParamSpec& spec = store->specs[id];
+    if (value < spec.min || value > spec.max) return false;
+    if (store->values[id] == value) return true;
+    store->values[id] = value;
+    store->changed    = true;
+    store->changedAt  = nowMs;
+    return true;
+}
+
+void paramsDefaults(ParamStore* store, uint32_t nowMs)
+{
+    for (uint8_t i = 0; i < store->count; i++) paramSet(store, i, store->specs[i].initial, nowMs);
+}
+
+//The values as they are now, into the record of the next slot
+static void recordBegin(ParamStore* store)
+{
+    uint8_t* r = store->record;
+    store->slot = (store->slot + 1) % PARAM_SLOTS;
+    store->sequence++;
+    r[0] = 'Y';
+    r[1] = 'P';
+    r[2] = store->version;
+    r[3] = store->count;
+    r[4] = store->sequence & 0xFF;
+    r[5] = store->sequence >> 8;
+    uint8_t length = PARAM_HEADER_BYTES;
+    for (uint8_t i = 0; i < store->count; i++) {
+        r[length++] = (uint16_t)store->values[i] & 0xFF;
+        r[length++] = (uint16_t)store->values[i] >> 8;
+    }
+    uint16_t crc = crc16(0xFFFF, r, length);
+    r[length++] = crc >> 8;
+    r[length++] = crc & 0xFF;
+    store->length  = length;
+    store->written = 0;
+    store->changed = false;
+}
+
+void paramsService(ParamStore* store, uint32_t nowMs)
+{
+    if (store->length == 0) {
+        if (!store->changed || nowMs - store->changedAt < PARAM_SAVE_DELAY) return;
+        recordBegin(store);
+    }
+
+    //Unchanged bytes cost a read, a changed one starts a write and returns
+    halEepromWrite(slotAddress(store->slot) + store->written, store->record + store->written, 1);
+    if (++store->written < store->length) return;
+    store->length = 0;
+    store->stored = true;
+}
+
+uint8_t paramsState(const ParamStore* store)
+{
+    if (store->changed || store->length != 0) return PARAM_CHANGED;
+    return store->stored ? PARAM_SAVED : PARAM_DEFAULTS;
+}
@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// Parameter store
+//------------------------------------------------------------------------------
+//Tunables that can change between sessions without reflashing. Their values
+//live in an int16_t array kept by the caller and indexed by parameter ID; the
+//control code reads values[ID] directly, one load like any other global.
+//Every parameter has a row in a table, also kept by the caller:
+//
+//    initial    the value until one is set, the old !adjust constant
+//    min, max   what paramSet() takes, and what a stored value has to be in
+//
+//Changes are saved to EEPROM in the background, PARAM_SAVE_DELAY ms after
+//the last one, so a value being dialled in is written once. A save writes
+//one byte per paramsService() call: the Mega's EEPROM takes ~3.4 ms for a
+//byte and lets the CPU go on meanwhile, so called every few ms nothing ever
+//waits for it.
+//
+//EEPROM, from PARAM_EEPROM_ADDRESS (after the throttle maps), PARAM_SLOTS
+//slots of PARAM_SLOT_BYTES, each
+//
+//    'Y' 'P' version count sequence(2)  value(2) x count  crc_hi crc_lo
+//
+//little endian, with the CRC-16/CCITT-FALSE of everything before it. Every
+//save goes to the slot after the last one with the sequence number one up,
+//so the writes wear the slots in turn, and a save cut short by a power off
+//leaves the previous slot as the newest valid one. paramsBegin() loads the
+//newest valid slot of the caller's version. A record with fewer parameters
+//(written before more were added) gives its values and the initial ones for
+//the rest; a stored value out of bounds is replaced by the initial one.
+//Bump the version when a parameter changes its meaning or ID. Uploading a
+//sketch through the bootloader leaves the EEPROM alone; an ISP chip erase
+//clears it unless the EESAVE fuse is set, and the car is back on the initial
+//values.
+
+#ifndef PARAMS_H
+#define PARAMS_H
+
+#include "hal.h"
+
+const uint16_t PARAM_EEPROM_ADDRESS = 1024;   //MAP_STORE_BYTES rounded up, see throttle_map.h
+const uint8_t  PARAM_SLOTS          = 16;
+const uint8_t  PARAM_SLOT_BYTES     = 64;
+const uint8_t  PARAM_HEADER_BYTES   = 6;
+const uint8_t  PARAM_MAX            = (PARAM_SLOT_BYTES - PARAM_HEADER_BYTES - 2) / 2;
+const uint16_t PARAM_SAVE_DELAY     = 1000;   //ms after the last change
+
+//paramsState()
+const uint8_t  PARAM_DEFAULTS       = 0;      //initial values, nothing of this version in EEPROM
+const uint8_t  PARAM_SAVED          = 1;      //the values are what EEPROM holds
+const uint8_t  PARAM_CHANGED        = 2;      //changed since, being saved or waiting to be
+
+struct ParamSpec {
+    int16_t initial;
+    int16_t min, max;
+};
+
+struct ParamStore {
+    const ParamSpec* specs;
+    int16_t* values;
+    uint8_t  count;
+    uint8_t  version;
+    uint8_t  slot;                  //of the newest record, the next save goes to the one after
+    uint16_t sequence;              //of the newest record
+    boolean  stored;                //there is a valid record
+    boolean  changed;               //since the last save started
+    uint32_t changedAt;             //ms
+    uint8_t  record[PARAM_SLOT_BYTES];   //being saved
+    uint8_t  length;                //of the record, 0 when no save is running
+    uint8_t  written;               //bytes of it written
+};
+
+//Loads the newest valid record, or the initial values. count <= PARAM_MAX
+void    paramsBegin(ParamStore* store, const ParamSpec* specs, int16_t* values, uint8_t count, uint8_t version);
+
+//false, and nothing changes, for an unknown ID or a value out of bounds
+boolean paramSet(ParamStore* store, uint8_t id, int16_t value, uint32_t nowMs);
+void    paramsDefaults(ParamStore* store, uint32_t nowMs);   //every parameter back to its initial value
+
+//Background save, every few ms: at most one EEPROM byte per call
+void    paramsService(ParamStore* store, uint32_t nowMs);
+uint8_t paramsState(const ParamStore* store);
+
+#endif
@@ -0,0 +1,100 @@
+//------------------------------------------------------------------------------
+// Loop latency profiler
+//------------------------------------------------------------------------------
+
+#include "profiler.h"
+
+#if PROFILER_ENABLED
+
+struct ProfileStage {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint16_t histogram[PROFILE_BUCKETS];
+};
+
+static ProfileStage stages[PROFILE_STAGES];
+
+//Buckets 0-3 hold 0-3 us, after that every power of two is split in 4
+static uint8_t bucketOf(uint32_t micros)
+{
+    if (micros < 4) return (uint8_t)micros;
+    uint8_t shift = 0;
+    while ((micros >> shift) >= 8) shift++;  //micros >> shift is now 4-7
+    uint16_t bucket = 4 + shift * 4 + ((micros >> shift) & 3);
+    return bucket < PROFILE_BUCKETS ? (uint8_t)bucket : PROFILE_BUCKETS - 1;
+}
+
+//Largest value that falls into the bucket
+static uint32_t bucketTop(uint8_t bucket)
+{
+    if (bucket < 4) return bucket;
+    uint8_t shift = (bucket - 4) / 4;
+    uint8_t sub   = (bucket - 4) % 4;
+    return ((uint32_t)(5 + sub) << shift) - 1;
+}
+
+void profilerReset()
+{
+    for (uint8_t s = 0; s < PROFILE_STAGES; s++) {
+        stages[s].count = 0;
+        stages[s].min   = 0xFFFFFFFFUL;
+        stages[s].max   = 0;
+        for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) stages[s].histogram[b] = 0;
+    }
+}
+
+uint32_t profilerStart()
+{
+    return halMicros();
+}
+
+uint32_t profilerLap(uint8_t stage, uint32_t lapStart)
+{
+    uint32_t now = halMicros();
+    profilerRecord(stage, now - lapStart);
+    return now;
+}
+
+void profilerRecord(uint8_t stage, uint32_t micros)
+{
+    if (stage >= PROFILE_STAGES) return;
+    ProfileStage& s = stages[stage];
+
+    s.count++;
+    if (micros < s.min) s.min = micros;
+    if (micros > s.max) s.max = micros;
+
+    uint8_t b = bucketOf(micros);
+    if (s.histogram[b] == 0xFFFF) {
+        //Keep the shape of the distribution, drop half of the weight
+        for (uint8_t i = 0; i < PROFILE_BUCKETS; i++) s.histogram[i] >>= 1;
+    }
+    s.histogram[b]++;
+}
+
+bool profilerStats(uint8_t stage, ProfileStats* stats)
+{
+    if (stage >= PROFILE_STAGES || stages[stage].count == 0) return false;
+    const ProfileStage& s = stages[stage];
+
+    uint32_t total = 0;
+    for (uint8_t b = 0; b < PROFILE_BUCKETS; b++) total += s.histogram[b];
+
+    //First bucket that takes the running sum to 99% of all samples
+    uint32_t limit = total - total / 100;
+    uint32_t sum   = 0;
+    uint8_t  b     = 0;
+    for (; b < PROFILE_BUCKETS - 1; b++) {
+        sum += s.histogram[b];
+        if (sum >= limit) break;
+    }
+
+    stats->count = s.count;
+    stats->min   = s.min;
+    stats->max   = s.max;
+    stats->p99   = bucketTop(b) < s.max ? bucketTop(b) : s.max;
+    return true;
+}
+
+#endif
@@ -0,0 +1,70 @@
+//------------------------------------------------------------------------------
+// Loop latency profiler
+//------------------------------------------------------------------------------
+//Times each stage of the control task, and the other scheduled tasks, with
+//micros() and keeps, per stage, the minimum, maximum and a histogram from
+//which the 99th percentile is read. Everything
+//lives in a fixed RAM table (about 140 bytes per stage), nothing is allocated.
+//
+//Stages are timed back to back with one clock read each:
+//
+//    uint32_t lap = profilerStart();
+//    readInputs();    lap = profilerLap(PROFILE_READ_INPUTS, lap);
+//    processInputs(); lap = profilerLap(PROFILE_PROCESS_INPUTS, lap);
+//
+//Histogram buckets are 4 per power of two, so percentiles are accurate to
+//about 20%. Compile with PROFILER_ENABLED 0 to remove the profiler entirely.
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "hal.h"
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+const uint8_t PROFILE_CONTROL_PERIOD  = 0;  //start of one control task to the start of the next
+const uint8_t PROFILE_READ_INPUTS     = 1;
+const uint8_t PROFILE_PROCESS_INPUTS  = 2;
+const uint8_t PROFILE_COMMUNICATION   = 3;  //uplink, transmit queues and telemetry frames
+const uint8_t PROFILE_SECURITY        = 4;
+const uint8_t PROFILE_RUN_THE_CAR     = 5;  //mode logic
+const uint8_t PROFILE_OUTPUTS         = 6;
+const uint8_t PROFILE_DISPLAY         = 7;
+const uint8_t PROFILE_LOGGER          = 8;  //SD card writes
+const uint8_t PROFILE_LAUNCH          = 9;  //launch control and boost, its own task
+const uint8_t PROFILE_STAGES          = 10;
+const uint8_t PROFILE_NONE            = 0xFF;
+
+const uint8_t PROFILE_BUCKETS         = 64;
+
+struct ProfileStats {
+    uint32_t count;   //samples since the last reset
+    uint32_t min;     //in microseconds
+    uint32_t max;
+    uint32_t p99;
+};
+
+//Saturates a statistic to what fits into a telemetry value
+inline int profileValue(uint32_t v) {return v > 32767 ? 32767 : (int)v;}
+
+#if PROFILER_ENABLED
+
+void     profilerReset();
+uint32_t profilerStart();
+uint32_t profilerLap(uint8_t stage, uint32_t lapStart);
+void     profilerRecord(uint8_t stage, uint32_t micros);
+bool     profilerStats(uint8_t stage, ProfileStats* stats);
+
+#else
+
+inline void     profilerReset() {}
+inline uint32_t profilerStart() {return 0;}
+inline uint32_t profilerLap(uint8_t, uint32_t) {return 0;}
+inline void     profilerRecord(uint8_t, uint32_t) {}
+inline bool     profilerStats(uint8_t, ProfileStats*) {return false;}
+
+#endif
+
+#endif
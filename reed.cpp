@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Reed switch wheel speed
+//------------------------------------------------------------------------------
+
+#include "reed.h"
+
+//Written by the interrupt
+static volatile uint32_t pulseTimes[REED_BUFFER];
+static volatile uint8_t  pulseHead = 0;
+static volatile uint8_t  pulsesStored = 0;  //up to 4, for reedSlowestRevolution()
+static uint32_t          lastAccepted = 0;
+static boolean           anyAccepted  = false;
+
+//Written by the main loop
+static uint8_t  pulseTail    = 0;
+static uint32_t periods[3];
+static uint8_t  periodCount  = 0;
+static uint32_t lastPulse    = 0;
+static boolean  havePulse    = false;
+static uint16_t overruns     = 0;
+
+static void reedInterrupt()
+{
+    reedPulse(halMicros());
+}
+
+void reedBegin(uint8_t pin)
+{
+    reedReset();
+    halAttachInterrupt(pin, reedInterrupt, FALLING);
+}
+
+void reedReset()
+{
+    halNoInterrupts();
+    pulseHead    = 0;
+    pulsesStored = 0;
+    anyAccepted  = false;
+    halInterrupts();
+
+    pulseTail    = 0;
+    periodCount  = 0;
+    havePulse    = false;
+    overruns     = 0;
+}
+
+void reedPulse(uint32_t micros)
+{
+    if (anyAccepted && micros - lastAccepted < REED_DEBOUNCE_US) return;
+    lastAccepted = micros;
+    anyAccepted  = true;
+
+    uint8_t head = pulseHead;
+    pulseTimes[head & (REED_BUFFER - 1)] = micros;
+    pulseHead = head + 1;
+    if (pulsesStored < 4) pulsesStored++;
+}
+
+static uint32_t median3(uint32_t a, uint32_t b, uint32_t c)
+{
+    if (a > b) {uint32_t t = a; a = b; b = t;}
+    if (b > c) b = c;
+    return a > b ? a : b;
+}
+
+uint8_t reedTake(uint32_t* times, uint8_t max, boolean* lost)
+{
+    uint8_t head = pulseHead;
+    *lost = false;
+    if ((uint8_t)(head - pulseTail) > REED_BUFFER) {
+        overruns  += (uint8_t)(head - pulseTail) - REED_BUFFER;
+        pulseTail  = head - REED_BUFFER;
+        *lost      = true;
+    }
+
+    uint8_t count = 0;
+    while (pulseTail != head && count < max) {
+        times[count++] = pulseTimes[pulseTail & (REED_BUFFER - 1)];
+        pulseTail++;
+    }
+    return count;
+}
+
+void reedLost()
+{
+    havePulse = false;   //the gap to the next kept pulse is not one revolution
+}
+
+void reedFeed(uint32_t t)
+{
+    if (havePulse) {
+        periods[2] = periods[1];
+        periods[1] = periods[0];
+        periods[0] = t - lastPulse;
+        if (periodCount < 3) periodCount++;
+    }
+    lastPulse = t;
+    havePulse = true;
+}
+
+uint32_t reedPeriod(uint32_t nowMicros, boolean atMagnet)
+{
+    if (periodCount == 0) return 0;
+
+    //A pulse stamped after nowMicros was taken is no time ago, not the 71 minutes
+    //the unsigned difference would make it
+    uint32_t elapsed = (int32_t)(nowMicros - lastPulse) > 0 ? nowMicros - lastPulse : 0;
+    if (elapsed > REED_STOPPED_US || (atMagnet && elapsed > REED_STOPPED_AT_MAGNET_US)) {
+        //Stopped: the next revolution needs two fresh pulses
+        periodCount = 0;
+        havePulse   = false;
+        return 0;
+    }
+
+    uint32_t period = periods[0];
+    if (periodCount == 3) period = median3(periods[0], periods[1], periods[2]);
+    return elapsed > period ? elapsed : period;
+}
+
+uint16_t reedOverruns()
+{
+    return overruns;
+}
+
+uint32_t reedSlowestRevolution(uint32_t nowMicros)
+{
+    if (pulsesStored < 4) return 0;
+    uint8_t  head    = pulseHead;
+    uint32_t later   = pulseTimes[(uint8_t)(head - 1) & (REED_BUFFER - 1)];
+    uint32_t slowest = nowMicros - later;
+    for (uint8_t i = 2; i <= 4; i++) {
+        uint32_t earlier = pulseTimes[(uint8_t)(head - i) & (REED_BUFFER - 1)];
+        if (later - earlier > slowest) slowest = later - earlier;
+        later = earlier;
+    }
+    return slowest;
+}
@@ -0,0 +1,57 @@
+//------------------------------------------------------------------------------
+// Reed switch wheel speed
+//------------------------------------------------------------------------------
+//The reed switch closes once per wheel revolution. Its falling edge raises an
+//interrupt that stores a micros() timestamp in a small ring buffer; only the
+//interrupt writes the head index and only the main loop writes the tail, so
+//no locking is needed. The main loop turns the timestamps into revolution
+//periods and reads a median-of-three period, which rejects a single missed or
+//doubled pulse without the lag of a long moving average.
+//
+//The main loop side is split so the pulses can be recorded and replayed:
+//reedTake() empties the interrupt's buffer, reedFeed() puts each pulse into
+//the period filter. A replay feeds the recorded pulses to reedFeed() and
+//gets exactly the same periods.
+
+#ifndef REED_H
+#define REED_H
+
+#include "hal.h"
+
+const uint8_t  REED_BUFFER               = 8;        //Pulses kept between two reads, power of two
+const uint32_t REED_DEBOUNCE_US          = 20000;    //Closer pulses are contact bounce (~190 mph)
+const uint32_t REED_STOPPED_US           = 2000000;  //No pulse for this long: the wheel stopped
+const uint32_t REED_STOPPED_AT_MAGNET_US = 300000;   //Shorter timeout while the switch stays closed
+
+void     reedBegin(uint8_t pin);
+void     reedReset();
+
+//What the interrupt does with a falling edge at the given time
+void     reedPulse(uint32_t micros);
+
+//Takes up to max pulses the interrupt stored since the last call, oldest
+//first; the rest wait for the next call. lost is set when the buffer
+//overflowed before this call, then reedLost() must come before the pulses
+//are fed.
+uint8_t  reedTake(uint32_t* times, uint8_t max, boolean* lost);
+void     reedLost();
+void     reedFeed(uint32_t micros);
+
+//Filtered time per wheel revolution in microseconds from the pulses fed so
+//far, 0 when the wheel is stopped. While pulses are late the elapsed time is returned instead, so the
+//speed decays smoothly towards the zero-speed timeouts. A pulse fed with a time after nowMicros
+//counts as elapsed 0.
+uint32_t reedPeriod(uint32_t nowMicros, boolean atMagnet);
+
+//Pulses lost because the main loop did not read them in time
+uint16_t reedOverruns();
+
+//The longest of the last three revolutions as the interrupt stored them, or
+//the time since the last pulse if that is longer; 0 before four pulses. Reads
+//the interrupt's buffer, not the main loop's filter, so it goes on working
+//while the main loop stalls, and one bounced pulse (which shortens two
+//revolutions) does not read as a speed. Only from an interrupt handler, or
+//with interrupts off.
+uint32_t reedSlowestRevolution(uint32_t nowMicros);
+
+#endif
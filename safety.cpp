@@ -0,0 +1,64 @@
+//------------------------------------------------------------------------------
+// Safety monitor
+//------------------------------------------------------------------------------
+
+#include "safety.h"
+
+void safetyBegin(SafetyMonitor* m, const SafetyConfig* config)
+{
+    memset(m, 0, sizeof(*m));
+    m->config = config;
+
+    //mph = dividend / period in whole miles, as processInputs() has it: over
+    //criticalMph from dividend / (criticalMph + 1) down, under limitMph above
+    //dividend / limitMph. A limit of 0 releases only once the wheel stops
+    m->tripRevolution    = config->velocityDividend / (config->criticalMph > 0 ? config->criticalMph + 1 : 1);
+    m->releaseRevolution = config->limitMph > 0 ? config->velocityDividend / config->limitMph : 0xFFFFFFFFUL;
+}
+
+//Trips a check once its condition held for its confirm ticks, and releases
+//it the same way
+static void check(SafetyMonitor* m, uint8_t index, boolean trip, boolean release)
+{
+    uint8_t bit     = 1 << index;
+    boolean tripped = (m->faults & bit) != 0;
+    if (tripped ? !release : !trip) {
+        m->count[index] = 0;
+        return;
+    }
+    if (++m->count[index] < m->config->confirm[index]) return;
+    m->count[index] = 0;
+    m->faults ^= bit;
+    if (!tripped) m->trips++;
+}
+
+uint8_t safetyTick(SafetyMonitor* m, const SafetyInputs* in)
+{
+    const SafetyConfig* c = m->config;
+    m->ticks++;
+
+    check(m, 0, in->bmsFault, !in->bmsFault);
+    check(m, 1, in->rpm > c->criticalRpm, in->rpm < c->limitRpm);
+    check(m, 2, in->revolution != 0 && in->revolution <= m->tripRevolution,
+                in->revolution == 0 || in->revolution > m->releaseRevolution);
+    check(m, 3, in->temp > c->criticalTemp, in->temp < c->limitTemp);
+    check(m, 4, in->button, !in->button);
+
+    boolean implausible = false;
+    for (uint8_t i = 0; i < ADC_CHANNELS; i++) {
+        uint16_t v = in->adc.value[i];
+        if (v < c->plausibleLow[i] || v > c->plausibleHigh[i]) implausible = true;
+    }
+    if (in->adc.sequence != m->sequence) {
+        m->sequence = in->adc.sequence;
+        m->stale    = 0;
+    }
+    else if (m->stale < 255) m->stale++;
+    if (m->stale > c->staleTicks) implausible = true;
+    check(m, 5, implausible, !implausible);
+
+    uint16_t throttle = in->adc.value[ADC_THROTTLE];
+    check(m, 6, in->braking && throttle > c->conflictThrottle, throttle < c->releasedThrottle);
+
+    return m->faults;
+}
@@ -0,0 +1,89 @@
+//------------------------------------------------------------------------------
+// Safety monitor
+//------------------------------------------------------------------------------
+//Runs from a timer interrupt at a fixed rate (halTimerBegin()), on inputs it
+//reads itself: the ADC sampler's latest snapshot, the BMS and brake pins and
+//the reed switch interrupt's buffer. None of it goes through the main loop, so
+//a main loop stuck in a blocking serial write or an SD card timeout still has
+//its outputs cut within a few ticks. runSecurityBlock() does the same checks
+//every control cycle on the conditioned inputs, as a second line.
+//
+//Each check trips after its condition held for confirm ticks and clears
+//after the release condition held as long:
+//
+//    BMS        the BMS fault line                    until it is clear
+//    rpm        over criticalRpm                      until under limitRpm
+//    velocity   over criticalMph                      until under limitMph
+//    temp       radiator over criticalTemp            until under limitTemp
+//    button     the virtual big red button            until released
+//    sensor     an ADC reading outside its channel's plausible range (an
+//               open or shorted sensor, a broken pedal wire), or the ADC
+//               snapshot not moving (the sampler's interrupt chain stopped)
+//    conflict   brake on with the throttle past conflictThrottle, until the
+//               throttle is back under releasedThrottle, whatever the brake
+//
+//All but the conflict are critical: engine relay, high voltage and outputs
+//off. The conflict only cuts the engine and motor outputs.
+//
+//Velocity is compared as revolution times worked out in safetyBegin(), so
+//a tick does no division; rpm and temperature come through the calibration
+//tables like in processInputs().
+
+#ifndef SAFETY_H
+#define SAFETY_H
+
+#include "hal.h"
+#include "adc_sampler.h"
+
+const uint8_t SAFETY_BMS       = 1 << 0;
+const uint8_t SAFETY_RPM       = 1 << 1;
+const uint8_t SAFETY_VELOCITY  = 1 << 2;
+const uint8_t SAFETY_TEMP      = 1 << 3;
+const uint8_t SAFETY_BUTTON    = 1 << 4;
+const uint8_t SAFETY_SENSOR    = 1 << 5;
+const uint8_t SAFETY_CONFLICT  = 1 << 6;
+const uint8_t SAFETY_CHECKS    = 7;
+const uint8_t SAFETY_CRITICAL  = SAFETY_BMS | SAFETY_RPM | SAFETY_VELOCITY | SAFETY_TEMP | SAFETY_BUTTON | SAFETY_SENSOR;
+
+struct SafetyConfig {
+    int16_t  criticalRpm,  limitRpm;
+    int16_t  criticalMph,  limitMph;
+    int16_t  criticalTemp, limitTemp;          //degrees F
+    uint16_t plausibleLow[ADC_CHANNELS];       //ADC counts, by ADC_* channel
+    uint16_t plausibleHigh[ADC_CHANNELS];
+    uint16_t conflictThrottle;                 //throttle ADC counts
+    uint16_t releasedThrottle;
+    uint8_t  staleTicks;                       //ticks the ADC snapshot may stand still
+    uint8_t  confirm[SAFETY_CHECKS];           //ticks, by bit of SAFETY_*
+    uint32_t velocityDividend;                 //mph = velocityDividend / us per revolution
+};
+
+//What the interrupt read this tick
+struct SafetyInputs {
+    AdcSnapshot adc;
+    int16_t  rpm;                              //from adc, through the calibration tables
+    int16_t  temp;
+    uint32_t revolution;                       //reedSlowestRevolution(), 0 stopped or unknown
+    boolean  bmsFault;
+    boolean  braking;
+    boolean  button;
+};
+
+struct SafetyMonitor {
+    const SafetyConfig* config;
+    uint32_t tripRevolution;                   //at most this long per revolution is over criticalMph
+    uint32_t releaseRevolution;                //more than this is under limitMph
+    volatile uint8_t faults;                   //SAFETY_* tripped, read by the main loop
+    uint8_t  count[SAFETY_CHECKS];             //ticks the trip or release condition has held
+    uint8_t  sequence;                         //the ADC snapshot's, last tick
+    uint8_t  stale;                            //ticks it has not moved
+    uint32_t ticks;
+    uint32_t trips;                            //checks tripped since safetyBegin()
+};
+
+void    safetyBegin(SafetyMonitor* m, const SafetyConfig* config);
+
+//Every tick of the timer interrupt. Returns the tripped checks, SAFETY_*
+uint8_t safetyTick(SafetyMonitor* m, const SafetyInputs* in);
+
+#endif
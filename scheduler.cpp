@@ -0,0 +1,58 @@
+//------------------------------------------------------------------------------
+// Fixed-rate cooperative task scheduler
+//------------------------------------------------------------------------------
+
+#include "scheduler.h"
+#include "profiler.h"
+#include "watchdog.h"
+
+static Task*   table     = 0;
+static uint8_t taskCount = 0;
+
+void schedulerBegin(Task* tasks, uint8_t count)
+{
+    table     = tasks;
+    taskCount = count;
+
+    uint32_t now = halMicros();
+    for (uint8_t i = 0; i < count; i++) {
+        table[i].release  = now;
+        table[i].overruns = 0;
+        table[i].skipped  = 0;
+    }
+}
+
+void schedulerRun()
+{
+    uint32_t now = halMicros();
+
+    for (uint8_t i = 0; i < taskCount; i++) {
+        Task& t = table[i];
+        uint32_t late = now - t.release;
+        if ((int32_t)late < 0) continue;          //Not released yet
+
+        //More than a period behind: drop the releases that were missed
+        if (late >= t.periodMicros) {
+            uint32_t missed = late / t.periodMicros;
+            t.skipped  = (t.skipped + missed > 0xFFFF) ? 0xFFFF : t.skipped + missed;
+            t.release += missed * t.periodMicros;
+        }
+
+        watchdogEnter(i, t.profileStage);
+        t.run();
+
+        uint32_t done = halMicros();
+        profilerRecord(t.profileStage, done - now);
+        watchdogLeave(done - now);
+        if (done - t.release > t.deadlineMicros && t.overruns != 0xFFFF) t.overruns++;
+        t.release += t.periodMicros;
+        return;
+    }
+}
+
+uint16_t schedulerOverruns()
+{
+    uint32_t total = 0;
+    for (uint8_t i = 0; i < taskCount; i++) total += table[i].overruns + table[i].skipped;
+    return total > 0xFFFF ? 0xFFFF : (uint16_t)total;
+}
@@ -0,0 +1,40 @@
+//------------------------------------------------------------------------------
+// Fixed-rate cooperative task scheduler
+//------------------------------------------------------------------------------
+//loop() calls schedulerRun(), which runs at most one task per call: the first
+//task in the table whose release time has come. Table order is priority
+//order, so after every task the scheduler looks at the most urgent one
+//again, and a slow telemetry task delays the control task by at most its
+//own run time.
+//
+//Releases are strictly periodic (release += period), so a late start does
+//not shift later ones. A task that falls a full period behind skips the
+//missed releases and counts them; a task that finishes later than its
+//deadline after its release counts an overrun.
+//
+//Every run is reported to the watchdog supervisor (watchdog.h), which feeds
+//the watchdog only while all the tasks keep running.
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include "hal.h"
+
+struct Task {
+    void     (*run)();
+    uint32_t periodMicros;
+    uint32_t deadlineMicros;   //From the release, at most the period
+    uint8_t  profileStage;     //Run time goes to this profiler stage, PROFILE_NONE for none
+
+    //Kept by the scheduler
+    uint32_t release;          //micros() of the next release
+    uint16_t overruns;
+    uint16_t skipped;
+};
+
+void     schedulerBegin(Task* tasks, uint8_t count);
+void     schedulerRun();
+
+uint16_t schedulerOverruns();  //All tasks, overruns plus skipped releases
+
+#endif
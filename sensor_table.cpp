@@ -0,0 +1,21 @@
+//------------------------------------------------------------------------------
+// Sensor linearization tables
+//------------------------------------------------------------------------------
+
+#include "sensor_table.h"
+
+int16_t sensorTableLookup(const int16_t* table, uint8_t bits, uint16_t adc)
+{
+    uint8_t  shift   = SENSOR_ADC_BITS - bits;
+    uint16_t segment = adc >> shift;
+    uint16_t offset  = adc & ((1 << shift) - 1);
+    if (segment >= (1 << bits)) return (int16_t)pgm_read_word(table + (1 << bits));  //out of range, clamp
+
+    int16_t y0 = (int16_t)pgm_read_word(table + segment);
+    if (offset == 0) return y0;
+    int16_t y1 = (int16_t)pgm_read_word(table + segment + 1);
+
+    //Rounded to the nearest unit
+    int32_t step = ((int32_t)y1 - y0) * offset + (1 << (shift - 1));
+    return y0 + (int16_t)(step >> shift);
+}
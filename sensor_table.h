@@ -0,0 +1,28 @@
+//------------------------------------------------------------------------------
+// Sensor linearization tables
+//------------------------------------------------------------------------------
+//Converts a 10 bit ADC reading to engineering units with a piecewise-linear
+//table instead of map(). A table has 2^bits segments of equal width over the
+//ADC range, so finding the segment and the position in it are a shift and a
+//mask, and the interpolation is one 16x16 multiply and a shift: no division,
+//which the AVR does in software in several hundred cycles.
+//
+//The tables live in flash (PROGMEM) and are generated from calibration CSVs
+//by host/sensor_table_gen into sensor_tables.h, which is not edited by hand:
+//
+//    make -C host tables
+//
+//A table of 2^bits segments has 2^bits + 1 points, at ADC counts 0, w, 2w ...
+//1024 with w = 1024 >> bits.
+
+#ifndef SENSOR_TABLE_H
+#define SENSOR_TABLE_H
+
+#include "hal.h"
+
+const uint8_t SENSOR_ADC_BITS = 10;
+
+//table: 2^bits + 1 points in PROGMEM, bits at most SENSOR_ADC_BITS
+int16_t sensorTableLookup(const int16_t* table, uint8_t bits, uint16_t adc);
+
+#endif
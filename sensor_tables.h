@@ -0,0 +1,36 @@
+//------------------------------------------------------------------------------
+// Sensor linearization tables
+//------------------------------------------------------------------------------
+//Generated by host/sensor_table_gen from the CSVs in calibration/, do not edit:
+//change the CSVs and run make -C host tables. See sensor_table.h.
+
+#ifndef SENSOR_TABLES_H
+#define SENSOR_TABLES_H
+
+#include "sensor_table.h"
+
+//calibration/rpm.csv, 2 calibration points, max error 0.94
+const uint8_t RPM_TABLE_BITS = 4;
+const int16_t RPM_TABLE[17] PROGMEM = {
+    0, 250, 500, 751, 1001, 1251, 1501, 1752,
+    2002, 2252, 2502, 2753, 3003, 3253, 3503, 3754,
+    4004
+};
+
+//calibration/radiator_temp.csv, 2 calibration points, max error 0.94
+const uint8_t RADIATOR_TEMP_TABLE_BITS = 4;
+const int16_t RADIATOR_TEMP_TABLE[17] PROGMEM = {
+    300, 281, 262, 244, 225, 206, 187, 169,
+    150, 131, 112, 94, 75, 56, 37, 18,
+    0
+};
+
+//calibration/fuel.csv, 2 calibration points, max error 0.92
+const uint8_t FUEL_TABLE_BITS = 4;
+const int16_t FUEL_TABLE[17] PROGMEM = {
+    0, 6, 13, 19, 25, 31, 38, 44,
+    50, 56, 63, 69, 75, 81, 88, 94,
+    100
+};
+
+#endif
@@ -0,0 +1,119 @@
+//------------------------------------------------------------------------------
+// Wheel slip estimate and traction control
+//------------------------------------------------------------------------------
+
+#include "slip.h"
+
+//Engine turns over wheel turns x 256 that the sum stands for, capped at 4
+static int16_t sumRatio(const SlipEstimator* s, uint8_t gear)
+{
+    //sum / (ratio x 60e6 us) x 256, with the sum shifted down by 16 and the
+    //factor's 16 fraction bits: 2^40 / (ratio x 60e6)
+    uint32_t ratio = (uint32_t)(uint16_t)(s->sum >> 16) * s->factor[gear - 1] >> 16;
+    return ratio > 4 * SLIP_ONE ? 4 * SLIP_ONE : (int16_t)ratio;
+}
+
+static void invalidate(SlipEstimator* s)
+{
+    s->valid = false;
+    s->slip  = 0;
+}
+
+//Cut at once, give back at the recovery rate
+static void setLimit(SlipEstimator* s)
+{
+    const SlipConfig* c = s->config;
+    int16_t over  = s->slip - s->target;
+    int32_t limit = over <= 0 ? SLIP_ONE : SLIP_ONE - (int32_t)over * c->gain;
+    if (limit < s->floor) limit = s->floor;
+    if (limit > s->limit + c->recovery) limit = s->limit + c->recovery;
+    s->limit = limit;
+}
+
+//Engine over wheel turns x 100: sum / 60e6 us x 100, with the sum shifted
+//down by 16 and 2^32 x 100 / 60e6 = 7158 in 16 fraction bits
+static uint16_t sumTurns(const SlipEstimator* s)
+{
+    uint32_t turns = (uint32_t)(uint16_t)(s->sum >> 16) * 7158 >> 16;
+    return turns > 0xffff ? 0xffff : (uint16_t)turns;
+}
+
+//The engine turns from the last update to micros, at the rpm of that update
+static void add(SlipEstimator* s, uint32_t micros)
+{
+    uint32_t dt = micros - s->last;
+    s->last = micros;
+    if (dt > 0xffff) dt = 0xffff;
+    uint32_t turns = (uint32_t)(uint16_t)s->rpm * (uint16_t)dt;
+    s->sum = s->sum + turns < s->sum ? 0xffffffffUL : s->sum + turns;
+}
+
+void slipBegin(SlipEstimator* s, const SlipConfig* config)
+{
+    memset(s, 0, sizeof(*s));
+    s->config = config;
+
+    for (uint8_t g = 0; g < SLIP_GEARS; g++)
+        s->factor[g] = ((uint64_t)1 << 40) * 100 / ((uint64_t)config->ratios[g] * 60000000UL);
+    s->target = (int16_t)config->target * SLIP_ONE / 100;
+    s->floor  = (int16_t)config->floor * SLIP_ONE / 100;
+    s->limit  = SLIP_ONE;
+}
+
+void slipTurn(SlipEstimator* s, uint32_t micros)
+{
+    add(s, micros);
+    s->turns = s->started && s->driven ? sumTurns(s) : 0;
+    if (s->started && s->clean) {
+        s->valid = true;
+        s->slip  = sumRatio(s, s->gear) - SLIP_ONE;
+    }
+    else invalidate(s);
+
+    s->sum     = 0;
+    s->start   = micros;
+    s->started = true;
+    s->driven  = s->drives;
+    s->clean   = s->counts;
+}
+
+void slipLost(SlipEstimator* s)
+{
+    s->started = false;
+    s->turns   = 0;
+}
+
+void slipUpdate(SlipEstimator* s, uint32_t micros, int rpm, int gear, boolean clutch)
+{
+    const SlipConfig* c = s->config;
+    add(s, micros);
+
+    boolean drives = clutch == false && rpm >= (int)c->minRpm;
+    boolean counts = drives && gear >= 1 && gear <= SLIP_GEARS;
+    if (drives == false) {
+        s->driven = false;
+        s->turns  = 0;
+    }
+    if (counts == false || gear != s->gear) s->clean = false;
+    s->rpm    = rpm < 0 ? 0 : rpm;
+    s->gear   = gear;
+    s->drives = drives;
+    s->counts = counts;
+
+    //The wheel stopped or turns too slowly to tell, or shifted or declutched:
+    //an estimate from before no longer holds
+    if (s->started && micros - s->start >= SLIP_MAX_REVOLUTION_US) {
+        s->started = false;
+        s->turns   = 0;
+    }
+    if (s->started == false || counts == false) invalidate(s);
+    else if (s->clean) {
+        //Spinning up: more engine turns already than the whole last revolution had
+        int16_t slip = sumRatio(s, gear) - SLIP_ONE;
+        if (slip > s->slip) {
+            s->valid = true;
+            s->slip  = slip;
+        }
+    }
+    setLimit(s);
+}
@@ -0,0 +1,101 @@
+//------------------------------------------------------------------------------
+// Wheel slip estimate and traction control
+//------------------------------------------------------------------------------
+//The reed switch is on an undriven wheel, so it turns once per 66 inches of
+//ground. The engine drives the other wheels through the gearbox, and with
+//the clutch out it turns ratio times per turn of a driven wheel. Counting
+//the engine's turns over one revolution of the undriven wheel then gives the
+//slip of the driven tyres:
+//
+//    slip = engine turns per reed revolution / ratio - 1
+//
+//Engine turns are rpm x time, summed every control cycle and split at the
+//reed pulses, so the estimate has no lag from the reed period filter (which
+//reads 10-20% high accelerating in first gear) and needs no division:
+//slipBegin() turns 1 / (ratio x 60 s) into a 16 bit factor per gear. It is
+//updated at every reed pulse, up to ~0.25 s apart at 15 mph; in between, a
+//revolution that has already taken more engine turns than the last estimate
+//raises it right away, so a tyre that breaks loose is seen within a few
+//control cycles.
+//
+//A revolution only counts if the clutch stayed out, the gear stayed the same
+//and the engine above minRpm (the clutch may still slip at a launch) all the
+//way round, and if it took less than SLIP_MAX_REVOLUTION_US (~4 mph).
+//Motor-only driving turns no rpm and is not covered. The engine turns per
+//revolution are kept as they are too, whatever the gear, for the gear
+//detection to check the gear sensor against (gear.h).
+//
+//Slip above target is cut from the engine and motor outputs in proportion,
+//gain times the excess, down to floor: slipLimit() scales an output by the
+//share let through. The cut comes at once and goes at the recovery rate, so
+//a cut that drops the rpm under minRpm, or a shift, does not hand the tyres
+//full power again the next cycle.
+
+#ifndef SLIP_H
+#define SLIP_H
+
+#include "hal.h"
+
+const uint8_t  SLIP_GEARS             = 5;
+const uint32_t SLIP_MAX_REVOLUTION_US = 1UL << 20;   //slower revolutions (~1.6 m/s) give no estimate
+const int16_t  SLIP_ONE               = 256;         //a slip or share of 1
+
+struct SlipConfig {
+    uint16_t ratios[SLIP_GEARS];    //engine turns per wheel turn x 100, final drive included
+    uint16_t minRpm;                //the clutch is not slipping above this
+    uint8_t  target;                //slip let through, percent: the tyres grip best a little above 0
+    uint8_t  gain;                  //share of the output cut per share of slip above the target
+    uint8_t  floor;                 //least share of the output left, percent
+    uint8_t  recovery;              //share given back per control cycle after a cut, x 256
+};
+
+struct SlipEstimator {
+    const SlipConfig* config;
+    uint16_t factor[SLIP_GEARS];    //engine over wheel turns x 256 from (sum >> 16) x factor >> 16
+    int16_t  target;                //config->target x 256 / 100
+    int16_t  floor;                 //config->floor x 256 / 100
+
+    //The revolution under way
+    uint32_t sum;                   //rpm x us since its reed pulse
+    uint32_t start;                 //micros of that pulse
+    uint32_t last;                  //micros of the last update or pulse
+    boolean  started;               //a pulse began it
+    boolean  driven;                //clutch out and above minRpm so far
+    boolean  clean;                 //and in the same gear: it counts so far
+
+    //The last update, which holds until the next
+    int      rpm;
+    uint8_t  gear;
+    boolean  drives;                //clutch out, above minRpm
+    boolean  counts;                //and in gear
+
+    uint16_t turns;                 //engine over wheel turns x 100 in the last driven revolution, 0 since the clutch went in
+    boolean  valid;                 //there is an estimate
+    int16_t  slip;                  //x 256; 0 without an estimate
+    int16_t  limit;                 //share of the outputs let through x 256
+};
+
+void    slipBegin(SlipEstimator* s, const SlipConfig* config);
+
+//Every reed pulse, oldest first, before the control cycle's slipUpdate()
+void    slipTurn(SlipEstimator* s, uint32_t micros);
+
+//When reed pulses were lost: the revolution under way is longer than one
+void    slipLost(SlipEstimator* s);
+
+//Every control cycle, with the gear, 0 for neutral or unknown
+void    slipUpdate(SlipEstimator* s, uint32_t micros, int rpm, int gear, boolean clutch);
+
+//An engine or motor output with the slip over the target cut off
+inline int slipLimit(const SlipEstimator* s, int output)
+{
+    return (int32_t)output * s->limit >> 8;
+}
+
+//Percent, for telemetry
+inline int slipPercent(const SlipEstimator* s)
+{
+    return (int32_t)s->slip * 100 >> 8;
+}
+
+#endif
@@ -0,0 +1,76 @@
+//------------------------------------------------------------------------------
+// Telemetry channel registry
+//------------------------------------------------------------------------------
+
+#include "telemetry_channels.h"
+#include "tx_queue.h"
+
+static TelemetryChannel* table        = 0;
+static uint8_t           channelCount = 0;
+static int             (*readValue)(uint8_t id) = 0;
+
+void telemetryChannelsBegin(TelemetryChannel* channels, uint8_t count, int (*value)(uint8_t id))
+{
+    table        = channels;
+    channelCount = count;
+    readValue    = value;
+    for (uint8_t i = 0; i < count; i++) {
+        table[i].nextCheck = 0;
+        table[i].everSent  = false;
+    }
+}
+
+static boolean wanted(TelemetryChannel& c, int16_t value, uint32_t nowMs)
+{
+    if (!c.everSent || nowMs - c.sentAt >= c.maxAgeMs) return true;
+    int32_t moved = (int32_t)value - c.sent;
+    if (moved < 0) moved = -moved;
+    return moved > c.deadband;
+}
+
+uint8_t telemetryChannelsFill(boolean (*add)(int value, int id), uint32_t nowMs, uint8_t* priority)
+{
+    uint8_t added = 0;
+    *priority = TX_PRIORITY_LOW;
+
+    for (int8_t level = TX_PRIORITIES - 1; level >= 0; level--) {
+        for (uint8_t i = 0; i < channelCount; i++) {
+            TelemetryChannel& c = table[i];
+            if (c.priority != level || c.periodMs == 0 || (int32_t)(nowMs - c.nextCheck) < 0) continue;
+
+            int16_t value = readValue(c.id);
+            if (wanted(c, value, nowMs)) {
+                if (!add(value, c.id)) return added;   //Full, the rest stays due
+                c.sent     = value;
+                c.sentAt   = nowMs;
+                c.everSent = true;
+                if (added++ == 0) *priority = level;
+            }
+            c.nextCheck = nowMs + c.periodMs;
+        }
+    }
+    return added;
+}
+
+TelemetryChannel* telemetryChannelFind(uint8_t id)
+{
+    for (uint8_t i = 0; i < channelCount; i++) if (table[i].id == id) return &table[i];
+    return 0;
+}
+
+boolean telemetryChannelSet(uint8_t id, uint8_t setting, int value)
+{
+    TelemetryChannel* c = telemetryChannelFind(id);
+    if (!c || value < 0) return false;
+    switch (setting) {
+    case CHANNEL_PERIOD:   c->periodMs = value; c->nextCheck = 0; break;
+    case CHANNEL_MAX_AGE:  c->maxAgeMs = value; break;
+    case CHANNEL_DEADBAND: c->deadband = value; break;
+    case CHANNEL_PRIORITY:
+        if (value >= TX_PRIORITIES) return false;
+        c->priority = value;
+        break;
+    default: return false;
+    }
+    return true;
+}
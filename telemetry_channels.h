@@ -0,0 +1,52 @@
+//------------------------------------------------------------------------------
+// Telemetry channel registry
+//------------------------------------------------------------------------------
+//Decides, per kTelemetryDataType channel, when its value goes into a frame.
+//Every channel has its own row in a table kept by the caller:
+//
+//    period     how often the value is looked at, in ms; 0 turns the channel off
+//    max age    it is sent at least this often, in ms, even if unchanged
+//    deadband   otherwise it is only sent when it moved more than this since
+//               the last value sent (0: on any change)
+//    priority   TX_PRIORITY_* of the frame it goes out in; higher priority
+//               channels get the frame space first
+//
+//telemetryChannelsFill() adds the channels that are due and changed (or too
+//old) to a frame, through the caller's add function (plain or delta frame). Channels that no longer fit stay due and go into the next
+//frame. telemetryChannelSet() changes a row at runtime, for the uplink.
+
+#ifndef TELEMETRY_CHANNELS_H
+#define TELEMETRY_CHANNELS_H
+
+#include "hal.h"
+
+struct TelemetryChannel {
+    uint8_t  id;                 //kTelemetryDataType*
+    uint16_t periodMs;
+    uint16_t maxAgeMs;
+    int16_t  deadband;
+    uint8_t  priority;           //TX_PRIORITY_*
+
+    //Kept by the registry
+    uint32_t nextCheck;          //ms
+    uint32_t sentAt;             //ms
+    int16_t  sent;               //Last value sent
+    boolean  everSent;
+};
+
+//What telemetryChannelSet() changes
+const uint8_t CHANNEL_PERIOD   = 0;
+const uint8_t CHANNEL_MAX_AGE  = 1;
+const uint8_t CHANNEL_DEADBAND = 2;
+const uint8_t CHANNEL_PRIORITY = 3;
+
+void    telemetryChannelsBegin(TelemetryChannel* channels, uint8_t count, int (*value)(uint8_t id));
+
+//Adds the due channels to an open frame with add(), which returns false when
+//the frame is full, and returns how many; *priority is the highest priority among them
+uint8_t telemetryChannelsFill(boolean (*add)(int value, int id), uint32_t nowMs, uint8_t* priority);
+
+boolean telemetryChannelSet(uint8_t id, uint8_t setting, int value);  //false for an unknown channel
+TelemetryChannel* telemetryChannelFind(uint8_t id);
+
+#endif
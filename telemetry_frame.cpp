@@ -0,0 +1,259 @@
+//------------------------------------------------------------------------------
+// Binary telemetry frames
+//------------------------------------------------------------------------------
+
+#include "telemetry_frame.h"
+
+#ifdef __AVR__
+#include <util/crc16.h>
+#endif
+
+const uint8_t DECODE_SYNC   = 0;
+const uint8_t DECODE_LENGTH = 1;
+const uint8_t DECODE_BODY   = 2;
+const uint8_t DECODE_CRC_HI = 3;
+const uint8_t DECODE_CRC_LO = 4;
+
+uint16_t crc16(uint16_t crc, const uint8_t* data, uint8_t length)
+{
+    while (length--) {
+#ifdef __AVR__
+        crc = _crc_xmodem_update(crc, *data++);   //Same polynomial, hand written assembly
+#else
+        crc ^= (uint16_t)*data++ << 8;
+        for (uint8_t bit = 0; bit < 8; bit++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+#endif
+    }
+    return crc;
+}
+
+//------------------------------------------------------------------------------
+// Encoder
+//------------------------------------------------------------------------------
+
+void frameBegin(TelemetryFrame* frame, uint8_t sequence)
+{
+    frame->bytes[0] = FRAME_SYNC;
+    frame->bytes[1] = 1;            //length, so far only the sequence number
+    frame->bytes[2] = sequence;
+    frame->length   = 3;
+    frame->fields   = 0;
+    frame->freeBits = 0;
+}
+
+boolean frameAdd(TelemetryFrame* frame, uint8_t id, int16_t value)
+{
+    if (frame->length + FRAME_FIELD_BYTES + 2 > FRAME_MAX_BYTES) return false;
+    uint8_t* p = frame->bytes + frame->length;
+    p[0] = id;
+    p[1] = (uint8_t)value;
+    p[2] = (uint8_t)((uint16_t)value >> 8);
+    frame->length   += FRAME_FIELD_BYTES;
+    frame->bytes[1] += FRAME_FIELD_BYTES;
+    return true;
+}
+
+void frameEnd(TelemetryFrame* frame)
+{
+    uint16_t crc = crc16(0xFFFF, frame->bytes + 1, frame->length - 1);
+    frame->bytes[frame->length++] = crc >> 8;
+    frame->bytes[frame->length++] = crc & 0xFF;
+}
+
+//------------------------------------------------------------------------------
+// Delta encoder
+//------------------------------------------------------------------------------
+
+const uint8_t CODE_SAME     = 0;
+const uint8_t CODE_DELTA4   = 1;
+const uint8_t CODE_DELTA8   = 2;
+const uint8_t CODE_WHOLE    = 3;
+
+static const uint8_t codeBits[4] = {0, 4, 8, 16};
+
+void deltaEncoderReset(DeltaEncoder* encoder)
+{
+    memset(encoder->sends, 0, sizeof(encoder->sends));
+}
+
+void deltaFrameBegin(TelemetryFrame* frame, uint8_t sequence)
+{
+    frameBegin(frame, sequence);
+    frame->bytes[0] = FRAME_SYNC_DELTA;
+}
+
+//Appends the low count bits of value, most significant first; the room was checked
+static void putBits(TelemetryFrame* frame, uint16_t value, uint8_t count)
+{
+    while (count) {
+        if (frame->freeBits == 0) {
+            frame->bytes[frame->length++] = 0;
+            frame->bytes[1]++;
+            frame->freeBits = 8;
+        }
+        uint8_t take  = count < frame->freeBits ? count : frame->freeBits;
+        uint8_t chunk = (value >> (count - take)) & ((1 << take) - 1);
+        frame->bytes[frame->length - 1] |= chunk << (frame->freeBits - take);
+        frame->freeBits -= take;
+        count -= take;
+    }
+}
+
+boolean deltaFrameAdd(TelemetryFrame* frame, DeltaEncoder* encoder, uint8_t id, int16_t value)
+{
+    uint8_t code = CODE_WHOLE;
+    int16_t delta = 0;
+    boolean tracked = id < DELTA_IDS;
+    if (tracked && encoder->sends[id] != 0 && encoder->sends[id] < DELTA_REFRESH) {
+        delta = value - encoder->last[id];
+        if (delta == 0)                      code = CODE_SAME;
+        else if (delta >= -8 && delta <= 7)  code = CODE_DELTA4;
+        else if (delta >= -128 && delta <= 127) code = CODE_DELTA8;
+    }
+
+    //Room for the field, the CRC after it and at most FRAME_MAX_FIELDS fields
+    uint8_t bits  = 8 + codeBits[code];
+    uint8_t bytes = bits > frame->freeBits ? (bits - frame->freeBits + 7) / 8 : 0;
+    if (frame->fields >= FRAME_MAX_FIELDS || frame->length + bytes + 2 > FRAME_MAX_BYTES || id > 63) return false;
+
+    putBits(frame, (id << 2) | code, 8);
+    if (code == CODE_WHOLE) putBits(frame, (uint16_t)value, 16);
+    else if (code != CODE_SAME) putBits(frame, (uint16_t)delta, codeBits[code]);
+    frame->fields++;
+
+    if (tracked) {
+        encoder->last[id]  = value;
+        encoder->sends[id] = (code == CODE_WHOLE) ? 1 : encoder->sends[id] + 1;
+    }
+    return true;
+}
+
+//------------------------------------------------------------------------------
+// Decoder
+//------------------------------------------------------------------------------
+
+void frameDecoderReset(FrameDecoder* decoder)
+{
+    memset(decoder, 0, sizeof(*decoder));
+    decoder->state = DECODE_SYNC;
+}
+
+//Reads count bits at *bit from the body, most significant first
+static uint16_t getBits(const uint8_t* body, uint16_t* bit, uint8_t count)
+{
+    uint16_t value = 0;
+    while (count--) {
+        value = (value << 1) | ((body[*bit >> 3] >> (7 - (*bit & 7))) & 1);
+        (*bit)++;
+    }
+    return value;
+}
+
+static void acceptDeltaFields(FrameDecoder* d)
+{
+    d->fieldCount = 0;
+    uint16_t bit = 8, end = d->length * 8;           //After the sequence number
+    while (end - bit >= 8 && d->fieldCount < FRAME_MAX_FIELDS) {
+        uint8_t id   = getBits(d->body, &bit, 6);
+        uint8_t code = getBits(d->body, &bit, 2);
+        if (end - bit < codeBits[code]) return;
+        int16_t value = 0;
+        if (code == CODE_WHOLE) value = (int16_t)getBits(d->body, &bit, 16);
+        else if (code != CODE_SAME) {
+            uint8_t n = codeBits[code];
+            value = (int16_t)(getBits(d->body, &bit, n) << (16 - n)) >> (16 - n);   //sign extended
+        }
+
+        if (code != CODE_WHOLE) {
+            if (id >= DELTA_IDS || !d->known[id]) {d->unresolved++; continue;}
+            value += d->last[id];
+        }
+        if (id < DELTA_IDS) {
+            d->last[id]  = value;
+            d->known[id] = true;
+        }
+        d->ids[d->fieldCount]    = id;
+        d->values[d->fieldCount] = value;
+        d->fieldCount++;
+    }
+}
+
+static void acceptFrame(FrameDecoder* d)
+{
+    uint8_t sequence = d->body[0];
+    if (d->haveSequence) {
+        uint8_t lost = sequence - d->sequence - 1;
+        d->lostFrames += lost;
+        if (lost) memset(d->known, 0, sizeof(d->known));   //Differences may refer to values we never saw
+    }
+    d->sequence     = sequence;
+    d->haveSequence = true;
+    d->frames++;
+
+    if (d->delta) {
+        acceptDeltaFields(d);
+        return;
+    }
+    d->fieldCount = (d->length - 1) / FRAME_FIELD_BYTES;
+    for (uint8_t i = 0; i < d->fieldCount; i++) {
+        const uint8_t* f = d->body + 1 + i * FRAME_FIELD_BYTES;
+        d->ids[i]    = f[0];
+        d->values[i] = (int16_t)(f[1] | ((uint16_t)f[2] << 8));
+    }
+}
+
+boolean framePush(FrameDecoder* d, uint8_t byte)
+{
+    switch (d->state) {
+    case DECODE_SYNC:
+        if (byte == FRAME_SYNC || byte == FRAME_SYNC_DELTA) {
+            d->delta = (byte == FRAME_SYNC_DELTA);
+            d->state = DECODE_LENGTH;
+        }
+        return false;
+
+    case DECODE_LENGTH:
+        if (byte < 1 || byte > sizeof(d->body) || (!d->delta && (byte - 1) % FRAME_FIELD_BYTES != 0)) {
+            //Not a length a frame can have, look for the next sync byte
+            d->state = DECODE_SYNC;
+            framePush(d, byte);
+            return false;
+        }
+        d->length   = byte;
+        d->received = 0;
+        d->crc      = crc16(0xFFFF, &byte, 1);
+        d->state    = DECODE_BODY;
+        return false;
+
+    case DECODE_BODY:
+        d->body[d->received++] = byte;
+        if (d->received == d->length) {
+            d->crc   = crc16(d->crc, d->body, d->length);
+            d->state = DECODE_CRC_HI;
+        }
+        return false;
+
+    case DECODE_CRC_HI:
+        if (byte != (d->crc >> 8)) {
+            d->crcErrors++;
+            d->state = DECODE_SYNC;
+            framePush(d, byte);             //May be the start of the next frame
+            return false;
+        }
+        d->state = DECODE_CRC_LO;
+        return false;
+
+    case DECODE_CRC_LO:
+        d->state = DECODE_SYNC;
+        if (byte != (d->crc & 0xFF)) {
+            d->crcErrors++;
+            framePush(d, byte);
+            return false;
+        }
+        acceptFrame(d);
+        return true;
+    }
+    d->state = DECODE_SYNC;
+    return false;
+}
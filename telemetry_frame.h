@@ -0,0 +1,102 @@
+//------------------------------------------------------------------------------
+// Binary telemetry frames
+//------------------------------------------------------------------------------
+//Replaces the ASCII <ID=value,ID=value> format. A frame is
+//
+//    0xA5  length  sequence  {id  value_lo  value_hi} ...  crc_hi  crc_lo
+//
+//length counts the bytes from sequence to the last field. The fields are the
+//kTelemetryDataType* IDs with their value as a 16 bit little-endian signed
+//integer. The CRC is CRC-16/CCITT-FALSE (polynomial 0x1021, start 0xFFFF)
+//over length, sequence and fields. The sequence number counts frames, so the
+//receiver can tell how many were lost.
+//
+//Delta frames carry the same fields in fewer bits, as differences to the
+//last value sent for the same ID:
+//
+//    0xA6  length  sequence  {fields, bit packed}  crc_hi  crc_lo
+//
+//Each field is a 6 bit ID and a 2 bit code, most significant bit first,
+//then depending on the code
+//
+//    0   nothing, the value has not changed
+//    1   4 bit signed difference
+//    2   8 bit signed difference
+//    3   the 16 bit value itself
+//
+//The last byte is padded with zeros; fewer than 8 bits left means no more
+//fields. Differences only make sense to a receiver that saw every frame, so
+//each ID goes out whole the first time and every DELTA_REFRESH times after
+//(a keyframe per ID). The decoder forgets all IDs when it sees a gap in the
+//sequence numbers and drops differences for an ID until its next whole value.
+//IDs from DELTA_IDS up always go out whole.
+//
+//The decoder is used by the host tools (host/telemetry_decode) and by the
+//ground station; it resynchronises on the next sync byte after any error.
+
+#ifndef TELEMETRY_FRAME_H
+#define TELEMETRY_FRAME_H
+
+#include "hal.h"
+
+const uint8_t FRAME_SYNC        = 0xA5;
+const uint8_t FRAME_SYNC_DELTA  = 0xA6;
+const uint8_t FRAME_FIELD_BYTES = 3;
+const uint8_t FRAME_MAX_FIELDS  = 20;
+const uint8_t FRAME_OVERHEAD    = 5;    //sync, length, sequence, CRC
+const uint8_t FRAME_MAX_BYTES   = FRAME_OVERHEAD + FRAME_MAX_FIELDS * FRAME_FIELD_BYTES;
+
+const uint8_t DELTA_IDS         = 40;   //IDs that keep a last value, below 64
+const uint8_t DELTA_REFRESH     = 8;    //Every 8th value of an ID goes out whole
+
+struct TelemetryFrame {
+    uint8_t bytes[FRAME_MAX_BYTES];
+    uint8_t length;                  //Bytes used in bytes[], including the CRC once ended
+    uint8_t fields;                  //Delta frames: fields so far
+    uint8_t freeBits;                //Delta frames: bits still free in the last byte
+};
+
+struct DeltaEncoder {
+    int16_t last[DELTA_IDS];         //Last value sent per ID
+    uint8_t sends[DELTA_IDS];        //Values sent since the last whole one, 0 before the first
+};
+
+uint16_t crc16(uint16_t crc, const uint8_t* data, uint8_t length);
+
+void     frameBegin(TelemetryFrame* frame, uint8_t sequence);
+boolean  frameAdd(TelemetryFrame* frame, uint8_t id, int16_t value);  //false when full
+void     frameEnd(TelemetryFrame* frame);                      //Both kinds of frame
+
+void     deltaEncoderReset(DeltaEncoder* encoder);              //Everything goes out whole again
+void     deltaFrameBegin(TelemetryFrame* frame, uint8_t sequence);
+boolean  deltaFrameAdd(TelemetryFrame* frame, DeltaEncoder* encoder, uint8_t id, int16_t value);  //false when full
+
+//Decoder
+struct FrameDecoder {
+    uint8_t  state;
+    uint8_t  body[1 + FRAME_MAX_FIELDS * FRAME_FIELD_BYTES];
+    uint8_t  length;
+    uint8_t  received;
+    uint16_t crc;
+    boolean  delta;                  //The frame being received is a delta frame
+    int16_t  last[DELTA_IDS];        //Delta frames: last value per ID
+    boolean  known[DELTA_IDS];       //  and whether it is valid
+
+    //Valid after framePush() returned true
+    uint8_t  sequence;
+    uint8_t  fieldCount;
+    uint8_t  ids[FRAME_MAX_FIELDS];
+    int16_t  values[FRAME_MAX_FIELDS];
+
+    //Statistics
+    uint32_t frames;
+    uint32_t crcErrors;
+    uint32_t lostFrames;             //From gaps in the sequence numbers
+    uint32_t unresolved;             //Differences dropped for want of a value to apply them to
+    boolean  haveSequence;
+};
+
+void     frameDecoderReset(FrameDecoder* decoder);
+boolean  framePush(FrameDecoder* decoder, uint8_t byte);   //true when a valid frame completed
+
+#endif
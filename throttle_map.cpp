@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// Throttle and torque maps
+//------------------------------------------------------------------------------
+
+#include "throttle_map.h"
+#include "telemetry_frame.h"   //crc16()
+
+//Cell index and the position in it in 1/256ths of the cell, 0-256; clamped to
+//the ends of the axis
+static uint8_t axisFind(const MapAxis& axis, int16_t value, uint16_t* fraction)
+{
+    int32_t offset = (int32_t)value - axis.min;
+    int32_t end    = (int32_t)(MAP_POINTS - 1) << axis.shift;
+    if (offset < 0)   offset = 0;
+    if (offset > end) offset = end;
+    uint8_t cell = offset >> axis.shift;
+    if (cell == MAP_POINTS - 1) cell--;
+    uint16_t position = offset - ((int32_t)cell << axis.shift);
+    *fraction = axis.shift >= MAP_FRACTION_BITS ? position >> (axis.shift - MAP_FRACTION_BITS)
+                                                : position << (MAP_FRACTION_BITS - axis.shift);
+    return cell;
+}
+
+uint8_t throttleMapLookup(const ThrottleMap* map, int16_t x, int16_t y)
+{
+    const uint16_t ONE = 1 << MAP_FRACTION_BITS;
+    uint16_t fx, fy;
+    uint8_t  ix = axisFind(map->x, x, &fx);
+    uint8_t  iy = axisFind(map->y, y, &fy);
+
+    //Along x in 16 bits, value * 256, then along y in 32 bits, value * 65536
+    const uint8_t* low  = map->cells[iy] + ix;
+    const uint8_t* high = map->cells[iy + 1] + ix;
+    uint16_t bottom = (uint16_t)low[0] * (ONE - fx) + (uint16_t)low[1] * fx;
+    uint16_t top    = (uint16_t)high[0] * (ONE - fx) + (uint16_t)high[1] * fx;
+    uint32_t value  = (uint32_t)bottom * (ONE - fy) + (uint32_t)top * fy;
+    return (value + ((uint32_t)1 << (2 * MAP_FRACTION_BITS - 1))) >> (2 * MAP_FRACTION_BITS);
+}
+
+void throttleMapEncode(const ThrottleMap* map, uint8_t* record)
+{
+    record[0] = map->x.min & 0xFF;
+    record[1] = (uint16_t)map->x.min >> 8;
+    record[2] = map->x.shift;
+    record[3] = map->y.min & 0xFF;
+    record[4] = (uint16_t)map->y.min >> 8;
+    record[5] = map->y.shift;
+    memcpy(record + 6, map->cells, MAP_POINTS * MAP_POINTS);
+}
+
+void throttleMapDecode(const uint8_t* record, ThrottleMap* map)
+{
+    map->x.min   = (int16_t)(record[0] | ((uint16_t)record[1] << 8));
+    map->x.shift = record[2];
+    map->y.min   = (int16_t)(record[3] | ((uint16_t)record[4] << 8));
+    map->y.shift = record[5];
+    memcpy(map->cells, record + 6, MAP_POINTS * MAP_POINTS);
+}
+
+boolean throttleMapsCheck()
+{
+    uint8_t header[MAP_HEADER_BYTES];
+    halEepromRead(MAP_EEPROM_ADDRESS, header, sizeof(header));
+    if (header[0] != 'Y' || header[1] != 'M' || header[2] != MAP_VERSION || header[3] != MAP_COUNT) return false;
+
+    uint16_t crc = crc16(0xFFFF, header, sizeof(header));
+    uint8_t  record[MAP_RECORD_BYTES];
+    for (uint8_t i = 0; i < MAP_COUNT; i++) {
+        halEepromRead(MAP_EEPROM_ADDRESS + MAP_HEADER_BYTES + i * MAP_RECORD_BYTES, record, sizeof(record));
+        if (record[2] > MAP_MAX_SHIFT || record[5] > MAP_MAX_SHIFT) return false;
+        crc = crc16(crc, record, sizeof(record));
+    }
+    uint8_t stored[2];
+    halEepromRead(MAP_EEPROM_ADDRESS + MAP_STORE_BYTES - 2, stored, sizeof(stored));
+    return stored[0] == (crc >> 8) && stored[1] == (crc & 0xFF);
+}
+
+void throttleMapLoad(uint8_t index, ThrottleMap* map)
+{
+    uint8_t record[MAP_RECORD_BYTES];
+    halEepromRead(MAP_EEPROM_ADDRESS + MAP_HEADER_BYTES + index * MAP_RECORD_BYTES, record, sizeof(record));
+    throttleMapDecode(record, map);
+}
@@ -0,0 +1,67 @@
+//------------------------------------------------------------------------------
+// Throttle and torque maps
+//------------------------------------------------------------------------------
+//2D tables that turn the pedal into an output, per mode: the servo angle
+//from engine rpm x pedal (to even out the engine's torque curve) and the
+//Kelly PWM from velocity x pedal. Each axis has MAP_POINTS points,
+//2^shift apart from its min, so finding the cell is a subtraction and a
+//shift; between points the value is interpolated bilinearly in fixed point,
+//the position in the cell as an 8 bit fraction: four 16 bit and two 32 bit
+//multiplies, no division. Outside an axis the value stays at its edge. The
+//8 bit fraction costs at most (step between neighbouring cells) / 256 over
+//exact interpolation, well under a count for smooth maps.
+//
+//The maps live in EEPROM at MAP_EEPROM_ADDRESS, MAP_COUNT of them, two per
+//mode in mode order (servo, then Kelly), as
+//
+//    'Y' 'M' version count  {map} x count  crc_hi crc_lo
+//    map: x_min(2) x_shift y_min(2) y_shift cells(81, row by row over y)
+//
+//little endian, with the CRC-16/CCITT-FALSE of everything before it. They
+//are made and checked by host/map_gen from calibration/throttle_maps.csv and
+//written with avrdude -U eeprom:w:maps.bin:r. Without valid maps the car
+//runs on the fixed throttle and assist values.
+
+#ifndef THROTTLE_MAP_H
+#define THROTTLE_MAP_H
+
+#include "hal.h"
+
+const uint8_t  MAP_POINTS         = 9;      //8 cells per axis
+const uint8_t  MAP_SERVO          = 0;
+const uint8_t  MAP_KELLY          = 1;
+const uint8_t  MAP_MODES          = 4;      //AUTOCROSS_MODE ... ELECTRICREGEN_MODE
+const uint8_t  MAP_COUNT          = 2 * MAP_MODES;
+const uint8_t  MAP_VERSION        = 1;
+const uint16_t MAP_EEPROM_ADDRESS = 0;
+const uint8_t  MAP_HEADER_BYTES   = 4;
+const uint8_t  MAP_RECORD_BYTES   = 6 + MAP_POINTS * MAP_POINTS;
+const uint16_t MAP_STORE_BYTES    = MAP_HEADER_BYTES + MAP_COUNT * MAP_RECORD_BYTES + 2;
+const uint8_t  MAP_MAX_SHIFT      = 14;     //Cells up to 16384 wide
+const uint8_t  MAP_FRACTION_BITS  = 8;      //Position in a cell, for the interpolation
+
+struct MapAxis {
+    int16_t min;
+    uint8_t shift;              //points at min + i * 2^shift
+};
+
+struct ThrottleMap {
+    MapAxis x, y;
+    uint8_t cells[MAP_POINTS][MAP_POINTS];   //[y][x]
+};
+
+uint8_t throttleMapLookup(const ThrottleMap* map, int16_t x, int16_t y);
+
+//Index of a mode's map (mode 1-4)
+inline uint8_t throttleMapIndex(uint8_t mode, uint8_t kind) {return (mode - 1) * 2 + kind;}
+
+//EEPROM: throttleMapsCheck() reads the whole store and checks its header and
+//CRC, once from setup(); throttleMapLoad() reads one map (about 90 bytes)
+boolean throttleMapsCheck();
+void    throttleMapLoad(uint8_t index, ThrottleMap* map);
+
+//The EEPROM layout of one map, shared with host/map_gen
+void    throttleMapEncode(const ThrottleMap* map, uint8_t* record);
+void    throttleMapDecode(const uint8_t* record, ThrottleMap* map);
+
+#endif
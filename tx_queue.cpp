@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// Non-blocking telemetry transmit queue
+//------------------------------------------------------------------------------
+
+#include "tx_queue.h"
+#include "telemetry_frame.h"
+
+struct TxQueue {
+    uint8_t  bytes[TX_QUEUE_BYTES];
+    uint16_t head;                     //Next byte to write, free running
+    uint16_t tail;                     //Next byte to send, free running
+    uint16_t drops[TX_PRIORITIES];
+};
+
+static TxQueue queues[HAL_SERIAL_PORTS];
+
+//Space a frame of the given priority has to leave free for higher priorities
+static const uint16_t reserve[TX_PRIORITIES] = {2 * FRAME_MAX_BYTES, FRAME_MAX_BYTES, 0};
+
+void txQueueReset()
+{
+    for (uint8_t p = 0; p < HAL_SERIAL_PORTS; p++) {
+        queues[p].head = queues[p].tail = 0;
+        for (uint8_t i = 0; i < TX_PRIORITIES; i++) queues[p].drops[i] = 0;
+    }
+}
+
+boolean txQueueFrame(uint8_t port, const uint8_t* bytes, uint8_t length, uint8_t priority)
+{
+    if (port >= HAL_SERIAL_PORTS) return false;
+    if (priority >= TX_PRIORITIES) priority = TX_PRIORITY_HIGH;
+    TxQueue& q = queues[port];
+
+    uint16_t free = TX_QUEUE_BYTES - (uint16_t)(q.head - q.tail);
+    if (length + reserve[priority] > free) {
+        if (q.drops[priority] != 0xFFFF) q.drops[priority]++;
+        return false;
+    }
+
+    //Up to two copies, around the end of the ring
+    uint16_t start = q.head & (TX_QUEUE_BYTES - 1);
+    uint16_t first = TX_QUEUE_BYTES - start;
+    if (first > length) first = length;
+    memcpy(q.bytes + start, bytes, first);
+    memcpy(q.bytes, bytes + first, length - first);
+    q.head += length;
+    return true;
+}
+
+void txQueuePump(uint8_t port)
+{
+    if (port >= HAL_SERIAL_PORTS) return;
+    TxQueue& q = queues[port];
+    if (q.head == q.tail) return;
+
+    int room = halSerialAvailableForWrite(port);
+    while (room > 0 && q.tail != q.head) {
+        halSerialWrite(port, q.bytes[q.tail & (TX_QUEUE_BYTES - 1)]);
+        q.tail++;
+        room--;
+    }
+}
+
+uint16_t txQueueUsed(uint8_t port)
+{
+    return port < HAL_SERIAL_PORTS ? (uint16_t)(queues[port].head - queues[port].tail) : 0;
+}
+
+uint16_t txQueueDrops(uint8_t port, uint8_t priority)
+{
+    return (port < HAL_SERIAL_PORTS && priority < TX_PRIORITIES) ? queues[port].drops[priority] : 0;
+}
+
+uint16_t txQueueTotalDrops(uint8_t port)
+{
+    uint16_t total = 0;
+    for (uint8_t i = 0; i < TX_PRIORITIES; i++) total += txQueueDrops(port, i);
+    return total;
+}
@@ -0,0 +1,39 @@
+//------------------------------------------------------------------------------
+// Non-blocking telemetry transmit queue
+//------------------------------------------------------------------------------
+//Each serial port gets a RAM ring buffer in front of the Arduino core's 64
+//byte TX buffer. Queueing a frame is a copy into the ring; txQueuePump(),
+//called from the loop, moves only as many bytes into the core's buffer as it
+//can take without blocking, and the core's UART data-register-empty
+//interrupt sends them. The control loop therefore never waits for the radio.
+//
+//(The core owns the USART UDRE interrupts while Serial/Serial1 are in use,
+//so the ring cannot be drained from that interrupt directly; the pump keeps
+//the core's buffer topped up instead.)
+//
+//Frames are queued whole or not at all, so a full queue never leaves half a
+//frame on the wire. Lower priorities must leave room for higher ones: a low
+//priority frame is only queued if two maximum size frames still fit after
+//it, a normal one if one still fits. Refused frames are counted per port and
+//priority.
+
+#ifndef TX_QUEUE_H
+#define TX_QUEUE_H
+
+#include "hal.h"
+
+const uint16_t TX_QUEUE_BYTES     = 256;  //Per port, power of two
+const uint8_t  TX_PRIORITY_LOW    = 0;    //Diagnostics, profile dumps
+const uint8_t  TX_PRIORITY_NORMAL = 1;    //Periodic telemetry
+const uint8_t  TX_PRIORITY_HIGH   = 2;    //Frames sent during a critical cycle
+const uint8_t  TX_PRIORITIES      = 3;
+
+void     txQueueReset();
+boolean  txQueueFrame(uint8_t port, const uint8_t* bytes, uint8_t length, uint8_t priority);
+void     txQueuePump(uint8_t port);
+
+uint16_t txQueueUsed(uint8_t port);
+uint16_t txQueueDrops(uint8_t port, uint8_t priority);
+uint16_t txQueueTotalDrops(uint8_t port);
+
+#endif
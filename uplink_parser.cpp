@@ -0,0 +1,84 @@
+//------------------------------------------------------------------------------
+// Uplink command parser
+//------------------------------------------------------------------------------
+
+#include "uplink_parser.h"
+
+const uint8_t UPLINK_WAIT  = 0;   //Waiting for '<'
+const uint8_t UPLINK_ID    = 1;   //Reading the digits of an ID
+const uint8_t UPLINK_VALUE = 2;   //Reading the sign and digits of a value
+
+void uplinkReset(UplinkParser* p)
+{
+    memset(p, 0, sizeof(*p));
+    p->state = UPLINK_WAIT;
+}
+
+static void startNumber(UplinkParser* p)
+{
+    p->number   = 0;
+    p->negative = false;
+    p->digits   = 0;
+}
+
+//Drops the message being parsed. A '<' starts the next one right away.
+static boolean fail(UplinkParser* p, uint8_t byte)
+{
+    p->errors++;
+    p->state = UPLINK_WAIT;
+    if (byte == '<') {
+        p->state = UPLINK_ID;
+        p->count = 0;
+        startNumber(p);
+    }
+    return false;
+}
+
+boolean uplinkPush(UplinkParser* p, uint8_t byte)
+{
+    if (p->state == UPLINK_WAIT) {
+        if (byte == '<') {
+            p->state = UPLINK_ID;
+            p->count = 0;
+            startNumber(p);
+        }
+        return false;
+    }
+
+    if (byte >= '0' && byte <= '9') {
+        if (p->digits >= UPLINK_MAX_DIGITS) return fail(p, byte);
+        p->number = p->number * 10 + (byte - '0');
+        p->digits++;
+        return false;
+    }
+
+    if (p->state == UPLINK_ID) {
+        if (byte != '=' || p->digits == 0 || p->number > 32767) return fail(p, byte);
+        p->id    = (int16_t)p->number;
+        p->state = UPLINK_VALUE;
+        startNumber(p);
+        return false;
+    }
+
+    //UPLINK_VALUE
+    if (byte == '-' && p->digits == 0 && !p->negative) {
+        p->negative = true;
+        return false;
+    }
+    if (byte != ',' && byte != '>') return fail(p, byte);
+    if (p->digits == 0 || p->number > 32767 + (int32_t)p->negative || p->count >= UPLINK_MAX_COMMANDS)
+        return fail(p, byte);
+
+    p->ids[p->count]    = p->id;
+    p->values[p->count] = (int16_t)(p->negative ? -p->number : p->number);
+    p->count++;
+    startNumber(p);
+
+    if (byte == ',') {
+        p->state = UPLINK_ID;
+        return false;
+    }
+    p->state = UPLINK_WAIT;
+    p->messages++;
+    return true;
+}
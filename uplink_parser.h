@@ -0,0 +1,41 @@
+//------------------------------------------------------------------------------
+// Uplink command parser
+//------------------------------------------------------------------------------
+//Parses the <ID=value,ID=value> commands sent to the car one byte at a time,
+//as they arrive. IDs and values are accumulated digit by digit, nothing is
+//buffered or scanned twice, and memory is fixed: at most UPLINK_MAX_COMMANDS
+//pairs per message.
+//
+//A message is only handed out once its closing '>' arrived, so a message cut
+//short by noise never applies half of its commands. Any unexpected byte
+//drops the message and the parser waits for the next '<'.
+
+#ifndef UPLINK_PARSER_H
+#define UPLINK_PARSER_H
+
+#include "hal.h"
+
+const uint8_t UPLINK_MAX_COMMANDS = 8;
+const uint8_t UPLINK_MAX_DIGITS   = 5;      //IDs and values are 16 bit
+
+struct UplinkParser {
+    uint8_t  state;
+    int32_t  number;
+    boolean  negative;
+    uint8_t  digits;
+    int16_t  id;
+
+    //Valid after uplinkPush() returned true
+    uint8_t  count;
+    int16_t  ids[UPLINK_MAX_COMMANDS];
+    int16_t  values[UPLINK_MAX_COMMANDS];
+
+    //Statistics
+    uint32_t messages;
+    uint32_t errors;                        //Messages dropped for bad syntax or length
+};
+
+void    uplinkReset(UplinkParser* parser);
+boolean uplinkPush(UplinkParser* parser, uint8_t byte);  //true when a message completed
+
+#endif
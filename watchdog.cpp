@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// Watchdog supervisor
+//------------------------------------------------------------------------------
+
+#include "watchdog.h"
+
+static WatchdogRecord record HAL_NOINIT;
+
+static uint16_t         beats    = 0;       //heartbeats since the watchdog was last fed
+static uint16_t         expected = 0;
+static volatile boolean expired  = false;
+static void           (*snapshotHandler)(WatchdogSnapshot* last) = 0;
+
+//The watchdog's interrupt. beats may be caught half written, it is only for
+//the record
+static void watchdogInterrupt()
+{
+    expired        = true;
+    record.cause   = WATCHDOG_EXPIRED;
+    record.missing = expected & ~beats;
+    if (record.resets < 255) record.resets++;
+    if (snapshotHandler) {
+        snapshotHandler(&record.last);
+        record.snapshot = true;
+    }
+}
+
+uint8_t watchdogLastReset(WatchdogRecord* last)
+{
+    if (record.magic != WATCHDOG_MAGIC) return WATCHDOG_POWER_ON;
+    *last = record;
+    return record.cause;
+}
+
+void watchdogBegin(uint8_t tasks, uint16_t timeoutMillis, void (*expiredHandler)(WatchdogSnapshot* last))
+{
+    uint8_t resets = record.magic == WATCHDOG_MAGIC ? record.resets : 0;
+    memset(&record, 0, sizeof(record));
+    record.magic       = WATCHDOG_MAGIC;
+    record.cause       = WATCHDOG_RESET;
+    record.resets      = resets;
+    record.task        = WATCHDOG_NO_TASK;
+    record.longestTask = WATCHDOG_NO_TASK;
+
+    expected        = tasks >= WATCHDOG_TASKS ? 0xFFFF : (1U << tasks) - 1;
+    beats           = 0;
+    expired         = false;
+    snapshotHandler = expiredHandler;
+    halWatchdogBegin(timeoutMillis, watchdogInterrupt);
+}
+
+void watchdogEnter(uint8_t task, uint8_t stage)
+{
+    record.task  = task;
+    record.stage = stage;
+    record.runs++;
+}
+
+void watchdogLeave(uint32_t runMicros)
+{
+    if (runMicros > record.longest) {
+        record.longest     = runMicros;
+        record.longestTask = record.task;
+    }
+    beats      |= 1U << record.task;
+    record.task = WATCHDOG_NO_TASK;
+
+    //Fed once every task ran, never again once it expired
+    if (beats != expected || expired) return;
+    beats = 0;
+    halWatchdogReset();
+}
+
+void watchdogStage(uint8_t stage)
+{
+    record.stage = stage;
+}
+
+boolean watchdogExpired()
+{
+    return expired;
+}
@@ -0,0 +1,80 @@
+//------------------------------------------------------------------------------
+// Watchdog supervisor
+//------------------------------------------------------------------------------
+//Arms the hardware watchdog (halWatchdogBegin()) and feeds it only while
+//every task of the scheduler's table keeps running. The scheduler reports
+//each task it starts and finishes; a finished task sets its heartbeat bit,
+//and once all bits are set the watchdog is reset and they start over. A task
+//that hangs (a blocking serial write, a card that never answers) stops the
+//heartbeats, and so does one that never gets its turn because the tasks
+//before it in the table take all the time.
+//
+//When the watchdog expires, its interrupt calls the sketch's handler, which
+//fills in the last inputs and outputs and turns the outputs off; from then on
+//the watchdog is not fed any more, and the next timeout resets the board.
+//
+//The record lives in .noinit RAM (HAL_NOINIT), which the startup code does
+//not clear, so it survives the reset but not a power cycle. It is kept up to
+//date as the tasks run: the task and the profiler stage (profiler.h) it is
+//in, how many tasks ran, the longest run. setup() reads it with
+//watchdogLastReset() before watchdogBegin() starts the next one.
+
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include "hal.h"
+#include "adc_sampler.h"
+
+const uint8_t  WATCHDOG_TASKS     = 16;     //at most, one heartbeat bit each
+const uint8_t  WATCHDOG_NO_TASK   = 0xFF;   //between two tasks
+const uint32_t WATCHDOG_MAGIC     = 0x57444F47;
+
+//What ended the last run, watchdogLastReset()
+const uint8_t  WATCHDOG_POWER_ON  = 0;      //no record survived
+const uint8_t  WATCHDOG_EXPIRED   = 1;      //the watchdog, its interrupt took the snapshot
+const uint8_t  WATCHDOG_RESET     = 2;      //a reset that kept the RAM: the reset button, the USB
+                                            //port being opened, or the watchdog with interrupts off
+
+//The last inputs and outputs, filled in by the sketch's handler
+struct WatchdogSnapshot {
+    uint16_t analog[ADC_CHANNELS];          //raw ADC counts, by ADC_*
+    uint16_t switches;                      //INPUT_* bits
+    int16_t  servo;                         //outputs as last worked out
+    int16_t  kelly;
+    int16_t  regen;
+    uint8_t  flags;                         //LOG_* bits
+};
+
+struct WatchdogRecord {
+    uint32_t magic;                         //WATCHDOG_MAGIC, else it is power-on garbage
+    uint8_t  cause;                         //WATCHDOG_RESET while running, WATCHDOG_EXPIRED once the interrupt came
+    uint8_t  resets;                        //watchdog resets since power on
+    uint8_t  task;                          //index in the task table, WATCHDOG_NO_TASK between tasks
+    uint8_t  stage;                         //PROFILE_* stage in it
+    uint16_t missing;                       //tasks without a heartbeat when it expired, bit per task
+    uint32_t runs;                          //task runs since watchdogBegin()
+    uint32_t longest;                       //longest task run in microseconds
+    uint8_t  longestTask;
+    boolean  snapshot;                      //last was filled in
+    WatchdogSnapshot last;
+};
+
+//From setup(), before watchdogBegin(): what ended the last run, WATCHDOG_*,
+//and unless WATCHDOG_POWER_ON the record it left
+uint8_t watchdogLastReset(WatchdogRecord* record);
+
+//Arms the watchdog for a table of tasks. expired runs in the watchdog's
+//interrupt when it expires
+void    watchdogBegin(uint8_t tasks, uint16_t timeoutMillis, void (*expired)(WatchdogSnapshot* last));
+
+//From the scheduler, around every task run
+void    watchdogEnter(uint8_t task, uint8_t stage);
+void    watchdogLeave(uint32_t runMicros);
+
+//From a task, the profiler stage it has got to
+void    watchdogStage(uint8_t stage);
+
+//The watchdog expired and the reset is coming
+boolean watchdogExpired();
+
+#endif